@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2010-2013 Jiri Techet <techet@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Benchmark of the frame times of a view during scripted pans, flings,
+ * zooms and go-to flights. The map uses locally rendered error tiles so
+ * the results do not depend on the network. The amount of markers, labels,
+ * points, path vertices and overlay sources is configurable.
+ *
+ * For every phase the distribution of the intervals between frames and of
+ * the time spent painting is printed in a key=value format, together with
+ * the number of frames dropped with respect to the target frame rate.
+ * The stage is a regular one; use a virtual X server such as Xvfb for
+ * unattended runs.
+ */
+
+#include <champlain/champlain.h>
+#include <math.h>
+#include <string.h>
+
+#define CENTER_LATITUDE 50.08
+#define CENTER_LONGITUDE 14.42
+#define ZOOM_LEVEL 12
+
+static gint n_markers = 0;
+static gint n_labels = 0;
+static gint n_points = 0;
+static gint n_path_vertices = 0;
+static gint n_overlays = 0;
+static gboolean wrap = FALSE;
+static gint fps = 60;
+static gint stage_width = 800;
+static gint stage_height = 600;
+
+static GOptionEntry entries[] =
+{
+  { "markers", 'm', 0, G_OPTION_ARG_INT, &n_markers,
+    "Number of plain markers (default 0)", "N" },
+  { "labels", 'l', 0, G_OPTION_ARG_INT, &n_labels,
+    "Number of labels (default 0)", "N" },
+  { "points", 'p', 0, G_OPTION_ARG_INT, &n_points,
+    "Number of points (default 0)", "N" },
+  { "path-vertices", 'v', 0, G_OPTION_ARG_INT, &n_path_vertices,
+    "Number of vertices of a path (default 0)", "N" },
+  { "overlays", 'o', 0, G_OPTION_ARG_INT, &n_overlays,
+    "Number of overlay sources (default 0)", "N" },
+  { "wrap", 'w', 0, G_OPTION_ARG_NONE, &wrap,
+    "Enable horizontal wrap", NULL },
+  { "fps", 'f', 0, G_OPTION_ARG_INT, &fps,
+    "Target frame rate used to count dropped frames (default 60)", "FPS" },
+  { "width", 'W', 0, G_OPTION_ARG_INT, &stage_width,
+    "Stage width (default 800)", "PX" },
+  { "height", 'H', 0, G_OPTION_ARG_INT, &stage_height,
+    "Stage height (default 600)", "PX" },
+  { NULL }
+};
+
+typedef struct _Bench Bench;
+
+typedef struct
+{
+  const gchar *name;
+  guint duration;
+  void (*start)(Bench *bench);
+  void (*frame)(Bench *bench, gdouble progress);
+} Phase;
+
+struct _Bench
+{
+  ChamplainView *view;
+  ClutterTimeline *timeline;
+  guint phase;
+
+  gboolean recording;
+  gint64 paint_start;
+  gint64 last_frame;
+  GArray *intervals;
+  GArray *paint_times;
+
+  /* state of the running phase */
+  gdouble start_x;
+  gdouble start_y;
+  guint zoom_steps;
+};
+
+
+static void
+move_to (Bench *bench,
+    gdouble x,
+    gdouble y)
+{
+  ChamplainMapSource *source = champlain_view_get_map_source (bench->view);
+  guint zoom = champlain_view_get_zoom_level (bench->view);
+
+  champlain_view_center_on (bench->view,
+      champlain_map_source_get_latitude (source, zoom, y),
+      champlain_map_source_get_longitude (source, zoom, x));
+}
+
+
+static void
+remember_position (Bench *bench)
+{
+  ChamplainMapSource *source = champlain_view_get_map_source (bench->view);
+  guint zoom = champlain_view_get_zoom_level (bench->view);
+
+  bench->start_x = champlain_map_source_get_x (source, zoom,
+        champlain_view_get_center_longitude (bench->view));
+  bench->start_y = champlain_map_source_get_y (source, zoom,
+        champlain_view_get_center_latitude (bench->view));
+  bench->zoom_steps = 0;
+}
+
+
+/* Steady drag to the east over two screen widths */
+static void
+pan_frame (Bench *bench,
+    gdouble progress)
+{
+  move_to (bench, bench->start_x + progress * 2 * stage_width, bench->start_y);
+}
+
+
+/* Decelerating motion to the north-west, like a kinetic scroll */
+static void
+fling_frame (Bench *bench,
+    gdouble progress)
+{
+  gdouble eased = 1.0 - pow (1.0 - progress, 3);
+
+  move_to (bench,
+      bench->start_x - eased * 3 * stage_width,
+      bench->start_y - eased * 2 * stage_height);
+}
+
+
+/* Three animated zooms in followed by three out */
+static void
+zoom_frame (Bench *bench,
+    gdouble progress)
+{
+  guint target = MIN ((guint) (progress * 6), 6);
+
+  while (bench->zoom_steps < target)
+    {
+      if (bench->zoom_steps < 3)
+        champlain_view_zoom_in (bench->view);
+      else
+        champlain_view_zoom_out (bench->view);
+      bench->zoom_steps++;
+    }
+}
+
+
+static void
+go_to_start (Bench *bench)
+{
+  remember_position (bench);
+  champlain_view_go_to (bench->view, CENTER_LATITUDE + 2.0, CENTER_LONGITUDE - 5.0);
+}
+
+
+static void
+idle_frame (G_GNUC_UNUSED Bench *bench,
+    G_GNUC_UNUSED gdouble progress)
+{
+}
+
+
+/* Low zoom where the wrap clones are visible */
+static void
+world_start (Bench *bench)
+{
+  champlain_view_set_zoom_level (bench->view, 2);
+  remember_position (bench);
+}
+
+
+static void
+world_frame (Bench *bench,
+    gdouble progress)
+{
+  ChamplainMapSource *source = champlain_view_get_map_source (bench->view);
+  guint width = champlain_map_source_get_column_count (source, 2) *
+    champlain_map_source_get_tile_size (source);
+
+  move_to (bench, bench->start_x + progress * 2 * width, bench->start_y);
+}
+
+
+static const Phase phases[] =
+{
+  { "pan", 3000, remember_position, pan_frame },
+  { "fling", 1500, remember_position, fling_frame },
+  { "zoom", 3000, remember_position, zoom_frame },
+  { "go-to", 4000, go_to_start, idle_frame },
+  { "world-pan", 3000, world_start, world_frame },
+};
+
+
+static gint
+compare_doubles (gconstpointer a,
+    gconstpointer b)
+{
+  gdouble da = *(const gdouble *) a;
+  gdouble db = *(const gdouble *) b;
+
+  return (da > db) - (da < db);
+}
+
+
+static gdouble
+percentile (GArray *values,
+    gdouble p)
+{
+  if (values->len == 0)
+    return 0.0;
+
+  return g_array_index (values, gdouble, (guint) (p * (values->len - 1)));
+}
+
+
+static void
+report_phase (Bench *bench,
+    const Phase *phase)
+{
+  gdouble budget = 1000.0 / fps;
+  guint dropped = 0;
+  guint i;
+
+  for (i = 0; i < bench->intervals->len; i++)
+    {
+      gdouble interval = g_array_index (bench->intervals, gdouble, i);
+
+      if (interval > 1.5 * budget)
+        dropped += (guint) (interval / budget + 0.5) - 1;
+    }
+
+  g_array_sort (bench->intervals, compare_doubles);
+  g_array_sort (bench->paint_times, compare_doubles);
+
+  g_print ("phase=%s frames=%u dropped=%u "
+      "interval_p50=%.2f interval_p95=%.2f interval_p99=%.2f interval_max=%.2f "
+      "paint_p50=%.2f paint_p95=%.2f paint_max=%.2f\n",
+      phase->name, bench->paint_times->len, dropped,
+      percentile (bench->intervals, 0.5), percentile (bench->intervals, 0.95),
+      percentile (bench->intervals, 0.99), percentile (bench->intervals, 1.0),
+      percentile (bench->paint_times, 0.5), percentile (bench->paint_times, 0.95),
+      percentile (bench->paint_times, 1.0));
+
+  g_array_set_size (bench->intervals, 0);
+  g_array_set_size (bench->paint_times, 0);
+}
+
+
+static gboolean
+pre_paint_cb (Bench *bench)
+{
+  bench->paint_start = g_get_monotonic_time ();
+  return TRUE;
+}
+
+
+static gboolean
+post_paint_cb (Bench *bench)
+{
+  gint64 now = g_get_monotonic_time ();
+  gdouble paint_time = (now - bench->paint_start) / 1000.0;
+
+  if (bench->recording)
+    {
+      if (bench->last_frame != 0)
+        {
+          gdouble interval = (now - bench->last_frame) / 1000.0;
+
+          g_array_append_val (bench->intervals, interval);
+        }
+      g_array_append_val (bench->paint_times, paint_time);
+      bench->last_frame = now;
+    }
+
+  return TRUE;
+}
+
+
+static gboolean start_cb (Bench *bench);
+
+
+static void
+new_frame_cb (ClutterTimeline *timeline,
+    G_GNUC_UNUSED gint msecs,
+    Bench *bench)
+{
+  phases[bench->phase].frame (bench, clutter_timeline_get_progress (timeline));
+}
+
+
+static void
+completed_cb (G_GNUC_UNUSED ClutterTimeline *timeline,
+    Bench *bench)
+{
+  bench->recording = FALSE;
+  report_phase (bench, &phases[bench->phase]);
+
+  g_clear_object (&bench->timeline);
+
+  bench->phase++;
+  if (bench->phase == G_N_ELEMENTS (phases))
+    {
+      clutter_main_quit ();
+      return;
+    }
+
+  /* Let the tiles of the previous phase settle */
+  g_timeout_add (500, (GSourceFunc) start_cb, bench);
+}
+
+
+static gboolean
+start_cb (Bench *bench)
+{
+  const Phase *phase = &phases[bench->phase];
+
+  phase->start (bench);
+
+  bench->last_frame = 0;
+  bench->recording = TRUE;
+
+  bench->timeline = clutter_timeline_new (phase->duration);
+  g_signal_connect (bench->timeline, "new-frame", G_CALLBACK (new_frame_cb), bench);
+  g_signal_connect (bench->timeline, "completed", G_CALLBACK (completed_cb), bench);
+  clutter_timeline_start (bench->timeline);
+
+  return FALSE;
+}
+
+
+static void
+random_location (GRand *rand,
+    ChamplainLocation *location)
+{
+  champlain_location_set_location (location,
+      CENTER_LATITUDE + g_rand_double_range (rand, -1.0, 1.0),
+      CENTER_LONGITUDE + g_rand_double_range (rand, -2.0, 2.0));
+}
+
+
+static void
+populate_view (ChamplainView *view)
+{
+  ChamplainMapSourceFactory *factory = champlain_map_source_factory_dup_default ();
+  ChamplainMarkerLayer *layer;
+  ChamplainPathLayer *path;
+  GRand *rand = g_rand_new_with_seed (1);
+  ClutterColor marker_color = { 0xcc, 0x00, 0x00, 0xff };
+  gdouble latitude, longitude;
+  gint i;
+
+  champlain_view_set_map_source (view,
+      champlain_map_source_factory_create_error_source (factory, 256));
+  for (i = 0; i < n_overlays; i++)
+    champlain_view_add_overlay_source (view,
+        champlain_map_source_factory_create_error_source (factory, 256), 128);
+
+  layer = champlain_marker_layer_new ();
+  for (i = 0; i < n_markers; i++)
+    {
+      ClutterActor *marker = champlain_marker_new ();
+      ClutterActor *square = clutter_actor_new ();
+
+      clutter_actor_set_size (square, 12, 12);
+      clutter_actor_set_background_color (square, &marker_color);
+      clutter_actor_add_child (marker, square);
+      random_location (rand, CHAMPLAIN_LOCATION (marker));
+      champlain_marker_layer_add_marker (layer, CHAMPLAIN_MARKER (marker));
+    }
+  for (i = 0; i < n_labels; i++)
+    {
+      gchar *text = g_strdup_printf ("Label %d", i);
+      ClutterActor *label = champlain_label_new_with_text (text, "Sans 10", NULL, NULL);
+
+      random_location (rand, CHAMPLAIN_LOCATION (label));
+      champlain_marker_layer_add_marker (layer, CHAMPLAIN_MARKER (label));
+      g_free (text);
+    }
+  for (i = 0; i < n_points; i++)
+    {
+      ClutterActor *point = champlain_point_new ();
+
+      random_location (rand, CHAMPLAIN_LOCATION (point));
+      champlain_marker_layer_add_marker (layer, CHAMPLAIN_MARKER (point));
+    }
+  champlain_view_add_layer (view, CHAMPLAIN_LAYER (layer));
+
+  /* A random walk around the center */
+  path = champlain_path_layer_new ();
+  latitude = CENTER_LATITUDE;
+  longitude = CENTER_LONGITUDE;
+  for (i = 0; i < n_path_vertices; i++)
+    {
+      latitude = CLAMP (latitude + g_rand_double_range (rand, -0.01, 0.01), CENTER_LATITUDE - 1.0, CENTER_LATITUDE + 1.0);
+      longitude = CLAMP (longitude + g_rand_double_range (rand, -0.02, 0.02), CENTER_LONGITUDE - 2.0, CENTER_LONGITUDE + 2.0);
+      champlain_path_layer_add_node (path,
+          CHAMPLAIN_LOCATION (champlain_coordinate_new_full (latitude, longitude)));
+    }
+  champlain_view_add_layer (view, CHAMPLAIN_LAYER (path));
+
+  champlain_view_set_horizontal_wrap (view, wrap);
+  champlain_view_set_zoom_level (view, ZOOM_LEVEL);
+  champlain_view_center_on (view, CENTER_LATITUDE, CENTER_LONGITUDE);
+
+  g_rand_free (rand);
+  g_object_unref (factory);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  ClutterActor *stage;
+  Bench bench;
+
+  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
+    return 1;
+
+  context = g_option_context_new ("- benchmark the frame times of view interactions");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (fps < 1)
+    fps = 60;
+
+  memset (&bench, 0, sizeof (Bench));
+  bench.intervals = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  bench.paint_times = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+  stage = clutter_stage_new ();
+  clutter_actor_set_size (stage, stage_width, stage_height);
+  g_signal_connect (stage, "destroy", G_CALLBACK (clutter_main_quit), NULL);
+
+  bench.view = CHAMPLAIN_VIEW (champlain_view_new ());
+  clutter_actor_set_size (CLUTTER_ACTOR (bench.view), stage_width, stage_height);
+  clutter_actor_add_child (stage, CLUTTER_ACTOR (bench.view));
+  populate_view (bench.view);
+
+  g_print ("markers=%d labels=%d points=%d path_vertices=%d overlays=%d wrap=%d fps=%d\n",
+      n_markers, n_labels, n_points, n_path_vertices, n_overlays, wrap, fps);
+
+  clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_PRE_PAINT,
+      (GSourceFunc) pre_paint_cb, &bench, NULL);
+  clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_POST_PAINT,
+      (GSourceFunc) post_paint_cb, &bench, NULL);
+
+  clutter_actor_show (stage);
+
+  /* Give the initial tiles time to load */
+  g_timeout_add_seconds (1, (GSourceFunc) start_cb, &bench);
+  clutter_main ();
+
+  g_array_free (bench.intervals, TRUE);
+  g_array_free (bench.paint_times, TRUE);
+
+  return 0;
+}
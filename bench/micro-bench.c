@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2010-2013 Jiri Techet <techet@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Microbenchmarks of the small functions called in the hot loops of the
+ * library: projections, wrapping, tile tables, cache keys, the memory
+ * cache and tile URI formatting. Internal helpers are reached through the
+ * non-exported wrappers declared in champlain-bench-private.h.
+ *
+ * Every benchmark prints one JSON object per line:
+ *
+ *   {"name": "...", "iterations": N, "total_ms": T, "ns_per_op": X}
+ */
+
+#include <champlain/champlain.h>
+#include "champlain/champlain-bench-private.h"
+
+#include <string.h>
+
+#define N_TILES 1024
+
+typedef struct
+{
+  const gchar *name;
+  /* the heavier benchmarks run fewer iterations */
+  guint divisor;
+  void (*run)(guint64 iterations);
+} MicroBench;
+
+static gint64 iterations = 10000000;
+static gchar *filter = NULL;
+
+static GOptionEntry entries[] =
+{
+  { "iterations", 'n', 0, G_OPTION_ARG_INT64, &iterations,
+    "Number of iterations of the cheapest benchmarks (default 10000000)", "N" },
+  { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter,
+    "Run only the benchmarks whose name contains the string", "STRING" },
+  { NULL }
+};
+
+static ChamplainMapSource *source;
+static ChamplainView *view;
+static ChamplainMemoryCache *memory_cache;
+static ChamplainTile *tiles[N_TILES];
+
+/* keeps the compiler from optimizing the measured calls away */
+static volatile gdouble sink;
+
+
+static void
+bench_get_x (guint64 n)
+{
+  gdouble sum = 0;
+  guint64 i;
+
+  for (i = 0; i < n; i++)
+    sum += champlain_map_source_get_x (source, 12, (gdouble) (i % 360) - 180.0);
+  sink = sum;
+}
+
+
+static void
+bench_get_y (guint64 n)
+{
+  gdouble sum = 0;
+  guint64 i;
+
+  for (i = 0; i < n; i++)
+    sum += champlain_map_source_get_y (source, 12, (gdouble) (i % 170) - 85.0);
+  sink = sum;
+}
+
+
+static void
+bench_get_latitude (guint64 n)
+{
+  gdouble sum = 0;
+  guint64 i;
+
+  for (i = 0; i < n; i++)
+    sum += champlain_map_source_get_latitude (source, 12, (gdouble) (i % 1048576));
+  sink = sum;
+}
+
+
+static void
+bench_get_longitude (guint64 n)
+{
+  gdouble sum = 0;
+  guint64 i;
+
+  for (i = 0; i < n; i++)
+    sum += champlain_map_source_get_longitude (source, 12, (gdouble) (i % 1048576));
+  sink = sum;
+}
+
+
+static void
+bench_x_to_wrap_x (guint64 n)
+{
+  gdouble sum = 0;
+  guint64 i;
+
+  for (i = 0; i < n; i++)
+    sum += _champlain_view_x_to_wrap_x ((gdouble) (i % 4096) - 2048.0, 1024.0);
+  sink = sum;
+}
+
+
+static void
+free_gint64 (gpointer data)
+{
+  g_slice_free (gint64, data);
+}
+
+
+/* Mirrors the view marking the tiles of a moving viewport */
+static void
+bench_tile_table (guint64 n)
+{
+  GHashTable *table = g_hash_table_new_full (g_int64_hash, g_int64_equal, free_gint64, NULL);
+  gdouble found = 0;
+  guint64 i;
+
+  for (i = 0; i < n; i++)
+    {
+      gint x = i % 64;
+      gint y = (i / 64) % 64;
+
+      _champlain_view_tile_table_set (view, table, x, y, TRUE);
+      found += _champlain_view_tile_in_tile_table (view, table, x, y);
+      if (i % 4 == 0)
+        _champlain_view_tile_table_set (view, table, x, y, FALSE);
+    }
+
+  sink = found;
+  g_hash_table_destroy (table);
+}
+
+
+static void
+bench_generate_queue_key (guint64 n)
+{
+  gsize total = 0;
+  guint64 i;
+
+  for (i = 0; i < n; i++)
+    {
+      gchar *key = _champlain_memory_cache_generate_key (memory_cache, tiles[i % N_TILES]);
+
+      total += strlen (key);
+      g_free (key);
+    }
+  sink = total;
+}
+
+
+/* The same tiles over and over, each store moves the tile to the head */
+static void
+bench_memory_cache_hit (guint64 n)
+{
+  ChamplainTileCache *cache = CHAMPLAIN_TILE_CACHE (memory_cache);
+  guint64 i;
+
+  champlain_memory_cache_clean (memory_cache);
+  for (i = 0; i < n; i++)
+    champlain_tile_cache_store_tile (cache, tiles[i % 64], "data", 4);
+}
+
+
+/* More tiles than fit in the cache, every store evicts the oldest one */
+static void
+bench_memory_cache_evict (guint64 n)
+{
+  ChamplainTileCache *cache = CHAMPLAIN_TILE_CACHE (memory_cache);
+  guint64 i;
+
+  champlain_memory_cache_clean (memory_cache);
+  for (i = 0; i < n; i++)
+    champlain_tile_cache_store_tile (cache, tiles[i % N_TILES], "data", 4);
+}
+
+
+static void
+bench_get_tile_uri (guint64 n)
+{
+  ChamplainNetworkTileSource *tile_source = CHAMPLAIN_NETWORK_TILE_SOURCE (source);
+  gsize total = 0;
+  guint64 i;
+
+  for (i = 0; i < n; i++)
+    {
+      gchar *uri = _champlain_network_tile_source_get_tile_uri (tile_source,
+            i % 4096, (i / 4096) % 4096, 12);
+
+      total += strlen (uri);
+      g_free (uri);
+    }
+  sink = total;
+}
+
+
+static const MicroBench benchmarks[] =
+{
+  { "map_source_get_x", 1, bench_get_x },
+  { "map_source_get_y", 1, bench_get_y },
+  { "map_source_get_latitude", 1, bench_get_latitude },
+  { "map_source_get_longitude", 1, bench_get_longitude },
+  { "x_to_wrap_x", 1, bench_x_to_wrap_x },
+  { "tile_table_set", 10, bench_tile_table },
+  { "generate_queue_key", 10, bench_generate_queue_key },
+  { "memory_cache_hit", 10, bench_memory_cache_hit },
+  { "memory_cache_evict", 10, bench_memory_cache_evict },
+  { "get_tile_uri", 10, bench_get_tile_uri },
+};
+
+
+static void
+run_benchmark (const MicroBench *bench)
+{
+  guint64 n = MAX (iterations / bench->divisor, 1);
+  gint64 start, elapsed;
+
+  /* warm up the caches and the allocator */
+  bench->run (MAX (n / 100, 1));
+
+  start = g_get_monotonic_time ();
+  bench->run (n);
+  elapsed = g_get_monotonic_time () - start;
+
+  g_print ("{\"name\": \"%s\", \"iterations\": %" G_GUINT64_FORMAT
+      ", \"total_ms\": %.3f, \"ns_per_op\": %.3f}\n",
+      bench->name, n, elapsed / 1000.0, elapsed * 1000.0 / n);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  ChamplainMapSourceFactory *factory;
+  GOptionContext *context;
+  GError *error = NULL;
+  guint i;
+
+  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
+    return 1;
+
+  context = g_option_context_new ("- time the hot internal primitives");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  /* No tiles are loaded, the sources are only used for the computations */
+  factory = champlain_map_source_factory_dup_default ();
+  source = g_object_ref_sink (champlain_map_source_factory_create (factory,
+          CHAMPLAIN_MAP_SOURCE_OSM_MAPNIK));
+  /* The tile table keys depend on the zoom level of the view */
+  view = g_object_ref_sink (champlain_view_new ());
+  champlain_view_set_map_source (view, champlain_map_source_factory_create_error_source (factory, 256));
+  champlain_view_set_zoom_level (view, 12);
+  memory_cache = g_object_ref_sink (champlain_memory_cache_new_full (256,
+          CHAMPLAIN_RENDERER (champlain_image_renderer_new ())));
+
+  for (i = 0; i < N_TILES; i++)
+    tiles[i] = g_object_ref_sink (champlain_tile_new_full (i % 32, i / 32, 256, 12));
+
+  for (i = 0; i < G_N_ELEMENTS (benchmarks); i++)
+    {
+      if (filter && !strstr (benchmarks[i].name, filter))
+        continue;
+      run_benchmark (&benchmarks[i]);
+    }
+
+  for (i = 0; i < N_TILES; i++)
+    g_object_unref (tiles[i]);
+  g_object_unref (memory_cache);
+  clutter_actor_destroy (CLUTTER_ACTOR (view));
+  g_object_unref (view);
+  g_object_unref (source);
+  g_object_unref (factory);
+
+  return 0;
+}
@@ -0,0 +1,581 @@
+/*
+ * Copyright (C) 2010-2013 Jiri Techet <techet@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Benchmark of the tile loading pipeline. A cached source chain
+ * (memory cache -> file cache -> network source -> error source) loads
+ * tiles from an HTTP server running in the same process, so no internet
+ * connection is needed and the results are repeatable.
+ *
+ * The script replayed by the benchmark contains one viewport per line:
+ *
+ *   zoom latitude longitude [width height]
+ *
+ * Empty lines and lines starting with '#' are ignored. All tiles covering
+ * the viewport are requested at once and the time until all of them are
+ * loaded is reported. The tiles are never added to a stage so no window is
+ * shown; the library however needs a working Clutter backend.
+ */
+
+#include <champlain/champlain.h>
+#include <libsoup/soup.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TILE_SIZE 256
+
+static const gchar *default_script =
+  "# pan across a city\n"
+  "12 50.08 14.42\n"
+  "12 50.08 14.47\n"
+  "12 50.10 14.52\n"
+  "12 50.05 14.52\n"
+  "# zoom in and back out\n"
+  "13 50.05 14.52\n"
+  "14 50.05 14.52\n"
+  "13 50.05 14.52\n"
+  "12 50.08 14.42\n";
+
+static gint latency = 50;
+static gint bandwidth = 0;
+static gdouble error_rate = 0.0;
+static gint passes = 2;
+static gint viewport_width = 800;
+static gint viewport_height = 600;
+static gchar *cache_dir = NULL;
+
+static GOptionEntry entries[] =
+{
+  { "latency", 'l', 0, G_OPTION_ARG_INT, &latency,
+    "Server response latency in milliseconds (default 50)", "MS" },
+  { "bandwidth", 'b', 0, G_OPTION_ARG_INT, &bandwidth,
+    "Server bandwidth per response in kB/s, 0 for unlimited (default 0)", "KBPS" },
+  { "error-rate", 'e', 0, G_OPTION_ARG_DOUBLE, &error_rate,
+    "Fraction of requests failing with an HTTP error (default 0)", "RATE" },
+  { "passes", 'p', 0, G_OPTION_ARG_INT, &passes,
+    "Number of times the script is replayed (default 2)", "N" },
+  { "width", 'W', 0, G_OPTION_ARG_INT, &viewport_width,
+    "Default viewport width (default 800)", "PX" },
+  { "height", 'H', 0, G_OPTION_ARG_INT, &viewport_height,
+    "Default viewport height (default 600)", "PX" },
+  { "cache-dir", 'c', 0, G_OPTION_ARG_FILENAME, &cache_dir,
+    "File cache directory, a temporary one is used by default", "DIR" },
+  { NULL }
+};
+
+typedef struct
+{
+  guint zoom;
+  gdouble latitude;
+  gdouble longitude;
+  gint width;
+  gint height;
+} Step;
+
+typedef struct
+{
+  SoupServer *server;
+  SoupMessage *msg;
+} PendingResponse;
+
+typedef struct
+{
+  ChamplainMapSource *chain;
+  ChamplainMapSource *memory_cache;
+  ChamplainMapSource *file_cache;
+  ChamplainMapSource *network_source;
+
+  GArray *steps;
+  guint step;
+  guint pass;
+
+  GPtrArray *tiles;
+  guint pending;
+  gint64 step_start;
+  gint64 pass_start;
+  guint pass_tiles;
+  gsize peak_memory;
+
+  GMainLoop *loop;
+} Bench;
+
+static GByteArray *tile_data;
+static guint served;
+static guint failed;
+
+
+static cairo_status_t
+write_png_cb (GByteArray *array,
+    const guchar *data,
+    guint length)
+{
+  g_byte_array_append (array, data, length);
+  return CAIRO_STATUS_SUCCESS;
+}
+
+
+/* All tiles are served with the same image of a typical PNG tile size */
+static void
+create_tile_data (void)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  gint i;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, TILE_SIZE, TILE_SIZE);
+  cr = cairo_create (surface);
+
+  cairo_set_source_rgb (cr, 0.95, 0.93, 0.91);
+  cairo_paint (cr);
+  cairo_set_source_rgb (cr, 0.6, 0.6, 0.6);
+  for (i = 0; i < 32; i++)
+    {
+      cairo_move_to (cr, g_random_double_range (0, TILE_SIZE), g_random_double_range (0, TILE_SIZE));
+      cairo_line_to (cr, g_random_double_range (0, TILE_SIZE), g_random_double_range (0, TILE_SIZE));
+    }
+  cairo_stroke (cr);
+  cairo_destroy (cr);
+
+  tile_data = g_byte_array_new ();
+  cairo_surface_write_to_png_stream (surface, (cairo_write_func_t) write_png_cb, tile_data);
+  cairo_surface_destroy (surface);
+}
+
+
+static gboolean
+respond_cb (PendingResponse *response)
+{
+  SoupMessage *msg = response->msg;
+
+  if (g_random_double () < error_rate)
+    {
+      soup_message_set_status (msg, SOUP_STATUS_INTERNAL_SERVER_ERROR);
+      failed++;
+    }
+  else
+    {
+      soup_message_set_status (msg, SOUP_STATUS_OK);
+      soup_message_set_response (msg, "image/png", SOUP_MEMORY_STATIC,
+          (const gchar *) tile_data->data, tile_data->len);
+      served++;
+    }
+
+  soup_server_unpause_message (response->server, msg);
+  g_object_unref (msg);
+  g_slice_free (PendingResponse, response);
+
+  return FALSE;
+}
+
+
+static void
+server_cb (SoupServer *server,
+    SoupMessage *msg,
+    G_GNUC_UNUSED const char *path,
+    G_GNUC_UNUSED GHashTable *query,
+    G_GNUC_UNUSED SoupClientContext *client,
+    G_GNUC_UNUSED gpointer data)
+{
+  PendingResponse *response;
+  guint delay = latency;
+
+  if (msg->method != SOUP_METHOD_GET)
+    {
+      soup_message_set_status (msg, SOUP_STATUS_NOT_IMPLEMENTED);
+      return;
+    }
+
+  /* bytes divided by kB/s gives milliseconds */
+  if (bandwidth > 0)
+    delay += tile_data->len / bandwidth;
+
+  response = g_slice_new (PendingResponse);
+  response->server = server;
+  response->msg = g_object_ref (msg);
+
+  soup_server_pause_message (server, msg);
+  g_timeout_add (delay, (GSourceFunc) respond_cb, response);
+}
+
+
+static SoupServer *
+start_server (guint *port)
+{
+  SoupServer *server;
+
+#if SOUP_CHECK_VERSION (2, 48, 0)
+  GError *error = NULL;
+  GSList *uris;
+
+  server = soup_server_new (NULL, NULL);
+  if (!soup_server_listen_local (server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &error))
+    {
+      g_printerr ("Cannot start the tile server: %s\n", error->message);
+      g_error_free (error);
+      g_object_unref (server);
+      return NULL;
+    }
+
+  uris = soup_server_get_uris (server);
+  *port = soup_uri_get_port (uris->data);
+  g_slist_free_full (uris, (GDestroyNotify) soup_uri_free);
+#else
+  SoupAddress *address;
+
+  address = soup_address_new ("127.0.0.1", SOUP_ADDRESS_ANY_PORT);
+  soup_address_resolve_sync (address, NULL);
+  server = soup_server_new (SOUP_SERVER_INTERFACE, address, NULL);
+  g_object_unref (address);
+  if (!server)
+    {
+      g_printerr ("Cannot start the tile server\n");
+      return NULL;
+    }
+
+  *port = soup_server_get_port (server);
+  soup_server_run_async (server);
+#endif
+
+  soup_server_add_handler (server, NULL, server_cb, NULL, NULL);
+
+  return server;
+}
+
+
+static GArray *
+parse_script (const gchar *contents)
+{
+  GArray *steps = g_array_new (FALSE, FALSE, sizeof (Step));
+  gchar **lines = g_strsplit (contents, "\n", -1);
+  gint i;
+
+  for (i = 0; lines[i]; i++)
+    {
+      gchar *line = g_strstrip (lines[i]);
+      Step step;
+      gint n;
+
+      if (*line == '\0' || *line == '#')
+        continue;
+
+      step.width = viewport_width;
+      step.height = viewport_height;
+      n = sscanf (line, "%u %lf %lf %d %d", &step.zoom, &step.latitude,
+            &step.longitude, &step.width, &step.height);
+      if (n != 3 && n != 5)
+        {
+          g_printerr ("Ignoring invalid script line: %s\n", line);
+          continue;
+        }
+
+      g_array_append_val (steps, step);
+    }
+
+  g_strfreev (lines);
+
+  return steps;
+}
+
+
+static ChamplainMapSource *
+create_chain (Bench *bench,
+    guint port)
+{
+  ChamplainMapSourceFactory *factory = champlain_map_source_factory_dup_default ();
+  ChamplainMapSourceChain *chain;
+  ChamplainMapSource *error_source;
+  gchar *uri_format;
+
+  uri_format = g_strdup_printf ("http://127.0.0.1:%u/#Z#/#X#/#Y#.png", port);
+  bench->network_source = CHAMPLAIN_MAP_SOURCE (champlain_network_tile_source_new_full (
+        "bench", "Benchmark", NULL, NULL, 0, 18, TILE_SIZE,
+        CHAMPLAIN_MAP_PROJECTION_MERCATOR, uri_format,
+        CHAMPLAIN_RENDERER (champlain_image_renderer_new ())));
+  g_free (uri_format);
+
+  error_source = champlain_map_source_factory_create_error_source (factory, TILE_SIZE);
+
+  bench->file_cache = CHAMPLAIN_MAP_SOURCE (champlain_file_cache_new_full (100000000,
+        cache_dir, CHAMPLAIN_RENDERER (champlain_image_renderer_new ())));
+  bench->memory_cache = CHAMPLAIN_MAP_SOURCE (champlain_memory_cache_new_full (100,
+        CHAMPLAIN_RENDERER (champlain_image_renderer_new ())));
+
+  chain = champlain_map_source_chain_new ();
+  champlain_map_source_chain_push (chain, error_source);
+  champlain_map_source_chain_push (chain, bench->network_source);
+  champlain_map_source_chain_push (chain, bench->file_cache);
+  champlain_map_source_chain_push (chain, bench->memory_cache);
+
+  g_object_unref (factory);
+
+  return g_object_ref_sink (CHAMPLAIN_MAP_SOURCE (chain));
+}
+
+
+static void run_step (Bench *bench);
+
+
+static void
+print_cache_stats (const gchar *name,
+    ChamplainMapSource *source)
+{
+  ChamplainMapSourceStats stats;
+  guint lookups;
+
+  champlain_map_source_get_stats (source, &stats);
+  lookups = stats.cache_hits + stats.cache_misses;
+  g_print ("  %-13s %u/%u hits (%.1f%%)\n", name, stats.cache_hits, lookups,
+      lookups > 0 ? 100.0 * stats.cache_hits / lookups : 0.0);
+  champlain_map_source_reset_stats (source);
+}
+
+
+static void
+finish_pass (Bench *bench)
+{
+  ChamplainMapSourceStats stats;
+  gdouble elapsed = (g_get_monotonic_time () - bench->pass_start) / 1000000.0;
+
+  champlain_map_source_get_stats (bench->network_source, &stats);
+
+  g_print ("pass %u: %u tiles in %.3f s (%.1f tiles/s)\n", bench->pass + 1,
+      bench->pass_tiles, elapsed, elapsed > 0 ? bench->pass_tiles / elapsed : 0.0);
+  print_cache_stats ("memory cache", bench->memory_cache);
+  print_cache_stats ("file cache", bench->file_cache);
+  g_print ("  %-13s %u requests, %u failures, %" G_GUINT64_FORMAT " kB, %u decodes in %.1f ms\n",
+      "network", stats.requests, stats.failures, stats.bytes_downloaded / 1024,
+      stats.decodes, stats.decode_time / 1000.0);
+  g_print ("  %-13s %u hedged, %u won by the mirror\n", "hedging",
+      stats.hedged, stats.hedge_wins);
+  g_print ("  %-13s %u served, %u failed\n", "server", served, failed);
+  g_print ("  %-13s %" G_GSIZE_FORMAT " kB peak, %" G_GSIZE_FORMAT " kB now\n",
+      "memory", bench->peak_memory / 1024, champlain_memory_usage_get_total () / 1024);
+
+  champlain_map_source_reset_stats (bench->network_source);
+  served = failed = 0;
+  bench->pass_tiles = 0;
+  bench->peak_memory = 0;
+}
+
+
+static gboolean
+finish_step (Bench *bench)
+{
+  Step *step = &g_array_index (bench->steps, Step, bench->step);
+  gdouble elapsed = (g_get_monotonic_time () - bench->step_start) / 1000.0;
+  guint i;
+
+  g_print ("pass %u step %u: zoom %u, %u tiles, %.1f ms to full viewport\n",
+      bench->pass + 1, bench->step + 1, step->zoom, bench->tiles->len, elapsed);
+
+  bench->pass_tiles += bench->tiles->len;
+  bench->peak_memory = MAX (bench->peak_memory, champlain_memory_usage_get_total ());
+
+  for (i = 0; i < bench->tiles->len; i++)
+    {
+      ClutterActor *tile = g_ptr_array_index (bench->tiles, i);
+
+      clutter_actor_destroy (tile);
+      g_object_unref (tile);
+    }
+  g_ptr_array_set_size (bench->tiles, 0);
+
+  bench->step++;
+  if (bench->step == bench->steps->len)
+    {
+      finish_pass (bench);
+      bench->step = 0;
+      bench->pass++;
+      if (bench->pass == (guint) passes)
+        {
+          g_main_loop_quit (bench->loop);
+          return FALSE;
+        }
+    }
+
+  run_step (bench);
+
+  return FALSE;
+}
+
+
+static void
+tile_state_notify (ChamplainTile *tile,
+    G_GNUC_UNUSED GParamSpec *pspec,
+    Bench *bench)
+{
+  if (champlain_tile_get_state (tile) != CHAMPLAIN_STATE_DONE)
+    return;
+
+  g_signal_handlers_disconnect_by_func (tile, tile_state_notify, bench);
+
+  /* Finish outside of the map source callbacks which may still use the tile */
+  bench->pending--;
+  if (bench->pending == 0)
+    g_idle_add ((GSourceFunc) finish_step, bench);
+}
+
+
+static void
+run_step (Bench *bench)
+{
+  Step *step = &g_array_index (bench->steps, Step, bench->step);
+  ChamplainMapSource *source = bench->chain;
+  gint x, y, x_first, y_first, x_last, y_last;
+  gint max_x, max_y;
+
+  x = champlain_map_source_get_x (source, step->zoom, step->longitude);
+  y = champlain_map_source_get_y (source, step->zoom, step->latitude);
+  max_x = champlain_map_source_get_column_count (source, step->zoom) - 1;
+  max_y = champlain_map_source_get_row_count (source, step->zoom) - 1;
+
+  x_first = CLAMP ((x - step->width / 2) / TILE_SIZE, 0, max_x);
+  y_first = CLAMP ((y - step->height / 2) / TILE_SIZE, 0, max_y);
+  x_last = CLAMP ((x + step->width / 2) / TILE_SIZE, 0, max_x);
+  y_last = CLAMP ((y + step->height / 2) / TILE_SIZE, 0, max_y);
+
+  if (bench->step == 0)
+    bench->pass_start = g_get_monotonic_time ();
+  bench->step_start = g_get_monotonic_time ();
+
+  /* Counted before filling as cache hits finish synchronously */
+  bench->pending = (x_last - x_first + 1) * (y_last - y_first + 1);
+
+  for (y = y_first; y <= y_last; y++)
+    for (x = x_first; x <= x_last; x++)
+      {
+        ChamplainTile *tile = champlain_tile_new_full (x, y, TILE_SIZE, step->zoom);
+
+        g_object_ref_sink (tile);
+        g_ptr_array_add (bench->tiles, tile);
+
+        g_signal_connect (tile, "notify::state", G_CALLBACK (tile_state_notify), bench);
+        champlain_tile_set_state (tile, CHAMPLAIN_STATE_LOADING);
+        champlain_map_source_fill_tile (source, tile);
+      }
+}
+
+
+static void
+remove_dir (const gchar *path)
+{
+  GDir *dir = g_dir_open (path, 0, NULL);
+  const gchar *name;
+
+  if (!dir)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *child = g_build_filename (path, name, NULL);
+
+      if (g_file_test (child, G_FILE_TEST_IS_DIR))
+        remove_dir (child);
+      else
+        g_unlink (child);
+      g_free (child);
+    }
+
+  g_dir_close (dir);
+  g_rmdir (path);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  SoupServer *server;
+  gchar *script = NULL;
+  gchar *tmp_dir = NULL;
+  guint port;
+  Bench bench = { 0, };
+
+  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
+    return 1;
+
+  context = g_option_context_new ("[SCRIPT] - benchmark the tile loading pipeline");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (argc > 1 && !g_file_get_contents (argv[1], &script, NULL, &error))
+    {
+      g_printerr ("Cannot read the script: %s\n", error->message);
+      g_error_free (error);
+      return 1;
+    }
+
+  bench.steps = parse_script (script ? script : default_script);
+  g_free (script);
+  if (bench.steps->len == 0 || passes < 1)
+    {
+      g_printerr ("Nothing to do\n");
+      return 1;
+    }
+
+  /* An empty file cache makes the first pass a cold start */
+  if (!cache_dir)
+    {
+      tmp_dir = g_dir_make_tmp ("champlain-bench-XXXXXX", &error);
+      if (!tmp_dir)
+        {
+          g_printerr ("Cannot create the cache directory: %s\n", error->message);
+          g_error_free (error);
+          return 1;
+        }
+      cache_dir = tmp_dir;
+    }
+
+  create_tile_data ();
+  server = start_server (&port);
+  if (!server)
+    return 1;
+
+  g_print ("latency %d ms, bandwidth %d kB/s, error rate %.2f, tile %u B, cache %s\n",
+      latency, bandwidth, error_rate, tile_data->len, cache_dir);
+
+  bench.chain = create_chain (&bench, port);
+  bench.tiles = g_ptr_array_new ();
+  bench.loop = g_main_loop_new (NULL, FALSE);
+
+  run_step (&bench);
+  g_main_loop_run (bench.loop);
+
+  g_main_loop_unref (bench.loop);
+  g_ptr_array_free (bench.tiles, TRUE);
+  g_array_free (bench.steps, TRUE);
+  g_object_unref (bench.chain);
+  g_object_unref (server);
+  g_byte_array_free (tile_data, TRUE);
+
+  if (tmp_dir)
+    {
+      remove_dir (tmp_dir);
+      g_free (tmp_dir);
+    }
+
+  return 0;
+}
@@ -371,7 +371,9 @@ view_size_allocated_cb (GtkWidget *widget,
 {
   GtkChamplainEmbedPrivate *priv = view->priv;
 
-  if (priv->view != NULL)
+  /* GTK allocates repeatedly with the same size, e.g. during a window drag */
+  if (priv->view != NULL &&
+      (priv->width != allocation->width || priv->height != allocation->height))
     clutter_actor_set_size (CLUTTER_ACTOR (priv->view), allocation->width, allocation->height);
 
   priv->width = allocation->width;
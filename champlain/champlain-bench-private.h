@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2010-2013 Jiri Techet <techet@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef CHAMPLAIN_BENCH_PRIVATE_H
+#define CHAMPLAIN_BENCH_PRIVATE_H
+
+#include <champlain/champlain.h>
+
+/* Internal helpers called in hot loops, used by bench/micro-bench.c which
+   links them from libchamplain-internal.la. The leading underscore keeps them
+   out of the symbols exported by the shared library. */
+
+G_BEGIN_DECLS
+
+gdouble _champlain_view_x_to_wrap_x (gdouble x,
+    gdouble width);
+void _champlain_view_tile_table_set (ChamplainView *view,
+    GHashTable *table,
+    gint tile_x,
+    gint tile_y,
+    gboolean value);
+gboolean _champlain_view_tile_in_tile_table (ChamplainView *view,
+    GHashTable *table,
+    gint tile_x,
+    gint tile_y);
+gchar *_champlain_memory_cache_generate_key (ChamplainMemoryCache *memory_cache,
+    ChamplainTile *tile);
+gchar *_champlain_network_tile_source_get_tile_uri (ChamplainNetworkTileSource *tile_source,
+    gint x,
+    gint y,
+    gint z);
+
+G_END_DECLS
+
+#endif
@@ -30,9 +30,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-#ifdef ENABLE_DEBUG
+ChamplainDebugFlags _champlain_debug_flags = 0;
 
-static ChamplainDebugFlags flags = 0;
+#ifdef ENABLE_DEBUG
 
 static GDebugKey keys[] = {
   { "Loading", CHAMPLAIN_DEBUG_LOADING },
@@ -49,7 +49,7 @@ static GDebugKey keys[] = {
 static void
 debug_set_flags (ChamplainDebugFlags new_flags)
 {
-  flags |= new_flags;
+  _champlain_debug_flags |= new_flags;
 }
 
 
@@ -69,7 +69,7 @@ champlain_debug_set_flags (const gchar *flags_string)
 gboolean
 champlain_debug_flag_is_set (ChamplainDebugFlags flag)
 {
-  return (flag & flags) != 0;
+  return (flag & _champlain_debug_flags) != 0;
 }
 
 
@@ -78,7 +78,7 @@ champlain_debug (ChamplainDebugFlags flag,
     const gchar *format,
     ...)
 {
-  if (flag & flags)
+  if (flag & _champlain_debug_flags)
     {
       va_list args;
       va_start (args, format);
@@ -40,11 +40,36 @@ typedef enum
   CHAMPLAIN_DEBUG_OTHER = 1 << 8,
 } ChamplainDebugFlags;
 
+/* Checked inline by DEBUG () so that disabled messages don't even evaluate
+   their arguments. The underscore keeps it out of the exported symbols. */
+extern ChamplainDebugFlags _champlain_debug_flags;
+
 gboolean champlain_debug_flag_is_set (ChamplainDebugFlags flag);
 void champlain_debug (ChamplainDebugFlags flag,
     const gchar *format,
     ...) G_GNUC_PRINTF (2, 3);
 void champlain_debug_set_flags (const gchar *flags_string);
+
+/* Static tracepoints. With sys/sdt.h available they compile to a single nop
+ * instruction which can be enabled at runtime on release builds by perf,
+ * bpftrace or systemtap, e.g.
+ *
+ *   bpftrace -e 'usdt:libchamplain-0.12.so:champlain:view_call
+ *       { printf ("%s\n", str (arg0)); }'
+ *
+ * Without sys/sdt.h they compile to nothing.
+ */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define CHAMPLAIN_PROBE(name) DTRACE_PROBE (champlain, name)
+#define CHAMPLAIN_PROBE1(name, a1) DTRACE_PROBE1 (champlain, name, a1)
+#define CHAMPLAIN_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4 (champlain, name, a1, a2, a3, a4)
+#else
+#define CHAMPLAIN_PROBE(name) G_STMT_START { } G_STMT_END
+#define CHAMPLAIN_PROBE1(name, a1) G_STMT_START { } G_STMT_END
+#define CHAMPLAIN_PROBE4(name, a1, a2, a3, a4) G_STMT_START { } G_STMT_END
+#endif
+
 G_END_DECLS
 
 #endif /* __CHAMPLAIN_DEBUG_H__ */
@@ -72,10 +97,13 @@ G_END_DECLS
 
 #undef DEBUG
 #define DEBUG(format, ...) \
-  champlain_debug (DEBUG_FLAG, "%s: " format, G_STRFUNC, ## __VA_ARGS__)
+  G_STMT_START { \
+    if (G_UNLIKELY (_champlain_debug_flags & DEBUG_FLAG)) \
+      champlain_debug (DEBUG_FLAG, "%s: " format, G_STRFUNC, ## __VA_ARGS__); \
+  } G_STMT_END
 
 #undef DEBUGGING
-#define DEBUGGING champlain_debug_flag_is_set (DEBUG_FLAG)
+#define DEBUGGING ((_champlain_debug_flags & DEBUG_FLAG) != 0)
 
 #else /* !defined (ENABLE_DEBUG) */
 
@@ -24,18 +24,28 @@
  * #ChamplainFileCache is a cache that stores and retrieves tiles from the
  * file system. Tiles most frequently loaded gain in "popularity". This popularity
  * is taken into account when purging the cache.
+ *
+ * When #ChamplainFileCache:max-underzoom is set, a missing tile is
+ * synthesized from its cached descendants, see
+ * champlain_file_cache_set_max_underzoom(). When #ChamplainFileCache:hedge-reads
+ * is set, a slow read is raced against the next map source, see
+ * champlain_file_cache_set_hedge_reads().
  */
 
 #define DEBUG_FLAG CHAMPLAIN_DEBUG_CACHE
 #include "champlain-debug.h"
 
 #include "champlain-file-cache.h"
+#include "champlain-private.h"
 
 #include <sqlite3.h>
 #include <errno.h>
 #include <glib.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <gdk/gdk.h>
 #include <string.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 G_DEFINE_TYPE (ChamplainFileCache, champlain_file_cache, CHAMPLAIN_TYPE_TILE_CACHE);
@@ -47,9 +57,25 @@ enum
 {
   PROP_0,
   PROP_SIZE_LIMIT,
-  PROP_CACHE_DIR
+  PROP_CACHE_DIR,
+  PROP_MAX_UNDERZOOM,
+  PROP_HEDGE_READS
 };
 
+/* Tuning parameters */
+#define MAX_UNDERZOOM_THREADS 2
+#define MAX_UNDERZOOM 2
+/* Number of recent read times the hedging delay is computed from */
+#define READ_TIME_SAMPLES 64
+#define MIN_READ_TIME_SAMPLES 10
+/* Hedging delays in milliseconds, the default is used until there are
+   enough samples */
+#define DEFAULT_HEDGE_DELAY 250
+#define MIN_HEDGE_DELAY 10
+
+/* The read a tile loaded by the next source is hedging */
+#define HEDGED_READ_KEY "champlain-hedged-read"
+
 struct _ChamplainFileCachePrivate
 {
   guint size_limit;
@@ -58,8 +84,27 @@ struct _ChamplainFileCachePrivate
   sqlite3 *db;
   sqlite3_stmt *stmt_select;
   sqlite3_stmt *stmt_update;
+
+  guint max_underzoom;
+  GThreadPool *underzoom_pool;
+  /* removes the files of invalidated tiles */
+  GThreadPool *delete_pool;
+
+  gboolean hedge_reads;
+  /* ring buffer of the last read times of cached tiles in milliseconds */
+  guint read_times[READ_TIME_SAMPLES];
+  guint n_read_times;
+  guint read_time_index;
 };
 
+typedef struct
+{
+  /* a directory to remove with all its contents */
+  gchar *dir;
+  /* or the tile files to remove */
+  GPtrArray *files;
+} DeleteJob;
+
 static void finalize_sql (ChamplainFileCache *file_cache);
 static void init_cache (ChamplainFileCache *file_cache);
 static gchar *get_filename (ChamplainFileCache *file_cache,
@@ -72,6 +117,9 @@ static gboolean create_cache_dir (const gchar *dir_name);
 
 static void fill_tile (ChamplainMapSource *map_source,
     ChamplainTile *tile);
+static void fill_tiles (ChamplainMapSource *map_source,
+    ChamplainTile **tiles,
+    guint n_tiles);
 
 static void store_tile (ChamplainTileCache *tile_cache,
     ChamplainTile *tile,
@@ -81,6 +129,10 @@ static void refresh_tile_time (ChamplainTileCache *tile_cache,
     ChamplainTile *tile);
 static void on_tile_filled (ChamplainTileCache *tile_cache,
     ChamplainTile *tile);
+static void invalidate_area (ChamplainTileCache *tile_cache,
+    ChamplainBoundingBox *bbox);
+static void underzoom_worker_thread (gpointer data,
+    gpointer user_data);
 
 static void
 champlain_file_cache_get_property (GObject *object,
@@ -100,6 +152,14 @@ champlain_file_cache_get_property (GObject *object,
       g_value_set_string (value, champlain_file_cache_get_cache_dir (file_cache));
       break;
 
+    case PROP_MAX_UNDERZOOM:
+      g_value_set_uint (value, champlain_file_cache_get_max_underzoom (file_cache));
+      break;
+
+    case PROP_HEDGE_READS:
+      g_value_set_boolean (value, champlain_file_cache_get_hedge_reads (file_cache));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -127,6 +187,14 @@ champlain_file_cache_set_property (GObject *object,
       priv->cache_dir = g_strdup (g_value_get_string (value));
       break;
 
+    case PROP_MAX_UNDERZOOM:
+      champlain_file_cache_set_max_underzoom (file_cache, g_value_get_uint (value));
+      break;
+
+    case PROP_HEDGE_READS:
+      champlain_file_cache_set_hedge_reads (file_cache, g_value_get_boolean (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -136,6 +204,20 @@ champlain_file_cache_set_property (GObject *object,
 static void
 champlain_file_cache_dispose (GObject *object)
 {
+  ChamplainFileCachePrivate *priv = CHAMPLAIN_FILE_CACHE (object)->priv;
+
+  if (priv->underzoom_pool)
+    {
+      g_thread_pool_free (priv->underzoom_pool, FALSE, TRUE);
+      priv->underzoom_pool = NULL;
+    }
+
+  if (priv->delete_pool)
+    {
+      g_thread_pool_free (priv->delete_pool, FALSE, TRUE);
+      priv->delete_pool = NULL;
+    }
+
   G_OBJECT_CLASS (champlain_file_cache_parent_class)->dispose (object);
 }
 
@@ -344,11 +426,45 @@ champlain_file_cache_class_init (ChamplainFileCacheClass *klass)
         G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
   g_object_class_install_property (object_class, PROP_CACHE_DIR, pspec);
 
+  /**
+   * ChamplainFileCache:max-underzoom:
+   *
+   * The number of zoom levels below a missing tile searched for cached
+   * descendants to synthesize the tile from.
+   *
+   * Since: 0.12.15
+   */
+  pspec = g_param_spec_uint ("max-underzoom",
+        "Max underzoom",
+        "The number of zoom levels searched for the descendants of missing tiles",
+        0,
+        MAX_UNDERZOOM,
+        0,
+        G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_MAX_UNDERZOOM, pspec);
+
+  /**
+   * ChamplainFileCache:hedge-reads:
+   *
+   * Whether a read of a cached tile taking longer than most of the recent
+   * ones is raced against the next map source.
+   *
+   * Since: 0.12.15
+   */
+  pspec = g_param_spec_boolean ("hedge-reads",
+        "Hedge reads",
+        "Race slow reads against the next map source",
+        FALSE,
+        G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_HEDGE_READS, pspec);
+
   tile_cache_class->store_tile = store_tile;
   tile_cache_class->refresh_tile_time = refresh_tile_time;
   tile_cache_class->on_tile_filled = on_tile_filled;
+  _champlain_type_set_vfunc (G_OBJECT_CLASS_TYPE (klass), "invalidate-area", (gpointer) invalidate_area);
 
   map_source_class->fill_tile = fill_tile;
+  champlain_map_source_class_set_fill_tiles (map_source_class, fill_tiles);
 }
 
 
@@ -365,6 +481,12 @@ champlain_file_cache_init (ChamplainFileCache *file_cache)
   priv->db = NULL;
   priv->stmt_select = NULL;
   priv->stmt_update = NULL;
+  priv->max_underzoom = 0;
+  priv->underzoom_pool = NULL;
+  priv->delete_pool = NULL;
+  priv->hedge_reads = FALSE;
+  priv->n_read_times = 0;
+  priv->read_time_index = 0;
 }
 
 
@@ -457,6 +579,147 @@ champlain_file_cache_set_size_limit (ChamplainFileCache *file_cache,
 }
 
 
+/**
+ * champlain_file_cache_get_max_underzoom:
+ * @file_cache: a #ChamplainFileCache
+ *
+ * Gets the number of zoom levels searched for the cached descendants of
+ * missing tiles.
+ *
+ * Returns: the number of zoom levels, 0 when underzooming is disabled.
+ *
+ * Since: 0.12.15
+ */
+guint
+champlain_file_cache_get_max_underzoom (ChamplainFileCache *file_cache)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_FILE_CACHE (file_cache), 0);
+
+  return file_cache->priv->max_underzoom;
+}
+
+
+/**
+ * champlain_file_cache_set_max_underzoom:
+ * @file_cache: a #ChamplainFileCache
+ * @max_underzoom: the number of zoom levels, at most 2
+ *
+ * Sets the number of zoom levels searched for the cached descendants of
+ * missing tiles. When a tile is not in the cache but its four children
+ * are, or with @max_underzoom 2 its sixteen grandchildren, the tile is
+ * synthesized by downsampling them in a separate thread and stored in the
+ * cache. A map cached only at high zoom levels can then be zoomed out
+ * without a network connection.
+ *
+ * The synthesized tiles are stored as expired so they are replaced by the
+ * tiles of the next map source once it can provide them. 0 disables the
+ * synthesis.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_file_cache_set_max_underzoom (ChamplainFileCache *file_cache,
+    guint max_underzoom)
+{
+  g_return_if_fail (CHAMPLAIN_IS_FILE_CACHE (file_cache));
+
+  ChamplainFileCachePrivate *priv = file_cache->priv;
+
+  priv->max_underzoom = MIN (max_underzoom, MAX_UNDERZOOM);
+  if (priv->max_underzoom > 0 && !priv->underzoom_pool)
+    priv->underzoom_pool = g_thread_pool_new (underzoom_worker_thread, NULL,
+          MAX_UNDERZOOM_THREADS, FALSE, NULL);
+
+  g_object_notify (G_OBJECT (file_cache), "max-underzoom");
+}
+
+
+/**
+ * champlain_file_cache_get_hedge_reads:
+ * @file_cache: a #ChamplainFileCache
+ *
+ * Checks whether slow reads are raced against the next map source, see
+ * champlain_file_cache_set_hedge_reads().
+ *
+ * Returns: %TRUE when slow reads are hedged
+ *
+ * Since: 0.12.15
+ */
+gboolean
+champlain_file_cache_get_hedge_reads (ChamplainFileCache *file_cache)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_FILE_CACHE (file_cache), FALSE);
+
+  return file_cache->priv->hedge_reads;
+}
+
+
+/**
+ * champlain_file_cache_set_hedge_reads:
+ * @file_cache: a #ChamplainFileCache
+ * @hedge_reads: whether slow reads are hedged
+ *
+ * When a read of a cached tile takes longer than 90 % of the recent reads,
+ * e.g. on a slow memory card, the tile is requested from the next map
+ * source as well and the first of the two displays it. The other one is
+ * cancelled. A tile delivered by the next source is stored in the cache as
+ * usual. The hedged reads and the reads the next source won are counted
+ * in the hedged and hedge_wins fields of #ChamplainMapSourceStats.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_file_cache_set_hedge_reads (ChamplainFileCache *file_cache,
+    gboolean hedge_reads)
+{
+  g_return_if_fail (CHAMPLAIN_IS_FILE_CACHE (file_cache));
+
+  file_cache->priv->hedge_reads = hedge_reads;
+
+  g_object_notify (G_OBJECT (file_cache), "hedge-reads");
+}
+
+
+static void
+record_read_time (ChamplainFileCachePrivate *priv,
+    guint read_time)
+{
+  priv->read_times[priv->read_time_index] = read_time;
+  priv->read_time_index = (priv->read_time_index + 1) % READ_TIME_SAMPLES;
+  if (priv->n_read_times < READ_TIME_SAMPLES)
+    priv->n_read_times++;
+}
+
+
+static gint
+compare_read_times (gconstpointer a,
+    gconstpointer b,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  guint ta = *(const guint *) a;
+  guint tb = *(const guint *) b;
+
+  return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+
+/* The 90th percentile of the recent read times */
+static guint
+get_hedge_delay (ChamplainFileCachePrivate *priv)
+{
+  guint sorted[READ_TIME_SAMPLES];
+  guint n = priv->n_read_times;
+
+  if (n < MIN_READ_TIME_SAMPLES)
+    return DEFAULT_HEDGE_DELAY;
+
+  memcpy (sorted, priv->read_times, n * sizeof (guint));
+  g_qsort_with_data (sorted, n, sizeof (guint), compare_read_times, NULL);
+
+  return MAX (sorted[n * 9 / 10], MIN_HEDGE_DELAY);
+}
+
+
 static gchar *
 get_filename (ChamplainFileCache *file_cache,
     ChamplainTile *tile)
@@ -506,12 +769,88 @@ tile_is_expired (ChamplainFileCache *file_cache,
 }
 
 
+/* The tiles of a champlain_map_source_fill_tiles () call, the misses are
+ * passed on together once all the files were tried */
+typedef struct
+{
+  ChamplainMapSource *map_source;
+  GPtrArray *misses;
+  /* number of tiles still being loaded */
+  guint pending;
+} FillBatch;
+
 typedef struct
 {
   ChamplainMapSource *map_source;
   ChamplainTile *tile;
+  gsize size;
+  /* NULL when filled by itself */
+  FillBatch *batch;
+
+  /* the file read, cancelled with the tile or when the hedge wins */
+  GCancellable *cancellable;
+  GCancellable *tile_cancellable;
+  gulong cancelled_id;
+  gint64 start_time;
+  guint hedge_timeout;
+  /* the tile requested from the next source when the read is slow */
+  ChamplainTile *hedge_tile;
+  gboolean hedge_won;
 } FileLoadedData;
 
+
+static void
+display_loaded_tile (ChamplainTile *tile)
+{
+  if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_LOADED)
+    {
+      /* if we have some content, use the tile even if it wasn't validated */
+      champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
+      champlain_tile_display_content (tile);
+    }
+}
+
+
+static void
+pass_to_next_source (ChamplainMapSource *map_source,
+    ChamplainTile *tile,
+    FillBatch *batch)
+{
+  ChamplainMapSource *next_source = champlain_map_source_get_next_source (map_source);
+
+  if (batch)
+    g_ptr_array_add (batch->misses, g_object_ref (tile));
+  else if (CHAMPLAIN_IS_MAP_SOURCE (next_source))
+    champlain_map_source_fill_tile (next_source, tile);
+  else
+    display_loaded_tile (tile);
+}
+
+
+static void
+fill_batch_tile_done (FillBatch *batch)
+{
+  ChamplainMapSource *next_source;
+  guint i;
+
+  if (!batch || --batch->pending > 0)
+    return;
+
+  next_source = champlain_map_source_get_next_source (batch->map_source);
+  if (CHAMPLAIN_IS_MAP_SOURCE (next_source) && batch->misses->len > 0)
+    champlain_map_source_fill_tiles (next_source,
+        (ChamplainTile **) batch->misses->pdata, batch->misses->len);
+  else if (!CHAMPLAIN_IS_MAP_SOURCE (next_source))
+    {
+      for (i = 0; i < batch->misses->len; i++)
+        display_loaded_tile (g_ptr_array_index (batch->misses, i));
+    }
+
+  g_ptr_array_free (batch->misses, TRUE);
+  g_object_unref (batch->map_source);
+  g_slice_free (FillBatch, batch);
+}
+
 static void
 tile_rendered_cb (ChamplainTile *tile,
     gpointer data,
@@ -520,6 +859,7 @@ tile_rendered_cb (ChamplainTile *tile,
     FileLoadedData *user_data)
 {
   ChamplainMapSource *map_source = user_data->map_source;
+  FillBatch *batch = user_data->batch;
   GFile *file;
   ChamplainFileCache *file_cache;
   ChamplainMapSource *next_source;
@@ -529,7 +869,9 @@ tile_rendered_cb (ChamplainTile *tile,
   gchar *filename = NULL;
 
   g_signal_handlers_disconnect_by_func (tile, tile_rendered_cb, user_data);
+  _champlain_memory_usage_add (CHAMPLAIN_MEMORY_CATEGORY_FILE_CACHE, -(gssize) user_data->size);
   g_slice_free (FileLoadedData, user_data);
+  _champlain_map_source_stats_render_end (map_source, tile);
 
   next_source = champlain_map_source_get_next_source (map_source);
   file_cache = CHAMPLAIN_FILE_CACHE (map_source);
@@ -538,6 +880,8 @@ tile_rendered_cb (ChamplainTile *tile,
   if (error)
     {
       DEBUG ("Tile rendering failed");
+      if (champlain_tile_is_cancelled (tile))
+        goto cleanup;
       goto load_next;
     }
 
@@ -609,22 +953,432 @@ tile_rendered_cb (ChamplainTile *tile,
     }
 
 load_next:
-  if (CHAMPLAIN_IS_MAP_SOURCE (next_source))
-    champlain_map_source_fill_tile (next_source, tile);
-  else if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_LOADED)
-    {
-      /* if we have some content, use the tile even if it wasn't validated */
-      champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
-      champlain_tile_display_content (tile);
-    }
+  pass_to_next_source (map_source, tile, batch);
 
 cleanup:
+  fill_batch_tile_done (batch);
   g_free (filename);
   g_object_unref (tile);
   g_object_unref (map_source);
 }
 
 
+/* Renders the loaded file, a failure is passed on to the next source by
+ * tile_rendered_cb () */
+static void
+render_contents (FileLoadedData *user_data,
+    const gchar *contents,
+    gsize length,
+    gboolean loaded)
+{
+  ChamplainTile *tile = user_data->tile;
+  ChamplainMapSource *map_source = user_data->map_source;
+  ChamplainRenderer *renderer;
+
+  renderer = champlain_map_source_get_renderer (map_source);
+
+  g_return_if_fail (CHAMPLAIN_IS_RENDERER (renderer));
+
+  g_signal_connect (tile, "render-complete", G_CALLBACK (tile_rendered_cb), user_data);
+
+  /* the renderer keeps a copy of the data until the tile is rendered */
+  user_data->size = length;
+  _champlain_memory_usage_add (CHAMPLAIN_MEMORY_CATEGORY_FILE_CACHE, length);
+
+  champlain_renderer_set_data (renderer, contents, length);
+  if (loaded)
+    _champlain_map_source_stats_render_begin (map_source, tile);
+  champlain_renderer_render (renderer, tile);
+}
+
+
+typedef struct
+{
+  FileLoadedData *user_data;
+  GCancellable *cancellable;
+  /* the directory of the tiles of the map source */
+  gchar *tiles_dir;
+  guint zoom_level;
+  gint x;
+  gint y;
+  guint size;
+  guint max_depth;
+
+  /* the PNG data of the synthesized tile */
+  gchar *buffer;
+  gsize buffer_size;
+} UnderzoomJob;
+
+
+/* Averages the blocks of factor x factor pixels of @src into @dst at
+ * (@dst_x, @dst_y). The colors are weighted by their alpha so transparent
+ * pixels do not darken the result. */
+static void
+box_filter (GdkPixbuf *src,
+    guint factor,
+    GdkPixbuf *dst,
+    guint dst_x,
+    guint dst_y)
+{
+  const guchar *src_pixels = gdk_pixbuf_get_pixels (src);
+  gint src_stride = gdk_pixbuf_get_rowstride (src);
+  gint n_channels = gdk_pixbuf_get_n_channels (src);
+  gboolean has_alpha = gdk_pixbuf_get_has_alpha (src);
+  guchar *dst_pixels = gdk_pixbuf_get_pixels (dst);
+  gint dst_stride = gdk_pixbuf_get_rowstride (dst);
+  guint out_size = gdk_pixbuf_get_width (src) / factor;
+  guint area = factor * factor;
+  guint x, y, i, j;
+
+  for (y = 0; y < out_size; y++)
+    {
+      guchar *out = dst_pixels + (dst_y + y) * dst_stride + dst_x * 4;
+
+      for (x = 0; x < out_size; x++, out += 4)
+        {
+          guint r = 0, g = 0, b = 0, a = 0;
+
+          for (j = 0; j < factor; j++)
+            {
+              const guchar *p = src_pixels + (y * factor + j) * src_stride + x * factor * n_channels;
+
+              for (i = 0; i < factor; i++, p += n_channels)
+                {
+                  guint alpha = has_alpha ? p[3] : 255;
+
+                  r += p[0] * alpha;
+                  g += p[1] * alpha;
+                  b += p[2] * alpha;
+                  a += alpha;
+                }
+            }
+
+          out[0] = a > 0 ? (r + a / 2) / a : 0;
+          out[1] = a > 0 ? (g + a / 2) / a : 0;
+          out[2] = a > 0 ? (b + a / 2) / a : 0;
+          out[3] = (a + area / 2) / area;
+        }
+    }
+}
+
+
+/* Returns the tile downsampled from its descendants @depth levels below,
+ * or NULL when some of them are not cached */
+static GdkPixbuf *
+downsample_descendants (UnderzoomJob *job,
+    guint depth)
+{
+  guint factor = 1 << depth;
+  guint part = job->size / factor;
+  GdkPixbuf *result;
+  guint cx, cy;
+
+  if (part == 0 || job->size % factor != 0)
+    return NULL;
+
+  result = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, job->size, job->size);
+
+  for (cy = 0; cy < factor; cy++)
+    for (cx = 0; cx < factor; cx++)
+      {
+        GdkPixbuf *child = NULL;
+        gchar *filename;
+
+        if (!g_cancellable_is_cancelled (job->cancellable))
+          {
+            filename = g_strdup_printf ("%s" G_DIR_SEPARATOR_S
+                  "%u" G_DIR_SEPARATOR_S
+                  "%d" G_DIR_SEPARATOR_S "%d.png",
+                  job->tiles_dir,
+                  job->zoom_level + depth,
+                  job->x * factor + cx,
+                  job->y * factor + cy);
+            child = gdk_pixbuf_new_from_file (filename, NULL);
+            g_free (filename);
+          }
+
+        if (!child ||
+            gdk_pixbuf_get_width (child) != (gint) job->size ||
+            gdk_pixbuf_get_height (child) != (gint) job->size ||
+            gdk_pixbuf_get_n_channels (child) < 3)
+          {
+            if (child)
+              g_object_unref (child);
+            g_object_unref (result);
+            return NULL;
+          }
+
+        box_filter (child, factor, result, cx * part, cy * part);
+        g_object_unref (child);
+      }
+
+  return result;
+}
+
+
+static gboolean
+underzoom_done_cb (gpointer data)
+{
+  UnderzoomJob *job = data;
+  FileLoadedData *user_data = job->user_data;
+  ChamplainTile *tile = user_data->tile;
+  ChamplainMapSource *map_source = user_data->map_source;
+
+  if (champlain_tile_is_cancelled (tile))
+    {
+      fill_batch_tile_done (user_data->batch);
+      g_slice_free (FileLoadedData, user_data);
+      g_object_unref (tile);
+      g_object_unref (map_source);
+    }
+  else if (job->buffer)
+    {
+      ChamplainFileCache *file_cache = CHAMPLAIN_FILE_CACHE (map_source);
+      gchar *filename = get_filename (file_cache, tile);
+      GTimeVal expired = { 0, };
+      GFileInfo *info;
+      GFile *file;
+
+      DEBUG ("Underzoomed %s", filename);
+
+      store_tile (CHAMPLAIN_TILE_CACHE (file_cache), tile, job->buffer, job->buffer_size);
+
+      /* shown until the next source provides the real tile */
+      file = g_file_new_for_path (filename);
+      info = g_file_info_new ();
+      g_file_info_set_modification_time (info, &expired);
+      g_file_set_attributes_from_info (file, info, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+      g_object_unref (info);
+      g_object_unref (file);
+      g_free (filename);
+
+      render_contents (user_data, job->buffer, job->buffer_size, TRUE);
+    }
+  else
+    render_contents (user_data, NULL, 0, FALSE);
+
+  g_object_unref (job->cancellable);
+  g_free (job->tiles_dir);
+  g_free (job->buffer);
+  g_slice_free (UnderzoomJob, job);
+
+  return FALSE;
+}
+
+
+static void
+underzoom_worker_thread (gpointer data,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  UnderzoomJob *job = data;
+  GdkPixbuf *pixbuf = NULL;
+  guint depth;
+
+  /* the nearest descendants give the sharpest result */
+  for (depth = 1; depth <= job->max_depth && !pixbuf; depth++)
+    pixbuf = downsample_descendants (job, depth);
+
+  if (pixbuf)
+    {
+      if (!gdk_pixbuf_save_to_buffer (pixbuf, &job->buffer, &job->buffer_size, "png", NULL, NULL))
+        job->buffer = NULL;
+      g_object_unref (pixbuf);
+    }
+
+  clutter_threads_add_idle_full (CLUTTER_PRIORITY_REDRAW, underzoom_done_cb, job, NULL);
+}
+
+
+/* Returns the deepest level worth trying, 0 when not even the first
+ * descendant of the tile is cached */
+static guint
+probe_descendants (const gchar *tiles_dir,
+    guint zoom_level,
+    gint x,
+    gint y,
+    guint max_depth)
+{
+  guint depth;
+
+  for (depth = max_depth; depth > 0; depth--)
+    {
+      gchar *filename = g_strdup_printf ("%s" G_DIR_SEPARATOR_S
+            "%u" G_DIR_SEPARATOR_S
+            "%d" G_DIR_SEPARATOR_S "%d.png",
+            tiles_dir,
+            zoom_level + depth,
+            x << depth,
+            y << depth);
+      gboolean exists = g_file_test (filename, G_FILE_TEST_EXISTS);
+
+      g_free (filename);
+      if (exists)
+        return depth;
+    }
+
+  return 0;
+}
+
+
+/* Returns TRUE when the missing tile is being synthesized from its
+ * descendants, the job then takes over @user_data */
+static gboolean
+underzoom_tile (FileLoadedData *user_data)
+{
+  ChamplainFileCache *file_cache = CHAMPLAIN_FILE_CACHE (user_data->map_source);
+  ChamplainFileCachePrivate *priv = file_cache->priv;
+  ChamplainTile *tile = user_data->tile;
+  guint zoom_level = champlain_tile_get_zoom_level (tile);
+  guint max_zoom_level;
+  guint max_depth;
+  UnderzoomJob *job;
+  gchar *tiles_dir;
+  GError *error = NULL;
+
+  if (priv->max_underzoom == 0 || !priv->underzoom_pool || !priv->cache_dir)
+    return FALSE;
+
+  /* there are no descendants beyond the deepest zoom level */
+  max_zoom_level = champlain_map_source_get_max_zoom_level (user_data->map_source);
+  if (zoom_level >= max_zoom_level)
+    return FALSE;
+
+  /* most misses have no descendants, don't occupy the pool for them */
+  tiles_dir = g_build_filename (priv->cache_dir,
+        champlain_map_source_get_id (user_data->map_source), NULL);
+  max_depth = probe_descendants (tiles_dir, zoom_level,
+        champlain_tile_get_x (tile), champlain_tile_get_y (tile),
+        MIN (priv->max_underzoom, max_zoom_level - zoom_level));
+  if (max_depth == 0)
+    {
+      g_free (tiles_dir);
+      return FALSE;
+    }
+
+  job = g_slice_new0 (UnderzoomJob);
+  job->user_data = user_data;
+  job->cancellable = g_object_ref (champlain_tile_get_cancellable (tile));
+  job->tiles_dir = tiles_dir;
+  job->zoom_level = zoom_level;
+  job->x = champlain_tile_get_x (tile);
+  job->y = champlain_tile_get_y (tile);
+  job->size = champlain_tile_get_size (tile);
+  job->max_depth = max_depth;
+
+  g_thread_pool_push (priv->underzoom_pool, job, &error);
+  if (error)
+    {
+      DEBUG ("Thread pool error: %s", error->message);
+      g_error_free (error);
+      g_object_unref (job->cancellable);
+      g_free (job->tiles_dir);
+      g_slice_free (UnderzoomJob, job);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+
+static void
+read_tile_cancelled_cb (G_GNUC_UNUSED GCancellable *tile_cancellable,
+    FileLoadedData *user_data)
+{
+  g_cancellable_cancel (user_data->cancellable);
+}
+
+
+/* The read is slower than most of the recent ones, the next source loads
+ * the tile into a tile of its own and the first of the two displays it */
+static gboolean
+hedge_timeout_cb (FileLoadedData *user_data)
+{
+  ChamplainMapSource *next_source = champlain_map_source_get_next_source (user_data->map_source);
+  ChamplainTile *tile = user_data->tile;
+  ChamplainTile *hedge_tile;
+
+  user_data->hedge_timeout = 0;
+
+  if (!CHAMPLAIN_IS_MAP_SOURCE (next_source) || champlain_tile_is_cancelled (tile))
+    return FALSE;
+
+  DEBUG ("Hedging slow read of tile %d, %d", champlain_tile_get_x (tile), champlain_tile_get_y (tile));
+
+  hedge_tile = champlain_tile_new_full (champlain_tile_get_x (tile),
+        champlain_tile_get_y (tile),
+        champlain_tile_get_size (tile),
+        champlain_tile_get_zoom_level (tile));
+  g_object_ref_sink (hedge_tile);
+  g_object_set_data (G_OBJECT (hedge_tile), HEDGED_READ_KEY, user_data);
+  user_data->hedge_tile = hedge_tile;
+
+  _champlain_map_source_peek_stats (user_data->map_source)->hedged++;
+  champlain_map_source_fill_tile (next_source, hedge_tile);
+
+  return FALSE;
+}
+
+
+/* The next source stored the hedge tile before the read finished */
+static void
+hedge_won (FileLoadedData *user_data,
+    const gchar *contents,
+    gsize size)
+{
+  FileLoadedData *render_data;
+
+  DEBUG ("Next source won the hedged read");
+  g_object_set_data (G_OBJECT (user_data->hedge_tile), HEDGED_READ_KEY, NULL);
+  user_data->hedge_won = TRUE;
+  _champlain_map_source_peek_stats (user_data->map_source)->hedge_wins++;
+  g_cancellable_cancel (user_data->cancellable);
+
+  /* the read keeps its data until its callback runs */
+  render_data = g_slice_new0 (FileLoadedData);
+  render_data->tile = g_object_ref (user_data->tile);
+  render_data->map_source = g_object_ref (user_data->map_source);
+  render_data->batch = user_data->batch;
+  if (render_data->batch)
+    render_data->batch->pending++;
+
+  champlain_tile_set_etag (render_data->tile, champlain_tile_get_etag (user_data->hedge_tile));
+  render_contents (render_data, contents, size, TRUE);
+}
+
+
+static void
+finish_read (FileLoadedData *user_data)
+{
+  if (user_data->hedge_timeout)
+    {
+      g_source_remove (user_data->hedge_timeout);
+      user_data->hedge_timeout = 0;
+    }
+
+  /* the read won, the hedge is not needed any more */
+  if (user_data->hedge_tile)
+    {
+      g_object_set_data (G_OBJECT (user_data->hedge_tile), HEDGED_READ_KEY, NULL);
+      if (!user_data->hedge_won)
+        g_cancellable_cancel (champlain_tile_get_cancellable (user_data->hedge_tile));
+      g_object_unref (user_data->hedge_tile);
+      user_data->hedge_tile = NULL;
+    }
+
+  if (user_data->tile_cancellable)
+    {
+      g_cancellable_disconnect (user_data->tile_cancellable, user_data->cancelled_id);
+      g_object_unref (user_data->tile_cancellable);
+      user_data->tile_cancellable = NULL;
+    }
+  if (user_data->cancellable)
+    {
+      g_object_unref (user_data->cancellable);
+      user_data->cancellable = NULL;
+    }
+}
+
+
 static void
 file_loaded_cb (GFile *file,
     GAsyncResult *res,
@@ -636,9 +1390,31 @@ file_loaded_cb (GFile *file,
   GError *error = NULL;
   ChamplainTile *tile = user_data->tile;
   ChamplainMapSource *map_source = user_data->map_source;
-  ChamplainRenderer *renderer;
 
   ok = g_file_load_contents_finish (file, res, &contents, &length, NULL, &error);
+  _champlain_trace_tile ('e', "cache", "file read", tile);
+  finish_read (user_data);
+
+  if (ok && !user_data->hedge_won)
+    record_read_time (CHAMPLAIN_FILE_CACHE (map_source)->priv,
+        (g_get_monotonic_time () - user_data->start_time) / 1000);
+
+  if (user_data->hedge_won ||
+      (!ok && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)))
+    {
+      DEBUG ("Loading of tile %d, %d got cancelled",
+          champlain_tile_get_x (tile), champlain_tile_get_y (tile));
+      if (ok)
+        g_free (contents);
+      else
+        g_error_free (error);
+      g_object_unref (file);
+      fill_batch_tile_done (user_data->batch);
+      g_slice_free (FileLoadedData, user_data);
+      g_object_unref (tile);
+      g_object_unref (map_source);
+      return;
+    }
 
   if (!ok)
     {
@@ -650,36 +1426,32 @@ file_loaded_cb (GFile *file,
       contents = NULL;
       length = 0;
       g_error_free (error);
+      _champlain_map_source_peek_stats (map_source)->cache_misses++;
     }
+  else
+    _champlain_map_source_peek_stats (map_source)->cache_hits++;
 
   g_object_unref (file);
 
-  renderer = champlain_map_source_get_renderer (map_source);
-
-  g_return_if_fail (CHAMPLAIN_IS_RENDERER (renderer));
-
-  g_signal_connect (tile, "render-complete", G_CALLBACK (tile_rendered_cb), user_data);
+  if (!ok && underzoom_tile (user_data))
+    return;
 
-  champlain_renderer_set_data (renderer, contents, length);
+  render_contents (user_data, contents, length, ok);
   g_free (contents);
-  champlain_renderer_render (renderer, tile);
 }
 
 
 static void
-fill_tile (ChamplainMapSource *map_source,
-    ChamplainTile *tile)
+load_tile (ChamplainMapSource *map_source,
+    ChamplainTile *tile,
+    FillBatch *batch)
 {
-  g_return_if_fail (CHAMPLAIN_IS_FILE_CACHE (map_source));
-  g_return_if_fail (CHAMPLAIN_IS_TILE (tile));
-
-  ChamplainMapSource *next_source = champlain_map_source_get_next_source (map_source);
-
-  if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_DONE)
+  if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_DONE || champlain_tile_is_cancelled (tile))
     return;
 
   if (champlain_tile_get_state (tile) != CHAMPLAIN_STATE_LOADED)
     {
+      ChamplainFileCachePrivate *priv = CHAMPLAIN_FILE_CACHE (map_source)->priv;
       FileLoadedData *user_data;
       gchar *filename;
       GFile *file;
@@ -688,25 +1460,74 @@ fill_tile (ChamplainMapSource *map_source,
       file = g_file_new_for_path (filename);
       g_free (filename);
 
-      user_data = g_slice_new (FileLoadedData);
+      user_data = g_slice_new0 (FileLoadedData);
       user_data->tile = tile;
       user_data->map_source = map_source;
+      user_data->size = 0;
+      user_data->batch = batch;
+      if (batch)
+        batch->pending++;
 
       g_object_ref (tile);
       g_object_ref (map_source);
 
       DEBUG ("fill of %s", filename);
 
-      g_file_load_contents_async (file, NULL, (GAsyncReadyCallback) file_loaded_cb, user_data);
-    }
-  else if (CHAMPLAIN_IS_MAP_SOURCE (next_source))
-    champlain_map_source_fill_tile (next_source, tile);
-  else if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_LOADED)
-    {
-      /* if we have some content, use the tile even if it wasn't validated */
-      champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
-      champlain_tile_display_content (tile);
+      /* a separate token lets the hedge cancel the read alone */
+      user_data->start_time = g_get_monotonic_time ();
+      if (priv->hedge_reads && CHAMPLAIN_IS_MAP_SOURCE (champlain_map_source_get_next_source (map_source)))
+        {
+          user_data->cancellable = g_cancellable_new ();
+          user_data->tile_cancellable = g_object_ref (champlain_tile_get_cancellable (tile));
+          user_data->cancelled_id = g_cancellable_connect (user_data->tile_cancellable,
+                G_CALLBACK (read_tile_cancelled_cb), user_data, NULL);
+          user_data->hedge_timeout = g_timeout_add (get_hedge_delay (priv),
+                (GSourceFunc) hedge_timeout_cb, user_data);
+        }
+      else
+        user_data->cancellable = g_object_ref (champlain_tile_get_cancellable (tile));
+
+      _champlain_trace_tile ('b', "cache", "file read", tile);
+      g_file_load_contents_async (file, user_data->cancellable,
+          (GAsyncReadyCallback) file_loaded_cb, user_data);
     }
+  else
+    pass_to_next_source (map_source, tile, batch);
+}
+
+
+static void
+fill_tile (ChamplainMapSource *map_source,
+    ChamplainTile *tile)
+{
+  g_return_if_fail (CHAMPLAIN_IS_FILE_CACHE (map_source));
+  g_return_if_fail (CHAMPLAIN_IS_TILE (tile));
+
+  load_tile (map_source, tile, NULL);
+}
+
+
+/* The files are loaded like for single tiles, the misses are passed on to
+ * the next source in one batch */
+static void
+fill_tiles (ChamplainMapSource *map_source,
+    ChamplainTile **tiles,
+    guint n_tiles)
+{
+  g_return_if_fail (CHAMPLAIN_IS_FILE_CACHE (map_source));
+
+  FillBatch *batch = g_slice_new (FillBatch);
+  guint i;
+
+  batch->map_source = g_object_ref (map_source);
+  batch->misses = g_ptr_array_new_with_free_func (g_object_unref);
+  /* held until all the loads are started */
+  batch->pending = 1;
+
+  for (i = 0; i < n_tiles; i++)
+    load_tile (map_source, tiles[i], batch);
+
+  fill_batch_tile_done (batch);
 }
 
 
@@ -769,6 +1590,7 @@ store_tile (ChamplainTileCache *tile_cache,
   GFile *file;
   GFileOutputStream *ostream;
   gsize bytes_written;
+  FileLoadedData *hedged;
 
   DEBUG ("Update of %p", tile);
 
@@ -825,6 +1647,11 @@ store_next:
   if (CHAMPLAIN_IS_TILE_CACHE (next_source))
     champlain_tile_cache_store_tile (CHAMPLAIN_TILE_CACHE (next_source), tile, contents, size);
 
+  /* the tile hedging a read of this cache was loaded first */
+  hedged = g_object_get_data (G_OBJECT (tile), HEDGED_READ_KEY);
+  if (hedged && hedged->map_source == map_source)
+    hedge_won (hedged, contents, size);
+
   g_free (filename);
   g_free (path);
   g_object_unref (file);
@@ -901,6 +1728,192 @@ delete_tile (ChamplainFileCache *file_cache, const gchar *filename)
 }
 
 
+/* Removes the tree of tile files, it may be large so it runs in a thread */
+static void
+remove_tree (const gchar *path)
+{
+  GDir *dir = g_dir_open (path, 0, NULL);
+  const gchar *name;
+
+  if (!dir)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *child = g_build_filename (path, name, NULL);
+
+      if (g_file_test (child, G_FILE_TEST_IS_DIR) &&
+          !g_file_test (child, G_FILE_TEST_IS_SYMLINK))
+        remove_tree (child);
+      else if (g_remove (child) == -1)
+        DEBUG ("Deleting tile from disk failed: %s", g_strerror (errno));
+      g_free (child);
+    }
+  g_dir_close (dir);
+
+  g_rmdir (path);
+}
+
+
+static void
+delete_worker_thread (gpointer data,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  DeleteJob *job = data;
+  guint i;
+
+  if (job->dir)
+    remove_tree (job->dir);
+
+  for (i = 0; job->files && i < job->files->len; i++)
+    {
+      if (g_remove (g_ptr_array_index (job->files, i)) == -1)
+        DEBUG ("Deleting tile from disk failed: %s", g_strerror (errno));
+    }
+
+  g_free (job->dir);
+  if (job->files)
+    g_ptr_array_unref (job->files);
+  g_slice_free (DeleteJob, job);
+}
+
+
+static void
+push_delete_job (ChamplainFileCache *file_cache,
+    gchar *dir,
+    GPtrArray *files)
+{
+  ChamplainFileCachePrivate *priv = file_cache->priv;
+  DeleteJob *job = g_slice_new (DeleteJob);
+
+  job->dir = dir;
+  job->files = files;
+
+  if (!priv->delete_pool)
+    priv->delete_pool = g_thread_pool_new (delete_worker_thread, NULL, 1, FALSE, NULL);
+  g_thread_pool_push (priv->delete_pool, job, NULL);
+}
+
+
+/* The rows of the tiles are deleted right away, their files are removed by a
+ * thread. A tile stored again in the meantime may lose its file, which is
+ * then treated as a cache miss. */
+static void
+invalidate_area (ChamplainTileCache *tile_cache,
+    ChamplainBoundingBox *bbox)
+{
+  ChamplainFileCache *file_cache = CHAMPLAIN_FILE_CACHE (tile_cache);
+  ChamplainFileCachePrivate *priv = file_cache->priv;
+  ChamplainMapSource *map_source = CHAMPLAIN_MAP_SOURCE (tile_cache);
+  GPtrArray *outdated;
+  sqlite3_stmt *stmt;
+  gchar *source_dir;
+  gchar *prefix, *prefix_end;
+  gsize prefix_len;
+  gchar *query;
+  gchar *error = NULL;
+  guint i;
+  int rc;
+
+  if (!priv->db)
+    return;
+
+  /* the cache directory may be shared with other map sources, the rows of
+     this one are between prefix and prefix_end in the filename index */
+  source_dir = g_build_filename (priv->cache_dir, champlain_map_source_get_id (map_source), NULL);
+  prefix = g_strconcat (source_dir, G_DIR_SEPARATOR_S, NULL);
+  prefix_len = strlen (prefix);
+  prefix_end = g_strdup (prefix);
+  prefix_end[prefix_len - 1]++;
+
+  if (!bbox)
+    {
+      gchar *stale_dir;
+
+      query = sqlite3_mprintf ("DELETE FROM tiles WHERE filename >= %Q AND filename < %Q",
+            prefix, prefix_end);
+      sqlite3_exec (priv->db, query, NULL, NULL, &error);
+      if (error != NULL)
+        {
+          DEBUG ("Deleting tiles from db failed: %s", error);
+          sqlite3_free (error);
+        }
+      sqlite3_free (query);
+
+      /* moved out of the way at once, new tiles go to a new directory */
+      stale_dir = g_strdup_printf ("%s.%" G_GINT64_FORMAT ".invalidated",
+            source_dir, g_get_monotonic_time ());
+      if (g_rename (source_dir, stale_dir) == 0)
+        push_delete_job (file_cache, stale_dir, NULL);
+      else
+        {
+          if (errno != ENOENT)
+            DEBUG ("Moving invalidated tiles failed: %s", g_strerror (errno));
+          g_free (stale_dir);
+        }
+
+      DEBUG ("Invalidating all tiles");
+      goto cleanup;
+    }
+
+  query = sqlite3_mprintf ("SELECT filename FROM tiles WHERE filename >= %Q AND filename < %Q",
+        prefix, prefix_end);
+  rc = sqlite3_prepare (priv->db, query, -1, &stmt, NULL);
+  sqlite3_free (query);
+  if (rc != SQLITE_OK)
+    {
+      DEBUG ("Can't fetch tiles to invalidate: %s", sqlite3_errmsg (priv->db));
+      goto cleanup;
+    }
+
+  /* deleted once the statement is finished */
+  outdated = g_ptr_array_new_with_free_func (g_free);
+  while (sqlite3_step (stmt) == SQLITE_ROW)
+    {
+      const gchar *filename = (const gchar *) sqlite3_column_text (stmt, 0);
+      guint zoom_level;
+      gint x, y;
+
+      if (filename &&
+          sscanf (filename + prefix_len, "%u" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d.png",
+              &zoom_level, &x, &y) == 3 &&
+          _champlain_map_source_tile_in_area (map_source, zoom_level, x, y, bbox))
+        g_ptr_array_add (outdated, g_strdup (filename));
+    }
+  sqlite3_finalize (stmt);
+
+  DEBUG ("Invalidating %u tiles", outdated->len);
+  if (outdated->len == 0)
+    {
+      g_ptr_array_unref (outdated);
+      goto cleanup;
+    }
+
+  sqlite3_exec (priv->db, "BEGIN", NULL, NULL, NULL);
+  for (i = 0; i < outdated->len; i++)
+    {
+      query = sqlite3_mprintf ("DELETE FROM tiles WHERE filename = %Q",
+            (gchar *) g_ptr_array_index (outdated, i));
+      sqlite3_exec (priv->db, query, NULL, NULL, &error);
+      if (error != NULL)
+        {
+          DEBUG ("Deleting tile from db failed: %s", error);
+          sqlite3_free (error);
+          error = NULL;
+        }
+      sqlite3_free (query);
+    }
+  sqlite3_exec (priv->db, "COMMIT", NULL, NULL, NULL);
+
+  push_delete_job (file_cache, NULL, outdated);
+
+cleanup:
+  g_free (prefix_end);
+  g_free (prefix);
+  g_free (source_dir);
+}
+
+
 static gboolean
 purge_on_idle (gpointer data)
 {
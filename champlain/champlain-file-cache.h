@@ -81,6 +81,14 @@ guint champlain_file_cache_get_size_limit (ChamplainFileCache *file_cache);
 void champlain_file_cache_set_size_limit (ChamplainFileCache *file_cache,
     guint size_limit);
 
+guint champlain_file_cache_get_max_underzoom (ChamplainFileCache *file_cache);
+void champlain_file_cache_set_max_underzoom (ChamplainFileCache *file_cache,
+    guint max_underzoom);
+
+gboolean champlain_file_cache_get_hedge_reads (ChamplainFileCache *file_cache);
+void champlain_file_cache_set_hedge_reads (ChamplainFileCache *file_cache,
+    gboolean hedge_reads);
+
 const gchar *champlain_file_cache_get_cache_dir (ChamplainFileCache *file_cache);
 
 void champlain_file_cache_purge (ChamplainFileCache *file_cache);
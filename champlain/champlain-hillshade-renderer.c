@@ -0,0 +1,1104 @@
+/*
+ * Copyright (C) 2010-2013 Jiri Techet <techet@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:champlain-hillshade-renderer
+ * @short_description: A renderer that computes relief shading from
+ * elevation tiles
+ *
+ * #ChamplainHillshadeRenderer renders grayscale relief from elevation tiles
+ * encoded in the color channels of PNG images, such as Terrarium or
+ * Terrain-RGB tiles. The shading is computed in separate threads from the
+ * slope of the terrain lit from the #ChamplainHillshadeRenderer:azimuth and
+ * #ChamplainHillshadeRenderer:altitude, or from the steepness alone when
+ * #ChamplainHillshadeRenderer:slope is set.
+ *
+ * The pixels at the tile borders are computed from the elevation of the
+ * neighbouring tiles decoded before, the border pixels of the tiles loaded
+ * first are extended from the tile itself. Such tiles are cached like the
+ * others, once all their missing neighbours were decoded the renderer emits
+ * #ChamplainRenderer::area-changed for them, so a view connected to it with
+ * champlain_view_invalidate_area() shades them again without the seams.
+ *
+ * The renderer is used by a tile source loading the elevation tiles. The
+ * rendered relief is passed to the caches as PNG data, so the usual image
+ * renderer of the caches displays it when the tiles are loaded again:
+ *
+ * |[
+ * source = champlain_network_tile_source_new_full ("terrarium-relief",
+ *     "Relief", license, license_uri, 0, 15, 256,
+ *     CHAMPLAIN_MAP_PROJECTION_MERCATOR,
+ *     "https://s3.amazonaws.com/elevation-tiles-prod/terrarium/#Z#/#X#/#Y#.png",
+ *     CHAMPLAIN_RENDERER (champlain_hillshade_renderer_new ()));
+ * ]|
+ *
+ * Chained with a file cache and a memory cache, the source can be added to
+ * a #ChamplainView with champlain_view_add_overlay_source().
+ */
+
+#include "config.h"
+
+#include "champlain-hillshade-renderer.h"
+
+#define DEBUG_FLAG CHAMPLAIN_DEBUG_LOADING
+#include "champlain-debug.h"
+
+#include "champlain-enum-types.h"
+#include "champlain-exportable.h"
+#include "champlain-private.h"
+
+#include <gdk/gdk.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Tuning parameters */
+#define MAX_THREADS 4
+/* Decoded elevation tiles kept for the borders of their neighbours */
+#define MAX_ELEVATION_GRIDS 32
+/* Tiles shaded with extended borders waiting for their neighbours */
+#define MAX_INCOMPLETE_TILES 1024
+
+#define EARTH_RADIUS 6378137.0
+
+enum
+{
+  PROP_0,
+  PROP_ENCODING,
+  PROP_AZIMUTH,
+  PROP_ALTITUDE,
+  PROP_Z_FACTOR,
+  PROP_SLOPE
+};
+
+G_DEFINE_TYPE (ChamplainHillshadeRenderer, champlain_hillshade_renderer, CHAMPLAIN_TYPE_RENDERER)
+
+#define GET_PRIVATE(o) \
+  (G_TYPE_INSTANCE_GET_PRIVATE ((o), CHAMPLAIN_TYPE_HILLSHADE_RENDERER, ChamplainHillshadeRendererPrivate))
+
+struct _ChamplainHillshadeRendererPrivate
+{
+  gchar *data;
+  guint size;
+
+  ChamplainElevationEncoding encoding;
+  gdouble azimuth;
+  gdouble altitude;
+  gdouble z_factor;
+  gboolean slope;
+
+  GThreadPool *thpool;
+  /* "z/x/y" -> ElevationGrid, shared by the worker threads */
+  GHashTable *grids;
+  GQueue *grid_order;
+  /* "z/x/y" -> bit mask of the neighbours missing when the tile was shaded */
+  GHashTable *incomplete;
+};
+
+typedef struct
+{
+  gfloat *heights;
+  guint size;
+} ElevationGrid;
+
+typedef struct
+{
+  /* the unit vector pointing to the light */
+  gfloat light_x;
+  gfloat light_y;
+  gfloat light_z;
+  gdouble z_factor;
+} ShadeParams;
+
+typedef struct _WorkerThreadData WorkerThreadData;
+
+struct _WorkerThreadData
+{
+  gint x;
+  gint y;
+  guint z;
+  ChamplainElevationEncoding encoding;
+  ShadeParams params;
+
+  ChamplainRenderer *renderer;
+  ChamplainTile *tile;
+  /* the worker thread must not touch the tile, it checks this instead */
+  GCancellable *cancellable;
+  gchar *data;
+  guint size;
+
+  /* the results of the worker */
+  GdkPixbuf *pixbuf;
+  cairo_surface_t *surface;
+  gchar *buffer;
+  gsize buffer_size;
+  /* "z/x/y" of the tiles whose last missing neighbour this one was */
+  GPtrArray *stale;
+};
+
+/* protects the elevation grids of all the renderers */
+G_LOCK_DEFINE_STATIC (elevation_grids);
+
+static void set_data (ChamplainRenderer *renderer,
+    const gchar *data,
+    guint size);
+static void render (ChamplainRenderer *renderer,
+    ChamplainTile *tile);
+static void hillshade_worker_thread (gpointer data,
+    gpointer user_data);
+
+
+static void
+elevation_grid_free (ElevationGrid *grid)
+{
+  g_free (grid->heights);
+  g_slice_free (ElevationGrid, grid);
+}
+
+
+static void
+clear_grids (ChamplainHillshadeRendererPrivate *priv)
+{
+  G_LOCK (elevation_grids);
+  g_queue_foreach (priv->grid_order, (GFunc) g_free, NULL);
+  g_queue_clear (priv->grid_order);
+  g_hash_table_remove_all (priv->grids);
+  G_UNLOCK (elevation_grids);
+}
+
+
+/* The elevation is only kept to shade the borders of further tiles */
+static void
+trim_memory (GObject *object,
+    ChamplainTrimLevel level)
+{
+  if (level < CHAMPLAIN_TRIM_LEVEL_LOW)
+    return;
+
+  clear_grids (CHAMPLAIN_HILLSHADE_RENDERER (object)->priv);
+}
+
+
+static void
+champlain_hillshade_renderer_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  ChamplainHillshadeRenderer *renderer = CHAMPLAIN_HILLSHADE_RENDERER (object);
+
+  switch (property_id)
+    {
+    case PROP_ENCODING:
+      g_value_set_enum (value, champlain_hillshade_renderer_get_encoding (renderer));
+      break;
+
+    case PROP_AZIMUTH:
+      g_value_set_double (value, champlain_hillshade_renderer_get_azimuth (renderer));
+      break;
+
+    case PROP_ALTITUDE:
+      g_value_set_double (value, champlain_hillshade_renderer_get_altitude (renderer));
+      break;
+
+    case PROP_Z_FACTOR:
+      g_value_set_double (value, champlain_hillshade_renderer_get_z_factor (renderer));
+      break;
+
+    case PROP_SLOPE:
+      g_value_set_boolean (value, champlain_hillshade_renderer_get_slope (renderer));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+
+static void
+champlain_hillshade_renderer_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  ChamplainHillshadeRenderer *renderer = CHAMPLAIN_HILLSHADE_RENDERER (object);
+
+  switch (property_id)
+    {
+    case PROP_ENCODING:
+      champlain_hillshade_renderer_set_encoding (renderer, g_value_get_enum (value));
+      break;
+
+    case PROP_AZIMUTH:
+      champlain_hillshade_renderer_set_azimuth (renderer, g_value_get_double (value));
+      break;
+
+    case PROP_ALTITUDE:
+      champlain_hillshade_renderer_set_altitude (renderer, g_value_get_double (value));
+      break;
+
+    case PROP_Z_FACTOR:
+      champlain_hillshade_renderer_set_z_factor (renderer, g_value_get_double (value));
+      break;
+
+    case PROP_SLOPE:
+      champlain_hillshade_renderer_set_slope (renderer, g_value_get_boolean (value));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+
+static void
+champlain_hillshade_renderer_dispose (GObject *object)
+{
+  ChamplainHillshadeRendererPrivate *priv = CHAMPLAIN_HILLSHADE_RENDERER (object)->priv;
+
+  if (priv->thpool)
+    {
+      g_thread_pool_free (priv->thpool, FALSE, TRUE);
+      priv->thpool = NULL;
+    }
+
+  G_OBJECT_CLASS (champlain_hillshade_renderer_parent_class)->dispose (object);
+}
+
+
+static void
+champlain_hillshade_renderer_finalize (GObject *object)
+{
+  ChamplainHillshadeRendererPrivate *priv = CHAMPLAIN_HILLSHADE_RENDERER (object)->priv;
+
+  g_free (priv->data);
+  clear_grids (priv);
+  g_hash_table_destroy (priv->grids);
+  g_queue_free (priv->grid_order);
+  g_hash_table_destroy (priv->incomplete);
+
+  G_OBJECT_CLASS (champlain_hillshade_renderer_parent_class)->finalize (object);
+}
+
+
+static void
+champlain_hillshade_renderer_class_init (ChamplainHillshadeRendererClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ChamplainRendererClass *renderer_class = CHAMPLAIN_RENDERER_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (ChamplainHillshadeRendererPrivate));
+
+  object_class->get_property = champlain_hillshade_renderer_get_property;
+  object_class->set_property = champlain_hillshade_renderer_set_property;
+  object_class->dispose = champlain_hillshade_renderer_dispose;
+  object_class->finalize = champlain_hillshade_renderer_finalize;
+
+  renderer_class->set_data = set_data;
+  renderer_class->render = render;
+
+  /**
+   * ChamplainHillshadeRenderer:encoding:
+   *
+   * How the elevation is encoded in the tiles.
+   *
+   * Since: 0.12.15
+   */
+  g_object_class_install_property (object_class,
+      PROP_ENCODING,
+      g_param_spec_enum ("encoding",
+          "Encoding",
+          "The encoding of the elevation tiles",
+          CHAMPLAIN_TYPE_ELEVATION_ENCODING,
+          CHAMPLAIN_ELEVATION_ENCODING_TERRARIUM,
+          G_PARAM_READWRITE));
+
+  /**
+   * ChamplainHillshadeRenderer:azimuth:
+   *
+   * The direction of the light in degrees clockwise from the north.
+   *
+   * Since: 0.12.15
+   */
+  g_object_class_install_property (object_class,
+      PROP_AZIMUTH,
+      g_param_spec_double ("azimuth",
+          "Azimuth",
+          "The direction of the light",
+          0.0,
+          360.0,
+          315.0,
+          G_PARAM_READWRITE));
+
+  /**
+   * ChamplainHillshadeRenderer:altitude:
+   *
+   * The angle of the light above the horizon in degrees.
+   *
+   * Since: 0.12.15
+   */
+  g_object_class_install_property (object_class,
+      PROP_ALTITUDE,
+      g_param_spec_double ("altitude",
+          "Altitude",
+          "The angle of the light above the horizon",
+          0.0,
+          90.0,
+          45.0,
+          G_PARAM_READWRITE));
+
+  /**
+   * ChamplainHillshadeRenderer:z-factor:
+   *
+   * The exaggeration of the elevation, values above 1 make the relief
+   * visible at low zoom levels.
+   *
+   * Since: 0.12.15
+   */
+  g_object_class_install_property (object_class,
+      PROP_Z_FACTOR,
+      g_param_spec_double ("z-factor",
+          "Z factor",
+          "The exaggeration of the elevation",
+          0.0,
+          G_MAXDOUBLE,
+          1.0,
+          G_PARAM_READWRITE));
+
+  /**
+   * ChamplainHillshadeRenderer:slope:
+   *
+   * Whether to render the steepness of the terrain instead of its
+   * illumination. Flat areas are white and the steeper slopes darker.
+   *
+   * Since: 0.12.15
+   */
+  g_object_class_install_property (object_class,
+      PROP_SLOPE,
+      g_param_spec_boolean ("slope",
+          "Slope",
+          "Render the steepness instead of the illumination",
+          FALSE,
+          G_PARAM_READWRITE));
+}
+
+
+static void
+champlain_hillshade_renderer_init (ChamplainHillshadeRenderer *self)
+{
+  ChamplainHillshadeRendererPrivate *priv = GET_PRIVATE (self);
+
+  self->priv = priv;
+
+  priv->data = NULL;
+  priv->size = 0;
+  priv->encoding = CHAMPLAIN_ELEVATION_ENCODING_TERRARIUM;
+  priv->azimuth = 315.0;
+  priv->altitude = 45.0;
+  priv->z_factor = 1.0;
+  priv->slope = FALSE;
+
+  priv->thpool = g_thread_pool_new (hillshade_worker_thread, self,
+        MAX_THREADS, FALSE, NULL);
+  priv->grids = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+        (GDestroyNotify) elevation_grid_free);
+  priv->grid_order = g_queue_new ();
+  priv->incomplete = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  _champlain_memory_usage_add_trim_handler (G_OBJECT (self), trim_memory);
+}
+
+
+/**
+ * champlain_hillshade_renderer_new:
+ *
+ * Constructor of #ChamplainHillshadeRenderer.
+ *
+ * Returns: a constructed #ChamplainHillshadeRenderer object
+ *
+ * Since: 0.12.15
+ */
+ChamplainHillshadeRenderer *
+champlain_hillshade_renderer_new (void)
+{
+  return g_object_new (CHAMPLAIN_TYPE_HILLSHADE_RENDERER, NULL);
+}
+
+
+static void
+set_data (ChamplainRenderer *renderer, const gchar *data, guint size)
+{
+  ChamplainHillshadeRendererPrivate *priv = GET_PRIVATE (renderer);
+
+  g_free (priv->data);
+
+  priv->data = g_memdup (data, size);
+  priv->size = size;
+}
+
+
+static gfloat *
+decode_elevation (WorkerThreadData *data,
+    guint *size)
+{
+  GInputStream *stream;
+  GdkPixbuf *pixbuf;
+  gfloat *heights;
+  const guchar *pixels;
+  gint width, n_channels, rowstride;
+  gint x, y;
+
+  stream = g_memory_input_stream_new_from_data (data->data, data->size, NULL);
+  pixbuf = gdk_pixbuf_new_from_stream (stream, data->cancellable, NULL);
+  g_object_unref (stream);
+
+  if (!pixbuf)
+    return NULL;
+
+  width = gdk_pixbuf_get_width (pixbuf);
+  n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+  if (width != gdk_pixbuf_get_height (pixbuf) || n_channels < 3 ||
+      gdk_pixbuf_get_bits_per_sample (pixbuf) != 8)
+    {
+      g_object_unref (pixbuf);
+      return NULL;
+    }
+
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  heights = g_new (gfloat, width * width);
+
+  for (y = 0; y < width; y++)
+    {
+      const guchar *p = pixels + y * rowstride;
+      gfloat *out = heights + y * width;
+
+      if (data->encoding == CHAMPLAIN_ELEVATION_ENCODING_TERRARIUM)
+        for (x = 0; x < width; x++, p += n_channels)
+          out[x] = p[0] * 256.0f + p[1] + p[2] / 256.0f - 32768.0f;
+      else
+        for (x = 0; x < width; x++, p += n_channels)
+          out[x] = (p[0] * 65536.0f + p[1] * 256.0f + p[2]) * 0.1f - 10000.0f;
+    }
+
+  g_object_unref (pixbuf);
+  *size = width;
+
+  return heights;
+}
+
+
+/* Copies the edge of @src adjacent to the tile at (@dx, @dy) into the
+ * border of the padded @grid. @src is either the neighbouring tile or, when
+ * @own is TRUE, the tile itself whose edge is extended. */
+static void
+copy_border (gfloat *grid,
+    guint size,
+    const gfloat *src,
+    gint dx,
+    gint dy,
+    gboolean own)
+{
+  guint stride = size + 2;
+  guint src_row = dy == 0 ? 0 : ((dy < 0) != own ? size - 1 : 0);
+  guint src_col = dx == 0 ? 0 : ((dx < 0) != own ? size - 1 : 0);
+  guint dst_row = dy < 0 ? 0 : (dy > 0 ? size + 1 : 1);
+  guint dst_col = dx < 0 ? 0 : (dx > 0 ? size + 1 : 1);
+  guint rows = dy == 0 ? size : 1;
+  guint cols = dx == 0 ? size : 1;
+  guint i;
+
+  for (i = 0; i < rows; i++)
+    memcpy (grid + (dst_row + i) * stride + dst_col,
+        src + (src_row + i) * size + src_col,
+        cols * sizeof (gfloat));
+}
+
+
+/* The bit of the neighbour in direction dx, dy in the masks of the
+ * incomplete tiles */
+#define NEIGHBOUR_BIT(dx, dy) (1u << (((dy) + 1) * 3 + (dx) + 1))
+
+/* Stores the decoded tile for its neighbours and fills the border of the
+ * padded grid from the neighbours decoded before. The tiles shaded before
+ * without this one and no other missing neighbour are added to the stale
+ * tiles of @data. */
+static void
+fill_borders (ChamplainHillshadeRendererPrivate *priv,
+    WorkerThreadData *data,
+    gfloat *heights,
+    guint size,
+    gfloat *grid)
+{
+  gint columns = 1 << data->z;
+  ElevationGrid *stored;
+  gchar *key;
+  gint dx, dy;
+  guint missing = 0;
+
+  stored = g_slice_new (ElevationGrid);
+  stored->heights = heights;
+  stored->size = size;
+  key = g_strdup_printf ("%u/%d/%d", data->z, data->x, data->y);
+
+  G_LOCK (elevation_grids);
+
+  /* the keys are owned by the queue */
+  if (g_hash_table_remove (priv->grids, key))
+    {
+      GList *link = g_queue_find_custom (priv->grid_order, key, (GCompareFunc) strcmp);
+
+      g_free (link->data);
+      g_queue_delete_link (priv->grid_order, link);
+    }
+  g_hash_table_insert (priv->grids, key, stored);
+  g_queue_push_tail (priv->grid_order, key);
+
+  if (g_queue_get_length (priv->grid_order) > MAX_ELEVATION_GRIDS)
+    {
+      gchar *oldest = g_queue_pop_head (priv->grid_order);
+
+      g_hash_table_remove (priv->grids, oldest);
+      g_free (oldest);
+    }
+
+  for (dy = -1; dy <= 1; dy++)
+    for (dx = -1; dx <= 1; dx++)
+      {
+        ElevationGrid *neighbour = NULL;
+        gint y = data->y + dy;
+
+        if (dx == 0 && dy == 0)
+          continue;
+
+        if (y >= 0 && y < columns)
+          {
+            gchar *neighbour_key;
+            gpointer mask;
+
+            /* the map wraps horizontally */
+            neighbour_key = g_strdup_printf ("%u/%d/%d", data->z,
+                  (data->x + dx + columns) % columns, y);
+            neighbour = g_hash_table_lookup (priv->grids, neighbour_key);
+
+            /* the neighbour was shaded without this tile */
+            if (g_hash_table_lookup_extended (priv->incomplete, neighbour_key, NULL, &mask))
+              {
+                guint rest = GPOINTER_TO_UINT (mask) & ~NEIGHBOUR_BIT (-dx, -dy);
+
+                if (rest == 0)
+                  {
+                    g_hash_table_remove (priv->incomplete, neighbour_key);
+                    g_ptr_array_add (data->stale, neighbour_key);
+                    neighbour_key = NULL;
+                  }
+                else
+                  g_hash_table_insert (priv->incomplete, g_strdup (neighbour_key), GUINT_TO_POINTER (rest));
+              }
+            g_free (neighbour_key);
+
+            /* there is no neighbour beyond the poles */
+            if (!neighbour || neighbour->size != size)
+              missing |= NEIGHBOUR_BIT (dx, dy);
+          }
+
+        if (neighbour && neighbour->size == size)
+          copy_border (grid, size, neighbour->heights, dx, dy, FALSE);
+        else
+          copy_border (grid, size, heights, dx, dy, TRUE);
+      }
+
+  if (missing)
+    {
+      /* the oldest entries aren't known, forget all of them */
+      if (g_hash_table_size (priv->incomplete) >= MAX_INCOMPLETE_TILES)
+        g_hash_table_remove_all (priv->incomplete);
+      g_hash_table_insert (priv->incomplete, g_strdup (key), GUINT_TO_POINTER (missing));
+    }
+  else
+    g_hash_table_remove (priv->incomplete, key);
+
+  G_UNLOCK (elevation_grids);
+}
+
+
+/* Horn's method. The rows are plain loops over contiguous floats without
+ * branches so the compiler vectorizes them. */
+static void
+shade_row (const gfloat *above,
+    const gfloat *row,
+    const gfloat *below,
+    gfloat *out,
+    guint width,
+    gfloat scale,
+    const ShadeParams *params)
+{
+  guint i;
+
+  for (i = 0; i < width; i++)
+    {
+      gfloat p = ((above[i + 2] + 2.0f * row[i + 2] + below[i + 2]) -
+                  (above[i] + 2.0f * row[i] + below[i])) * scale;
+      gfloat q = ((above[i] + 2.0f * above[i + 1] + above[i + 2]) -
+                  (below[i] + 2.0f * below[i + 1] + below[i + 2])) * scale;
+      gfloat norm = 1.0f / sqrtf (1.0f + p * p + q * q);
+
+      out[i] = (params->light_z - p * params->light_x - q * params->light_y) * norm;
+    }
+}
+
+
+static void
+shade_to_gray (const gfloat *shade,
+    guchar *gray,
+    guint width)
+{
+  guint i;
+
+  for (i = 0; i < width; i++)
+    {
+      gfloat v = shade[i] * 255.0f + 0.5f;
+
+      v = v < 0.0f ? 0.0f : v;
+      v = v > 255.0f ? 255.0f : v;
+      gray[i] = (guchar) v;
+    }
+}
+
+
+/* The tiles shaded with the extended borders are re-rendered, the area is
+ * the center of the tile so that its neighbours stay valid */
+static void
+emit_stale_tiles (WorkerThreadData *data)
+{
+  guint i;
+
+  for (i = 0; i < data->stale->len; i++)
+    {
+      ChamplainBoundingBox *bbox;
+      guint z;
+      gint x, y;
+      gdouble n;
+
+      if (sscanf (g_ptr_array_index (data->stale, i), "%u/%d/%d", &z, &x, &y) != 3)
+        continue;
+
+      DEBUG ("Tile (%d, %d, %u) has all its neighbours now", x, y, z);
+      n = 1 << z;
+      bbox = champlain_bounding_box_new ();
+      bbox->left = bbox->right = (x + 0.5) / n * 360.0 - 180.0;
+      bbox->top = bbox->bottom = atan (sinh (G_PI * (1.0 - 2.0 * (y + 0.5) / n))) * 180.0 / G_PI;
+      champlain_renderer_area_changed (data->renderer, bbox);
+      champlain_bounding_box_free (bbox);
+    }
+}
+
+
+static gboolean
+tile_rendered_cb (gpointer worker_data)
+{
+  WorkerThreadData *data = (WorkerThreadData *) worker_data;
+  ChamplainTile *tile = data->tile;
+  gboolean error = TRUE;
+
+  if (data->pixbuf && !champlain_tile_is_cancelled (tile))
+    {
+      ClutterContent *content = clutter_image_new ();
+
+      if (clutter_image_set_data (CLUTTER_IMAGE (content),
+              gdk_pixbuf_get_pixels (data->pixbuf),
+              COGL_PIXEL_FORMAT_RGB_888,
+              gdk_pixbuf_get_width (data->pixbuf),
+              gdk_pixbuf_get_height (data->pixbuf),
+              gdk_pixbuf_get_rowstride (data->pixbuf),
+              NULL))
+        {
+          ClutterActor *actor = clutter_actor_new ();
+          guint size = champlain_tile_get_size (tile);
+
+          clutter_actor_set_size (actor, size, size);
+          clutter_actor_set_content (actor, content);
+          /* has to be set for proper opacity */
+          clutter_actor_set_offscreen_redirect (actor, CLUTTER_OFFSCREEN_REDIRECT_AUTOMATIC_FOR_OPACITY);
+
+          champlain_exportable_set_surface (CHAMPLAIN_EXPORTABLE (tile), data->surface);
+          champlain_tile_set_content (tile, actor);
+          error = FALSE;
+        }
+      g_object_unref (content);
+    }
+
+  if (error)
+    g_signal_emit_by_name (tile, "render-complete", NULL, 0, TRUE);
+  else
+    g_signal_emit_by_name (tile, "render-complete", data->buffer, data->buffer_size, FALSE);
+
+  emit_stale_tiles (data);
+
+  if (data->pixbuf)
+    g_object_unref (data->pixbuf);
+  if (data->surface)
+    cairo_surface_destroy (data->surface);
+  g_free (data->buffer);
+  g_free (data->data);
+  g_ptr_array_free (data->stale, TRUE);
+  g_object_unref (data->cancellable);
+  g_object_unref (data->renderer);
+  g_object_unref (tile);
+  g_slice_free (WorkerThreadData, data);
+
+  return FALSE;
+}
+
+
+static void
+hillshade_worker_thread (gpointer worker_data,
+    gpointer user_data)
+{
+  WorkerThreadData *data = (WorkerThreadData *) worker_data;
+  ChamplainHillshadeRendererPrivate *priv = CHAMPLAIN_HILLSHADE_RENDERER (user_data)->priv;
+  gfloat *heights, *grid, *shade;
+  guchar *gray, *pixels, *surface_data;
+  gint rowstride, surface_stride;
+  gdouble n_rows;
+  guint size, stride, row, i;
+
+  if (g_cancellable_is_cancelled (data->cancellable))
+    {
+      DEBUG ("Tile (%d, %d, %u) not needed any more", data->x, data->y, data->z);
+      goto finish;
+    }
+
+  heights = decode_elevation (data, &size);
+  if (!heights)
+    {
+      DEBUG ("Can't decode elevation tile (%d, %d, %u)", data->x, data->y, data->z);
+      goto finish;
+    }
+
+  stride = size + 2;
+  grid = g_new (gfloat, stride * stride);
+  for (row = 0; row < size; row++)
+    memcpy (grid + (row + 1) * stride + 1, heights + row * size, size * sizeof (gfloat));
+  /* the heights are kept for the neighbours, they must not be used after */
+  fill_borders (priv, data, heights, size, grid);
+
+  data->pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, size, size);
+  data->surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, size, size);
+  pixels = gdk_pixbuf_get_pixels (data->pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (data->pixbuf);
+  cairo_surface_flush (data->surface);
+  surface_data = cairo_image_surface_get_data (data->surface);
+  surface_stride = cairo_image_surface_get_stride (data->surface);
+
+  shade = g_new (gfloat, size);
+  gray = g_new (guchar, size);
+  n_rows = (gdouble) size * (1 << data->z);
+
+  for (row = 0; row < size; row++)
+    {
+      /* the pixels get smaller towards the poles in the Mercator projection */
+      gdouble lat = atan (sinh (G_PI * (1.0 - 2.0 * ((gdouble) data->y * size + row + 0.5) / n_rows)));
+      gdouble pixel_size = cos (lat) * 2.0 * G_PI * EARTH_RADIUS / n_rows;
+      guchar *pixbuf_row = pixels + row * rowstride;
+      guint32 *surface_row = (guint32 *) (surface_data + row * surface_stride);
+
+      shade_row (grid + row * stride, grid + (row + 1) * stride, grid + (row + 2) * stride,
+          shade, size, data->params.z_factor / (8.0 * pixel_size), &data->params);
+      shade_to_gray (shade, gray, size);
+
+      for (i = 0; i < size; i++)
+        {
+          pixbuf_row[3 * i] = pixbuf_row[3 * i + 1] = pixbuf_row[3 * i + 2] = gray[i];
+          surface_row[i] = gray[i] * 0x010101;
+        }
+    }
+  cairo_surface_mark_dirty (data->surface);
+
+  g_free (gray);
+  g_free (shade);
+  g_free (grid);
+
+  if (!gdk_pixbuf_save_to_buffer (data->pixbuf, &data->buffer, &data->buffer_size, "png", NULL, NULL))
+    {
+      g_object_unref (data->pixbuf);
+      data->pixbuf = NULL;
+    }
+
+finish:
+  clutter_threads_add_idle_full (CLUTTER_PRIORITY_REDRAW, tile_rendered_cb, data, NULL);
+}
+
+
+static void
+render (ChamplainRenderer *renderer, ChamplainTile *tile)
+{
+  ChamplainHillshadeRendererPrivate *priv = GET_PRIVATE (renderer);
+  GError *error = NULL;
+  WorkerThreadData *data;
+  gdouble azimuth, altitude;
+
+  if (!priv->data || priv->size == 0)
+    {
+      g_signal_emit_by_name (tile, "render-complete", priv->data, priv->size, TRUE);
+      return;
+    }
+
+  data = g_slice_new0 (WorkerThreadData);
+  data->x = champlain_tile_get_x (tile);
+  data->y = champlain_tile_get_y (tile);
+  data->z = champlain_tile_get_zoom_level (tile);
+  data->encoding = priv->encoding;
+  data->tile = g_object_ref (tile);
+  data->renderer = g_object_ref (renderer);
+  data->cancellable = g_object_ref (champlain_tile_get_cancellable (tile));
+  data->stale = g_ptr_array_new_with_free_func (g_free);
+  data->data = priv->data;
+  data->size = priv->size;
+  priv->data = NULL;
+
+  /* the steepness is the illumination from straight above */
+  azimuth = priv->azimuth * G_PI / 180.0;
+  altitude = priv->slope ? G_PI / 2.0 : priv->altitude * G_PI / 180.0;
+  data->params.light_x = priv->slope ? 0.0f : cos (altitude) * sin (azimuth);
+  data->params.light_y = priv->slope ? 0.0f : cos (altitude) * cos (azimuth);
+  data->params.light_z = sin (altitude);
+  data->params.z_factor = priv->z_factor;
+
+  g_thread_pool_push (priv->thpool, data, &error);
+  if (error)
+    {
+      g_error ("Thread pool error: %s", error->message);
+      g_error_free (error);
+      g_free (data->data);
+      g_object_unref (data->cancellable);
+      g_object_unref (data->renderer);
+      g_object_unref (data->tile);
+      g_slice_free (WorkerThreadData, data);
+    }
+}
+
+
+/**
+ * champlain_hillshade_renderer_get_encoding:
+ * @renderer: a #ChamplainHillshadeRenderer
+ *
+ * Gets the encoding of the elevation tiles.
+ *
+ * Returns: the encoding of the elevation tiles.
+ *
+ * Since: 0.12.15
+ */
+ChamplainElevationEncoding
+champlain_hillshade_renderer_get_encoding (ChamplainHillshadeRenderer *renderer)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_HILLSHADE_RENDERER (renderer), CHAMPLAIN_ELEVATION_ENCODING_TERRARIUM);
+
+  return renderer->priv->encoding;
+}
+
+
+/**
+ * champlain_hillshade_renderer_set_encoding:
+ * @renderer: a #ChamplainHillshadeRenderer
+ * @encoding: the encoding of the elevation tiles
+ *
+ * Sets the encoding of the elevation tiles.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_hillshade_renderer_set_encoding (ChamplainHillshadeRenderer *renderer,
+    ChamplainElevationEncoding encoding)
+{
+  g_return_if_fail (CHAMPLAIN_IS_HILLSHADE_RENDERER (renderer));
+
+  renderer->priv->encoding = encoding;
+  /* decoded with the previous encoding */
+  clear_grids (renderer->priv);
+
+  g_object_notify (G_OBJECT (renderer), "encoding");
+  champlain_renderer_area_changed (CHAMPLAIN_RENDERER (renderer), NULL);
+}
+
+
+/**
+ * champlain_hillshade_renderer_get_azimuth:
+ * @renderer: a #ChamplainHillshadeRenderer
+ *
+ * Gets the direction of the light.
+ *
+ * Returns: the direction of the light in degrees clockwise from the north.
+ *
+ * Since: 0.12.15
+ */
+gdouble
+champlain_hillshade_renderer_get_azimuth (ChamplainHillshadeRenderer *renderer)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_HILLSHADE_RENDERER (renderer), 0.0);
+
+  return renderer->priv->azimuth;
+}
+
+
+/**
+ * champlain_hillshade_renderer_set_azimuth:
+ * @renderer: a #ChamplainHillshadeRenderer
+ * @azimuth: the direction of the light in degrees clockwise from the north
+ *
+ * Sets the direction of the light, the default 315 lights the terrain from
+ * the north-west.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_hillshade_renderer_set_azimuth (ChamplainHillshadeRenderer *renderer,
+    gdouble azimuth)
+{
+  g_return_if_fail (CHAMPLAIN_IS_HILLSHADE_RENDERER (renderer));
+
+  renderer->priv->azimuth = azimuth;
+
+  g_object_notify (G_OBJECT (renderer), "azimuth");
+  champlain_renderer_area_changed (CHAMPLAIN_RENDERER (renderer), NULL);
+}
+
+
+/**
+ * champlain_hillshade_renderer_get_altitude:
+ * @renderer: a #ChamplainHillshadeRenderer
+ *
+ * Gets the angle of the light above the horizon.
+ *
+ * Returns: the angle of the light in degrees.
+ *
+ * Since: 0.12.15
+ */
+gdouble
+champlain_hillshade_renderer_get_altitude (ChamplainHillshadeRenderer *renderer)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_HILLSHADE_RENDERER (renderer), 0.0);
+
+  return renderer->priv->altitude;
+}
+
+
+/**
+ * champlain_hillshade_renderer_set_altitude:
+ * @renderer: a #ChamplainHillshadeRenderer
+ * @altitude: the angle of the light above the horizon in degrees
+ *
+ * Sets the angle of the light above the horizon.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_hillshade_renderer_set_altitude (ChamplainHillshadeRenderer *renderer,
+    gdouble altitude)
+{
+  g_return_if_fail (CHAMPLAIN_IS_HILLSHADE_RENDERER (renderer));
+
+  renderer->priv->altitude = altitude;
+
+  g_object_notify (G_OBJECT (renderer), "altitude");
+  champlain_renderer_area_changed (CHAMPLAIN_RENDERER (renderer), NULL);
+}
+
+
+/**
+ * champlain_hillshade_renderer_get_z_factor:
+ * @renderer: a #ChamplainHillshadeRenderer
+ *
+ * Gets the exaggeration of the elevation.
+ *
+ * Returns: the exaggeration of the elevation.
+ *
+ * Since: 0.12.15
+ */
+gdouble
+champlain_hillshade_renderer_get_z_factor (ChamplainHillshadeRenderer *renderer)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_HILLSHADE_RENDERER (renderer), 1.0);
+
+  return renderer->priv->z_factor;
+}
+
+
+/**
+ * champlain_hillshade_renderer_set_z_factor:
+ * @renderer: a #ChamplainHillshadeRenderer
+ * @z_factor: the exaggeration of the elevation
+ *
+ * Sets the exaggeration of the elevation.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_hillshade_renderer_set_z_factor (ChamplainHillshadeRenderer *renderer,
+    gdouble z_factor)
+{
+  g_return_if_fail (CHAMPLAIN_IS_HILLSHADE_RENDERER (renderer));
+
+  renderer->priv->z_factor = z_factor;
+
+  g_object_notify (G_OBJECT (renderer), "z-factor");
+  champlain_renderer_area_changed (CHAMPLAIN_RENDERER (renderer), NULL);
+}
+
+
+/**
+ * champlain_hillshade_renderer_get_slope:
+ * @renderer: a #ChamplainHillshadeRenderer
+ *
+ * Checks whether the steepness of the terrain is rendered instead of its
+ * illumination.
+ *
+ * Returns: TRUE when the steepness is rendered, FALSE otherwise.
+ *
+ * Since: 0.12.15
+ */
+gboolean
+champlain_hillshade_renderer_get_slope (ChamplainHillshadeRenderer *renderer)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_HILLSHADE_RENDERER (renderer), FALSE);
+
+  return renderer->priv->slope;
+}
+
+
+/**
+ * champlain_hillshade_renderer_set_slope:
+ * @renderer: a #ChamplainHillshadeRenderer
+ * @slope: whether to render the steepness
+ *
+ * Sets whether the steepness of the terrain is rendered instead of its
+ * illumination.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_hillshade_renderer_set_slope (ChamplainHillshadeRenderer *renderer,
+    gboolean slope)
+{
+  g_return_if_fail (CHAMPLAIN_IS_HILLSHADE_RENDERER (renderer));
+
+  renderer->priv->slope = slope;
+
+  g_object_notify (G_OBJECT (renderer), "slope");
+  champlain_renderer_area_changed (CHAMPLAIN_RENDERER (renderer), NULL);
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2010-2013 Jiri Techet <techet@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#if !defined (__CHAMPLAIN_CHAMPLAIN_H_INSIDE__) && !defined (CHAMPLAIN_COMPILATION)
+#error "Only <champlain/champlain.h> can be included directly."
+#endif
+
+#ifndef __CHAMPLAIN_HILLSHADE_RENDERER_H__
+#define __CHAMPLAIN_HILLSHADE_RENDERER_H__
+
+#include <champlain/champlain-tile.h>
+#include <champlain/champlain-renderer.h>
+
+G_BEGIN_DECLS
+
+#define CHAMPLAIN_TYPE_HILLSHADE_RENDERER champlain_hillshade_renderer_get_type ()
+
+#define CHAMPLAIN_HILLSHADE_RENDERER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), CHAMPLAIN_TYPE_HILLSHADE_RENDERER, ChamplainHillshadeRenderer))
+
+#define CHAMPLAIN_HILLSHADE_RENDERER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), CHAMPLAIN_TYPE_HILLSHADE_RENDERER, ChamplainHillshadeRendererClass))
+
+#define CHAMPLAIN_IS_HILLSHADE_RENDERER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), CHAMPLAIN_TYPE_HILLSHADE_RENDERER))
+
+#define CHAMPLAIN_IS_HILLSHADE_RENDERER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), CHAMPLAIN_TYPE_HILLSHADE_RENDERER))
+
+#define CHAMPLAIN_HILLSHADE_RENDERER_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), CHAMPLAIN_TYPE_HILLSHADE_RENDERER, ChamplainHillshadeRendererClass))
+
+typedef struct _ChamplainHillshadeRendererPrivate ChamplainHillshadeRendererPrivate;
+
+typedef struct _ChamplainHillshadeRenderer ChamplainHillshadeRenderer;
+typedef struct _ChamplainHillshadeRendererClass ChamplainHillshadeRendererClass;
+
+/**
+ * ChamplainElevationEncoding:
+ * @CHAMPLAIN_ELEVATION_ENCODING_TERRARIUM: Terrarium tiles, the elevation in
+ * meters is R * 256 + G + B / 256 - 32768
+ * @CHAMPLAIN_ELEVATION_ENCODING_TERRAIN_RGB: Terrain-RGB tiles, the elevation
+ * in meters is (R * 65536 + G * 256 + B) * 0.1 - 10000
+ *
+ * How the elevation is encoded in the color channels of the tiles.
+ *
+ * Since: 0.12.15
+ */
+typedef enum
+{
+  CHAMPLAIN_ELEVATION_ENCODING_TERRARIUM,
+  CHAMPLAIN_ELEVATION_ENCODING_TERRAIN_RGB
+} ChamplainElevationEncoding;
+
+/**
+ * ChamplainHillshadeRenderer:
+ *
+ * The #ChamplainHillshadeRenderer structure contains only private data
+ * and should be accessed using the provided API
+ *
+ * Since: 0.12.15
+ */
+struct _ChamplainHillshadeRenderer
+{
+  ChamplainRenderer parent;
+
+  ChamplainHillshadeRendererPrivate *priv;
+};
+
+struct _ChamplainHillshadeRendererClass
+{
+  ChamplainRendererClass parent_class;
+};
+
+GType champlain_hillshade_renderer_get_type (void);
+
+ChamplainHillshadeRenderer *champlain_hillshade_renderer_new (void);
+
+ChamplainElevationEncoding champlain_hillshade_renderer_get_encoding (ChamplainHillshadeRenderer *renderer);
+void champlain_hillshade_renderer_set_encoding (ChamplainHillshadeRenderer *renderer,
+    ChamplainElevationEncoding encoding);
+
+gdouble champlain_hillshade_renderer_get_azimuth (ChamplainHillshadeRenderer *renderer);
+void champlain_hillshade_renderer_set_azimuth (ChamplainHillshadeRenderer *renderer,
+    gdouble azimuth);
+
+gdouble champlain_hillshade_renderer_get_altitude (ChamplainHillshadeRenderer *renderer);
+void champlain_hillshade_renderer_set_altitude (ChamplainHillshadeRenderer *renderer,
+    gdouble altitude);
+
+gdouble champlain_hillshade_renderer_get_z_factor (ChamplainHillshadeRenderer *renderer);
+void champlain_hillshade_renderer_set_z_factor (ChamplainHillshadeRenderer *renderer,
+    gdouble z_factor);
+
+gboolean champlain_hillshade_renderer_get_slope (ChamplainHillshadeRenderer *renderer);
+void champlain_hillshade_renderer_set_slope (ChamplainHillshadeRenderer *renderer,
+    gboolean slope);
+
+G_END_DECLS
+
+#endif /* __CHAMPLAIN_HILLSHADE_RENDERER_H__ */
@@ -146,8 +146,12 @@ image_tile_draw_cb (ClutterCanvas   *canvas,
   cairo_paint (cr);
   cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
 
-  cairo_set_source_surface (cr, surface, 0, 0);
-  cairo_paint(cr);
+  /* The surface is released by champlain_trim_memory() */
+  if (surface)
+    {
+      cairo_set_source_surface (cr, surface, 0, 0);
+      cairo_paint (cr);
+    }
 
   return FALSE;
 }
@@ -165,11 +169,15 @@ image_rendered_cb (GInputStream *stream, GAsyncResult *res, RendererData *data)
   cairo_surface_t *image_surface = NULL;
   cairo_format_t format;
   cairo_t *cr;
+  GError *err = NULL;
   
-  pixbuf = gdk_pixbuf_new_from_stream_finish (res, NULL);
+  pixbuf = gdk_pixbuf_new_from_stream_finish (res, &err);
   if (!pixbuf)
     {
-      g_warning ("NULL pixbuf");
+      /* the tile left the view while being decoded */
+      if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("NULL pixbuf");
+      g_clear_error (&err);
       goto finish;
     }
   
@@ -246,6 +254,7 @@ render (ChamplainRenderer *renderer, ChamplainTile *tile)
   data->size = priv->size;
     
   stream = g_memory_input_stream_new_from_data (priv->data, priv->size, NULL);
-  gdk_pixbuf_new_from_stream_async (stream, NULL, (GAsyncReadyCallback)image_rendered_cb, data);
+  gdk_pixbuf_new_from_stream_async (stream, champlain_tile_get_cancellable (tile),
+      (GAsyncReadyCallback)image_rendered_cb, data);
   priv->data = NULL;
 }
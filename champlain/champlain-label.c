@@ -752,6 +752,7 @@ draw_label (ChamplainLabel *label)
       ClutterContent *canvas;
       
       canvas = clutter_canvas_new ();
+      _champlain_memory_usage_track_canvas (canvas, CHAMPLAIN_MEMORY_CATEGORY_LABEL_CANVASES);
       clutter_canvas_set_size (CLUTTER_CANVAS (canvas), total_width, total_height + priv->point);
       g_signal_connect (canvas, "draw", G_CALLBACK (draw_background), label);
       background = clutter_actor_new ();
@@ -764,6 +765,7 @@ draw_label (ChamplainLabel *label)
       if (priv->draw_shadow)
         {
           canvas = clutter_canvas_new ();
+          _champlain_memory_usage_track_canvas (canvas, CHAMPLAIN_MEMORY_CATEGORY_LABEL_CANVASES);
           clutter_canvas_set_size (CLUTTER_CANVAS (canvas), total_width + get_shadow_slope_width (label), total_height + priv->point);
           g_signal_connect (canvas, "draw", G_CALLBACK (draw_shadow), label);
 
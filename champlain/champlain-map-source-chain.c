@@ -28,11 +28,44 @@
  * sources have to be pushed into the chain in the reverse order starting
  * from #ChamplainNetworkTileSource. After its creation, #ChamplainMapSourceChain
  * behaves as a chain of map sources it contains.
+ *
+ * The chain can also serve tiles above the maximum zoom level of its map
+ * sources, see champlain_map_source_chain_set_max_overzoom(). Such tiles
+ * are produced by cropping and upscaling the ancestor tile at the maximum
+ * zoom level, which is loaded through the chain only once for all of its
+ * descendants.
+ *
+ * Missing tiles below the maximum zoom level can likewise be assembled from
+ * their cached descendants by the #ChamplainFileCache sources of the chain,
+ * see champlain_map_source_chain_set_max_underzoom().
  */
 
+#include "config.h"
+
 #include "champlain-map-source-chain.h"
+
+#define DEBUG_FLAG CHAMPLAIN_DEBUG_LOADING
+#include "champlain-debug.h"
+
 #include "champlain-tile-cache.h"
+#include "champlain-file-cache.h"
 #include "champlain-tile-source.h"
+#include "champlain-exportable.h"
+#include "champlain-private.h"
+
+#include <stdio.h>
+
+/* Number of decoded ancestor tiles kept for overzooming */
+#define OVERZOOM_CACHE_SIZE 32
+/* The same limit as ChamplainFileCache:max-underzoom */
+#define MAX_UNDERZOOM 2
+
+enum
+{
+  PROP_0,
+  PROP_MAX_OVERZOOM,
+  PROP_MAX_UNDERZOOM
+};
 
 G_DEFINE_TYPE (ChamplainMapSourceChain, champlain_map_source_chain, CHAMPLAIN_TYPE_MAP_SOURCE);
 
@@ -43,8 +76,24 @@ struct _ChamplainMapSourceChainPrivate
 {
   ChamplainMapSource *stack_top;
   ChamplainMapSource *stack_bottom;
+
+  guint max_overzoom;
+  guint max_underzoom;
+  /* "z/x/y" -> cairo_surface_t of decoded ancestor tiles */
+  GHashTable *overzoom_surfaces;
+  GQueue *overzoom_order;
+  /* "z/x/y" -> AncestorLoad of ancestor tiles being loaded */
+  GHashTable *overzoom_pending;
 };
 
+typedef struct
+{
+  ChamplainMapSourceChain *source_chain;
+  ChamplainTile *ancestor;
+  gchar *key;
+  GList *tiles;
+} AncestorLoad;
+
 static const gchar *get_id (ChamplainMapSource *map_source);
 static const gchar *get_name (ChamplainMapSource *map_source);
 static const gchar *get_license (ChamplainMapSource *map_source);
@@ -55,8 +104,61 @@ static guint get_tile_size (ChamplainMapSource *map_source);
 
 static void fill_tile (ChamplainMapSource *map_source,
     ChamplainTile *tile);
+static void fill_tiles (ChamplainMapSource *map_source,
+    ChamplainTile **tiles,
+    guint n_tiles);
 static void on_set_next_source_cb (ChamplainMapSourceChain *source_chain,
     G_GNUC_UNUSED gpointer user_data);
+static void trim_memory (GObject *object,
+    ChamplainTrimLevel level);
+
+
+static void
+champlain_map_source_chain_get_property (GObject *object,
+    guint prop_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  ChamplainMapSourceChain *source_chain = CHAMPLAIN_MAP_SOURCE_CHAIN (object);
+
+  switch (prop_id)
+    {
+    case PROP_MAX_OVERZOOM:
+      g_value_set_uint (value, source_chain->priv->max_overzoom);
+      break;
+
+    case PROP_MAX_UNDERZOOM:
+      g_value_set_uint (value, source_chain->priv->max_underzoom);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+
+static void
+champlain_map_source_chain_set_property (GObject *object,
+    guint prop_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  ChamplainMapSourceChain *source_chain = CHAMPLAIN_MAP_SOURCE_CHAIN (object);
+
+  switch (prop_id)
+    {
+    case PROP_MAX_OVERZOOM:
+      champlain_map_source_chain_set_max_overzoom (source_chain, g_value_get_uint (value));
+      break;
+
+    case PROP_MAX_UNDERZOOM:
+      champlain_map_source_chain_set_max_underzoom (source_chain, g_value_get_uint (value));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
 
 
 static void
@@ -74,6 +176,12 @@ champlain_map_source_chain_dispose (GObject *object)
 static void
 champlain_map_source_chain_finalize (GObject *object)
 {
+  ChamplainMapSourceChainPrivate *priv = CHAMPLAIN_MAP_SOURCE_CHAIN (object)->priv;
+
+  g_hash_table_destroy (priv->overzoom_surfaces);
+  g_queue_free (priv->overzoom_order);
+  g_hash_table_destroy (priv->overzoom_pending);
+
   G_OBJECT_CLASS (champlain_map_source_chain_parent_class)->finalize (object);
 }
 
@@ -87,6 +195,8 @@ champlain_map_source_chain_class_init (ChamplainMapSourceChainClass *klass)
 
   object_class->finalize = champlain_map_source_chain_finalize;
   object_class->dispose = champlain_map_source_chain_dispose;
+  object_class->get_property = champlain_map_source_chain_get_property;
+  object_class->set_property = champlain_map_source_chain_set_property;
 
   ChamplainMapSourceClass *map_source_class = CHAMPLAIN_MAP_SOURCE_CLASS (klass);
 
@@ -99,6 +209,43 @@ champlain_map_source_chain_class_init (ChamplainMapSourceChainClass *klass)
   map_source_class->get_tile_size = get_tile_size;
 
   map_source_class->fill_tile = fill_tile;
+  champlain_map_source_class_set_fill_tiles (map_source_class, fill_tiles);
+
+  /**
+   * ChamplainMapSourceChain:max-overzoom:
+   *
+   * The number of zoom levels above the maximum zoom level of the chained
+   * map sources for which tiles are synthesized from their ancestors
+   *
+   * Since: 0.12.15
+   */
+  g_object_class_install_property (object_class,
+      PROP_MAX_OVERZOOM,
+      g_param_spec_uint ("max-overzoom",
+          "Max overzoom",
+          "Number of zoom levels synthesized above the maximum zoom level",
+          0,
+          50,
+          0,
+          G_PARAM_READWRITE));
+
+  /**
+   * ChamplainMapSourceChain:max-underzoom:
+   *
+   * The number of zoom levels below a missing tile searched for cached
+   * descendants from which the file caches of the chain assemble it
+   *
+   * Since: 0.12.15
+   */
+  g_object_class_install_property (object_class,
+      PROP_MAX_UNDERZOOM,
+      g_param_spec_uint ("max-underzoom",
+          "Max underzoom",
+          "Number of zoom levels searched for descendants of missing tiles",
+          0,
+          MAX_UNDERZOOM,
+          0,
+          G_PARAM_READWRITE));
 }
 
 
@@ -112,8 +259,17 @@ champlain_map_source_chain_init (ChamplainMapSourceChain *source_chain)
   priv->stack_top = NULL;
   priv->stack_bottom = NULL;
 
+  priv->max_overzoom = 0;
+  priv->max_underzoom = 0;
+  priv->overzoom_surfaces = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) cairo_surface_destroy);
+  priv->overzoom_order = g_queue_new ();
+  priv->overzoom_pending = g_hash_table_new (g_str_hash, g_str_equal);
+
   g_signal_connect (source_chain, "notify::next-source",
       G_CALLBACK (on_set_next_source_cb), NULL);
+
+  _champlain_memory_usage_add_trim_handler (G_OBJECT (source_chain), trim_memory);
 }
 
 
@@ -213,7 +369,7 @@ get_max_zoom_level (ChamplainMapSource *map_source)
   ChamplainMapSourceChainPrivate *priv = source_chain->priv;
   g_return_val_if_fail (priv->stack_top, 0);
 
-  return champlain_map_source_get_max_zoom_level (priv->stack_top);
+  return champlain_map_source_get_max_zoom_level (priv->stack_top) + priv->max_overzoom;
 }
 
 
@@ -231,6 +387,205 @@ get_tile_size (ChamplainMapSource *map_source)
 }
 
 
+static gboolean
+overzoom_draw_cb (G_GNUC_UNUSED ClutterCanvas *canvas,
+    cairo_t *cr,
+    G_GNUC_UNUSED gint width,
+    G_GNUC_UNUSED gint height,
+    ChamplainTile *tile)
+{
+  cairo_surface_t *surface;
+
+  surface = champlain_exportable_get_surface (CHAMPLAIN_EXPORTABLE (tile));
+
+  /* Clear the drawing area */
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+
+  if (surface)
+    {
+      cairo_set_source_surface (cr, surface, 0, 0);
+      cairo_paint (cr);
+    }
+
+  return FALSE;
+}
+
+
+/* Crops the part of the ancestor surface covered by the tile and scales
+   it to the tile size */
+static void
+fill_tile_from_ancestor (ChamplainTile *tile,
+    cairo_surface_t *ancestor_surface,
+    guint ancestor_zoom)
+{
+  guint size = champlain_tile_get_size (tile);
+  guint delta = champlain_tile_get_zoom_level (tile) - ancestor_zoom;
+  gint scale = 1 << delta;
+  gdouble offset_x = (champlain_tile_get_x (tile) % scale) * (gdouble) size / scale;
+  gdouble offset_y = (champlain_tile_get_y (tile) % scale) * (gdouble) size / scale;
+  cairo_surface_t *surface;
+  cairo_pattern_t *pattern;
+  ClutterContent *content;
+  ClutterActor *actor;
+  cairo_t *cr;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, size, size);
+  cr = cairo_create (surface);
+  cairo_scale (cr, scale, scale);
+  cairo_set_source_surface (cr, ancestor_surface, -offset_x, -offset_y);
+  pattern = cairo_get_source (cr);
+  cairo_pattern_set_filter (pattern, CAIRO_FILTER_BILINEAR);
+  cairo_pattern_set_extend (pattern, CAIRO_EXTEND_PAD);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+
+  champlain_exportable_set_surface (CHAMPLAIN_EXPORTABLE (tile), surface);
+  cairo_surface_destroy (surface);
+
+  content = clutter_canvas_new ();
+  clutter_canvas_set_size (CLUTTER_CANVAS (content), size, size);
+  g_signal_connect (content, "draw", G_CALLBACK (overzoom_draw_cb), tile);
+  clutter_content_invalidate (content);
+
+  actor = clutter_actor_new ();
+  clutter_actor_set_size (actor, size, size);
+  clutter_actor_set_content (actor, content);
+  g_object_unref (content);
+  /* has to be set for proper opacity */
+  clutter_actor_set_offscreen_redirect (actor, CLUTTER_OFFSCREEN_REDIRECT_AUTOMATIC_FOR_OPACITY);
+
+  champlain_tile_set_content (tile, actor);
+  champlain_tile_set_fade_in (tile, FALSE);
+  champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
+  champlain_tile_display_content (tile);
+}
+
+
+static void
+store_ancestor_surface (ChamplainMapSourceChain *source_chain,
+    const gchar *key,
+    cairo_surface_t *surface)
+{
+  ChamplainMapSourceChainPrivate *priv = source_chain->priv;
+  gchar *stored_key;
+
+  if (g_hash_table_lookup (priv->overzoom_surfaces, key))
+    return;
+
+  stored_key = g_strdup (key);
+  g_hash_table_insert (priv->overzoom_surfaces, stored_key, cairo_surface_reference (surface));
+  g_queue_push_tail (priv->overzoom_order, stored_key);
+
+  if (g_queue_get_length (priv->overzoom_order) > OVERZOOM_CACHE_SIZE)
+    g_hash_table_remove (priv->overzoom_surfaces, g_queue_pop_head (priv->overzoom_order));
+}
+
+
+/* The ancestor surfaces are only kept to overzoom further tiles */
+static void
+trim_memory (GObject *object,
+    G_GNUC_UNUSED ChamplainTrimLevel level)
+{
+  ChamplainMapSourceChainPrivate *priv = CHAMPLAIN_MAP_SOURCE_CHAIN (object)->priv;
+
+  g_queue_clear (priv->overzoom_order);
+  g_hash_table_remove_all (priv->overzoom_surfaces);
+}
+
+
+static void
+ancestor_state_notify (ChamplainTile *ancestor,
+    G_GNUC_UNUSED GParamSpec *pspec,
+    AncestorLoad *load)
+{
+  ChamplainMapSourceChain *source_chain = load->source_chain;
+  ChamplainMapSourceChainPrivate *priv = source_chain->priv;
+  cairo_surface_t *surface;
+  GList *iter;
+
+  if (champlain_tile_get_state (ancestor) != CHAMPLAIN_STATE_DONE)
+    return;
+
+  g_signal_handlers_disconnect_by_func (ancestor, ancestor_state_notify, load);
+  g_hash_table_remove (priv->overzoom_pending, load->key);
+
+  surface = champlain_exportable_get_surface (CHAMPLAIN_EXPORTABLE (ancestor));
+  if (surface)
+    store_ancestor_surface (source_chain, load->key, surface);
+
+  for (iter = load->tiles; iter; iter = iter->next)
+    {
+      ChamplainTile *tile = iter->data;
+
+      /* the tile got cancelled in the meantime */
+      if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_DONE)
+        continue;
+
+      if (surface)
+        fill_tile_from_ancestor (tile, surface, champlain_tile_get_zoom_level (ancestor));
+      else if (priv->stack_bottom)
+        champlain_map_source_fill_tile (priv->stack_bottom, tile);
+    }
+
+  g_list_free_full (load->tiles, g_object_unref);
+  clutter_actor_destroy (CLUTTER_ACTOR (ancestor));
+  g_object_unref (ancestor);
+  g_free (load->key);
+  g_object_unref (source_chain);
+  g_slice_free (AncestorLoad, load);
+}
+
+
+static void
+fill_overzoomed_tile (ChamplainMapSourceChain *source_chain,
+    ChamplainTile *tile,
+    guint max_zoom)
+{
+  ChamplainMapSourceChainPrivate *priv = source_chain->priv;
+  guint delta = champlain_tile_get_zoom_level (tile) - max_zoom;
+  guint x = champlain_tile_get_x (tile) >> delta;
+  guint y = champlain_tile_get_y (tile) >> delta;
+  cairo_surface_t *surface;
+  AncestorLoad *load;
+  gchar *key;
+
+  key = g_strdup_printf ("%u/%u/%u", max_zoom, x, y);
+
+  surface = g_hash_table_lookup (priv->overzoom_surfaces, key);
+  if (surface)
+    {
+      DEBUG ("Overzooming tile %s from decoded ancestor", key);
+      fill_tile_from_ancestor (tile, surface, max_zoom);
+      g_free (key);
+      return;
+    }
+
+  load = g_hash_table_lookup (priv->overzoom_pending, key);
+  if (load)
+    {
+      load->tiles = g_list_prepend (load->tiles, g_object_ref (tile));
+      g_free (key);
+      return;
+    }
+
+  DEBUG ("Loading ancestor tile %s for overzoom", key);
+
+  load = g_slice_new (AncestorLoad);
+  load->source_chain = g_object_ref (source_chain);
+  load->key = key;
+  load->tiles = g_list_prepend (NULL, g_object_ref (tile));
+  load->ancestor = champlain_tile_new_full (x, y, champlain_tile_get_size (tile), max_zoom);
+  g_object_ref_sink (load->ancestor);
+  g_hash_table_insert (priv->overzoom_pending, load->key, load);
+
+  g_signal_connect (load->ancestor, "notify::state", G_CALLBACK (ancestor_state_notify), load);
+  champlain_tile_set_state (load->ancestor, CHAMPLAIN_STATE_LOADING);
+  champlain_map_source_fill_tile (priv->stack_top, load->ancestor);
+}
+
+
 static void
 fill_tile (ChamplainMapSource *map_source,
     ChamplainTile *tile)
@@ -242,10 +597,58 @@ fill_tile (ChamplainMapSource *map_source,
   ChamplainMapSourceChainPrivate *priv = source_chain->priv;
   g_return_if_fail (priv->stack_top);
 
+  if (priv->max_overzoom > 0 && champlain_tile_get_state (tile) != CHAMPLAIN_STATE_DONE)
+    {
+      guint max_zoom = champlain_map_source_get_max_zoom_level (priv->stack_top);
+      guint zoom = champlain_tile_get_zoom_level (tile);
+
+      if (zoom > max_zoom && zoom <= max_zoom + priv->max_overzoom)
+        {
+          fill_overzoomed_tile (source_chain, tile, max_zoom);
+          return;
+        }
+    }
+
   champlain_map_source_fill_tile (priv->stack_top, tile);
 }
 
 
+/* Overzoomed tiles are served from their ancestors, the rest of the batch
+ * is passed to the top of the stack in one piece */
+static void
+fill_tiles (ChamplainMapSource *map_source,
+    ChamplainTile **tiles,
+    guint n_tiles)
+{
+  ChamplainMapSourceChain *source_chain = CHAMPLAIN_MAP_SOURCE_CHAIN (map_source);
+
+  g_return_if_fail (source_chain);
+
+  ChamplainMapSourceChainPrivate *priv = source_chain->priv;
+  g_return_if_fail (priv->stack_top);
+
+  ChamplainTile **batch = g_newa (ChamplainTile *, n_tiles);
+  guint max_zoom = champlain_map_source_get_max_zoom_level (priv->stack_top);
+  guint n_batch = 0;
+  guint i;
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      ChamplainTile *tile = tiles[i];
+      guint zoom = champlain_tile_get_zoom_level (tile);
+
+      if (priv->max_overzoom > 0 && champlain_tile_get_state (tile) != CHAMPLAIN_STATE_DONE &&
+          zoom > max_zoom && zoom <= max_zoom + priv->max_overzoom)
+        fill_overzoomed_tile (source_chain, tile, max_zoom);
+      else
+        batch[n_batch++] = tile;
+    }
+
+  if (n_batch > 0)
+    champlain_map_source_fill_tiles (priv->stack_top, batch, n_batch);
+}
+
+
 static void
 on_set_next_source_cb (ChamplainMapSourceChain *source_chain,
     G_GNUC_UNUSED gpointer user_data)
@@ -330,6 +733,10 @@ champlain_map_source_chain_push (ChamplainMapSourceChain *source_chain,
           ChamplainTileCache *tile_cache = CHAMPLAIN_TILE_CACHE (map_source);
           assign_cache_of_next_source_sequence (source_chain, priv->stack_top, tile_cache);
         }
+
+      if (priv->max_underzoom > 0 && CHAMPLAIN_IS_FILE_CACHE (map_source))
+        champlain_file_cache_set_max_underzoom (CHAMPLAIN_FILE_CACHE (map_source),
+            priv->max_underzoom);
     }
 }
 
@@ -373,3 +780,153 @@ champlain_map_source_chain_pop (ChamplainMapSourceChain *source_chain)
 
   g_object_unref (old_stack_top);
 }
+
+
+/**
+ * champlain_map_source_chain_set_max_overzoom:
+ * @source_chain: a #ChamplainMapSourceChain
+ * @max_overzoom: the number of zoom levels to synthesize
+ *
+ * Sets the number of zoom levels above the maximum zoom level of the chained
+ * map sources for which the chain provides tiles. These tiles are obtained
+ * by cropping and upscaling the ancestor tile at the maximum zoom level, so
+ * no network requests are made for them and a view using the chain can be
+ * zoomed further than the map source supports. The maximum zoom level reported
+ * by the chain is increased accordingly.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_map_source_chain_set_max_overzoom (ChamplainMapSourceChain *source_chain,
+    guint max_overzoom)
+{
+  g_return_if_fail (CHAMPLAIN_IS_MAP_SOURCE_CHAIN (source_chain));
+
+  source_chain->priv->max_overzoom = max_overzoom;
+
+  g_object_notify (G_OBJECT (source_chain), "max-overzoom");
+}
+
+
+/**
+ * champlain_map_source_chain_get_max_overzoom:
+ * @source_chain: a #ChamplainMapSourceChain
+ *
+ * Gets the number of zoom levels synthesized above the maximum zoom level
+ * of the chained map sources.
+ *
+ * Returns: the number of overzoomed levels.
+ *
+ * Since: 0.12.15
+ */
+guint
+champlain_map_source_chain_get_max_overzoom (ChamplainMapSourceChain *source_chain)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_MAP_SOURCE_CHAIN (source_chain), 0);
+
+  return source_chain->priv->max_overzoom;
+}
+
+
+/**
+ * champlain_map_source_chain_set_max_underzoom:
+ * @source_chain: a #ChamplainMapSourceChain
+ * @max_underzoom: the number of zoom levels searched for descendants, at
+ * most 2
+ *
+ * Sets the #ChamplainFileCache:max-underzoom property of all file caches in
+ * the chain, including those pushed later. A tile missing from a file cache
+ * is then assembled from its cached descendants at most @max_underzoom
+ * levels below it, which lets a view zoomed out while offline show the
+ * areas browsed before at higher zoom levels.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_map_source_chain_set_max_underzoom (ChamplainMapSourceChain *source_chain,
+    guint max_underzoom)
+{
+  g_return_if_fail (CHAMPLAIN_IS_MAP_SOURCE_CHAIN (source_chain));
+
+  ChamplainMapSourceChainPrivate *priv = source_chain->priv;
+  ChamplainMapSource *map_source = priv->stack_top;
+
+  priv->max_underzoom = MIN (max_underzoom, MAX_UNDERZOOM);
+
+  while (map_source && map_source != priv->stack_bottom)
+    {
+      if (CHAMPLAIN_IS_FILE_CACHE (map_source))
+        champlain_file_cache_set_max_underzoom (CHAMPLAIN_FILE_CACHE (map_source),
+            priv->max_underzoom);
+      map_source = champlain_map_source_get_next_source (map_source);
+    }
+
+  g_object_notify (G_OBJECT (source_chain), "max-underzoom");
+}
+
+
+/**
+ * champlain_map_source_chain_get_max_underzoom:
+ * @source_chain: a #ChamplainMapSourceChain
+ *
+ * Gets the number of zoom levels searched for cached descendants of tiles
+ * missing from the file caches of the chain.
+ *
+ * Returns: the number of underzoomed levels.
+ *
+ * Since: 0.12.15
+ */
+guint
+champlain_map_source_chain_get_max_underzoom (ChamplainMapSourceChain *source_chain)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_MAP_SOURCE_CHAIN (source_chain), 0);
+
+  return source_chain->priv->max_underzoom;
+}
+
+
+/* Drops the tiles intersecting @bbox (or all of them if NULL) from the caches
+ * of the chain and the decoded ancestors kept for overzooming when one of
+ * the sources of the chain renders with @renderer, or always if it is NULL.
+ * Returns whether the chain was invalidated. */
+gboolean
+_champlain_map_source_chain_invalidate_area (ChamplainMapSourceChain *source_chain,
+    ChamplainRenderer *renderer,
+    ChamplainBoundingBox *bbox)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_MAP_SOURCE_CHAIN (source_chain), FALSE);
+
+  ChamplainMapSourceChainPrivate *priv = source_chain->priv;
+  ChamplainMapSource *map_source = priv->stack_top;
+  GList *link;
+
+  if (!_champlain_map_source_uses_renderer (map_source, renderer))
+    return FALSE;
+
+  while (map_source)
+    {
+      if (CHAMPLAIN_IS_TILE_CACHE (map_source))
+        champlain_tile_cache_invalidate_area (CHAMPLAIN_TILE_CACHE (map_source), bbox);
+      map_source = champlain_map_source_get_next_source (map_source);
+    }
+
+  link = priv->overzoom_order->head;
+  while (link)
+    {
+      GList *next = link->next;
+      gchar *key = link->data;
+      guint zoom_level;
+      gint x, y;
+
+      if (sscanf (key, "%u/%d/%d", &zoom_level, &x, &y) == 3 &&
+          _champlain_map_source_tile_in_area (CHAMPLAIN_MAP_SOURCE (source_chain),
+              zoom_level, x, y, bbox))
+        {
+          g_queue_delete_link (priv->overzoom_order, link);
+          g_hash_table_remove (priv->overzoom_surfaces, key);
+        }
+      link = next;
+    }
+
+  return TRUE;
+}
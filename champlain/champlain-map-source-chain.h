@@ -79,6 +79,13 @@ void champlain_map_source_chain_push (ChamplainMapSourceChain *source_chain,
     ChamplainMapSource *map_source);
 void champlain_map_source_chain_pop (ChamplainMapSourceChain *source_chain);
 
+void champlain_map_source_chain_set_max_overzoom (ChamplainMapSourceChain *source_chain,
+    guint max_overzoom);
+guint champlain_map_source_chain_get_max_overzoom (ChamplainMapSourceChain *source_chain);
+void champlain_map_source_chain_set_max_underzoom (ChamplainMapSourceChain *source_chain,
+    guint max_underzoom);
+guint champlain_map_source_chain_get_max_underzoom (ChamplainMapSourceChain *source_chain);
+
 G_END_DECLS
 
 #endif /* _CHAMPLAIN_MAP_SOURCE_CHAIN_H_ */
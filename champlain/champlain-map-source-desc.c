@@ -42,6 +42,7 @@ enum
   PROP_PROJECTION,
   PROP_CONSTRUCTOR,
   PROP_DATA,
+  PROP_MIRROR_URI_FORMATS,
 };
 
 struct _ChamplainMapSourceDescPrivate
@@ -57,6 +58,7 @@ struct _ChamplainMapSourceDescPrivate
   ChamplainMapProjection projection;
   ChamplainMapSourceConstructor constructor;
   gpointer data;
+  gchar **mirror_uri_formats;
 };
 
 G_DEFINE_TYPE (ChamplainMapSourceDesc, champlain_map_source_desc, G_TYPE_OBJECT);
@@ -143,6 +145,10 @@ champlain_map_source_desc_get_property (GObject *object,
       g_value_set_pointer (value, priv->data);
       break;
 
+    case PROP_MIRROR_URI_FORMATS:
+      g_value_set_boxed (value, priv->mirror_uri_formats);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -202,6 +208,10 @@ champlain_map_source_desc_set_property (GObject *object,
       set_data (desc, g_value_get_pointer (value));
       break;
 
+    case PROP_MIRROR_URI_FORMATS:
+      champlain_map_source_desc_set_mirror_uri_formats (desc, g_value_get_boxed (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -227,6 +237,7 @@ champlain_map_source_desc_finalize (GObject *object)
   g_free (priv->license);
   g_free (priv->license_uri);
   g_free (priv->uri_format);
+  g_strfreev (priv->mirror_uri_formats);
 
   G_OBJECT_CLASS (champlain_map_source_desc_parent_class)->finalize (object);
 }
@@ -413,6 +424,23 @@ champlain_map_source_desc_class_init (ChamplainMapSourceDescClass *klass)
           "User data",
           "User data",
           G_PARAM_READABLE | G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  /**
+   * ChamplainMapSourceDesc:mirror-uri-formats:
+   *
+   * URI formats of alternate servers providing the same tiles as
+   * #ChamplainMapSourceDesc:uri-format. Network map sources send a duplicate
+   * request to one of them when a tile takes unusually long to download.
+   *
+   * Since: 0.12.15
+   */
+  g_object_class_install_property (object_class,
+      PROP_MIRROR_URI_FORMATS,
+      g_param_spec_boxed ("mirror-uri-formats",
+          "Mirror URI formats",
+          "URI formats of alternate servers",
+          G_TYPE_STRV,
+          G_PARAM_READWRITE));
 }
 
 
@@ -434,6 +462,7 @@ champlain_map_source_desc_init (ChamplainMapSourceDesc *desc)
   priv->projection = CHAMPLAIN_MAP_PROJECTION_MERCATOR;
   priv->constructor = NULL;
   priv->data = NULL;
+  priv->mirror_uri_formats = NULL;
 }
 
 
@@ -697,6 +726,53 @@ champlain_map_source_desc_get_constructor (ChamplainMapSourceDesc *desc)
 }
 
 
+/**
+ * champlain_map_source_desc_get_mirror_uri_formats:
+ * @desc: a #ChamplainMapSourceDesc
+ *
+ * Gets the URI formats of the alternate servers of a network map source.
+ *
+ * Returns: (transfer none) (array zero-terminated=1) (allow-none): the
+ * mirror URI formats or %NULL when there are none.
+ *
+ * Since: 0.12.15
+ */
+const gchar * const *
+champlain_map_source_desc_get_mirror_uri_formats (ChamplainMapSourceDesc *desc)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_MAP_SOURCE_DESC (desc), NULL);
+
+  return (const gchar * const *) desc->priv->mirror_uri_formats;
+}
+
+
+/**
+ * champlain_map_source_desc_set_mirror_uri_formats:
+ * @desc: a #ChamplainMapSourceDesc
+ * @uri_formats: (array zero-terminated=1) (allow-none): %NULL-terminated
+ * array of URI formats in the format of #ChamplainMapSourceDesc:uri-format
+ *
+ * Sets the URI formats of alternate servers providing the same tiles. Map
+ * sources created from the description afterwards use them to hedge slow
+ * downloads.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_map_source_desc_set_mirror_uri_formats (ChamplainMapSourceDesc *desc,
+    const gchar * const *uri_formats)
+{
+  g_return_if_fail (CHAMPLAIN_IS_MAP_SOURCE_DESC (desc));
+
+  ChamplainMapSourceDescPrivate *priv = desc->priv;
+
+  g_strfreev (priv->mirror_uri_formats);
+  priv->mirror_uri_formats = g_strdupv ((gchar **) uri_formats);
+
+  g_object_notify (G_OBJECT (desc), "mirror-uri-formats");
+}
+
+
 static void
 set_id (ChamplainMapSourceDesc *desc,
     const gchar *id)
@@ -119,6 +119,9 @@ guint champlain_map_source_desc_get_tile_size (ChamplainMapSourceDesc *desc);
 ChamplainMapProjection champlain_map_source_desc_get_projection (ChamplainMapSourceDesc *desc);
 gpointer champlain_map_source_desc_get_data (ChamplainMapSourceDesc *desc);
 ChamplainMapSourceConstructor champlain_map_source_desc_get_constructor (ChamplainMapSourceDesc *desc);
+const gchar * const *champlain_map_source_desc_get_mirror_uri_formats (ChamplainMapSourceDesc *desc);
+void champlain_map_source_desc_set_mirror_uri_formats (ChamplainMapSourceDesc *desc,
+    const gchar * const *uri_formats);
 
 G_END_DECLS
 
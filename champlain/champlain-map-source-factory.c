@@ -31,6 +31,9 @@
  * To get the list of registered map sources, use
  * #champlain_map_source_factory_get_registered.
  *
+ * Applications showing the same map source in several views can use
+ * #champlain_map_source_factory_dup_shared_source so that the views share
+ * a single cached source chain.
  */
 #include "config.h"
 
@@ -80,6 +83,9 @@ G_DEFINE_TYPE (ChamplainMapSourceFactory, champlain_map_source_factory, G_TYPE_O
 struct _ChamplainMapSourceFactoryPrivate
 {
   GSList *registered_sources;
+  /* id -> ChamplainMapSource, each entry holds a reference to the factory
+     and is removed when the source is finalized */
+  GHashTable *shared_sources;
 };
 
 static ChamplainMapSource *champlain_map_source_new_generic (
@@ -91,12 +97,34 @@ static ChamplainMapSource *champlain_map_source_new_memphis (
 #endif
 
 
+static void
+shared_source_finalized (ChamplainMapSourceFactory *factory,
+    GObject *where_the_object_was)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, factory->priv->shared_sources);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      if (value == where_the_object_was)
+        {
+          g_hash_table_iter_remove (&iter);
+          break;
+        }
+    }
+
+  g_object_unref (factory);
+}
+
+
 static void
 champlain_map_source_factory_finalize (GObject *object)
 {
   ChamplainMapSourceFactory *factory = CHAMPLAIN_MAP_SOURCE_FACTORY (object);
 
   g_slist_free (factory->priv->registered_sources);
+  g_hash_table_destroy (factory->priv->shared_sources);
 
   G_OBJECT_CLASS (champlain_map_source_factory_parent_class)->finalize (object);
 }
@@ -146,6 +174,7 @@ champlain_map_source_factory_init (ChamplainMapSourceFactory *factory)
 
   factory->priv = priv;
   priv->registered_sources = NULL;
+  priv->shared_sources = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
   desc = champlain_map_source_desc_new_full (
         CHAMPLAIN_MAP_SOURCE_OSM_MAPNIK,
@@ -483,6 +512,65 @@ champlain_map_source_factory_create_cached_source (ChamplainMapSourceFactory *fa
 }
 
 
+/**
+ * champlain_map_source_factory_dup_shared_source:
+ * @factory: the Factory
+ * @id: the wanted map source id
+ *
+ * Gets a cached map source shared by all its users in the process. The
+ * first call creates the source chain in the same way as
+ * champlain_map_source_factory_create_cached_source (); subsequent calls
+ * with the same id return the same chain as long as it is alive. Views
+ * using the returned source share its memory cache, file cache connection
+ * and network session, and a tile requested by several views at the same
+ * time is downloaded and decoded only once.
+ *
+ * Returns: (transfer full): the shared #ChamplainMapSourceChain or NULL if
+ * no map source with the given id is registered. Free it with
+ * #g_object_unref() when not needed.
+ *
+ * Since: 0.12.15
+ */
+ChamplainMapSource *
+champlain_map_source_factory_dup_shared_source (ChamplainMapSourceFactory *factory,
+    const gchar *id)
+{
+  ChamplainMapSourceFactoryPrivate *priv;
+  ChamplainMapSource *source;
+  GSList *item;
+
+  g_return_val_if_fail (CHAMPLAIN_IS_MAP_SOURCE_FACTORY (factory), NULL);
+  g_return_val_if_fail (id != NULL, NULL);
+
+  priv = factory->priv;
+
+  source = g_hash_table_lookup (priv->shared_sources, id);
+  if (source)
+    return g_object_ref (source);
+
+  for (item = priv->registered_sources; item != NULL; item = g_slist_next (item))
+    {
+      if (strcmp (champlain_map_source_desc_get_id (item->data), id) == 0)
+        break;
+    }
+
+  if (!item)
+    return NULL;
+
+  DEBUG ("Creating shared source %s", id);
+
+  source = champlain_map_source_factory_create_cached_source (factory, id);
+  g_object_ref_sink (source);
+
+  /* the registry has to outlive the shared sources */
+  g_object_ref (factory);
+  g_hash_table_insert (priv->shared_sources, g_strdup (id), source);
+  g_object_weak_ref (G_OBJECT (source), (GWeakNotify) shared_source_finalized, factory);
+
+  return source;
+}
+
+
 /**
  * champlain_map_source_factory_create_memcached_source:
  * @factory: the Factory
@@ -613,6 +701,8 @@ champlain_map_source_new_generic (ChamplainMapSourceDesc *desc)
             projection,
             uri_format,
             renderer));
+  champlain_network_tile_source_set_mirror_uri_formats (CHAMPLAIN_NETWORK_TILE_SOURCE (map_source),
+      champlain_map_source_desc_get_mirror_uri_formats (desc));
 
   return map_source;
 }
@@ -84,6 +84,8 @@ ChamplainMapSource *champlain_map_source_factory_create_cached_source (Champlain
     const gchar *id);
 ChamplainMapSource *champlain_map_source_factory_create_memcached_source (ChamplainMapSourceFactory *factory,
     const gchar *id);
+ChamplainMapSource *champlain_map_source_factory_dup_shared_source (ChamplainMapSourceFactory *factory,
+    const gchar *id);
 ChamplainMapSource *champlain_map_source_factory_create_error_source (ChamplainMapSourceFactory *factory,
     guint tile_size);
 
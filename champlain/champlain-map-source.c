@@ -26,7 +26,11 @@
  *
  * When loading new tiles, #ChamplainView calls champlain_map_source_fill_tile()
  * on the current #ChamplainMapSource passing it a #ChamplainTile to be filled
- * with the image.
+ * with the image. The tiles needed by a single viewport update are passed
+ * together to champlain_map_source_fill_tiles(). Map sources able to
+ * amortize per-request costs over several tiles implement it with
+ * champlain_map_source_class_set_fill_tiles(), the caches of the library
+ * pass the tiles they miss on to the next source as one batch again.
  *
  * Apart from being a base class of all map sources, #ChamplainMapSource
  * also supports cooperation of multiple map sources by arranging them into
@@ -52,8 +56,11 @@
  */
 
 #include "champlain-map-source.h"
+#include "champlain-tile-cache.h"
+#include "champlain-private.h"
 
 #include <math.h>
+#include <string.h>
 
 G_DEFINE_ABSTRACT_TYPE (ChamplainMapSource, champlain_map_source, G_TYPE_INITIALLY_UNOWNED);
 
@@ -71,6 +78,7 @@ struct _ChamplainMapSourcePrivate
 {
   ChamplainMapSource *next_source;
   ChamplainRenderer *renderer;
+  ChamplainMapSourceStats stats;
 };
 
 static void
@@ -225,6 +233,7 @@ champlain_map_source_init (ChamplainMapSource *map_source)
 
   priv->next_source = NULL;
   priv->renderer = NULL;
+  memset (&priv->stats, 0, sizeof (ChamplainMapSourceStats));
 }
 
 
@@ -689,5 +698,228 @@ champlain_map_source_fill_tile (ChamplainMapSource *map_source,
 {
   g_return_if_fail (CHAMPLAIN_IS_MAP_SOURCE (map_source));
 
+  map_source->priv->stats.requests++;
+  _champlain_trace_tile ('n', "fill_tile", G_OBJECT_TYPE_NAME (map_source), tile);
+
   CHAMPLAIN_MAP_SOURCE_GET_CLASS (map_source)->fill_tile (map_source, tile);
 }
+
+
+void
+_champlain_type_set_vfunc (GType type,
+    const gchar *name,
+    gpointer func)
+{
+  g_type_set_qdata (type, g_quark_from_static_string (name), func);
+}
+
+
+gpointer
+_champlain_type_get_vfunc (GType type,
+    const gchar *name)
+{
+  GQuark quark = g_quark_from_static_string (name);
+
+  for (; type != 0; type = g_type_parent (type))
+    {
+      gpointer func = g_type_get_qdata (type, quark);
+
+      if (func)
+        return func;
+    }
+
+  return NULL;
+}
+
+
+/**
+ * champlain_map_source_fill_tiles:
+ * @map_source: a #ChamplainMapSource
+ * @tiles: (array length=n_tiles): the tiles to fill
+ * @n_tiles: the number of tiles
+ *
+ * Fills several tiles at once, like calling champlain_map_source_fill_tile()
+ * on each of them. The view passes all tiles of a viewport update in one
+ * call, ordered from the center of the view, so that map sources supporting
+ * it can serve neighbouring tiles together, e.g. with a single database
+ * query or a single rendering pass. Other map sources fill the tiles one by
+ * one.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_map_source_fill_tiles (ChamplainMapSource *map_source,
+    ChamplainTile **tiles,
+    guint n_tiles)
+{
+  ChamplainFillTilesFunc fill_tiles;
+  guint i;
+
+  g_return_if_fail (CHAMPLAIN_IS_MAP_SOURCE (map_source));
+  g_return_if_fail (tiles != NULL || n_tiles == 0);
+
+  map_source->priv->stats.requests += n_tiles;
+  for (i = 0; i < n_tiles; i++)
+    _champlain_trace_tile ('n', "fill_tile", G_OBJECT_TYPE_NAME (map_source), tiles[i]);
+
+  fill_tiles = (ChamplainFillTilesFunc) _champlain_type_get_vfunc (G_OBJECT_TYPE (map_source), "fill-tiles");
+  if (fill_tiles)
+    fill_tiles (map_source, tiles, n_tiles);
+  else
+    {
+      ChamplainMapSourceClass *klass = CHAMPLAIN_MAP_SOURCE_GET_CLASS (map_source);
+
+      for (i = 0; i < n_tiles; i++)
+        klass->fill_tile (map_source, tiles[i]);
+    }
+}
+
+
+/**
+ * champlain_map_source_class_set_fill_tiles:
+ * @klass: the class of a #ChamplainMapSource subclass
+ * @fill_tiles: the function filling several tiles at once
+ *
+ * Sets the implementation of champlain_map_source_fill_tiles() for the map
+ * sources of the class and its subclasses. To be called from the class
+ * initialization function. The function has to fill all the tiles, like
+ * the fill_tile virtual function does for a single tile.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_map_source_class_set_fill_tiles (ChamplainMapSourceClass *klass,
+    ChamplainFillTilesFunc fill_tiles)
+{
+  g_return_if_fail (CHAMPLAIN_IS_MAP_SOURCE_CLASS (klass));
+
+  _champlain_type_set_vfunc (G_TYPE_FROM_CLASS (klass), "fill-tiles", (gpointer) fill_tiles);
+}
+
+
+/**
+ * champlain_map_source_get_stats:
+ * @map_source: a #ChamplainMapSource
+ * @stats: (out caller-allocates): location to store the statistics
+ *
+ * Gets the tile loading statistics of the map source. The counters are
+ * per source so for a #ChamplainMapSourceChain the statistics of the
+ * individual sources of the chain have to be queried to get e.g. cache
+ * hits of each cache layer.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_map_source_get_stats (ChamplainMapSource *map_source,
+    ChamplainMapSourceStats *stats)
+{
+  g_return_if_fail (CHAMPLAIN_IS_MAP_SOURCE (map_source));
+  g_return_if_fail (stats != NULL);
+
+  *stats = map_source->priv->stats;
+}
+
+
+/**
+ * champlain_map_source_reset_stats:
+ * @map_source: a #ChamplainMapSource
+ *
+ * Resets the tile loading statistics of the map source. The in_flight
+ * counter is kept as it reflects the current state.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_map_source_reset_stats (ChamplainMapSource *map_source)
+{
+  g_return_if_fail (CHAMPLAIN_IS_MAP_SOURCE (map_source));
+
+  guint in_flight = map_source->priv->stats.in_flight;
+
+  memset (&map_source->priv->stats, 0, sizeof (ChamplainMapSourceStats));
+  map_source->priv->stats.in_flight = in_flight;
+}
+
+
+ChamplainMapSourceStats *
+_champlain_map_source_peek_stats (ChamplainMapSource *map_source)
+{
+  return &map_source->priv->stats;
+}
+
+
+/* Pixels around the tile taken into account, features drawn outside of the
+   area of a change (wide lines, labels) may reach into the tile */
+#define AREA_MARGIN 32
+
+gboolean
+_champlain_map_source_tile_in_area (ChamplainMapSource *map_source,
+    guint zoom_level,
+    gint x,
+    gint y,
+    ChamplainBoundingBox *bbox)
+{
+  guint size;
+  gdouble left, right, top, bottom;
+
+  if (!bbox)
+    return TRUE;
+
+  size = champlain_map_source_get_tile_size (map_source);
+  left = champlain_map_source_get_longitude (map_source, zoom_level, (gdouble) x * size - AREA_MARGIN);
+  right = champlain_map_source_get_longitude (map_source, zoom_level, (gdouble) (x + 1) * size + AREA_MARGIN);
+  top = champlain_map_source_get_latitude (map_source, zoom_level, (gdouble) y * size - AREA_MARGIN);
+  bottom = champlain_map_source_get_latitude (map_source, zoom_level, (gdouble) (y + 1) * size + AREA_MARGIN);
+
+  return left <= bbox->right && right >= bbox->left &&
+         bottom <= bbox->top && top >= bbox->bottom;
+}
+
+
+/* Whether a source following @map_source, except for the caches which
+   store what the others rendered, renders with @renderer. Any source
+   matches a NULL renderer. */
+gboolean
+_champlain_map_source_uses_renderer (ChamplainMapSource *map_source,
+    ChamplainRenderer *renderer)
+{
+  if (!renderer)
+    return TRUE;
+
+  for (; map_source; map_source = champlain_map_source_get_next_source (map_source))
+    {
+      if (!CHAMPLAIN_IS_TILE_CACHE (map_source) &&
+          champlain_map_source_get_renderer (map_source) == renderer)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+
+void
+_champlain_map_source_stats_render_begin (ChamplainMapSource *map_source,
+    ChamplainTile *tile)
+{
+  gint64 *start = g_new (gint64, 1);
+
+  *start = g_get_monotonic_time ();
+  g_object_set_data_full (G_OBJECT (tile), "render-start", start, g_free);
+  _champlain_trace_tile ('b', "render", G_OBJECT_TYPE_NAME (map_source), tile);
+}
+
+
+void
+_champlain_map_source_stats_render_end (ChamplainMapSource *map_source,
+    ChamplainTile *tile)
+{
+  gint64 *start = g_object_get_data (G_OBJECT (tile), "render-start");
+
+  if (!start)
+    return;
+
+  map_source->priv->stats.decodes++;
+  map_source->priv->stats.decode_time += g_get_monotonic_time () - *start;
+  g_object_set_data (G_OBJECT (tile), "render-start", NULL);
+  _champlain_trace_tile ('e', "render", G_OBJECT_TYPE_NAME (map_source), tile);
+}
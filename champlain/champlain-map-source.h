@@ -61,6 +61,42 @@ typedef enum
   CHAMPLAIN_MAP_PROJECTION_MERCATOR
 } ChamplainMapProjection;
 
+/**
+ * ChamplainMapSourceStats:
+ * @requests: number of tiles requested from the map source
+ * @cancelled: number of tile loads cancelled because the tile was no longer needed
+ * @failures: number of tiles the map source failed to load and passed on
+ * @cache_hits: number of tiles found in the cache (cache sources only)
+ * @cache_misses: number of tiles not found in the cache (cache sources only)
+ * @bytes_downloaded: number of bytes downloaded (network sources only)
+ * @decodes: number of tiles rendered by the renderer of the map source
+ * @decode_time: total time in microseconds between handing data to the
+ * renderer and the tile being rendered
+ * @in_flight: number of tile loads currently in progress
+ * @hedged: number of slow downloads duplicated to a mirror (network sources)
+ * or slow reads raced against the next source (file caches)
+ * @hedge_wins: number of hedged loads the mirror or the next source
+ * answered first
+ *
+ * Tile loading statistics of a map source, see champlain_map_source_get_stats().
+ *
+ * Since: 0.12.15
+ */
+typedef struct
+{
+  guint requests;
+  guint cancelled;
+  guint failures;
+  guint cache_hits;
+  guint cache_misses;
+  guint64 bytes_downloaded;
+  guint decodes;
+  guint64 decode_time;
+  guint in_flight;
+  guint hedged;
+  guint hedge_wins;
+} ChamplainMapSourceStats;
+
 /**
  * ChamplainMapSource:
  *
@@ -76,6 +112,21 @@ struct _ChamplainMapSource
   ChamplainMapSourcePrivate *priv;
 };
 
+/**
+ * ChamplainFillTilesFunc:
+ * @map_source: a #ChamplainMapSource
+ * @tiles: (array length=n_tiles): the tiles to fill
+ * @n_tiles: the number of tiles
+ *
+ * Fills several tiles at once, see champlain_map_source_fill_tiles() and
+ * champlain_map_source_class_set_fill_tiles().
+ *
+ * Since: 0.12.15
+ */
+typedef void (*ChamplainFillTilesFunc) (ChamplainMapSource *map_source,
+    ChamplainTile **tiles,
+    guint n_tiles);
+
 struct _ChamplainMapSourceClass
 {
   GInitiallyUnownedClass parent_class;
@@ -135,6 +186,15 @@ gdouble champlain_map_source_get_meters_per_pixel (ChamplainMapSource *map_sourc
 
 void champlain_map_source_fill_tile (ChamplainMapSource *map_source,
     ChamplainTile *tile);
+void champlain_map_source_fill_tiles (ChamplainMapSource *map_source,
+    ChamplainTile **tiles,
+    guint n_tiles);
+void champlain_map_source_class_set_fill_tiles (ChamplainMapSourceClass *klass,
+    ChamplainFillTilesFunc fill_tiles);
+
+void champlain_map_source_get_stats (ChamplainMapSource *map_source,
+    ChamplainMapSourceStats *stats);
+void champlain_map_source_reset_stats (ChamplainMapSource *map_source);
 
 G_END_DECLS
 
@@ -30,8 +30,11 @@
 #include "champlain-debug.h"
 
 #include "champlain-memory-cache.h"
+#include "champlain-private.h"
+#include "champlain-bench-private.h"
 
 #include <glib.h>
+#include <stdio.h>
 #include <string.h>
 
 G_DEFINE_TYPE (ChamplainMemoryCache, champlain_memory_cache, CHAMPLAIN_TYPE_TILE_CACHE);
@@ -62,6 +65,9 @@ typedef struct
 
 static void fill_tile (ChamplainMapSource *map_source,
     ChamplainTile *tile);
+static void fill_tiles (ChamplainMapSource *map_source,
+    ChamplainTile **tiles,
+    guint n_tiles);
 
 static void store_tile (ChamplainTileCache *tile_cache,
     ChamplainTile *tile,
@@ -71,6 +77,10 @@ static void refresh_tile_time (ChamplainTileCache *tile_cache,
     ChamplainTile *tile);
 static void on_tile_filled (ChamplainTileCache *tile_cache,
     ChamplainTile *tile);
+static void invalidate_area (ChamplainTileCache *tile_cache,
+    ChamplainBoundingBox *bbox);
+static void delete_queue_member (QueueMember *member,
+    gpointer user_data);
 
 
 static void
@@ -167,8 +177,10 @@ champlain_memory_cache_class_init (ChamplainMemoryCacheClass *klass)
   tile_cache_class->store_tile = store_tile;
   tile_cache_class->refresh_tile_time = refresh_tile_time;
   tile_cache_class->on_tile_filled = on_tile_filled;
+  _champlain_type_set_vfunc (G_OBJECT_CLASS_TYPE (klass), "invalidate-area", (gpointer) invalidate_area);
 
   map_source_class->fill_tile = fill_tile;
+  champlain_map_source_class_set_fill_tiles (map_source_class, fill_tiles);
 }
 
 
@@ -198,6 +210,30 @@ champlain_memory_cache_new_full (guint size_limit,
 }
 
 
+static void
+trim_memory (GObject *object,
+    ChamplainTrimLevel level)
+{
+  ChamplainMemoryCachePrivate *priv = CHAMPLAIN_MEMORY_CACHE (object)->priv;
+  guint keep;
+
+  if (level < CHAMPLAIN_TRIM_LEVEL_LOW)
+    return;
+
+  keep = level == CHAMPLAIN_TRIM_LEVEL_CRITICAL ? 0 : priv->queue->length / 2;
+  DEBUG ("Trimming memory cache from %u to %u tiles", priv->queue->length, keep);
+
+  /* The least recently used tiles are at the tail */
+  while (priv->queue->length > keep)
+    {
+      QueueMember *member = g_queue_pop_tail (priv->queue);
+
+      g_hash_table_remove (priv->hash_table, member->key);
+      delete_queue_member (member, NULL);
+    }
+}
+
+
 static void
 champlain_memory_cache_init (ChamplainMemoryCache *memory_cache)
 {
@@ -207,6 +243,8 @@ champlain_memory_cache_init (ChamplainMemoryCache *memory_cache)
 
   priv->queue = g_queue_new ();
   priv->hash_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  _champlain_memory_usage_add_trim_handler (G_OBJECT (memory_cache), trim_memory);
 }
 
 
@@ -270,6 +308,14 @@ generate_queue_key (ChamplainMemoryCache *memory_cache,
 }
 
 
+gchar *
+_champlain_memory_cache_generate_key (ChamplainMemoryCache *memory_cache,
+    ChamplainTile *tile)
+{
+  return generate_queue_key (memory_cache, tile);
+}
+
+
 static void
 move_queue_member_to_head (GQueue *queue, GList *link)
 {
@@ -283,6 +329,7 @@ delete_queue_member (QueueMember *member, gpointer user_data)
 {
   if (member)
     {
+      _champlain_memory_usage_add (CHAMPLAIN_MEMORY_CATEGORY_MEMORY_CACHE, -(gssize) member->size);
       g_free (member->key);
       g_free (member->data);
       g_slice_free (QueueMember, member);
@@ -300,6 +347,7 @@ tile_rendered_cb (ChamplainTile *tile,
   ChamplainMapSource *next_source;
 
   g_signal_handlers_disconnect_by_func (tile, tile_rendered_cb, map_source);
+  _champlain_map_source_stats_render_end (map_source, tile);
 
   next_source = champlain_map_source_get_next_source (map_source);
 
@@ -312,7 +360,7 @@ tile_rendered_cb (ChamplainTile *tile,
       champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
       champlain_tile_display_content (tile);
     }
-  else if (next_source)
+  else if (next_source && !champlain_tile_is_cancelled (tile))
     champlain_map_source_fill_tile (next_source, tile);
 
   g_object_unref (map_source);
@@ -320,17 +368,14 @@ tile_rendered_cb (ChamplainTile *tile,
 }
 
 
-static void
-fill_tile (ChamplainMapSource *map_source,
+/* Renders the tile when it is cached, returns FALSE when it has to be
+ * passed on to the next source */
+static gboolean
+fill_cached_tile (ChamplainMapSource *map_source,
     ChamplainTile *tile)
 {
-  g_return_if_fail (CHAMPLAIN_IS_MEMORY_CACHE (map_source));
-  g_return_if_fail (CHAMPLAIN_IS_TILE (tile));
-
-  ChamplainMapSource *next_source = champlain_map_source_get_next_source (map_source);
-
-  if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_DONE)
-    return;
+  if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_DONE || champlain_tile_is_cancelled (tile))
+    return TRUE;
 
   if (champlain_tile_get_state (tile) != CHAMPLAIN_STATE_LOADED)
     {
@@ -347,11 +392,12 @@ fill_tile (ChamplainMapSource *map_source,
         {
           QueueMember *member = link->data;
 
+          _champlain_map_source_peek_stats (map_source)->cache_hits++;
           move_queue_member_to_head (priv->queue, link);
 
           renderer = champlain_map_source_get_renderer (map_source);
 
-          g_return_if_fail (CHAMPLAIN_IS_RENDERER (renderer));
+          g_return_val_if_fail (CHAMPLAIN_IS_RENDERER (renderer), TRUE);
 
           g_object_ref (map_source);
           g_object_ref (tile);
@@ -359,15 +405,23 @@ fill_tile (ChamplainMapSource *map_source,
           g_signal_connect (tile, "render-complete", G_CALLBACK (tile_rendered_cb), map_source);
 
           champlain_renderer_set_data (renderer, member->data, member->size);
+          _champlain_map_source_stats_render_begin (map_source, tile);
           champlain_renderer_render (renderer, tile);
 
-          return;
+          return TRUE;
         }
+
+      _champlain_map_source_peek_stats (map_source)->cache_misses++;
     }
 
-  if (CHAMPLAIN_IS_MAP_SOURCE (next_source))
-    champlain_map_source_fill_tile (next_source, tile);
-  else if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_LOADED)
+  return FALSE;
+}
+
+
+static void
+display_loaded_tile (ChamplainTile *tile)
+{
+  if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_LOADED)
     {
       /* if we have some content, use the tile even if it wasn't validated */
       champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
@@ -376,6 +430,57 @@ fill_tile (ChamplainMapSource *map_source,
 }
 
 
+static void
+fill_tile (ChamplainMapSource *map_source,
+    ChamplainTile *tile)
+{
+  g_return_if_fail (CHAMPLAIN_IS_MEMORY_CACHE (map_source));
+  g_return_if_fail (CHAMPLAIN_IS_TILE (tile));
+
+  ChamplainMapSource *next_source = champlain_map_source_get_next_source (map_source);
+
+  if (fill_cached_tile (map_source, tile))
+    return;
+
+  if (CHAMPLAIN_IS_MAP_SOURCE (next_source))
+    champlain_map_source_fill_tile (next_source, tile);
+  else
+    display_loaded_tile (tile);
+}
+
+
+/* The tiles missing from the cache are passed on in one batch */
+static void
+fill_tiles (ChamplainMapSource *map_source,
+    ChamplainTile **tiles,
+    guint n_tiles)
+{
+  g_return_if_fail (CHAMPLAIN_IS_MEMORY_CACHE (map_source));
+
+  ChamplainMapSource *next_source = champlain_map_source_get_next_source (map_source);
+  ChamplainTile **misses = g_newa (ChamplainTile *, n_tiles);
+  guint n_misses = 0;
+  guint i;
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      if (!fill_cached_tile (map_source, tiles[i]))
+        misses[n_misses++] = tiles[i];
+    }
+
+  if (n_misses == 0)
+    return;
+
+  if (CHAMPLAIN_IS_MAP_SOURCE (next_source))
+    champlain_map_source_fill_tiles (next_source, misses, n_misses);
+  else
+    {
+      for (i = 0; i < n_misses; i++)
+        display_loaded_tile (misses[i]);
+    }
+}
+
+
 static void
 store_tile (ChamplainTileCache *tile_cache,
     ChamplainTile *tile,
@@ -413,6 +518,7 @@ store_tile (ChamplainTileCache *tile_cache,
       member->key = key;
       member->data = g_memdup (contents, size);
       member->size = size;
+      _champlain_memory_usage_add (CHAMPLAIN_MEMORY_CATEGORY_MEMORY_CACHE, size);
 
       g_queue_push_head (priv->queue, member);
       g_hash_table_insert (priv->hash_table, g_strdup (key), g_queue_peek_head_link (priv->queue));
@@ -457,6 +563,33 @@ champlain_memory_cache_clean (ChamplainMemoryCache *memory_cache)
 }
 
 
+static void
+invalidate_area (ChamplainTileCache *tile_cache,
+    ChamplainBoundingBox *bbox)
+{
+  ChamplainMemoryCachePrivate *priv = CHAMPLAIN_MEMORY_CACHE (tile_cache)->priv;
+  GList *link = priv->queue->head;
+
+  while (link)
+    {
+      QueueMember *member = link->data;
+      GList *next = link->next;
+      guint zoom_level;
+      gint x, y;
+
+      if (sscanf (member->key, "%u/%d/%d/", &zoom_level, &x, &y) == 3 &&
+          _champlain_map_source_tile_in_area (CHAMPLAIN_MAP_SOURCE (tile_cache), zoom_level, x, y, bbox))
+        {
+          g_queue_delete_link (priv->queue, link);
+          g_hash_table_remove (priv->hash_table, member->key);
+          delete_queue_member (member, NULL);
+        }
+
+      link = next;
+    }
+}
+
+
 static void
 on_tile_filled (ChamplainTileCache *tile_cache,
     ChamplainTile *tile)
@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2010-2013 Jiri Techet <techet@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:champlain-memory-usage
+ * @short_description: Memory accounting of the library subsystems
+ *
+ * The library keeps track of the number of bytes held by its main memory
+ * consumers, see #ChamplainMemoryCategory. The numbers are computed from
+ * the sizes of the allocated buffers, textures are assumed to use 4 bytes
+ * per pixel.
+ *
+ * The current numbers can be obtained with champlain_memory_usage_get() or
+ * logged with champlain_memory_usage_dump(). When the
+ * CHAMPLAIN_MEMORY_DUMP environment variable is set to a number of seconds
+ * before the first #ChamplainView is created, the numbers are logged
+ * periodically.
+ *
+ * Memory caches, decoded frames and tiles of the views can be released
+ * with champlain_trim_memory(). With GLib 2.64 or newer this happens
+ * automatically when #GMemoryMonitor reports low memory.
+ */
+
+#include "config.h"
+
+#define DEBUG_FLAG CHAMPLAIN_DEBUG_CACHE
+#include "champlain-debug.h"
+
+#include "champlain-memory-usage.h"
+#include "champlain-private.h"
+
+#include <stdlib.h>
+#include <gio/gio.h>
+
+G_LOCK_DEFINE_STATIC (usage);
+
+static gsize usage[CHAMPLAIN_MEMORY_CATEGORY_LAST] = { 0, };
+
+static const gchar *category_names[CHAMPLAIN_MEMORY_CATEGORY_LAST] = {
+  "tile surfaces",
+  "tile textures",
+  "memory cache",
+  "file cache",
+  "path canvases",
+  "label canvases",
+  "point canvases",
+  "map data",
+};
+
+static cairo_user_data_key_t surface_key;
+
+typedef struct
+{
+  ChamplainMemoryCategory category;
+  gsize bytes;
+} TrackedObject;
+
+typedef struct
+{
+  GObject *object;
+  ChamplainTrimFunc func;
+} TrimHandler;
+
+/* Only accessed from the main thread */
+static GList *trim_handlers = NULL;
+
+
+/**
+ * champlain_memory_usage_get:
+ * @category: a #ChamplainMemoryCategory
+ *
+ * Gets the number of bytes currently used by the given subsystem.
+ *
+ * Returns: the number of bytes.
+ *
+ * Since: 0.12.15
+ */
+gsize
+champlain_memory_usage_get (ChamplainMemoryCategory category)
+{
+  gsize bytes;
+
+  g_return_val_if_fail (category < CHAMPLAIN_MEMORY_CATEGORY_LAST, 0);
+
+  G_LOCK (usage);
+  bytes = usage[category];
+  G_UNLOCK (usage);
+
+  return bytes;
+}
+
+
+/**
+ * champlain_memory_usage_get_total:
+ *
+ * Gets the number of bytes currently used by all accounted subsystems.
+ *
+ * Returns: the number of bytes.
+ *
+ * Since: 0.12.15
+ */
+gsize
+champlain_memory_usage_get_total (void)
+{
+  gsize total = 0;
+  gint i;
+
+  G_LOCK (usage);
+  for (i = 0; i < CHAMPLAIN_MEMORY_CATEGORY_LAST; i++)
+    total += usage[i];
+  G_UNLOCK (usage);
+
+  return total;
+}
+
+
+/**
+ * champlain_memory_usage_dump:
+ *
+ * Logs the memory usage of all accounted subsystems using g_message().
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_memory_usage_dump (void)
+{
+  gsize snapshot[CHAMPLAIN_MEMORY_CATEGORY_LAST];
+  gsize total = 0;
+  gint i;
+
+  G_LOCK (usage);
+  for (i = 0; i < CHAMPLAIN_MEMORY_CATEGORY_LAST; i++)
+    {
+      snapshot[i] = usage[i];
+      total += usage[i];
+    }
+  G_UNLOCK (usage);
+
+  g_message ("libchamplain memory usage: %" G_GSIZE_FORMAT " kB", total / 1024);
+  for (i = 0; i < CHAMPLAIN_MEMORY_CATEGORY_LAST; i++)
+    g_message ("  %-16s %10" G_GSIZE_FORMAT " kB", category_names[i], snapshot[i] / 1024);
+}
+
+
+static gboolean
+dump_timeout_cb (G_GNUC_UNUSED gpointer data)
+{
+  champlain_memory_usage_dump ();
+  return TRUE;
+}
+
+
+void
+_champlain_memory_usage_init_from_env (void)
+{
+  static gboolean initialized = FALSE;
+  const gchar *interval;
+
+  if (initialized)
+    return;
+  initialized = TRUE;
+
+  interval = g_getenv ("CHAMPLAIN_MEMORY_DUMP");
+  if (interval && atoi (interval) > 0)
+    g_timeout_add_seconds (atoi (interval), dump_timeout_cb, NULL);
+}
+
+
+void
+_champlain_memory_usage_add (ChamplainMemoryCategory category,
+    gssize bytes)
+{
+  G_LOCK (usage);
+  usage[category] += bytes;
+  G_UNLOCK (usage);
+}
+
+
+static void
+tracked_surface_destroyed (TrackedObject *tracked)
+{
+  _champlain_memory_usage_add (tracked->category, -(gssize) tracked->bytes);
+  g_slice_free (TrackedObject, tracked);
+}
+
+
+/* Accounts the surface until it is destroyed; surfaces shared by several
+   owners are accounted only once */
+void
+_champlain_memory_usage_track_surface (cairo_surface_t *surface,
+    ChamplainMemoryCategory category)
+{
+  TrackedObject *tracked;
+
+  if (!surface || cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE)
+    return;
+
+  if (cairo_surface_get_user_data (surface, &surface_key))
+    return;
+
+  tracked = g_slice_new (TrackedObject);
+  tracked->category = category;
+  tracked->bytes = cairo_image_surface_get_stride (surface) *
+    cairo_image_surface_get_height (surface);
+
+  if (cairo_surface_set_user_data (surface, &surface_key, tracked,
+          (cairo_destroy_func_t) tracked_surface_destroyed) != CAIRO_STATUS_SUCCESS)
+    {
+      g_slice_free (TrackedObject, tracked);
+      return;
+    }
+
+  _champlain_memory_usage_add (category, tracked->bytes);
+}
+
+
+static void
+tracked_object_finalized (TrackedObject *tracked,
+    G_GNUC_UNUSED GObject *where_the_object_was)
+{
+  _champlain_memory_usage_add (tracked->category, -(gssize) tracked->bytes);
+  g_slice_free (TrackedObject, tracked);
+}
+
+
+/* Accounts bytes until the object is finalized */
+void
+_champlain_memory_usage_track_object (GObject *object,
+    ChamplainMemoryCategory category,
+    gsize bytes)
+{
+  TrackedObject *tracked = g_slice_new (TrackedObject);
+
+  tracked->category = category;
+  tracked->bytes = bytes;
+  _champlain_memory_usage_add (category, bytes);
+
+  g_object_weak_ref (object, (GWeakNotify) tracked_object_finalized, tracked);
+}
+
+
+static void
+canvas_size_changed (ClutterCanvas *canvas,
+    G_GNUC_UNUSED GParamSpec *pspec,
+    TrackedObject *tracked)
+{
+  gint width, height;
+  gsize bytes;
+
+  g_object_get (canvas, "width", &width, "height", &height, NULL);
+  bytes = (gsize) MAX (width, 0) * MAX (height, 0) * 4;
+
+  _champlain_memory_usage_add (tracked->category, (gssize) bytes - (gssize) tracked->bytes);
+  tracked->bytes = bytes;
+}
+
+
+/* Accounts the canvas texture, following its size changes, until the
+   canvas is finalized */
+void
+_champlain_memory_usage_track_canvas (ClutterContent *canvas,
+    ChamplainMemoryCategory category)
+{
+  TrackedObject *tracked = g_slice_new (TrackedObject);
+
+  tracked->category = category;
+  tracked->bytes = 0;
+
+  g_object_weak_ref (G_OBJECT (canvas), (GWeakNotify) tracked_object_finalized, tracked);
+  g_signal_connect (canvas, "notify::width", G_CALLBACK (canvas_size_changed), tracked);
+  g_signal_connect (canvas, "notify::height", G_CALLBACK (canvas_size_changed), tracked);
+
+  canvas_size_changed (CLUTTER_CANVAS (canvas), NULL, tracked);
+}
+
+
+/**
+ * champlain_trim_memory:
+ * @level: a #ChamplainTrimLevel
+ *
+ * Releases memory held by the memory caches, map sources and views. The
+ * released data is loaded again when needed. After
+ * %CHAMPLAIN_TRIM_LEVEL_CRITICAL, champlain_view_to_surface() returns %NULL
+ * until the view loads new tiles.
+ *
+ * Applications should call this function when they are notified about low
+ * memory by the platform. With GLib 2.64 or newer the library reacts to
+ * #GMemoryMonitor by itself.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_trim_memory (ChamplainTrimLevel level)
+{
+  GList *handlers, *iter;
+  gsize before = champlain_memory_usage_get_total ();
+
+  g_return_if_fail (level <= CHAMPLAIN_TRIM_LEVEL_CRITICAL);
+
+  /* A handler may release the last reference of another registered object */
+  handlers = g_list_copy (trim_handlers);
+  for (iter = handlers; iter; iter = iter->next)
+    g_object_ref (((TrimHandler *) iter->data)->object);
+
+  for (iter = handlers; iter; iter = iter->next)
+    {
+      TrimHandler *handler = iter->data;
+      GObject *object = handler->object;
+
+      handler->func (object, level);
+      g_object_unref (object);
+    }
+  g_list_free (handlers);
+
+  DEBUG ("Trimmed memory at level %d: %" G_GSIZE_FORMAT " kB -> %" G_GSIZE_FORMAT " kB",
+      level, before / 1024, champlain_memory_usage_get_total () / 1024);
+}
+
+
+#if GLIB_CHECK_VERSION (2, 64, 0)
+static void
+low_memory_warning_cb (G_GNUC_UNUSED GMemoryMonitor *monitor,
+    GMemoryMonitorWarningLevel warning_level,
+    G_GNUC_UNUSED gpointer data)
+{
+  if (warning_level >= G_MEMORY_MONITOR_WARNING_LEVEL_CRITICAL)
+    champlain_trim_memory (CHAMPLAIN_TRIM_LEVEL_CRITICAL);
+  else if (warning_level >= G_MEMORY_MONITOR_WARNING_LEVEL_MEDIUM)
+    champlain_trim_memory (CHAMPLAIN_TRIM_LEVEL_LOW);
+  else
+    champlain_trim_memory (CHAMPLAIN_TRIM_LEVEL_MODERATE);
+}
+#endif
+
+
+static void
+trim_handler_object_finalized (TrimHandler *handler,
+    G_GNUC_UNUSED GObject *where_the_object_was)
+{
+  trim_handlers = g_list_remove (trim_handlers, handler);
+  g_slice_free (TrimHandler, handler);
+}
+
+
+void
+_champlain_memory_usage_add_trim_handler (GObject *object,
+    ChamplainTrimFunc func)
+{
+  TrimHandler *handler;
+
+#if GLIB_CHECK_VERSION (2, 64, 0)
+  static GMemoryMonitor *monitor = NULL;
+
+  /* Kept for the lifetime of the process */
+  if (!monitor)
+    {
+      monitor = g_memory_monitor_dup_default ();
+      g_signal_connect (monitor, "low-memory-warning",
+          G_CALLBACK (low_memory_warning_cb), NULL);
+    }
+#endif
+
+  handler = g_slice_new (TrimHandler);
+  handler->object = object;
+  handler->func = func;
+  trim_handlers = g_list_prepend (trim_handlers, handler);
+
+  g_object_weak_ref (object, (GWeakNotify) trim_handler_object_finalized, handler);
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2010-2013 Jiri Techet <techet@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#if !defined (__CHAMPLAIN_CHAMPLAIN_H_INSIDE__) && !defined (CHAMPLAIN_COMPILATION)
+#error "Only <champlain/champlain.h> can be included directly."
+#endif
+
+#ifndef _CHAMPLAIN_MEMORY_USAGE_H_
+#define _CHAMPLAIN_MEMORY_USAGE_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ChamplainMemoryCategory:
+ * @CHAMPLAIN_MEMORY_CATEGORY_TILE_SURFACES: decoded cairo surfaces of tiles
+ * @CHAMPLAIN_MEMORY_CATEGORY_TILE_TEXTURES: textures of the tile content actors
+ * @CHAMPLAIN_MEMORY_CATEGORY_MEMORY_CACHE: tile data stored in #ChamplainMemoryCache
+ * @CHAMPLAIN_MEMORY_CATEGORY_FILE_CACHE: tile data read by #ChamplainFileCache
+ * waiting to be rendered
+ * @CHAMPLAIN_MEMORY_CATEGORY_PATH_CANVASES: canvases of #ChamplainPathLayer
+ * @CHAMPLAIN_MEMORY_CATEGORY_LABEL_CANVASES: canvases of #ChamplainLabel
+ * @CHAMPLAIN_MEMORY_CATEGORY_POINT_CANVASES: canvases of #ChamplainPoint
+ * @CHAMPLAIN_MEMORY_CATEGORY_MAP_DATA: map data kept by renderers to apply
+ * updates
+ * @CHAMPLAIN_MEMORY_CATEGORY_LAST: the number of categories
+ *
+ * Subsystems whose memory consumption is accounted by the library.
+ *
+ * Since: 0.12.15
+ */
+typedef enum
+{
+  CHAMPLAIN_MEMORY_CATEGORY_TILE_SURFACES,
+  CHAMPLAIN_MEMORY_CATEGORY_TILE_TEXTURES,
+  CHAMPLAIN_MEMORY_CATEGORY_MEMORY_CACHE,
+  CHAMPLAIN_MEMORY_CATEGORY_FILE_CACHE,
+  CHAMPLAIN_MEMORY_CATEGORY_PATH_CANVASES,
+  CHAMPLAIN_MEMORY_CATEGORY_LABEL_CANVASES,
+  CHAMPLAIN_MEMORY_CATEGORY_POINT_CANVASES,
+  CHAMPLAIN_MEMORY_CATEGORY_MAP_DATA,
+  CHAMPLAIN_MEMORY_CATEGORY_LAST
+} ChamplainMemoryCategory;
+
+/**
+ * ChamplainTrimLevel:
+ * @CHAMPLAIN_TRIM_LEVEL_MODERATE: drop data loaded or kept in advance, such as
+ * prefetched frames and the tiles of the previous zoom level
+ * @CHAMPLAIN_TRIM_LEVEL_LOW: additionally shrink the memory caches
+ * @CHAMPLAIN_TRIM_LEVEL_CRITICAL: additionally empty the memory caches and
+ * release the surfaces of the displayed tiles
+ *
+ * How much memory champlain_trim_memory() should release. Every level
+ * includes the actions of the lower levels.
+ *
+ * Since: 0.12.15
+ */
+typedef enum
+{
+  CHAMPLAIN_TRIM_LEVEL_MODERATE,
+  CHAMPLAIN_TRIM_LEVEL_LOW,
+  CHAMPLAIN_TRIM_LEVEL_CRITICAL
+} ChamplainTrimLevel;
+
+gsize champlain_memory_usage_get (ChamplainMemoryCategory category);
+gsize champlain_memory_usage_get_total (void);
+void champlain_memory_usage_dump (void);
+
+void champlain_trim_memory (ChamplainTrimLevel level);
+
+G_END_DECLS
+
+#endif /* _CHAMPLAIN_MEMORY_USAGE_H_ */
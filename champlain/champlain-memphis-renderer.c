@@ -31,6 +31,11 @@
  * (TODO: link to the specification) The default rules only show
  * highways as thin black lines.
  * Once loaded, rules can be queried and edited.
+ *
+ * Changes of the map data can be applied with
+ * champlain_memphis_renderer_update_data() without reloading the whole
+ * data set once enabled by champlain_memphis_renderer_set_updates_enabled(). The renderer emits #ChamplainRenderer::area-changed with the
+ * area affected by every change of the data or of the rules.
  */
 
 
@@ -43,6 +48,7 @@
 #include "champlain-private.h"
 #include "champlain-memphis-renderer.h"
 #include "champlain-bounding-box.h"
+#include "champlain-memory-usage.h"
 
 #include <gdk/gdk.h>
 
@@ -76,6 +82,40 @@ static void set_data (ChamplainRenderer *renderer,
 static void set_bounding_box (ChamplainMemphisRenderer *renderer,
     ChamplainBoundingBox *bbox);
 
+typedef enum
+{
+  OSM_NODE,
+  OSM_WAY,
+  OSM_RELATION,
+  OSM_N_TYPES
+} OsmType;
+
+static const gchar *osm_type_names[OSM_N_TYPES] = { "node", "way", "relation" };
+
+typedef struct
+{
+  OsmType type;
+  gchar *id;
+  /* the element serialized back to XML, including its children */
+  GString *xml;
+  gdouble lat;
+  gdouble lon;
+  /* alternating tag keys and values */
+  GPtrArray *tags;
+  /* the ids of the nodes of a way; the members of a relation prefixed
+   * with the first letter of their type */
+  GPtrArray *refs;
+  gboolean deleted;
+} OsmElement;
+
+/* The map data indexed by element id, used to merge updates as libmemphis
+ * can only load complete data sets */
+typedef struct
+{
+  GHashTable *elements[OSM_N_TYPES];
+  gchar *bounds;
+} OsmIndex;
+
 
 G_DEFINE_TYPE (ChamplainMemphisRenderer, champlain_memphis_renderer, CHAMPLAIN_TYPE_RENDERER)
 
@@ -89,6 +129,15 @@ struct _ChamplainMemphisRendererPrivate
   GThreadPool *thpool;
   guint tile_size;
   ChamplainBoundingBox *bbox;
+
+  /* the last data passed to set_data () when updates are enabled, indexed
+     on the first update */
+  gboolean updates_enabled;
+  /* data was set, it can't be indexed when neither of the two is kept */
+  gboolean has_data;
+  gchar *raw_data;
+  guint raw_size;
+  OsmIndex *index;
 };
 
 typedef struct _WorkerThreadData WorkerThreadData;
@@ -102,6 +151,8 @@ struct _WorkerThreadData
 
   ChamplainRenderer *renderer;
   ChamplainTile *tile;
+  /* the worker thread must not touch the tile, it checks this instead */
+  GCancellable *cancellable;
   cairo_surface_t *cst;
 };
 
@@ -120,6 +171,48 @@ static void memphis_worker_thread (gpointer data,
     gpointer user_data);
 
 
+static void
+osm_element_free (OsmElement *element)
+{
+  g_free (element->id);
+  g_string_free (element->xml, TRUE);
+  g_ptr_array_free (element->tags, TRUE);
+  g_ptr_array_free (element->refs, TRUE);
+  g_slice_free (OsmElement, element);
+}
+
+
+static OsmIndex *
+osm_index_new (void)
+{
+  OsmIndex *index = g_slice_new (OsmIndex);
+  gint i;
+
+  /* the keys are owned by the elements */
+  for (i = 0; i < OSM_N_TYPES; i++)
+    index->elements[i] = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+          (GDestroyNotify) osm_element_free);
+  index->bounds = NULL;
+
+  return index;
+}
+
+
+static void
+osm_index_free (OsmIndex *index)
+{
+  gint i;
+
+  if (!index)
+    return;
+
+  for (i = 0; i < OSM_N_TYPES; i++)
+    g_hash_table_destroy (index->elements[i]);
+  g_free (index->bounds);
+  g_slice_free (OsmIndex, index);
+}
+
+
 static void
 champlain_memphis_renderer_get_property (GObject *object,
     guint property_id,
@@ -194,6 +287,24 @@ champlain_memphis_renderer_dispose (GObject *object)
 }
 
 
+/* The copy of the data is accounted as it can be as large as the data
+ * loaded by memphis */
+static void
+set_raw_data (ChamplainMemphisRenderer *renderer,
+    const gchar *data,
+    guint size)
+{
+  ChamplainMemphisRendererPrivate *priv = renderer->priv;
+
+  _champlain_memory_usage_add (CHAMPLAIN_MEMORY_CATEGORY_MAP_DATA, -(gssize) priv->raw_size);
+  g_free (priv->raw_data);
+
+  priv->raw_data = data ? g_memdup (data, size) : NULL;
+  priv->raw_size = data ? size : 0;
+  _champlain_memory_usage_add (CHAMPLAIN_MEMORY_CATEGORY_MAP_DATA, priv->raw_size);
+}
+
+
 static void
 champlain_memphis_renderer_finalize (GObject *object)
 {
@@ -201,6 +312,8 @@ champlain_memphis_renderer_finalize (GObject *object)
   ChamplainMemphisRendererPrivate *priv = renderer->priv;
 
   champlain_bounding_box_free (priv->bbox);
+  set_raw_data (renderer, NULL, 0);
+  osm_index_free (priv->index);
 
   G_OBJECT_CLASS (champlain_memphis_renderer_parent_class)->finalize (object);
 }
@@ -266,6 +379,11 @@ champlain_memphis_renderer_init (ChamplainMemphisRenderer *renderer)
         MAX_THREADS, FALSE, NULL);
 
   priv->bbox = NULL;
+  priv->updates_enabled = FALSE;
+  priv->has_data = FALSE;
+  priv->raw_data = NULL;
+  priv->raw_size = 0;
+  priv->index = NULL;
 }
 
 
@@ -319,6 +437,7 @@ tile_loaded_cb (gpointer worker_data)
   gsize buffer_size;
   ClutterContent *content;
 
+  g_object_unref (data->cancellable);
   g_slice_free (WorkerThreadData, data);
 
   if (!tile)
@@ -327,7 +446,7 @@ tile_loaded_cb (gpointer worker_data)
       goto finish;
     }
 
-  if (!cst)
+  if (!cst || champlain_tile_is_cancelled (tile))
     goto finish;
 
   /* modify directly the buffer of cairo surface - we don't use it any more
@@ -395,6 +514,13 @@ memphis_worker_thread (gpointer worker_data,
 
   data->cst = NULL;
 
+  if (g_cancellable_is_cancelled (data->cancellable))
+    {
+      DEBUG ("Tile (%d, %d, %d) not needed any more", data->x, data->y, data->z);
+      clutter_threads_add_idle_full (CLUTTER_PRIORITY_REDRAW, tile_loaded_cb, data, NULL);
+      return;
+    }
+
   g_rw_lock_reader_lock (&MemphisLock);
   has_data = memphis_renderer_tile_has_data (renderer->priv->renderer, data->x, data->y, data->z);
   g_rw_lock_reader_unlock (&MemphisLock);
@@ -441,6 +567,7 @@ render (ChamplainRenderer *renderer,
   data->size = priv->tile_size;
   data->tile = tile;
   data->renderer = renderer;
+  data->cancellable = g_object_ref (champlain_tile_get_cancellable (tile));
 
   g_object_ref (tile);
   g_object_ref (renderer);
@@ -450,6 +577,7 @@ render (ChamplainRenderer *renderer,
     {
       g_error ("Thread pool error: %s", error->message);
       g_error_free (error);
+      g_object_unref (data->cancellable);
       g_slice_free (WorkerThreadData, data);
       g_object_unref (renderer);
       g_object_unref (tile);
@@ -457,13 +585,482 @@ render (ChamplainRenderer *renderer,
 }
 
 
+typedef struct
+{
+  GPtrArray *elements;
+  gchar *bounds;
+  OsmElement *current;
+  /* nesting of the children of the current element */
+  guint depth;
+  gboolean in_delete;
+} OsmParser;
+
+
+static void
+append_start_tag (GString *xml,
+    const gchar *element_name,
+    const gchar **attribute_names,
+    const gchar **attribute_values)
+{
+  gint i;
+
+  g_string_append_printf (xml, "<%s", element_name);
+  for (i = 0; attribute_names[i]; i++)
+    {
+      gchar *attribute;
+
+      /* the attributes of osmChange files that memphis does not know */
+      if (strcmp (attribute_names[i], "action") == 0)
+        continue;
+
+      attribute = g_markup_printf_escaped (" %s=\"%s\"", attribute_names[i], attribute_values[i]);
+      g_string_append (xml, attribute);
+      g_free (attribute);
+    }
+  g_string_append_c (xml, '>');
+}
+
+
+static void
+osm_start_element (G_GNUC_UNUSED GMarkupParseContext *context,
+    const gchar *element_name,
+    const gchar **attribute_names,
+    const gchar **attribute_values,
+    gpointer user_data,
+    GError **error)
+{
+  OsmParser *parser = user_data;
+  OsmElement *element = parser->current;
+  gint type, i;
+
+  if (element)
+    {
+      const gchar *k = NULL, *v = NULL, *ref = NULL, *member_type = NULL;
+
+      append_start_tag (element->xml, element_name, attribute_names, attribute_values);
+      parser->depth++;
+
+      for (i = 0; attribute_names[i]; i++)
+        {
+          if (strcmp (attribute_names[i], "k") == 0)
+            k = attribute_values[i];
+          else if (strcmp (attribute_names[i], "v") == 0)
+            v = attribute_values[i];
+          else if (strcmp (attribute_names[i], "ref") == 0)
+            ref = attribute_values[i];
+          else if (strcmp (attribute_names[i], "type") == 0)
+            member_type = attribute_values[i];
+        }
+
+      if (strcmp (element_name, "tag") == 0 && k && v)
+        {
+          g_ptr_array_add (element->tags, g_strdup (k));
+          g_ptr_array_add (element->tags, g_strdup (v));
+        }
+      else if (strcmp (element_name, "nd") == 0 && ref)
+        g_ptr_array_add (element->refs, g_strdup (ref));
+      else if (strcmp (element_name, "member") == 0 && ref && member_type)
+        g_ptr_array_add (element->refs, g_strdup_printf ("%c%s", member_type[0], ref));
+      return;
+    }
+
+  if (strcmp (element_name, "delete") == 0)
+    {
+      parser->in_delete = TRUE;
+      return;
+    }
+
+  if (strcmp (element_name, "bounds") == 0)
+    {
+      GString *bounds = g_string_new (NULL);
+
+      append_start_tag (bounds, element_name, attribute_names, attribute_values);
+      g_string_append (bounds, "</bounds>");
+      g_free (parser->bounds);
+      parser->bounds = g_string_free (bounds, FALSE);
+      return;
+    }
+
+  for (type = 0; type < OSM_N_TYPES; type++)
+    if (strcmp (element_name, osm_type_names[type]) == 0)
+      break;
+
+  /* osm, osmChange, create, modify and whatever else wraps the elements */
+  if (type == OSM_N_TYPES)
+    return;
+
+  element = g_slice_new0 (OsmElement);
+  element->type = type;
+  element->xml = g_string_new (NULL);
+  element->tags = g_ptr_array_new_with_free_func (g_free);
+  element->refs = g_ptr_array_new_with_free_func (g_free);
+  element->deleted = parser->in_delete;
+
+  for (i = 0; attribute_names[i]; i++)
+    {
+      const gchar *name = attribute_names[i];
+      const gchar *value = attribute_values[i];
+
+      if (strcmp (name, "id") == 0)
+        element->id = g_strdup (value);
+      else if (strcmp (name, "lat") == 0)
+        element->lat = g_ascii_strtod (value, NULL);
+      else if (strcmp (name, "lon") == 0)
+        element->lon = g_ascii_strtod (value, NULL);
+      else if ((strcmp (name, "action") == 0 && strcmp (value, "delete") == 0) ||
+               (strcmp (name, "visible") == 0 && strcmp (value, "false") == 0))
+        element->deleted = TRUE;
+    }
+
+  if (!element->id)
+    {
+      g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_MISSING_ATTRIBUTE,
+          "Element <%s> has no id", element_name);
+      osm_element_free (element);
+      return;
+    }
+
+  append_start_tag (element->xml, element_name, attribute_names, attribute_values);
+  parser->current = element;
+  parser->depth = 0;
+}
+
+
+static void
+osm_end_element (G_GNUC_UNUSED GMarkupParseContext *context,
+    const gchar *element_name,
+    gpointer user_data,
+    G_GNUC_UNUSED GError **error)
+{
+  OsmParser *parser = user_data;
+  OsmElement *element = parser->current;
+
+  if (!element)
+    {
+      if (strcmp (element_name, "delete") == 0)
+        parser->in_delete = FALSE;
+      return;
+    }
+
+  g_string_append_printf (element->xml, "</%s>", element_name);
+
+  if (parser->depth > 0)
+    parser->depth--;
+  else
+    {
+      g_ptr_array_add (parser->elements, element);
+      parser->current = NULL;
+    }
+}
+
+
+/* Returns the elements of @data in document order, or NULL on error */
+static GPtrArray *
+osm_parse (const gchar *data,
+    guint size,
+    gchar **bounds,
+    GError **error)
+{
+  GMarkupParser markup_parser = { osm_start_element, osm_end_element, NULL, NULL, NULL };
+  GMarkupParseContext *context;
+  OsmParser parser = { NULL, NULL, NULL, 0, FALSE };
+  gboolean success;
+
+  parser.elements = g_ptr_array_new ();
+  context = g_markup_parse_context_new (&markup_parser, 0, &parser, NULL);
+  success = g_markup_parse_context_parse (context, data, size, error) &&
+    g_markup_parse_context_end_parse (context, error);
+  g_markup_parse_context_free (context);
+
+  if (parser.current)
+    osm_element_free (parser.current);
+
+  if (!success)
+    {
+      g_ptr_array_foreach (parser.elements, (GFunc) osm_element_free, NULL);
+      g_ptr_array_free (parser.elements, TRUE);
+      g_free (parser.bounds);
+      return NULL;
+    }
+
+  if (bounds)
+    *bounds = parser.bounds;
+  else
+    g_free (parser.bounds);
+
+  return parser.elements;
+}
+
+
+static OsmElement *
+osm_index_lookup (OsmIndex *index,
+    OsmType type,
+    const gchar *id)
+{
+  return g_hash_table_lookup (index->elements[type], id);
+}
+
+
+static void
+extend_element_area (OsmIndex *index,
+    OsmElement *element,
+    ChamplainBoundingBox *area)
+{
+  guint i;
+
+  if (element->type == OSM_NODE)
+    {
+      champlain_bounding_box_extend (area, element->lat, element->lon);
+      return;
+    }
+
+  for (i = 0; i < element->refs->len; i++)
+    {
+      const gchar *ref = g_ptr_array_index (element->refs, i);
+      OsmElement *member = NULL;
+
+      if (element->type == OSM_WAY)
+        member = osm_index_lookup (index, OSM_NODE, ref);
+      else if (ref[0] == 'n')
+        member = osm_index_lookup (index, OSM_NODE, ref + 1);
+      /* relations of relations are not followed, they may form cycles */
+      else if (ref[0] == 'w')
+        member = osm_index_lookup (index, OSM_WAY, ref + 1);
+
+      if (member)
+        extend_element_area (index, member, area);
+    }
+}
+
+
+/* The ways drawn through a moved node change over their whole length */
+static void
+extend_ways_area (OsmIndex *index,
+    GHashTable *nodes,
+    ChamplainBoundingBox *area)
+{
+  GHashTableIter iter;
+  gpointer value;
+  guint i;
+
+  if (g_hash_table_size (nodes) == 0)
+    return;
+
+  g_hash_table_iter_init (&iter, index->elements[OSM_WAY]);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      OsmElement *way = value;
+
+      for (i = 0; i < way->refs->len; i++)
+        {
+          if (g_hash_table_lookup (nodes, g_ptr_array_index (way->refs, i)))
+            {
+              extend_element_area (index, way, area);
+              break;
+            }
+        }
+    }
+}
+
+
+static gboolean
+ensure_index (ChamplainMemphisRenderer *renderer)
+{
+  ChamplainMemphisRendererPrivate *priv = renderer->priv;
+  GPtrArray *elements;
+  guint i;
+
+  if (priv->index)
+    return TRUE;
+
+  /* the data was set without updates enabled, its copy isn't kept */
+  if (!priv->raw_data && priv->has_data)
+    return FALSE;
+
+  priv->index = osm_index_new ();
+  if (!priv->raw_data)
+    return TRUE;
+
+  /* already loaded by memphis, it parses */
+  elements = osm_parse (priv->raw_data, priv->raw_size, &priv->index->bounds, NULL);
+  set_raw_data (renderer, NULL, 0);
+
+  if (!elements)
+    {
+      osm_index_free (priv->index);
+      priv->index = NULL;
+      return FALSE;
+    }
+
+  for (i = 0; i < elements->len; i++)
+    {
+      OsmElement *element = g_ptr_array_index (elements, i);
+
+      if (element->deleted)
+        osm_element_free (element);
+      else
+        g_hash_table_replace (priv->index->elements[element->type], element->id, element);
+    }
+  g_ptr_array_free (elements, TRUE);
+
+  DEBUG ("Indexed %u nodes, %u ways and %u relations",
+      g_hash_table_size (priv->index->elements[OSM_NODE]),
+      g_hash_table_size (priv->index->elements[OSM_WAY]),
+      g_hash_table_size (priv->index->elements[OSM_RELATION]));
+
+  return TRUE;
+}
+
+
+static GString *
+osm_index_to_xml (OsmIndex *index)
+{
+  GString *xml = g_string_new ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<osm version=\"0.6\" generator=\"libchamplain\">\n");
+  GHashTableIter iter;
+  gpointer value;
+  gint type;
+
+  if (index->bounds)
+    g_string_append_printf (xml, "%s\n", index->bounds);
+
+  /* memphis resolves the references while parsing, nodes go first */
+  for (type = 0; type < OSM_N_TYPES; type++)
+    {
+      g_hash_table_iter_init (&iter, index->elements[type]);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+          g_string_append (xml, ((OsmElement *) value)->xml->str);
+          g_string_append_c (xml, '\n');
+        }
+    }
+
+  g_string_append (xml, "</osm>\n");
+
+  return xml;
+}
+
+
+static gboolean
+element_matches (OsmElement *element,
+    gchar **keys,
+    gchar **values)
+{
+  guint i;
+  gint j, k;
+
+  for (i = 0; i + 1 < element->tags->len; i += 2)
+    {
+      const gchar *tag_key = g_ptr_array_index (element->tags, i);
+      const gchar *tag_value = g_ptr_array_index (element->tags, i + 1);
+
+      for (j = 0; keys[j]; j++)
+        {
+          if (strcmp (keys[j], tag_key) != 0)
+            continue;
+
+          for (k = 0; values[k]; k++)
+            if (strcmp (values[k], "*") == 0 || strcmp (values[k], tag_value) == 0)
+              return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+
+/* Returns the area covered by the elements a rule applies to, or NULL
+ * when there are none */
+static ChamplainBoundingBox *
+get_rule_area (ChamplainMemphisRenderer *renderer,
+    gchar **keys,
+    gchar **values,
+    ChamplainMemphisRuleType rule_type)
+{
+  ChamplainMemphisRendererPrivate *priv = renderer->priv;
+  ChamplainBoundingBox *area;
+  GHashTableIter iter;
+  gpointer value;
+  gint type;
+
+  if (!keys || !values)
+    return NULL;
+
+  area = champlain_bounding_box_new ();
+  for (type = 0; type < OSM_N_TYPES; type++)
+    {
+      if (rule_type != CHAMPLAIN_MEMPHIS_RULE_TYPE_UNKNOWN &&
+          rule_type != CHAMPLAIN_MEMPHIS_RULE_TYPE_NODE + type)
+        continue;
+
+      g_hash_table_iter_init (&iter, priv->index->elements[type]);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+          if (element_matches (value, keys, values))
+            extend_element_area (priv->index, value, area);
+        }
+    }
+
+  if (area->left > area->right)
+    {
+      champlain_bounding_box_free (area);
+      return NULL;
+    }
+
+  return area;
+}
+
+
+static void
+emit_rule_area (ChamplainMemphisRenderer *renderer,
+    gchar **keys,
+    gchar **values,
+    ChamplainMemphisRuleType rule_type)
+{
+  ChamplainBoundingBox *area;
+
+  /* without the index the affected area is unknown */
+  if (!ensure_index (renderer))
+    {
+      champlain_renderer_area_changed (CHAMPLAIN_RENDERER (renderer), NULL);
+      return;
+    }
+
+  area = get_rule_area (renderer, keys, values, rule_type);
+  if (area)
+    {
+      champlain_renderer_area_changed (CHAMPLAIN_RENDERER (renderer), area);
+      champlain_bounding_box_free (area);
+    }
+}
+
+
+static void
+set_map (ChamplainMemphisRenderer *renderer,
+    MemphisMap *map)
+{
+  ChamplainMemphisRendererPrivate *priv = renderer->priv;
+  ChamplainBoundingBox *bbox;
+
+  g_rw_lock_writer_lock (&MemphisLock);
+  memphis_renderer_set_map (priv->renderer, map);
+  g_rw_lock_writer_unlock (&MemphisLock);
+
+  bbox = champlain_bounding_box_new ();
+
+  memphis_map_get_bounding_box (map, &bbox->bottom, &bbox->left, &bbox->top,
+      &bbox->right);
+  g_object_set (G_OBJECT (renderer), "bounding-box", bbox, NULL);
+  champlain_bounding_box_free (bbox);
+}
+
+
 static void
 set_data (ChamplainRenderer *renderer,
     const gchar *data,
     guint size)
 {
   ChamplainMemphisRendererPrivate *priv = GET_PRIVATE (renderer);
-  ChamplainBoundingBox *bbox;
   GError *err = NULL;
 
   MemphisMap *map = memphis_map_new ();
@@ -480,16 +1077,154 @@ set_data (ChamplainRenderer *renderer,
       return;
     }
 
-  g_rw_lock_writer_lock (&MemphisLock);
-  memphis_renderer_set_map (priv->renderer, map);
-  g_rw_lock_writer_unlock (&MemphisLock);
+  set_map (CHAMPLAIN_MEMPHIS_RENDERER (renderer), map);
 
-  bbox = champlain_bounding_box_new ();
+  /* indexed only when the first update arrives */
+  osm_index_free (priv->index);
+  priv->index = NULL;
+  priv->has_data = TRUE;
+  if (priv->updates_enabled)
+    set_raw_data (CHAMPLAIN_MEMPHIS_RENDERER (renderer), data, size);
 
-  memphis_map_get_bounding_box (map, &bbox->bottom, &bbox->left, &bbox->top,
-      &bbox->right);
-  g_object_set (G_OBJECT (renderer), "bounding-box", bbox, NULL);
-  champlain_bounding_box_free (bbox);
+  champlain_renderer_area_changed (renderer, _champlain_renderer_get_data_area (renderer));
+}
+
+
+/**
+ * champlain_memphis_renderer_update_data:
+ * @renderer: a #ChamplainMemphisRenderer
+ * @data: (array length=size): OSM XML or osmChange data
+ * @size: the size of the data
+ *
+ * Merges changed elements into the data passed to the renderer before.
+ * Nodes, ways and relations replace the ones with the same id, elements
+ * inside a &lt;delete&gt; block of an osmChange file or with the
+ * <literal>action="delete"</literal> or <literal>visible="false"</literal>
+ * attribute are removed. The #ChamplainRenderer::area-changed signal is
+ * emitted with the area covered by the changed elements before and after
+ * the change so only the tiles in it need to be rendered again.
+ *
+ * Updates have to be enabled with
+ * champlain_memphis_renderer_set_updates_enabled() before the data is set.
+ * The first update indexes the complete data, keep updates for small
+ * changes and use champlain_renderer_set_data() to replace the data.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_memphis_renderer_update_data (ChamplainMemphisRenderer *renderer,
+    const gchar *data,
+    guint size)
+{
+  g_return_if_fail (CHAMPLAIN_IS_MEMPHIS_RENDERER (renderer) && data != NULL);
+
+  ChamplainMemphisRendererPrivate *priv = renderer->priv;
+  ChamplainBoundingBox *area;
+  GPtrArray *changes;
+  GPtrArray *keys;
+  GHashTable *nodes;
+  MemphisMap *map;
+  GString *xml;
+  GError *err = NULL;
+  guint i;
+
+  g_return_if_fail (priv->updates_enabled);
+
+  if (!priv->index && !priv->raw_data && priv->has_data)
+    {
+      g_critical ("Can't update map data set before updates were enabled");
+      return;
+    }
+
+  if (!ensure_index (renderer))
+    {
+      g_critical ("Can't index map data");
+      return;
+    }
+
+  changes = osm_parse (data, size, NULL, &err);
+  if (!changes)
+    {
+      g_critical ("Can't parse map data update: \"%s\"", err->message);
+      g_error_free (err);
+      return;
+    }
+
+  if (changes->len == 0)
+    {
+      g_ptr_array_free (changes, TRUE);
+      return;
+    }
+
+  area = champlain_bounding_box_new ();
+  /* the changed elements as the type letter followed by the id, they
+   * may be freed by the following changes of the same element */
+  keys = g_ptr_array_new_with_free_func (g_free);
+  nodes = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (i = 0; i < changes->len; i++)
+    {
+      OsmElement *change = g_ptr_array_index (changes, i);
+      OsmElement *old = osm_index_lookup (priv->index, change->type, change->id);
+      gchar *key = g_strdup_printf ("%c%s", osm_type_names[change->type][0], change->id);
+
+      g_ptr_array_add (keys, key);
+      if (change->type == OSM_NODE)
+        g_hash_table_insert (nodes, key + 1, key + 1);
+      if (old)
+        extend_element_area (priv->index, old, area);
+    }
+  extend_ways_area (priv->index, nodes, area);
+
+  for (i = 0; i < changes->len; i++)
+    {
+      OsmElement *change = g_ptr_array_index (changes, i);
+
+      if (change->deleted)
+        {
+          g_hash_table_remove (priv->index->elements[change->type], change->id);
+          osm_element_free (change);
+        }
+      else
+        g_hash_table_replace (priv->index->elements[change->type], change->id, change);
+    }
+  g_ptr_array_free (changes, TRUE);
+
+  for (i = 0; i < keys->len; i++)
+    {
+      const gchar *key = g_ptr_array_index (keys, i);
+      OsmType type = key[0] == 'n' ? OSM_NODE : key[0] == 'w' ? OSM_WAY : OSM_RELATION;
+      OsmElement *element = osm_index_lookup (priv->index, type, key + 1);
+
+      if (element)
+        extend_element_area (priv->index, element, area);
+    }
+  extend_ways_area (priv->index, nodes, area);
+
+  DEBUG ("Merged %u changed elements", keys->len);
+  g_hash_table_destroy (nodes);
+  g_ptr_array_free (keys, TRUE);
+
+  xml = osm_index_to_xml (priv->index);
+  map = memphis_map_new ();
+  memphis_map_load_from_data (map, xml->str, xml->len, &err);
+  g_string_free (xml, TRUE);
+
+  if (err != NULL)
+    {
+      g_critical ("Can't load map data: \"%s\"", err->message);
+      memphis_map_free (map);
+      g_error_free (err);
+      champlain_bounding_box_free (area);
+      return;
+    }
+
+  set_map (renderer, map);
+
+  /* the changed elements may all be unknown */
+  if (area->left <= area->right)
+    champlain_renderer_area_changed (CHAMPLAIN_RENDERER (renderer), area);
+  champlain_bounding_box_free (area);
 }
 
 
@@ -538,6 +1273,8 @@ champlain_memphis_renderer_load_rules (
         strlen (default_rules), NULL);
 
   g_rw_lock_writer_unlock (&MemphisLock);
+
+  champlain_renderer_area_changed (CHAMPLAIN_RENDERER (renderer), NULL);
 }
 
 
@@ -593,6 +1330,8 @@ champlain_memphis_renderer_set_background_color (
   memphis_rule_set_set_bg_color (renderer->priv->rules, color->red,
       color->green, color->blue, color->alpha);
   g_rw_lock_writer_unlock (&MemphisLock);
+
+  champlain_renderer_area_changed (CHAMPLAIN_RENDERER (renderer), NULL);
 }
 
 
@@ -616,6 +1355,8 @@ champlain_memphis_renderer_set_rule (ChamplainMemphisRenderer *renderer,
   g_rw_lock_writer_lock (&MemphisLock);
   memphis_rule_set_set_rule (renderer->priv->rules, (MemphisRule *) rule);
   g_rw_lock_writer_unlock (&MemphisLock);
+
+  emit_rule_area (renderer, rule->keys, rule->values, rule->type);
 }
 
 
@@ -689,11 +1430,77 @@ champlain_memphis_renderer_remove_rule (
     ChamplainMemphisRenderer *renderer,
     const gchar *id)
 {
-  g_return_if_fail (CHAMPLAIN_IS_MEMPHIS_RENDERER (renderer));
+  g_return_if_fail (CHAMPLAIN_IS_MEMPHIS_RENDERER (renderer) && id != NULL);
+
+  gchar **parts;
 
   g_rw_lock_writer_lock (&MemphisLock);
   memphis_rule_set_remove_rule (renderer->priv->rules, id);
   g_rw_lock_writer_unlock (&MemphisLock);
+
+  /* the id is key1|key2|...|keyN:value1|value2|...|valueM */
+  parts = g_strsplit (id, ":", 2);
+  if (g_strv_length (parts) == 2)
+    {
+      gchar **keys = g_strsplit (parts[0], "|", -1);
+      gchar **values = g_strsplit (parts[1], "|", -1);
+
+      emit_rule_area (renderer, keys, values, CHAMPLAIN_MEMPHIS_RULE_TYPE_UNKNOWN);
+      g_strfreev (keys);
+      g_strfreev (values);
+    }
+  g_strfreev (parts);
+}
+
+
+/**
+ * champlain_memphis_renderer_set_updates_enabled:
+ * @renderer: a #ChamplainMemphisRenderer
+ * @enabled: whether champlain_memphis_renderer_update_data() will be used
+ *
+ * Enables updates of the map data with
+ * champlain_memphis_renderer_update_data(). The renderer then keeps a copy
+ * of the data passed to champlain_renderer_set_data() afterwards, which is
+ * indexed when the first update arrives. Disabling updates releases the
+ * copy, the data has to be set again before it can be updated.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_memphis_renderer_set_updates_enabled (ChamplainMemphisRenderer *renderer,
+    gboolean enabled)
+{
+  g_return_if_fail (CHAMPLAIN_IS_MEMPHIS_RENDERER (renderer));
+
+  ChamplainMemphisRendererPrivate *priv = renderer->priv;
+
+  priv->updates_enabled = enabled;
+  if (!enabled)
+    {
+      set_raw_data (renderer, NULL, 0);
+      osm_index_free (priv->index);
+      priv->index = NULL;
+    }
+}
+
+
+/**
+ * champlain_memphis_renderer_get_updates_enabled:
+ * @renderer: a #ChamplainMemphisRenderer
+ *
+ * Checks whether updates of the map data are enabled, see
+ * champlain_memphis_renderer_set_updates_enabled().
+ *
+ * Returns: %TRUE when the data can be updated
+ *
+ * Since: 0.12.15
+ */
+gboolean
+champlain_memphis_renderer_get_updates_enabled (ChamplainMemphisRenderer *renderer)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_MEMPHIS_RENDERER (renderer), FALSE);
+
+  return renderer->priv->updates_enabled;
 }
 
 
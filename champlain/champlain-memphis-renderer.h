@@ -187,6 +187,13 @@ void champlain_memphis_renderer_set_tile_size (ChamplainMemphisRenderer *rendere
 
 guint champlain_memphis_renderer_get_tile_size (ChamplainMemphisRenderer *renderer);
 
+void champlain_memphis_renderer_update_data (ChamplainMemphisRenderer *renderer,
+    const gchar *data,
+    guint size);
+void champlain_memphis_renderer_set_updates_enabled (ChamplainMemphisRenderer *renderer,
+    gboolean enabled);
+gboolean champlain_memphis_renderer_get_updates_enabled (ChamplainMemphisRenderer *renderer);
+
 #undef __CHAMPLAIN_CHAMPLAIN_H_INSIDE__
 
 G_END_DECLS
@@ -37,7 +37,11 @@
 #include "champlain-enum-types.h"
 #include "champlain-version.h"
 #include "champlain-tile.h"
+#include "champlain-private.h"
 
+#include <errno.h>
+#include <math.h>
+#include <string.h>
 #include <libsoup/soup.h>
 
 G_DEFINE_TYPE (ChamplainNetworkBboxTileSource, champlain_network_bbox_tile_source, CHAMPLAIN_TYPE_TILE_SOURCE)
@@ -50,19 +54,66 @@ enum
   PROP_0,
   PROP_API_URI,
   PROP_PROXY_URI,
-  PROP_STATE
+  PROP_STATE,
+  PROP_CACHE_DIR,
+  PROP_MAX_PARALLEL_LOADS
 };
 
+/* Edge size in degrees of the chunks of a chunked load, the API accepts
+   at most 0.25 */
+#define CHUNK_SIZE 0.2
+#define DEFAULT_MAX_PARALLEL_LOADS 2
+/* Milliseconds the loaded chunks are collected before they are passed to
+   the renderer */
+#define MERGE_DELAY 250
+
+typedef struct _ChunkedLoad ChunkedLoad;
+
 struct _ChamplainNetworkBboxTileSourcePrivate
 {
   gchar *api_uri;
   gchar *proxy_uri;
   SoupSession *soup_session;
   ChamplainState state;
+  gchar *cache_dir;
+  guint max_parallel_loads;
+  ChunkedLoad *chunked_load;
 };
 
+struct _ChunkedLoad
+{
+  ChamplainNetworkBboxTileSource *source;
+  ChamplainBoundingBox *bbox;
+  /* Chunks not requested yet, closest to the center of the area first */
+  GQueue *chunks;
+  guint in_flight;
+  /* The contents of the <osm> elements of the loaded chunks */
+  GString *merged;
+  /* "type:id" of the merged nodes, ways and relations. Elements crossing
+     the border of a chunk are returned with both chunks. */
+  GHashTable *merged_ids;
+  /* Extent of the chunks merged since the renderer got the data last time,
+     NULL when none was */
+  ChamplainBoundingBox *merged_area;
+  /* The renderer got the data of this load, later updates only change the
+     rendering within merged_area */
+  gboolean rendered;
+  guint merge_timeout;
+  /* Replaced by another load, the results are thrown away */
+  gboolean cancelled;
+};
+
+typedef struct
+{
+  ChunkedLoad *load;
+  /* position in the global grid of chunks */
+  gint x;
+  gint y;
+} Chunk;
+
 static void fill_tile (ChamplainMapSource *map_source,
     ChamplainTile *tile);
+static void cancel_chunked_load (ChunkedLoad *load);
 
 
 static void
@@ -90,6 +141,14 @@ champlain_network_bbox_tile_source_get_property (GObject *object,
       g_value_set_enum (value, priv->state);
       break;
 
+    case PROP_CACHE_DIR:
+      g_value_set_string (value, priv->cache_dir);
+      break;
+
+    case PROP_MAX_PARALLEL_LOADS:
+      g_value_set_uint (value, priv->max_parallel_loads);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -127,6 +186,16 @@ champlain_network_bbox_tile_source_set_property (GObject *object,
       g_object_notify (G_OBJECT (self), "state");
       break;
 
+    case PROP_CACHE_DIR:
+      champlain_network_bbox_tile_source_set_cache_dir (self,
+          g_value_get_string (value));
+      break;
+
+    case PROP_MAX_PARALLEL_LOADS:
+      champlain_network_bbox_tile_source_set_max_parallel_loads (self,
+          g_value_get_uint (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -140,6 +209,12 @@ champlain_network_bbox_tile_source_dispose (GObject *object)
     CHAMPLAIN_NETWORK_BBOX_TILE_SOURCE (object);
   ChamplainNetworkBboxTileSourcePrivate *priv = self->priv;
 
+  if (priv->chunked_load)
+    {
+      cancel_chunked_load (priv->chunked_load);
+      priv->chunked_load = NULL;
+    }
+
   if (priv->soup_session != NULL)
     {
       soup_session_abort (priv->soup_session);
@@ -159,6 +234,7 @@ champlain_network_bbox_tile_source_finalize (GObject *object)
 
   g_free (priv->api_uri);
   g_free (priv->proxy_uri);
+  g_free (priv->cache_dir);
 
   G_OBJECT_CLASS (champlain_network_bbox_tile_source_parent_class)->finalize (object);
 }
@@ -225,6 +301,40 @@ champlain_network_bbox_tile_source_class_init (ChamplainNetworkBboxTileSourceCla
           CHAMPLAIN_TYPE_STATE,
           CHAMPLAIN_STATE_NONE,
           G_PARAM_READWRITE));
+
+  /**
+   * ChamplainNetworkBboxTileSource:cache-dir:
+   *
+   * The directory where the data of chunked loads is cached, see
+   * champlain_network_bbox_tile_source_load_map_data_chunked()
+   *
+   * Since: 0.12.15
+   */
+  g_object_class_install_property (object_class,
+      PROP_CACHE_DIR,
+      g_param_spec_string ("cache-dir",
+          "Cache directory",
+          "The directory of the cached map data chunks",
+          NULL,
+          G_PARAM_READWRITE));
+
+  /**
+   * ChamplainNetworkBboxTileSource:max-parallel-loads:
+   *
+   * The maximum number of chunks of a chunked load requested at the same
+   * time, see champlain_network_bbox_tile_source_load_map_data_chunked()
+   *
+   * Since: 0.12.15
+   */
+  g_object_class_install_property (object_class,
+      PROP_MAX_PARALLEL_LOADS,
+      g_param_spec_uint ("max-parallel-loads",
+          "Max parallel loads",
+          "Maximum number of chunks loaded at the same time",
+          1,
+          G_MAXUINT,
+          DEFAULT_MAX_PARALLEL_LOADS,
+          G_PARAM_READWRITE));
 }
 
 
@@ -251,6 +361,10 @@ champlain_network_bbox_tile_source_init (ChamplainNetworkBboxTileSource *self)
       NULL);
 
   priv->state = CHAMPLAIN_STATE_NONE;
+  priv->cache_dir = g_build_filename (g_get_user_cache_dir (),
+        "champlain", "osm", NULL);
+  priv->max_parallel_loads = DEFAULT_MAX_PARALLEL_LOADS;
+  priv->chunked_load = NULL;
 }
 
 
@@ -330,6 +444,8 @@ load_map_data_cb (G_GNUC_UNUSED SoupSession *session, SoupMessage *msg,
  * Asynchronously loads map data within a bounding box from the server.
  * The box must not exceed an edge size of 0.25 degree. There are also
  * limitations on the maximum number of nodes that can be requested.
+ * Larger areas can be loaded with
+ * champlain_network_bbox_tile_source_load_map_data_chunked().
  *
  * For details, see: <ulink role="online-location"
  * url="http://api.openstreetmap.org/api/capabilities">
@@ -366,6 +482,565 @@ champlain_network_bbox_tile_source_load_map_data (
 }
 
 
+static void
+chunk_free (Chunk *chunk)
+{
+  g_slice_free (Chunk, chunk);
+}
+
+
+static void
+chunked_load_free (ChunkedLoad *load)
+{
+  if (load->merge_timeout)
+    g_source_remove (load->merge_timeout);
+
+  g_queue_foreach (load->chunks, (GFunc) chunk_free, NULL);
+  g_queue_free (load->chunks);
+  g_string_free (load->merged, TRUE);
+  g_hash_table_destroy (load->merged_ids);
+  if (load->merged_area)
+    champlain_bounding_box_free (load->merged_area);
+  champlain_bounding_box_free (load->bbox);
+  g_slice_free (ChunkedLoad, load);
+}
+
+
+/* The chunks already requested finish but their data is thrown away */
+static void
+cancel_chunked_load (ChunkedLoad *load)
+{
+  load->cancelled = TRUE;
+
+  if (load->merge_timeout)
+    {
+      g_source_remove (load->merge_timeout);
+      load->merge_timeout = 0;
+    }
+
+  g_queue_foreach (load->chunks, (GFunc) chunk_free, NULL);
+  g_queue_clear (load->chunks);
+
+  if (load->in_flight == 0)
+    chunked_load_free (load);
+}
+
+
+static gchar *
+get_chunk_filename (ChamplainNetworkBboxTileSource *self,
+    Chunk *chunk)
+{
+  gchar *basename, *filename;
+
+  if (!self->priv->cache_dir)
+    return NULL;
+
+  basename = g_strdup_printf ("%d_%d.osm", chunk->x, chunk->y);
+  filename = g_build_filename (self->priv->cache_dir, basename, NULL);
+  g_free (basename);
+
+  return filename;
+}
+
+
+/* Returns the value of the attribute @attr_name of the start tag spanning
+ * [@tag, @tag_end), or NULL if it has none */
+static gchar *
+get_attribute (const gchar *tag,
+    const gchar *tag_end,
+    const gchar *attr_name)
+{
+  gsize len = strlen (attr_name);
+  const gchar *attr;
+
+  for (attr = tag; attr + len + 2 < tag_end; attr++)
+    {
+      if (g_ascii_isspace (attr[0]) && strncmp (attr + 1, attr_name, len) == 0 &&
+          attr[len + 1] == '=' && (attr[len + 2] == '"' || attr[len + 2] == '\''))
+        {
+          const gchar *value = attr + len + 3;
+          const gchar *value_end = strchr (value, attr[len + 2]);
+
+          if (!value_end || value_end > tag_end)
+            return NULL;
+
+          return g_strndup (value, value_end - value);
+        }
+    }
+
+  return NULL;
+}
+
+
+/* Returns "type:id" of an element whose start tag spans [@tag, @tag_end),
+ * or NULL if it has no id */
+static gchar *
+get_element_key (const gchar *name,
+    const gchar *tag,
+    const gchar *tag_end)
+{
+  gchar *id = get_attribute (tag, tag_end, "id");
+  gchar *key;
+
+  if (!id)
+    return NULL;
+
+  key = g_strdup_printf ("%s:%s", name, id);
+  g_free (id);
+
+  return key;
+}
+
+
+/* All nodes of the ways of a chunk are in it, their extent covers the
+ * rendering changed by the chunk */
+static void
+extend_merged_area (ChunkedLoad *load,
+    const gchar *tag,
+    const gchar *tag_end)
+{
+  gchar *lat = get_attribute (tag, tag_end, "lat");
+  gchar *lon = get_attribute (tag, tag_end, "lon");
+
+  if (lat && lon)
+    {
+      if (!load->merged_area)
+        load->merged_area = champlain_bounding_box_new ();
+      champlain_bounding_box_extend (load->merged_area,
+          g_ascii_strtod (lat, NULL), g_ascii_strtod (lon, NULL));
+    }
+
+  g_free (lat);
+  g_free (lon);
+}
+
+
+/* Appends the elements of the <osm> element of a chunk to the merged data,
+ * skipping the <bounds> and the elements already merged from other chunks */
+static void
+merge_chunk_data (ChunkedLoad *load,
+    const gchar *data,
+    gsize size)
+{
+  gchar *text = g_strndup (data, size);
+  gchar *start, *end;
+
+  start = strstr (text, "<osm");
+  if (start)
+    start = strchr (start, '>');
+  end = start ? g_strrstr (start, "</osm>") : NULL;
+  if (!end)
+    {
+      DEBUG ("Invalid map data chunk");
+      g_free (text);
+      return;
+    }
+
+  start++;
+  *end = '\0';
+
+  while ((start = strchr (start, '<')) != NULL)
+    {
+      gchar *tag_end = strchr (start, '>');
+      gchar *element_end;
+      gchar *name;
+      gchar *key = NULL;
+
+      if (!tag_end)
+        break;
+
+      /* comments and processing instructions */
+      if (start[1] == '!' || start[1] == '?')
+        {
+          start = tag_end + 1;
+          continue;
+        }
+
+      name = g_strndup (start + 1, strcspn (start + 1, " \t\r\n/>"));
+
+      if (tag_end[-1] == '/')
+        element_end = tag_end + 1;
+      else
+        {
+          gchar *end_tag = g_strdup_printf ("</%s>", name);
+
+          element_end = strstr (tag_end, end_tag);
+          if (element_end)
+            element_end += strlen (end_tag);
+          g_free (end_tag);
+        }
+
+      if (!element_end)
+        {
+          DEBUG ("Unterminated <%s> element in map data chunk", name);
+          g_free (name);
+          break;
+        }
+
+      /* The merged data gets a single <bounds> element of the whole area */
+      if (strcmp (name, "node") == 0 || strcmp (name, "way") == 0 ||
+          strcmp (name, "relation") == 0)
+        key = get_element_key (name, start, tag_end);
+      if (strcmp (name, "node") == 0)
+        extend_merged_area (load, start, tag_end);
+
+      if (strcmp (name, "bounds") != 0 &&
+          (!key || !g_hash_table_lookup (load->merged_ids, key)))
+        {
+          g_string_append_len (load->merged, start, element_end - start);
+          g_string_append_c (load->merged, '\n');
+          if (key)
+            {
+              g_hash_table_insert (load->merged_ids, key, GINT_TO_POINTER (TRUE));
+              key = NULL;
+            }
+        }
+
+      g_free (key);
+      g_free (name);
+      start = element_end;
+    }
+
+  g_free (text);
+}
+
+
+static void
+update_renderer (ChunkedLoad *load)
+{
+  ChamplainRenderer *renderer;
+  gchar left[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar bottom[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar right[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar top[G_ASCII_DTOSTR_BUF_SIZE];
+  GString *doc;
+
+  /* nothing new since the last update */
+  if (load->rendered && !load->merged_area)
+    return;
+
+  doc = g_string_sized_new (load->merged->len + 256);
+  g_string_append (doc, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<osm version=\"0.6\" generator=\"libchamplain\">\n");
+  g_string_append_printf (doc,
+      "<bounds minlat=\"%s\" minlon=\"%s\" maxlat=\"%s\" maxlon=\"%s\"/>\n",
+      g_ascii_dtostr (bottom, G_ASCII_DTOSTR_BUF_SIZE, load->bbox->bottom),
+      g_ascii_dtostr (left, G_ASCII_DTOSTR_BUF_SIZE, load->bbox->left),
+      g_ascii_dtostr (top, G_ASCII_DTOSTR_BUF_SIZE, load->bbox->top),
+      g_ascii_dtostr (right, G_ASCII_DTOSTR_BUF_SIZE, load->bbox->right));
+  g_string_append_len (doc, load->merged->str, load->merged->len);
+  g_string_append (doc, "</osm>\n");
+
+  DEBUG ("Passing %" G_GSIZE_FORMAT " bytes of merged map data to the renderer", doc->len);
+
+  /* the data of the previous load is replaced by the first update, the
+     following ones only add the chunks merged since */
+  renderer = champlain_map_source_get_renderer (CHAMPLAIN_MAP_SOURCE (load->source));
+  if (!load->rendered)
+    champlain_renderer_set_data (renderer, doc->str, doc->len);
+  else
+    _champlain_renderer_set_data_in_area (renderer, doc->str, doc->len, load->merged_area);
+  load->rendered = TRUE;
+
+  if (load->merged_area)
+    {
+      champlain_bounding_box_free (load->merged_area);
+      load->merged_area = NULL;
+    }
+
+  g_string_free (doc, TRUE);
+}
+
+
+static gboolean
+merge_timeout_cb (ChunkedLoad *load)
+{
+  load->merge_timeout = 0;
+  update_renderer (load);
+
+  return FALSE;
+}
+
+
+static void start_chunks (ChunkedLoad *load);
+
+static void
+chunk_done (Chunk *chunk)
+{
+  ChunkedLoad *load = chunk->load;
+
+  chunk_free (chunk);
+  load->in_flight--;
+
+  if (load->cancelled)
+    {
+      if (load->in_flight == 0)
+        chunked_load_free (load);
+      return;
+    }
+
+  start_chunks (load);
+
+  if (load->in_flight == 0)
+    {
+      ChamplainNetworkBboxTileSource *self = load->source;
+
+      DEBUG ("Chunked load finished");
+      self->priv->chunked_load = NULL;
+      g_object_set (G_OBJECT (self), "state", CHAMPLAIN_STATE_DONE, NULL);
+      update_renderer (load);
+      chunked_load_free (load);
+    }
+  else if (!load->merge_timeout)
+    load->merge_timeout = g_timeout_add (MERGE_DELAY,
+          (GSourceFunc) merge_timeout_cb, load);
+}
+
+
+static void
+chunk_stored_cb (GFile *file,
+    GAsyncResult *res,
+    gchar *contents)
+{
+  GError *error = NULL;
+
+  if (!g_file_replace_contents_finish (file, res, NULL, &error))
+    {
+      DEBUG ("Unable to cache map data chunk: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_free (contents);
+  g_object_unref (file);
+}
+
+
+static void
+chunk_downloaded_cb (G_GNUC_UNUSED SoupSession *session,
+    SoupMessage *msg,
+    Chunk *chunk)
+{
+  ChunkedLoad *load = chunk->load;
+  gchar *filename;
+
+  if (load->cancelled)
+    goto finish;
+
+  if (!SOUP_STATUS_IS_SUCCESSFUL (msg->status_code))
+    {
+      DEBUG ("Unable to download chunk %d, %d: %s", chunk->x, chunk->y,
+          soup_status_get_phrase (msg->status_code));
+      goto finish;
+    }
+
+  merge_chunk_data (load, msg->response_body->data, msg->response_body->length);
+
+  filename = get_chunk_filename (load->source, chunk);
+  if (filename)
+    {
+      if (g_mkdir_with_parents (load->source->priv->cache_dir, 0700) == -1 && errno != EEXIST)
+        DEBUG ("Unable to create the map data cache path '%s': %s",
+            load->source->priv->cache_dir, g_strerror (errno));
+      else
+        {
+          GFile *file = g_file_new_for_path (filename);
+          /* the response body is freed with the message */
+          gchar *contents = g_memdup (msg->response_body->data, msg->response_body->length);
+
+          g_file_replace_contents_async (file, contents, msg->response_body->length,
+              NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL,
+              (GAsyncReadyCallback) chunk_stored_cb, contents);
+        }
+      g_free (filename);
+    }
+
+finish:
+  chunk_done (chunk);
+}
+
+
+static void
+download_chunk (Chunk *chunk)
+{
+  ChamplainNetworkBboxTileSourcePrivate *priv = chunk->load->source->priv;
+  gchar left[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar bottom[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar right[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar top[G_ASCII_DTOSTR_BUF_SIZE];
+  SoupMessage *msg;
+  gchar *url;
+
+  if (!priv->soup_session)
+    {
+      chunk_done (chunk);
+      return;
+    }
+
+  url = g_strdup_printf (
+        "http://api.openstreetmap.org/api/0.6/map?bbox=%s,%s,%s,%s",
+        g_ascii_formatd (left, G_ASCII_DTOSTR_BUF_SIZE, "%f", MAX (chunk->x * CHUNK_SIZE, -180.0)),
+        g_ascii_formatd (bottom, G_ASCII_DTOSTR_BUF_SIZE, "%f", MAX (chunk->y * CHUNK_SIZE, -90.0)),
+        g_ascii_formatd (right, G_ASCII_DTOSTR_BUF_SIZE, "%f", MIN ((chunk->x + 1) * CHUNK_SIZE, 180.0)),
+        g_ascii_formatd (top, G_ASCII_DTOSTR_BUF_SIZE, "%f", MIN ((chunk->y + 1) * CHUNK_SIZE, 90.0)));
+  msg = soup_message_new ("GET", url);
+
+  DEBUG ("Request BBox data chunk: '%s'", url);
+
+  g_free (url);
+
+  soup_session_queue_message (priv->soup_session, msg,
+      (SoupSessionCallback) chunk_downloaded_cb, chunk);
+}
+
+
+static void
+chunk_file_loaded_cb (GFile *file,
+    GAsyncResult *res,
+    Chunk *chunk)
+{
+  ChunkedLoad *load = chunk->load;
+  gchar *contents;
+  gsize length;
+
+  if (!g_file_load_contents_finish (file, res, &contents, &length, NULL, NULL))
+    {
+      g_object_unref (file);
+      if (load->cancelled)
+        chunk_done (chunk);
+      else
+        download_chunk (chunk);
+      return;
+    }
+
+  DEBUG ("Chunk %d, %d loaded from the cache", chunk->x, chunk->y);
+  if (!load->cancelled)
+    merge_chunk_data (load, contents, length);
+
+  g_free (contents);
+  g_object_unref (file);
+  chunk_done (chunk);
+}
+
+
+/* Requests the next chunks, up to the limit of parallel loads */
+static void
+start_chunks (ChunkedLoad *load)
+{
+  ChamplainNetworkBboxTileSourcePrivate *priv = load->source->priv;
+
+  while (load->in_flight < priv->max_parallel_loads && !g_queue_is_empty (load->chunks))
+    {
+      Chunk *chunk = g_queue_pop_head (load->chunks);
+      gchar *filename = get_chunk_filename (load->source, chunk);
+
+      load->in_flight++;
+
+      if (filename && g_file_test (filename, G_FILE_TEST_EXISTS))
+        {
+          GFile *file = g_file_new_for_path (filename);
+
+          g_file_load_contents_async (file, NULL,
+              (GAsyncReadyCallback) chunk_file_loaded_cb, chunk);
+        }
+      else
+        download_chunk (chunk);
+
+      g_free (filename);
+    }
+}
+
+
+static gint
+compare_chunks (Chunk *a,
+    Chunk *b,
+    ChamplainBoundingBox *bbox)
+{
+  gdouble lon, lat, da, db;
+
+  champlain_bounding_box_get_center (bbox, &lat, &lon);
+  da = pow ((a->x + 0.5) * CHUNK_SIZE - lon, 2) + pow ((a->y + 0.5) * CHUNK_SIZE - lat, 2);
+  db = pow ((b->x + 0.5) * CHUNK_SIZE - lon, 2) + pow ((b->y + 0.5) * CHUNK_SIZE - lat, 2);
+
+  return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+
+/**
+ * champlain_network_bbox_tile_source_load_map_data_chunked:
+ * @map_data_source: a #ChamplainNetworkBboxTileSource
+ * @bbox: bounding box of the requested area
+ *
+ * Asynchronously loads map data within a bounding box of any size. The
+ * area is split into chunks the server accepts, which are requested
+ * concurrently, see champlain_network_bbox_tile_source_set_max_parallel_loads(),
+ * starting from the center of the area. The downloaded chunks are stored in
+ * the directory set by champlain_network_bbox_tile_source_set_cache_dir()
+ * and loaded from there the next time.
+ *
+ * The renderer receives the merged data of the chunks loaded so far while
+ * the load is in progress, and all of it once the
+ * #ChamplainNetworkBboxTileSource:state changes to %CHAMPLAIN_STATE_DONE.
+ * Renderers emitting #ChamplainRenderer::area-changed report the whole map
+ * as changed only for the first of these updates, the following ones cover
+ * the area of the newly loaded chunks. A new call replaces the load in
+ * progress.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_network_bbox_tile_source_load_map_data_chunked (
+    ChamplainNetworkBboxTileSource *self,
+    ChamplainBoundingBox *bbox)
+{
+  g_return_if_fail (CHAMPLAIN_IS_NETWORK_BBOX_TILE_SOURCE (self));
+  g_return_if_fail (bbox != NULL && champlain_bounding_box_is_valid (bbox));
+
+  ChamplainNetworkBboxTileSourcePrivate *priv = self->priv;
+  ChunkedLoad *load;
+  gint x, y, x_min, x_max, y_min, y_max;
+
+  if (priv->chunked_load)
+    cancel_chunked_load (priv->chunked_load);
+
+  load = g_slice_new (ChunkedLoad);
+  load->source = self;
+  load->bbox = champlain_bounding_box_copy (bbox);
+  load->chunks = g_queue_new ();
+  load->in_flight = 0;
+  load->merged = g_string_new (NULL);
+  load->merged_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  load->merged_area = NULL;
+  load->rendered = FALSE;
+  load->merge_timeout = 0;
+  load->cancelled = FALSE;
+  priv->chunked_load = load;
+
+  x_min = floor (bbox->left / CHUNK_SIZE);
+  x_max = MAX (x_min, (gint) ceil (bbox->right / CHUNK_SIZE) - 1);
+  y_min = floor (bbox->bottom / CHUNK_SIZE);
+  y_max = MAX (y_min, (gint) ceil (bbox->top / CHUNK_SIZE) - 1);
+
+  for (x = x_min; x <= x_max; x++)
+    {
+      for (y = y_min; y <= y_max; y++)
+        {
+          Chunk *chunk = g_slice_new (Chunk);
+
+          chunk->load = load;
+          chunk->x = x;
+          chunk->y = y;
+          g_queue_insert_sorted (load->chunks, chunk,
+              (GCompareDataFunc) compare_chunks, load->bbox);
+        }
+    }
+
+  DEBUG ("Loading map data in %u chunks", g_queue_get_length (load->chunks));
+
+  g_object_set (G_OBJECT (self), "state", CHAMPLAIN_STATE_LOADING, NULL);
+  start_chunks (load);
+}
+
+
 static void
 tile_rendered_cb (ChamplainTile *tile,
     gpointer data,
@@ -480,3 +1155,94 @@ champlain_network_bbox_tile_source_set_api_uri (
   priv->api_uri = g_strdup (api_uri);
   g_object_notify (G_OBJECT (self), "api-uri");
 }
+
+
+/**
+ * champlain_network_bbox_tile_source_get_cache_dir:
+ * @map_data_source: a #ChamplainNetworkBboxTileSource
+ *
+ * Gets the directory where the chunks of chunked loads are cached.
+ *
+ * Returns: the cache directory or %NULL when the chunks are not cached.
+ *
+ * Since: 0.12.15
+ */
+const gchar *
+champlain_network_bbox_tile_source_get_cache_dir (
+    ChamplainNetworkBboxTileSource *self)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_NETWORK_BBOX_TILE_SOURCE (self), NULL);
+
+  return self->priv->cache_dir;
+}
+
+
+/**
+ * champlain_network_bbox_tile_source_set_cache_dir:
+ * @map_data_source: a #ChamplainNetworkBboxTileSource
+ * @cache_dir: (allow-none): the cache directory or %NULL
+ *
+ * Sets the directory where the chunks of
+ * champlain_network_bbox_tile_source_load_map_data_chunked() are cached.
+ * The cached chunks never expire, delete the directory to load fresh data.
+ * %NULL disables the cache.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_network_bbox_tile_source_set_cache_dir (
+    ChamplainNetworkBboxTileSource *self,
+    const gchar *cache_dir)
+{
+  g_return_if_fail (CHAMPLAIN_IS_NETWORK_BBOX_TILE_SOURCE (self));
+
+  ChamplainNetworkBboxTileSourcePrivate *priv = self->priv;
+
+  g_free (priv->cache_dir);
+  priv->cache_dir = g_strdup (cache_dir);
+  g_object_notify (G_OBJECT (self), "cache-dir");
+}
+
+
+/**
+ * champlain_network_bbox_tile_source_get_max_parallel_loads:
+ * @map_data_source: a #ChamplainNetworkBboxTileSource
+ *
+ * Gets the maximum number of chunks loaded at the same time.
+ *
+ * Returns: the maximum number of parallel loads.
+ *
+ * Since: 0.12.15
+ */
+guint
+champlain_network_bbox_tile_source_get_max_parallel_loads (
+    ChamplainNetworkBboxTileSource *self)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_NETWORK_BBOX_TILE_SOURCE (self), 0);
+
+  return self->priv->max_parallel_loads;
+}
+
+
+/**
+ * champlain_network_bbox_tile_source_set_max_parallel_loads:
+ * @map_data_source: a #ChamplainNetworkBboxTileSource
+ * @max_loads: the maximum number of parallel loads
+ *
+ * Sets how many chunks of
+ * champlain_network_bbox_tile_source_load_map_data_chunked() are loaded at
+ * the same time. Respect the usage policy of the API server when raising
+ * it, the default of 2 matches the connection limit of the source.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_network_bbox_tile_source_set_max_parallel_loads (
+    ChamplainNetworkBboxTileSource *self,
+    guint max_loads)
+{
+  g_return_if_fail (CHAMPLAIN_IS_NETWORK_BBOX_TILE_SOURCE (self) && max_loads > 0);
+
+  self->priv->max_parallel_loads = max_loads;
+  g_object_notify (G_OBJECT (self), "max-parallel-loads");
+}
@@ -85,6 +85,10 @@ void champlain_network_bbox_tile_source_load_map_data (
     ChamplainNetworkBboxTileSource *map_data_source,
     ChamplainBoundingBox *bbox);
 
+void champlain_network_bbox_tile_source_load_map_data_chunked (
+    ChamplainNetworkBboxTileSource *map_data_source,
+    ChamplainBoundingBox *bbox);
+
 const gchar *champlain_network_bbox_tile_source_get_api_uri (
     ChamplainNetworkBboxTileSource *map_data_source);
 
@@ -92,6 +96,20 @@ void champlain_network_bbox_tile_source_set_api_uri (
     ChamplainNetworkBboxTileSource *map_data_source,
     const gchar *api_uri);
 
+const gchar *champlain_network_bbox_tile_source_get_cache_dir (
+    ChamplainNetworkBboxTileSource *map_data_source);
+
+void champlain_network_bbox_tile_source_set_cache_dir (
+    ChamplainNetworkBboxTileSource *map_data_source,
+    const gchar *cache_dir);
+
+guint champlain_network_bbox_tile_source_get_max_parallel_loads (
+    ChamplainNetworkBboxTileSource *map_data_source);
+
+void champlain_network_bbox_tile_source_set_max_parallel_loads (
+    ChamplainNetworkBboxTileSource *map_data_source,
+    guint max_loads);
+
 G_END_DECLS
 
 #endif /* _CHAMPLAIN_NETWORK_BBOX_TILE_SOURCE */
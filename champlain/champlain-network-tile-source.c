@@ -29,6 +29,10 @@
  * Some preconfigured network map sources are built-in this library,
  * see #ChamplainMapSourceFactory.
  *
+ * When the server provides tiles twice as large as the tile size of the map
+ * source (e.g. 512 px tiles for a 256 px source), the
+ * #ChamplainNetworkTileSource:large-tiles mode can be used to download one
+ * large tile for four regular tiles.
  */
 
 #include "config.h"
@@ -44,6 +48,7 @@
 #include "champlain-map-source.h"
 #include "champlain-marshal.h"
 #include "champlain-private.h"
+#include "champlain-bench-private.h"
 
 #include <errno.h>
 #include <gdk/gdk.h>
@@ -61,9 +66,25 @@ enum
   PROP_0,
   PROP_URI_FORMAT,
   PROP_OFFLINE,
-  PROP_PROXY_URI
+  PROP_PROXY_URI,
+  PROP_LARGE_TILES,
+  PROP_DETACH_GRACE_TIME,
+  PROP_MAX_DETACHED_LOADS,
+  PROP_MIRROR_URI_FORMATS
 };
 
+/* Defaults of the budget for downloads of tiles the view no longer shows */
+#define DEFAULT_DETACH_GRACE_TIME 3000
+#define DEFAULT_MAX_DETACHED_LOADS 4
+
+/* Number of recent download times the hedging delay is computed from */
+#define LATENCY_SAMPLES 64
+#define MIN_LATENCY_SAMPLES 10
+/* Hedging delays in milliseconds, the default is used until there are
+   enough samples */
+#define DEFAULT_HEDGE_DELAY 1000
+#define MIN_HEDGE_DELAY 50
+
 G_DEFINE_TYPE (ChamplainNetworkTileSource, champlain_network_tile_source, CHAMPLAIN_TYPE_TILE_SOURCE);
 
 #define GET_PRIVATE(obj) \
@@ -75,12 +96,37 @@ struct _ChamplainNetworkTileSourcePrivate
   gchar *uri_format;
   gchar *proxy_uri;
   SoupSession *soup_session;
+  gboolean large_tiles;
+  /* "z/x/y" of the large tile -> LargeTileLoad */
+  GHashTable *large_tile_loads;
+  /* encodes the slices of large tiles for the cache */
+  GThreadPool *slice_pool;
+  /* "z/x/y" of a tile being downloaded -> list of other tiles waiting for it */
+  GHashTable *tile_loads;
+  guint detach_grace_time;
+  guint max_detached_loads;
+  /* TileCancelledData of the detached downloads, oldest first */
+  GQueue *detached_loads;
+  gchar **mirror_uri_formats;
+  guint next_mirror;
+  /* ring buffer of the last download times in milliseconds */
+  guint latencies[LATENCY_SAMPLES];
+  guint n_latencies;
+  guint latency_index;
 };
 
 typedef struct
 {
   ChamplainMapSource *map_source;
   SoupMessage *msg;
+  SoupMessage *hedge_msg;
+  ChamplainTile *tile;
+  /* the tile left the view, the download only goes to the cache */
+  gboolean detached;
+  guint grace_timeout;
+  /* the tile which took over the download after the original one was
+     cancelled */
+  ChamplainTile *reattached_tile;
 } TileCancelledData;
 
 typedef struct
@@ -88,20 +134,64 @@ typedef struct
   ChamplainMapSource *map_source;
   ChamplainTile *tile;
   TileCancelledData *cancelled_data;
+  gint64 start_time;
+  /* the request and its duplicate sent to a mirror when it is slow,
+     NULL once their callback ran */
+  SoupMessage *msg;
+  SoupMessage *hedge_msg;
+  guint hedge_timeout;
+  /* number of requests whose callback did not run yet */
+  guint pending;
+  /* one of the requests delivered the tile */
+  gboolean completed;
 } TileLoadedData;
 
 typedef struct
 {
   ChamplainMapSource *map_source;
   gchar *etag;
+  GList *followers;
 } TileRenderedData;
 
+/* A large tile download shared by the regular tiles it covers */
+typedef struct
+{
+  ChamplainMapSource *map_source;
+  SoupMessage *msg;
+  gchar *key;
+  gint x;
+  gint y;
+  gint z;
+  /* number of regular tiles per side covered by the large tile */
+  gint n;
+  GList *tiles;
+} LargeTileLoad;
+
+/* The slices of a large tile encoded in a worker thread and stored in the
+   cache from the main loop one at a time */
+typedef struct
+{
+  ChamplainMapSource *map_source;
+  ChamplainTileCache *tile_cache;
+  cairo_surface_t *large_surface;
+  /* the first slice and the number of slices per side */
+  gint x;
+  gint y;
+  gint z;
+  gint n;
+  guint tile_size;
+  /* GByteArray with the PNG data of the slices, column by column */
+  GPtrArray *pngs;
+  guint next;
+} SliceStoreJob;
+
 
 static void fill_tile (ChamplainMapSource *map_source,
     ChamplainTile *tile);
-static void tile_state_notify (ChamplainTile *tile,
-    G_GNUC_UNUSED GParamSpec *pspec,
+static void tile_cancelled_cb (GCancellable *cancellable,
     TileCancelledData *data);
+static void display_surface (ChamplainTile *tile,
+    cairo_surface_t *surface);
 
 static gchar *get_tile_uri (ChamplainNetworkTileSource *source,
     gint x,
@@ -130,6 +220,22 @@ champlain_network_tile_source_get_property (GObject *object,
       g_value_set_string (value, priv->proxy_uri);
       break;
 
+    case PROP_LARGE_TILES:
+      g_value_set_boolean (value, priv->large_tiles);
+      break;
+
+    case PROP_DETACH_GRACE_TIME:
+      g_value_set_uint (value, priv->detach_grace_time);
+      break;
+
+    case PROP_MAX_DETACHED_LOADS:
+      g_value_set_uint (value, priv->max_detached_loads);
+      break;
+
+    case PROP_MIRROR_URI_FORMATS:
+      g_value_set_boxed (value, priv->mirror_uri_formats);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -158,6 +264,22 @@ champlain_network_tile_source_set_property (GObject *object,
       champlain_network_tile_source_set_proxy_uri (tile_source, g_value_get_string (value));
       break;
 
+    case PROP_LARGE_TILES:
+      champlain_network_tile_source_set_large_tiles (tile_source, g_value_get_boolean (value));
+      break;
+
+    case PROP_DETACH_GRACE_TIME:
+      champlain_network_tile_source_set_detach_grace_time (tile_source, g_value_get_uint (value));
+      break;
+
+    case PROP_MAX_DETACHED_LOADS:
+      champlain_network_tile_source_set_max_detached_loads (tile_source, g_value_get_uint (value));
+      break;
+
+    case PROP_MIRROR_URI_FORMATS:
+      champlain_network_tile_source_set_mirror_uri_formats (tile_source, g_value_get_boxed (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -171,9 +293,12 @@ champlain_network_tile_source_dispose (GObject *object)
 
   if (priv->soup_session)
     {
-      soup_session_abort (priv->soup_session);
-      g_object_unref (priv->soup_session);
+      SoupSession *soup_session = priv->soup_session;
+
+      /* cleared first so that cancelled downloads are not requeued */
       priv->soup_session = NULL;
+      soup_session_abort (soup_session);
+      g_object_unref (soup_session);
     }
 
   G_OBJECT_CLASS (champlain_network_tile_source_parent_class)->dispose (object);
@@ -187,6 +312,12 @@ champlain_network_tile_source_finalize (GObject *object)
 
   g_free (priv->uri_format);
   g_free (priv->proxy_uri);
+  g_hash_table_destroy (priv->large_tile_loads);
+  if (priv->slice_pool)
+    g_thread_pool_free (priv->slice_pool, FALSE, TRUE);
+  g_hash_table_destroy (priv->tile_loads);
+  g_queue_free (priv->detached_loads);
+  g_strfreev (priv->mirror_uri_formats);
 
   G_OBJECT_CLASS (champlain_network_tile_source_parent_class)->finalize (object);
 }
@@ -257,6 +388,70 @@ champlain_network_tile_source_class_init (ChamplainNetworkTileSourceClass *klass
         "",
         G_PARAM_READWRITE);
   g_object_class_install_property (object_class, PROP_PROXY_URI, pspec);
+
+  /**
+   * ChamplainNetworkTileSource:large-tiles:
+   *
+   * Specifies whether the URI format points to tiles twice as large as the
+   * tile size, see #champlain_network_tile_source_set_large_tiles
+   *
+   * Since: 0.12.15
+   */
+  pspec = g_param_spec_boolean ("large-tiles",
+        "Large tiles",
+        "Download tiles twice as large and split them",
+        FALSE,
+        G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_LARGE_TILES, pspec);
+
+  /**
+   * ChamplainNetworkTileSource:detach-grace-time:
+   *
+   * How long downloads of tiles no longer shown by the view may continue,
+   * see #champlain_network_tile_source_set_detach_grace_time
+   *
+   * Since: 0.12.15
+   */
+  pspec = g_param_spec_uint ("detach-grace-time",
+        "Detach grace time",
+        "Milliseconds the downloads of tiles that left the view may continue",
+        0,
+        G_MAXUINT,
+        DEFAULT_DETACH_GRACE_TIME,
+        G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_DETACH_GRACE_TIME, pspec);
+
+  /**
+   * ChamplainNetworkTileSource:max-detached-loads:
+   *
+   * The maximum number of downloads of tiles no longer shown by the view,
+   * see #champlain_network_tile_source_set_max_detached_loads
+   *
+   * Since: 0.12.15
+   */
+  pspec = g_param_spec_uint ("max-detached-loads",
+        "Max detached loads",
+        "Maximum number of continuing downloads of tiles that left the view",
+        0,
+        G_MAXUINT,
+        DEFAULT_MAX_DETACHED_LOADS,
+        G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_MAX_DETACHED_LOADS, pspec);
+
+  /**
+   * ChamplainNetworkTileSource:mirror-uri-formats:
+   *
+   * URI formats of alternate servers used for slow downloads, see
+   * #champlain_network_tile_source_set_mirror_uri_formats
+   *
+   * Since: 0.12.15
+   */
+  pspec = g_param_spec_boxed ("mirror-uri-formats",
+        "Mirror URI formats",
+        "URI formats of alternate servers",
+        G_TYPE_STRV,
+        G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_MIRROR_URI_FORMATS, pspec);
 }
 
 
@@ -270,6 +465,17 @@ champlain_network_tile_source_init (ChamplainNetworkTileSource *tile_source)
   priv->proxy_uri = NULL;
   priv->uri_format = NULL;
   priv->offline = FALSE;
+  priv->large_tiles = FALSE;
+  priv->large_tile_loads = g_hash_table_new (g_str_hash, g_str_equal);
+  priv->slice_pool = NULL;
+  priv->tile_loads = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  priv->detach_grace_time = DEFAULT_DETACH_GRACE_TIME;
+  priv->max_detached_loads = DEFAULT_MAX_DETACHED_LOADS;
+  priv->detached_loads = g_queue_new ();
+  priv->mirror_uri_formats = NULL;
+  priv->next_mirror = 0;
+  priv->n_latencies = 0;
+  priv->latency_index = 0;
 
   priv->soup_session = soup_session_new_with_options (
         "proxy-uri", NULL,
@@ -482,28 +688,217 @@ champlain_network_tile_source_set_offline (ChamplainNetworkTileSource *tile_sour
 }
 
 
+/**
+ * champlain_network_tile_source_get_large_tiles:
+ * @tile_source: the #ChamplainNetworkTileSource
+ *
+ * Gets whether the tile source downloads large tiles.
+ *
+ * Returns: TRUE when large tiles are downloaded and split; FALSE otherwise.
+ *
+ * Since: 0.12.15
+ */
+gboolean
+champlain_network_tile_source_get_large_tiles (ChamplainNetworkTileSource *tile_source)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_NETWORK_TILE_SOURCE (tile_source), FALSE);
+
+  return tile_source->priv->large_tiles;
+}
+
+
+/**
+ * champlain_network_tile_source_set_large_tiles:
+ * @tile_source: the #ChamplainNetworkTileSource
+ * @large_tiles: TRUE when the URI format points to large tiles
+ *
+ * Sets the large tile mode. In this mode the URI format is expected to
+ * point to tiles twice as large as the tile size of the source, which cover
+ * the area of 2x2 regular tiles at the next zoom level (e.g. 512 px tiles
+ * for a 256 px map source). A single large tile is then downloaded and
+ * decoded for the four regular tiles it covers, which reduces the number
+ * of requests to a quarter. All four slices are stored into the tile cache.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_network_tile_source_set_large_tiles (ChamplainNetworkTileSource *tile_source,
+    gboolean large_tiles)
+{
+  g_return_if_fail (CHAMPLAIN_IS_NETWORK_TILE_SOURCE (tile_source));
+
+  tile_source->priv->large_tiles = large_tiles;
+
+  g_object_notify (G_OBJECT (tile_source), "large-tiles");
+}
+
+
+/**
+ * champlain_network_tile_source_get_detach_grace_time:
+ * @tile_source: the #ChamplainNetworkTileSource
+ *
+ * Gets the time downloads of tiles that left the view may continue.
+ *
+ * Returns: the grace time in milliseconds.
+ *
+ * Since: 0.12.15
+ */
+guint
+champlain_network_tile_source_get_detach_grace_time (ChamplainNetworkTileSource *tile_source)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_NETWORK_TILE_SOURCE (tile_source), 0);
+
+  return tile_source->priv->detach_grace_time;
+}
+
+
+/**
+ * champlain_network_tile_source_set_detach_grace_time:
+ * @tile_source: the #ChamplainNetworkTileSource
+ * @grace_time: the grace time in milliseconds
+ *
+ * When a tile leaves the view while it is being downloaded, e.g. because
+ * the view was panned or zoomed, the download is not cancelled right away.
+ * It may continue for @grace_time milliseconds and, if it finishes in time,
+ * the tile is stored into the tile cache so that panning or zooming back
+ * does not download it again. Downloads still running after the grace time
+ * are cancelled. 0 cancels the downloads immediately.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_network_tile_source_set_detach_grace_time (ChamplainNetworkTileSource *tile_source,
+    guint grace_time)
+{
+  g_return_if_fail (CHAMPLAIN_IS_NETWORK_TILE_SOURCE (tile_source));
+
+  tile_source->priv->detach_grace_time = grace_time;
+
+  g_object_notify (G_OBJECT (tile_source), "detach-grace-time");
+}
+
+
+/**
+ * champlain_network_tile_source_get_max_detached_loads:
+ * @tile_source: the #ChamplainNetworkTileSource
+ *
+ * Gets the maximum number of downloads of tiles that left the view.
+ *
+ * Returns: the maximum number of detached downloads.
+ *
+ * Since: 0.12.15
+ */
+guint
+champlain_network_tile_source_get_max_detached_loads (ChamplainNetworkTileSource *tile_source)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_NETWORK_TILE_SOURCE (tile_source), 0);
+
+  return tile_source->priv->max_detached_loads;
+}
+
+
+/**
+ * champlain_network_tile_source_set_max_detached_loads:
+ * @tile_source: the #ChamplainNetworkTileSource
+ * @max_loads: the maximum number of detached downloads
+ *
+ * Sets how many downloads of tiles that left the view may continue at the
+ * same time, see champlain_network_tile_source_set_detach_grace_time().
+ * Detached downloads share the connections with the downloads of the
+ * visible tiles, so when there are more of them, the oldest ones are
+ * cancelled. 0 cancels the downloads immediately.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_network_tile_source_set_max_detached_loads (ChamplainNetworkTileSource *tile_source,
+    guint max_loads)
+{
+  g_return_if_fail (CHAMPLAIN_IS_NETWORK_TILE_SOURCE (tile_source));
+
+  tile_source->priv->max_detached_loads = max_loads;
+
+  g_object_notify (G_OBJECT (tile_source), "max-detached-loads");
+}
+
+
+/**
+ * champlain_network_tile_source_get_mirror_uri_formats:
+ * @tile_source: the #ChamplainNetworkTileSource
+ *
+ * Gets the URI formats of the alternate servers.
+ *
+ * Returns: (transfer none) (array zero-terminated=1) (allow-none): the
+ * mirror URI formats or %NULL when there are none.
+ *
+ * Since: 0.12.15
+ */
+const gchar * const *
+champlain_network_tile_source_get_mirror_uri_formats (ChamplainNetworkTileSource *tile_source)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_NETWORK_TILE_SOURCE (tile_source), NULL);
+
+  return (const gchar * const *) tile_source->priv->mirror_uri_formats;
+}
+
+
+/**
+ * champlain_network_tile_source_set_mirror_uri_formats:
+ * @tile_source: the #ChamplainNetworkTileSource
+ * @uri_formats: (array zero-terminated=1) (allow-none): %NULL-terminated
+ * array of URI formats, see champlain_network_tile_source_set_uri_format()
+ *
+ * Sets the URI formats of alternate servers providing the same tiles.
+ * When a download takes longer than 90% of the recent downloads, the same
+ * tile is requested from the next mirror as well. The tile is taken from
+ * whichever request finishes first and the other one is cancelled. The
+ * statistics of the map source count how often this happened, see
+ * #ChamplainMapSourceStats. Large tile downloads are not hedged.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_network_tile_source_set_mirror_uri_formats (ChamplainNetworkTileSource *tile_source,
+    const gchar * const *uri_formats)
+{
+  g_return_if_fail (CHAMPLAIN_IS_NETWORK_TILE_SOURCE (tile_source));
+
+  ChamplainNetworkTileSourcePrivate *priv = tile_source->priv;
+
+  g_strfreev (priv->mirror_uri_formats);
+  priv->mirror_uri_formats = g_strdupv ((gchar **) uri_formats);
+  priv->next_mirror = 0;
+
+  g_object_notify (G_OBJECT (tile_source), "mirror-uri-formats");
+}
+
+
 #define SIZE 8
-static gchar *
-get_tile_uri (ChamplainNetworkTileSource *tile_source,
+/* Replaces the #X#, #Y#, #TMSY# and #Z# markers of @uri_format. Other tokens
+ * are passed to @token_func, which returns their allocated replacement or
+ * NULL to keep them as they are. */
+gchar *
+_champlain_format_tile_uri (const gchar *uri_format,
     gint x,
     gint y,
-    gint z)
+    gint z,
+    ChamplainUriTokenFunc token_func,
+    gpointer user_data)
 {
-  ChamplainNetworkTileSourcePrivate *priv = tile_source->priv;
-
   gchar **tokens;
   gchar *token;
   GString *ret;
   gint i = 0;
 
-  tokens = g_strsplit (priv->uri_format, "#", 20);
+  tokens = g_strsplit (uri_format, "#", 20);
   token = tokens[i];
-  ret = g_string_sized_new (strlen (priv->uri_format));
+  ret = g_string_sized_new (strlen (uri_format));
 
   while (token != NULL)
     {
       gint number = G_MAXINT;
       gchar value[SIZE];
+      gchar *replacement = NULL;
 
       if (strcmp (token, "X") == 0)
         number = x;
@@ -516,11 +911,19 @@ get_tile_uri (ChamplainNetworkTileSource *tile_source,
       if (strcmp (token, "Z") == 0)
         number = z;
 
+      if (number == G_MAXINT && token_func)
+        replacement = token_func (token, user_data);
+
       if (number != G_MAXINT)
         {
           g_snprintf (value, SIZE, "%d", number);
           g_string_append (ret, value);
         }
+      else if (replacement)
+        {
+          g_string_append (ret, replacement);
+          g_free (replacement);
+        }
       else
         g_string_append (ret, token);
 
@@ -535,6 +938,161 @@ get_tile_uri (ChamplainNetworkTileSource *tile_source,
 }
 
 
+static gchar *
+get_tile_uri (ChamplainNetworkTileSource *tile_source,
+    gint x,
+    gint y,
+    gint z)
+{
+  return _champlain_format_tile_uri (tile_source->priv->uri_format, x, y, z, NULL, NULL);
+}
+
+
+static void
+record_latency (ChamplainNetworkTileSourcePrivate *priv,
+    guint latency)
+{
+  priv->latencies[priv->latency_index] = latency;
+  priv->latency_index = (priv->latency_index + 1) % LATENCY_SAMPLES;
+  if (priv->n_latencies < LATENCY_SAMPLES)
+    priv->n_latencies++;
+}
+
+
+static gint
+compare_latencies (gconstpointer a,
+    gconstpointer b,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  guint la = *(const guint *) a;
+  guint lb = *(const guint *) b;
+
+  return la < lb ? -1 : (la > lb ? 1 : 0);
+}
+
+
+/* The 90th percentile of the recent download times */
+static guint
+get_hedge_delay (ChamplainNetworkTileSourcePrivate *priv)
+{
+  guint sorted[LATENCY_SAMPLES];
+  guint n = priv->n_latencies;
+
+  if (n < MIN_LATENCY_SAMPLES)
+    return DEFAULT_HEDGE_DELAY;
+
+  memcpy (sorted, priv->latencies, n * sizeof (guint));
+  g_qsort_with_data (sorted, n, sizeof (guint), compare_latencies, NULL);
+
+  return MAX (sorted[n * 9 / 10], MIN_HEDGE_DELAY);
+}
+
+
+gchar *
+_champlain_network_tile_source_get_tile_uri (ChamplainNetworkTileSource *tile_source,
+    gint x,
+    gint y,
+    gint z)
+{
+  return get_tile_uri (tile_source, x, y, z);
+}
+
+
+static gchar *
+get_tile_key (ChamplainTile *tile)
+{
+  return g_strdup_printf ("%u/%u/%u",
+      champlain_tile_get_zoom_level (tile),
+      champlain_tile_get_x (tile),
+      champlain_tile_get_y (tile));
+}
+
+
+/* Removes the download of the tile from the in-flight table and returns
+   the tiles which requested the same tile in the meantime */
+static GList *
+take_followers (ChamplainNetworkTileSource *tile_source,
+    ChamplainTile *tile)
+{
+  ChamplainNetworkTileSourcePrivate *priv = tile_source->priv;
+  gchar *key = get_tile_key (tile);
+  GList *followers = g_hash_table_lookup (priv->tile_loads, key);
+
+  g_hash_table_remove (priv->tile_loads, key);
+  g_free (key);
+
+  return followers;
+}
+
+
+/* Returns a tile waiting for the download of @tile which is still needed */
+static ChamplainTile *
+find_live_follower (ChamplainNetworkTileSource *tile_source,
+    ChamplainTile *tile)
+{
+  gchar *key = get_tile_key (tile);
+  GList *iter = g_hash_table_lookup (tile_source->priv->tile_loads, key);
+
+  g_free (key);
+
+  for (; iter; iter = iter->next)
+    {
+      if (champlain_tile_get_state (iter->data) != CHAMPLAIN_STATE_DONE &&
+          !champlain_tile_is_cancelled (iter->data))
+        return iter->data;
+    }
+
+  return NULL;
+}
+
+
+static void
+complete_followers (ChamplainMapSource *map_source,
+    GList *followers,
+    ChamplainTile *leader,
+    guint status_code)
+{
+  ChamplainNetworkTileSourcePrivate *priv = CHAMPLAIN_NETWORK_TILE_SOURCE (map_source)->priv;
+  ChamplainMapSource *next_source = champlain_map_source_get_next_source (map_source);
+  cairo_surface_t *surface = NULL;
+  GList *iter;
+
+  if (leader)
+    surface = champlain_exportable_get_surface (CHAMPLAIN_EXPORTABLE (leader));
+
+  for (iter = followers; iter; iter = iter->next)
+    {
+      ChamplainTile *tile = iter->data;
+      ChamplainState state = champlain_tile_get_state (tile);
+
+      if (state == CHAMPLAIN_STATE_DONE || champlain_tile_is_cancelled (tile))
+        continue;
+
+      if (status_code == SOUP_STATUS_NOT_MODIFIED && state == CHAMPLAIN_STATE_LOADED)
+        {
+          champlain_tile_set_fade_in (tile, TRUE);
+          champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
+          champlain_tile_display_content (tile);
+        }
+      else if (status_code == SOUP_STATUS_CANCELLED || status_code == SOUP_STATUS_NOT_MODIFIED)
+        {
+          /* the download was meant for another tile, request it again */
+          if (priv->soup_session)
+            fill_tile (map_source, tile);
+        }
+      else if (SOUP_STATUS_IS_SUCCESSFUL (status_code) && surface)
+        {
+          champlain_tile_set_etag (tile, champlain_tile_get_etag (leader));
+          display_surface (tile, surface);
+        }
+      else if (next_source)
+        champlain_map_source_fill_tile (next_source, tile);
+    }
+
+  g_list_free_full (followers, g_object_unref);
+}
+
+
 static void
 tile_rendered_cb (ChamplainTile *tile,
     gpointer data,
@@ -545,9 +1103,12 @@ tile_rendered_cb (ChamplainTile *tile,
   ChamplainMapSource *map_source = user_data->map_source;
   ChamplainMapSource *next_source;
   gchar *etag = user_data->etag;
+  GList *followers = user_data->followers;
+  guint status_code = SOUP_STATUS_OK;
 
   g_signal_handlers_disconnect_by_func (tile, tile_rendered_cb, user_data);
   g_slice_free (TileRenderedData, user_data);
+  _champlain_map_source_stats_render_end (map_source, tile);
 
   next_source = champlain_map_source_get_next_source (map_source);
 
@@ -566,8 +1127,20 @@ tile_rendered_cb (ChamplainTile *tile,
       champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
       champlain_tile_display_content (tile);
     }
-  else if (next_source)
-    champlain_map_source_fill_tile (next_source, tile);
+  else if (champlain_tile_is_cancelled (tile))
+    {
+      /* the decoding was cancelled, the followers have to load the tile
+         themselves */
+      status_code = SOUP_STATUS_CANCELLED;
+    }
+  else
+    {
+      _champlain_map_source_peek_stats (map_source)->failures++;
+      if (next_source)
+        champlain_map_source_fill_tile (next_source, tile);
+    }
+
+  complete_followers (map_source, followers, error ? NULL : tile, status_code);
 
   g_free (etag);
   g_object_unref (map_source);
@@ -576,7 +1149,7 @@ tile_rendered_cb (ChamplainTile *tile,
 
 
 static void
-tile_loaded_cb (G_GNUC_UNUSED SoupSession *session,
+tile_loaded_cb (SoupSession *session,
     SoupMessage *msg,
     gpointer user_data)
 {
@@ -587,25 +1160,106 @@ tile_loaded_cb (G_GNUC_UNUSED SoupSession *session,
   ChamplainMapSource *next_source = champlain_map_source_get_next_source (map_source);
   ChamplainTile *tile = callback_data->tile;
   const gchar *etag;
+  ChamplainMapSourceStats *stats = _champlain_map_source_peek_stats (map_source);
   TileRenderedData *data;
   ChamplainRenderer *renderer;
+  GList *followers;
+  gboolean orphaned;
+  gboolean hedge_won;
+  SoupMessage *loser = NULL;
+
+  hedge_won = msg == callback_data->hedge_msg;
+  if (hedge_won)
+    callback_data->hedge_msg = NULL;
+  else
+    callback_data->msg = NULL;
+  callback_data->pending--;
 
-  g_signal_handlers_disconnect_by_func (tile, tile_state_notify, callback_data->cancelled_data);
-  g_slice_free (TileLoadedData, callback_data);
+  /* the other request of a hedged download already delivered the tile */
+  if (callback_data->completed)
+    {
+      if (callback_data->pending == 0)
+        g_slice_free (TileLoadedData, callback_data);
+      return;
+    }
+
+  /* the other request may still succeed */
+  if (callback_data->pending > 0 &&
+      !SOUP_STATUS_IS_SUCCESSFUL (msg->status_code) &&
+      msg->status_code != SOUP_STATUS_NOT_MODIFIED)
+    return;
+
+  callback_data->completed = TRUE;
+  if (callback_data->hedge_timeout)
+    g_source_remove (callback_data->hedge_timeout);
+
+  if (SOUP_STATUS_IS_SUCCESSFUL (msg->status_code) ||
+      msg->status_code == SOUP_STATUS_NOT_MODIFIED)
+    record_latency (CHAMPLAIN_NETWORK_TILE_SOURCE (map_source)->priv,
+        (g_get_monotonic_time () - callback_data->start_time) / 1000);
+  if (hedge_won)
+    {
+      DEBUG ("Mirror won the hedged download");
+      stats->hedge_wins++;
+    }
+
+  /* nobody shows the tile any more, the download is only for the cache */
+  orphaned = callback_data->cancelled_data->detached;
+  g_signal_handlers_disconnect_by_func (champlain_tile_get_cancellable (tile),
+      tile_cancelled_cb, callback_data->cancelled_data);
+
+  if (callback_data->pending > 0)
+    loser = callback_data->msg ? callback_data->msg : callback_data->hedge_msg;
+  else
+    g_slice_free (TileLoadedData, callback_data);
+
+  /* callback_data is freed by the callback of the loser */
+  if (loser)
+    soup_session_cancel_message (session, loser, SOUP_STATUS_CANCELLED);
+
+  followers = take_followers (CHAMPLAIN_NETWORK_TILE_SOURCE (map_source), tile);
+  orphaned = orphaned && followers == NULL;
+  stats->in_flight--;
+  _champlain_trace_tile ('e', "network", "download", tile);
 
   DEBUG ("Got reply %d", msg->status_code);
 
+  /* the followers request the tile again */
   if (msg->status_code == SOUP_STATUS_CANCELLED)
     {
       DEBUG ("Download of tile %d, %d got cancelled",
           champlain_tile_get_x (tile), champlain_tile_get_y (tile));
+      stats->cancelled++;
       goto cleanup;
     }
 
+  /* The tile is no longer needed but others wait for the same data, the
+     first of them still needed takes its place */
+  if (champlain_tile_is_cancelled (tile))
+    {
+      GList *iter;
+
+      for (iter = followers; iter; iter = iter->next)
+        {
+          if (champlain_tile_get_state (iter->data) != CHAMPLAIN_STATE_DONE &&
+              !champlain_tile_is_cancelled (iter->data))
+            break;
+        }
+
+      if (iter)
+        {
+          g_object_unref (tile);
+          tile = iter->data;
+          followers = g_list_delete_link (followers, iter);
+        }
+    }
+
   if (msg->status_code == SOUP_STATUS_NOT_MODIFIED)
     {
       if (tile_cache)
         champlain_tile_cache_refresh_tile_time (tile_cache, tile);
+      if (orphaned)
+        goto cleanup;
       goto finish;
     }
 
@@ -616,29 +1270,51 @@ tile_loaded_cb (G_GNUC_UNUSED SoupSession *session,
           champlain_tile_get_y (tile),
           soup_status_get_phrase (msg->status_code));
 
+      stats->failures++;
+      if (orphaned)
+        goto cleanup;
       goto load_next;
     }
 
+  stats->bytes_downloaded += msg->response_body->length;
+
   /* Verify if the server sent an etag and save it */
   etag = soup_message_headers_get_one (msg->response_headers, "ETag");
   DEBUG ("Received ETag %s", etag);
 
+  /* The tile actor is gone, store the data without rendering it */
+  if (orphaned)
+    {
+      DEBUG ("Storing detached tile %d, %d",
+          champlain_tile_get_x (tile), champlain_tile_get_y (tile));
+      if (tile_cache)
+        {
+          if (etag != NULL)
+            champlain_tile_set_etag (tile, etag);
+          champlain_tile_cache_store_tile (tile_cache, tile,
+              msg->response_body->data, msg->response_body->length);
+        }
+      goto cleanup;
+    }
+
   renderer = champlain_map_source_get_renderer (map_source);
   g_return_if_fail (CHAMPLAIN_IS_RENDERER (renderer));
 
   data = g_slice_new (TileRenderedData);
   data->map_source = map_source;
   data->etag = g_strdup (etag);
+  data->followers = followers;
 
   g_signal_connect (tile, "render-complete", G_CALLBACK (tile_rendered_cb), data);
 
   champlain_renderer_set_data (renderer, msg->response_body->data, msg->response_body->length);
+  _champlain_map_source_stats_render_begin (map_source, tile);
   champlain_renderer_render (renderer, tile);
 
   return;
 
 load_next:
-  if (next_source)
+  if (next_source && !champlain_tile_is_cancelled (tile))
     champlain_map_source_fill_tile (next_source, tile);
 
   goto cleanup;
@@ -649,6 +1325,7 @@ finish:
   champlain_tile_display_content (tile);
 
 cleanup:
+  complete_followers (map_source, followers, NULL, msg->status_code);
   g_object_unref (tile);
   g_object_unref (map_source);
 }
@@ -658,30 +1335,228 @@ static void
 destroy_cancelled_data (TileCancelledData *data,
     G_GNUC_UNUSED GClosure *closure)
 {
+  if (data->grace_timeout)
+    g_source_remove (data->grace_timeout);
+
+  if (data->reattached_tile)
+    {
+      g_signal_handlers_disconnect_by_func (champlain_tile_get_cancellable (data->reattached_tile),
+          tile_cancelled_cb, data);
+      g_object_unref (data->reattached_tile);
+    }
+
   if (data->map_source)
-    g_object_remove_weak_pointer (G_OBJECT (data->map_source), (gpointer *) &data->map_source);
+    {
+      g_queue_remove (CHAMPLAIN_NETWORK_TILE_SOURCE (data->map_source)->priv->detached_loads, data);
+      g_object_remove_weak_pointer (G_OBJECT (data->map_source), (gpointer *) &data->map_source);
+    }
 
   if (data->msg)
     g_object_remove_weak_pointer (G_OBJECT (data->msg), (gpointer *) &data->msg);
 
+  if (data->hedge_msg)
+    g_object_remove_weak_pointer (G_OBJECT (data->hedge_msg), (gpointer *) &data->hedge_msg);
+
   g_slice_free (TileCancelledData, data);
 }
 
 
 static void
-tile_state_notify (ChamplainTile *tile,
-    G_GNUC_UNUSED GParamSpec *pspec,
+cancel_load_messages (SoupSession *session,
+    TileCancelledData *data)
+{
+  SoupMessage *msg = data->msg;
+  SoupMessage *hedge_msg = data->hedge_msg;
+
+  /* data may be freed by tile_loaded_cb() from now on */
+  if (hedge_msg)
+    soup_session_cancel_message (session, hedge_msg, SOUP_STATUS_CANCELLED);
+  if (msg)
+    soup_session_cancel_message (session, msg, SOUP_STATUS_CANCELLED);
+}
+
+
+/* Cancelling @tile detaches the download again */
+static void
+watch_tile (TileCancelledData *data,
+    ChamplainTile *tile)
+{
+  if (data->reattached_tile)
+    {
+      g_signal_handlers_disconnect_by_func (champlain_tile_get_cancellable (data->reattached_tile),
+          tile_cancelled_cb, data);
+      g_object_unref (data->reattached_tile);
+    }
+  data->reattached_tile = g_object_ref (tile);
+  g_signal_connect (champlain_tile_get_cancellable (tile), "cancelled",
+      G_CALLBACK (tile_cancelled_cb), data);
+}
+
+
+/* Another view still waits for the download, it continues for that tile
+ * instead of being subject to the budget of detached downloads */
+static gboolean
+hand_over_load (TileCancelledData *data)
+{
+  ChamplainTile *follower = find_live_follower (CHAMPLAIN_NETWORK_TILE_SOURCE (data->map_source),
+        data->tile);
+
+  if (!follower)
+    return FALSE;
+
+  DEBUG ("Handing tile download over to a waiting tile");
+  data->detached = FALSE;
+  watch_tile (data, follower);
+
+  return TRUE;
+}
+
+
+static void
+cancel_detached_load (TileCancelledData *data)
+{
+  ChamplainNetworkTileSourcePrivate *priv = CHAMPLAIN_NETWORK_TILE_SOURCE (data->map_source)->priv;
+
+  g_queue_remove (priv->detached_loads, data);
+  if (data->grace_timeout)
+    {
+      g_source_remove (data->grace_timeout);
+      data->grace_timeout = 0;
+    }
+
+  if (hand_over_load (data))
+    return;
+
+  if (priv->soup_session)
+    cancel_load_messages (priv->soup_session, data);
+}
+
+
+static gboolean
+detached_load_expired_cb (TileCancelledData *data)
+{
+  DEBUG ("Grace time of a detached tile download expired");
+  data->grace_timeout = 0;
+  cancel_detached_load (data);
+
+  return FALSE;
+}
+
+
+/* The tile came back into the view while its detached download is running */
+static void
+reattach_load (ChamplainNetworkTileSource *tile_source,
+    ChamplainTile *tile)
+{
+  ChamplainNetworkTileSourcePrivate *priv = tile_source->priv;
+  GList *iter;
+
+  for (iter = priv->detached_loads->head; iter; iter = iter->next)
+    {
+      TileCancelledData *data = iter->data;
+
+      if (champlain_tile_get_x (data->tile) == champlain_tile_get_x (tile) &&
+          champlain_tile_get_y (data->tile) == champlain_tile_get_y (tile) &&
+          champlain_tile_get_zoom_level (data->tile) == champlain_tile_get_zoom_level (tile))
+        {
+          DEBUG ("Reattaching tile download");
+          g_queue_delete_link (priv->detached_loads, iter);
+          g_source_remove (data->grace_timeout);
+          data->grace_timeout = 0;
+          data->detached = FALSE;
+          watch_tile (data, tile);
+          return;
+        }
+    }
+}
+
+
+/* The view no longer needs the tile. Instead of throwing the partially
+ * downloaded data away, the download may finish into the cache within the
+ * grace time and the budget of detached downloads. */
+static void
+tile_cancelled_cb (G_GNUC_UNUSED GCancellable *cancellable,
     TileCancelledData *data)
 {
-  if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_DONE && data->map_source && data->msg)
+  if (data->map_source && (data->msg || data->hedge_msg) && !data->detached)
     {
-      DEBUG ("Canceling tile download");
       ChamplainNetworkTileSourcePrivate *priv = CHAMPLAIN_NETWORK_TILE_SOURCE (data->map_source)->priv;
-      soup_session_cancel_message (priv->soup_session, data->msg, SOUP_STATUS_CANCELLED);
+
+      if (hand_over_load (data))
+        return;
+
+      if (priv->detach_grace_time == 0 || priv->max_detached_loads == 0)
+        {
+          DEBUG ("Canceling tile download");
+          cancel_load_messages (priv->soup_session, data);
+          return;
+        }
+
+      DEBUG ("Detaching tile download");
+      data->detached = TRUE;
+      data->grace_timeout = g_timeout_add (priv->detach_grace_time,
+            (GSourceFunc) detached_load_expired_cb, data);
+      g_queue_push_tail (priv->detached_loads, data);
+
+      while (g_queue_get_length (priv->detached_loads) > priv->max_detached_loads)
+        cancel_detached_load (g_queue_peek_head (priv->detached_loads));
     }
 }
 
 
+/* The download takes longer than most of the recent ones, the same tile is
+ * requested from a mirror as well and the first response wins */
+static gboolean
+hedge_timeout_cb (TileLoadedData *callback_data)
+{
+  ChamplainNetworkTileSourcePrivate *priv = CHAMPLAIN_NETWORK_TILE_SOURCE (callback_data->map_source)->priv;
+  TileCancelledData *cancelled_data = callback_data->cancelled_data;
+  ChamplainTile *tile = callback_data->tile;
+  SoupMessageHeadersIter iter;
+  const gchar *name, *value;
+  SoupMessage *msg;
+  gchar *uri;
+
+  callback_data->hedge_timeout = 0;
+
+  /* nobody waits for the tile any more */
+  if (cancelled_data->detached || !priv->soup_session ||
+      !priv->mirror_uri_formats || !priv->mirror_uri_formats[0])
+    return FALSE;
+
+  uri = _champlain_format_tile_uri (
+        priv->mirror_uri_formats[priv->next_mirror++ % g_strv_length (priv->mirror_uri_formats)],
+        champlain_tile_get_x (tile),
+        champlain_tile_get_y (tile),
+        champlain_tile_get_zoom_level (tile),
+        NULL, NULL);
+  msg = soup_message_new (SOUP_METHOD_GET, uri);
+  if (!msg)
+    {
+      DEBUG ("Invalid mirror URI %s", uri);
+      g_free (uri);
+      return FALSE;
+    }
+  DEBUG ("Hedging slow tile download with %s", uri);
+  g_free (uri);
+
+  /* the same validation headers as the original request */
+  soup_message_headers_iter_init (&iter, callback_data->msg->request_headers);
+  while (soup_message_headers_iter_next (&iter, &name, &value))
+    soup_message_headers_append (msg->request_headers, name, value);
+
+  callback_data->hedge_msg = msg;
+  callback_data->pending++;
+  cancelled_data->hedge_msg = msg;
+  g_object_add_weak_pointer (G_OBJECT (msg), (gpointer *) &cancelled_data->hedge_msg);
+
+  _champlain_map_source_peek_stats (callback_data->map_source)->hedged++;
+  soup_session_queue_message (priv->soup_session, msg, tile_loaded_cb, callback_data);
+
+  return FALSE;
+}
+
+
 static gchar *
 get_modified_time_string (ChamplainTile *tile)
 {
@@ -707,6 +1582,420 @@ get_modified_time_string (ChamplainTile *tile)
 }
 
 
+static gboolean
+slice_draw_cb (G_GNUC_UNUSED ClutterCanvas *canvas,
+    cairo_t *cr,
+    G_GNUC_UNUSED gint width,
+    G_GNUC_UNUSED gint height,
+    ChamplainTile *tile)
+{
+  cairo_surface_t *surface;
+
+  surface = champlain_exportable_get_surface (CHAMPLAIN_EXPORTABLE (tile));
+
+  /* Clear the drawing area */
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+
+  if (surface)
+    {
+      cairo_set_source_surface (cr, surface, 0, 0);
+      cairo_paint (cr);
+    }
+
+  return FALSE;
+}
+
+
+/* Extracts the part of the large tile covered by the regular tile x, y
+   at zoom level z */
+static cairo_surface_t *
+create_slice (cairo_surface_t *large_surface,
+    gint n,
+    gint first_x,
+    gint first_y,
+    guint size,
+    gint x,
+    gint y)
+{
+  gdouble cell = (gdouble) cairo_image_surface_get_width (large_surface) / n;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, size, size);
+  cr = cairo_create (surface);
+  cairo_scale (cr, size / cell, size / cell);
+  cairo_set_source_surface (cr, large_surface,
+      -(x - first_x) * cell,
+      -(y - first_y) * cell);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+
+  return surface;
+}
+
+
+static cairo_status_t
+write_png_cb (GByteArray *array,
+    const guchar *data,
+    guint length)
+{
+  g_byte_array_append (array, data, length);
+  return CAIRO_STATUS_SUCCESS;
+}
+
+
+static void
+display_surface (ChamplainTile *tile,
+    cairo_surface_t *surface)
+{
+  guint size = champlain_tile_get_size (tile);
+  ClutterContent *content;
+  ClutterActor *actor;
+
+  champlain_exportable_set_surface (CHAMPLAIN_EXPORTABLE (tile), surface);
+
+  content = clutter_canvas_new ();
+  clutter_canvas_set_size (CLUTTER_CANVAS (content), size, size);
+  g_signal_connect (content, "draw", G_CALLBACK (slice_draw_cb), tile);
+  clutter_content_invalidate (content);
+
+  actor = clutter_actor_new ();
+  clutter_actor_set_size (actor, size, size);
+  clutter_actor_set_content (actor, content);
+  g_object_unref (content);
+  /* has to be set for proper opacity */
+  clutter_actor_set_offscreen_redirect (actor, CLUTTER_OFFSCREEN_REDIRECT_AUTOMATIC_FOR_OPACITY);
+
+  champlain_tile_set_content (tile, actor);
+  champlain_tile_set_fade_in (tile, TRUE);
+  champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
+  champlain_tile_display_content (tile);
+}
+
+
+static void
+large_tile_load_free (LargeTileLoad *load)
+{
+  ChamplainNetworkTileSourcePrivate *priv = CHAMPLAIN_NETWORK_TILE_SOURCE (load->map_source)->priv;
+
+  g_hash_table_remove (priv->large_tile_loads, load->key);
+  g_list_free_full (load->tiles, g_object_unref);
+  g_object_unref (load->map_source);
+  g_free (load->key);
+  g_slice_free (LargeTileLoad, load);
+}
+
+
+static void large_tile_cancelled_cb (GCancellable *cancellable,
+    LargeTileLoad *load);
+
+
+/* Stores one slice per main loop iteration so that the frames are not
+   delayed by all of them */
+static gboolean
+store_slices_cb (SliceStoreJob *job)
+{
+  if (job->next < job->pngs->len)
+    {
+      GByteArray *png = g_ptr_array_index (job->pngs, job->next);
+      gint x = job->x + job->next / job->n;
+      gint y = job->y + job->next % job->n;
+      ChamplainTile *cache_tile;
+
+      job->next++;
+      if (png->len == 0)
+        return TRUE;
+
+      cache_tile = champlain_tile_new_full (x, y, job->tile_size, job->z);
+      g_object_ref_sink (cache_tile);
+      champlain_tile_cache_store_tile (job->tile_cache, cache_tile, (const gchar *) png->data, png->len);
+      clutter_actor_destroy (CLUTTER_ACTOR (cache_tile));
+      g_object_unref (cache_tile);
+
+      return TRUE;
+    }
+
+  g_ptr_array_free (job->pngs, TRUE);
+  cairo_surface_destroy (job->large_surface);
+  g_object_unref (job->tile_cache);
+  g_object_unref (job->map_source);
+  g_slice_free (SliceStoreJob, job);
+
+  return FALSE;
+}
+
+
+static void
+slice_worker_thread (gpointer data,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  SliceStoreJob *job = data;
+  gint i, j;
+
+  for (i = 0; i < job->n; i++)
+    for (j = 0; j < job->n; j++)
+      {
+        cairo_surface_t *slice = create_slice (job->large_surface, job->n, job->x, job->y,
+              job->tile_size, job->x + i, job->y + j);
+        GByteArray *png = g_byte_array_new ();
+
+        /* an empty slice is skipped when storing */
+        if (cairo_surface_write_to_png_stream (slice, (cairo_write_func_t) write_png_cb, png) != CAIRO_STATUS_SUCCESS)
+          g_byte_array_set_size (png, 0);
+        g_ptr_array_add (job->pngs, png);
+        cairo_surface_destroy (slice);
+      }
+
+  clutter_threads_add_idle_full (G_PRIORITY_LOW, (GSourceFunc) store_slices_cb, job, NULL);
+}
+
+
+static void
+store_slices (LargeTileLoad *load,
+    ChamplainTileCache *tile_cache,
+    cairo_surface_t *large_surface,
+    guint tile_size)
+{
+  ChamplainNetworkTileSourcePrivate *priv = CHAMPLAIN_NETWORK_TILE_SOURCE (load->map_source)->priv;
+  SliceStoreJob *job = g_slice_new (SliceStoreJob);
+  GError *error = NULL;
+
+  job->map_source = g_object_ref (load->map_source);
+  job->tile_cache = g_object_ref (tile_cache);
+  job->large_surface = cairo_surface_reference (large_surface);
+  job->x = load->x * load->n;
+  job->y = load->y * load->n;
+  job->z = load->n == 1 ? load->z : load->z + 1;
+  job->n = load->n;
+  job->tile_size = tile_size;
+  job->pngs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_byte_array_unref);
+  job->next = 0;
+
+  if (!priv->slice_pool)
+    priv->slice_pool = g_thread_pool_new (slice_worker_thread, NULL, 1, FALSE, NULL);
+
+  g_thread_pool_push (priv->slice_pool, job, &error);
+  if (error)
+    {
+      DEBUG ("Thread pool error: %s", error->message);
+      g_error_free (error);
+      store_slices_cb (job);
+    }
+}
+
+
+static void
+large_tile_fail (LargeTileLoad *load)
+{
+  ChamplainMapSource *next_source = champlain_map_source_get_next_source (load->map_source);
+  GList *iter;
+
+  for (iter = load->tiles; iter; iter = iter->next)
+    {
+      ChamplainTile *tile = iter->data;
+
+      if (champlain_tile_get_state (tile) != CHAMPLAIN_STATE_DONE &&
+          !champlain_tile_is_cancelled (tile) && next_source)
+        champlain_map_source_fill_tile (next_source, tile);
+    }
+}
+
+
+static void
+large_tile_rendered_cb (ChamplainTile *large_tile,
+    G_GNUC_UNUSED gpointer data,
+    G_GNUC_UNUSED guint size,
+    gboolean error,
+    LargeTileLoad *load)
+{
+  ChamplainMapSource *map_source = load->map_source;
+  ChamplainTileCache *tile_cache = champlain_tile_source_get_cache (CHAMPLAIN_TILE_SOURCE (map_source));
+  guint tile_size = champlain_map_source_get_tile_size (map_source);
+  cairo_surface_t *large_surface;
+  GList *iter;
+
+  g_signal_handlers_disconnect_by_func (large_tile, large_tile_rendered_cb, load);
+  _champlain_map_source_stats_render_end (map_source, large_tile);
+
+  large_surface = champlain_exportable_get_surface (CHAMPLAIN_EXPORTABLE (large_tile));
+  if (error || !large_surface)
+    {
+      _champlain_map_source_peek_stats (map_source)->failures++;
+      large_tile_fail (load);
+      goto cleanup;
+    }
+
+  /* only the slices of the waiting tiles are needed right away */
+  for (iter = load->tiles; iter; iter = iter->next)
+    {
+      ChamplainTile *tile = iter->data;
+      cairo_surface_t *slice;
+
+      if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_DONE ||
+          champlain_tile_is_cancelled (tile))
+        continue;
+
+      slice = create_slice (large_surface, load->n, load->x * load->n, load->y * load->n,
+            tile_size, champlain_tile_get_x (tile), champlain_tile_get_y (tile));
+      display_surface (tile, slice);
+      cairo_surface_destroy (slice);
+    }
+
+  /* the encoding of all of them for the cache is slow */
+  if (tile_cache)
+    store_slices (load, tile_cache, large_surface, tile_size);
+
+cleanup:
+  clutter_actor_destroy (CLUTTER_ACTOR (large_tile));
+  g_object_unref (large_tile);
+  large_tile_load_free (load);
+}
+
+
+static void
+large_tile_loaded_cb (G_GNUC_UNUSED SoupSession *session,
+    SoupMessage *msg,
+    LargeTileLoad *load)
+{
+  ChamplainMapSource *map_source = load->map_source;
+  ChamplainMapSourceStats *stats = _champlain_map_source_peek_stats (map_source);
+  ChamplainRenderer *renderer;
+  ChamplainTile *large_tile;
+  GList *iter;
+
+  for (iter = load->tiles; iter; iter = iter->next)
+    g_signal_handlers_disconnect_by_func (champlain_tile_get_cancellable (iter->data),
+        large_tile_cancelled_cb, load);
+  load->msg = NULL;
+  stats->in_flight--;
+  _champlain_trace_async ('e', "network", "download large tile", load, load->z, load->x, load->y);
+
+  DEBUG ("Got reply %d for large tile %s", msg->status_code, load->key);
+
+  if (msg->status_code == SOUP_STATUS_CANCELLED)
+    {
+      stats->cancelled++;
+      large_tile_load_free (load);
+      return;
+    }
+
+  if (!SOUP_STATUS_IS_SUCCESSFUL (msg->status_code))
+    {
+      stats->failures++;
+      large_tile_fail (load);
+      large_tile_load_free (load);
+      return;
+    }
+
+  stats->bytes_downloaded += msg->response_body->length;
+
+  renderer = champlain_map_source_get_renderer (map_source);
+
+  /* decode the large tile only once, off-stage */
+  large_tile = champlain_tile_new_full (load->x, load->y,
+        2 * champlain_map_source_get_tile_size (map_source), load->z);
+  g_object_ref_sink (large_tile);
+  g_signal_connect (large_tile, "render-complete", G_CALLBACK (large_tile_rendered_cb), load);
+
+  champlain_renderer_set_data (renderer, msg->response_body->data, msg->response_body->length);
+  _champlain_map_source_stats_render_begin (map_source, large_tile);
+  champlain_renderer_render (renderer, large_tile);
+}
+
+
+static void
+large_tile_cancelled_cb (G_GNUC_UNUSED GCancellable *cancellable,
+    LargeTileLoad *load)
+{
+  GList *iter;
+
+  if (!load->msg)
+    return;
+
+  /* cancel only when none of the covered tiles is waiting */
+  for (iter = load->tiles; iter; iter = iter->next)
+    {
+      if (champlain_tile_get_state (iter->data) != CHAMPLAIN_STATE_DONE &&
+          !champlain_tile_is_cancelled (iter->data))
+        return;
+    }
+
+  DEBUG ("Canceling large tile download");
+  soup_session_cancel_message (CHAMPLAIN_NETWORK_TILE_SOURCE (load->map_source)->priv->soup_session,
+      load->msg, SOUP_STATUS_CANCELLED);
+}
+
+
+static void
+fill_tile_large (ChamplainMapSource *map_source,
+    ChamplainTile *tile)
+{
+  ChamplainNetworkTileSource *tile_source = CHAMPLAIN_NETWORK_TILE_SOURCE (map_source);
+  ChamplainNetworkTileSourcePrivate *priv = tile_source->priv;
+  gint z = champlain_tile_get_zoom_level (tile);
+  gint x = champlain_tile_get_x (tile);
+  gint y = champlain_tile_get_y (tile);
+  gint n = 1;
+  LargeTileLoad *load;
+  gchar *key;
+  gchar *uri;
+
+  /* the large tile one zoom level up covers 2x2 tiles, at zoom level 0 the
+     single large tile is shrunk instead */
+  if (z > 0)
+    {
+      z--;
+      x /= 2;
+      y /= 2;
+      n = 2;
+    }
+
+  key = g_strdup_printf ("%d/%d/%d/%d", z, x, y, n);
+  load = g_hash_table_lookup (priv->large_tile_loads, key);
+  if (load)
+    {
+      g_free (key);
+      load->tiles = g_list_prepend (load->tiles, g_object_ref (tile));
+      if (load->msg)
+        g_signal_connect (champlain_tile_get_cancellable (tile), "cancelled",
+            G_CALLBACK (large_tile_cancelled_cb), load);
+      return;
+    }
+
+  uri = get_tile_uri (tile_source, x, y, z);
+  DEBUG ("Loading large tile %s from %s", key, uri);
+
+  load = g_slice_new (LargeTileLoad);
+  load->map_source = g_object_ref (map_source);
+  load->key = key;
+  load->x = x;
+  load->y = y;
+  load->z = z;
+  load->n = n;
+  load->tiles = g_list_prepend (NULL, g_object_ref (tile));
+  load->msg = soup_message_new (SOUP_METHOD_GET, uri);
+  g_free (uri);
+  g_hash_table_insert (priv->large_tile_loads, load->key, load);
+
+  if (!load->msg)
+    {
+      large_tile_fail (load);
+      large_tile_load_free (load);
+      return;
+    }
+
+  g_signal_connect (champlain_tile_get_cancellable (tile), "cancelled",
+      G_CALLBACK (large_tile_cancelled_cb), load);
+
+  _champlain_map_source_peek_stats (map_source)->in_flight++;
+  _champlain_trace_async ('b', "network", "download large tile", load, z, x, y);
+  soup_session_queue_message (priv->soup_session, load->msg,
+      (SoupSessionCallback) large_tile_loaded_cb, load);
+}
+
+
 static void
 fill_tile (ChamplainMapSource *map_source,
     ChamplainTile *tile)
@@ -717,14 +2006,31 @@ fill_tile (ChamplainMapSource *map_source,
   ChamplainNetworkTileSource *tile_source = CHAMPLAIN_NETWORK_TILE_SOURCE (map_source);
   ChamplainNetworkTileSourcePrivate *priv = tile_source->priv;
 
-  if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_DONE)
+  if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_DONE || champlain_tile_is_cancelled (tile))
     return;
 
-  if (!priv->offline)
+  if (!priv->offline && priv->large_tiles)
+    fill_tile_large (map_source, tile);
+  else if (!priv->offline)
     {
       TileLoadedData *callback_data;
       SoupMessage *msg;
       gchar *uri;
+      gchar *key;
+      gpointer followers;
+
+      /* the same tile is already being downloaded, e.g. for another view
+         sharing this source */
+      key = get_tile_key (tile);
+      if (g_hash_table_lookup_extended (priv->tile_loads, key, NULL, &followers))
+        {
+          DEBUG ("Tile %s already being downloaded", key);
+          reattach_load (tile_source, tile);
+          followers = g_list_prepend (followers, g_object_ref (tile));
+          g_hash_table_insert (priv->tile_loads, key, followers);
+          return;
+        }
+      g_hash_table_insert (priv->tile_loads, key, NULL);
 
       uri = get_tile_uri (tile_source,
             champlain_tile_get_x (tile),
@@ -763,21 +2069,39 @@ fill_tile (ChamplainMapSource *map_source,
       TileCancelledData *tile_cancelled_data = g_slice_new (TileCancelledData);
       tile_cancelled_data->map_source = map_source;
       tile_cancelled_data->msg = msg;
+      tile_cancelled_data->hedge_msg = NULL;
+      tile_cancelled_data->tile = tile;
+      tile_cancelled_data->detached = FALSE;
+      tile_cancelled_data->grace_timeout = 0;
+      tile_cancelled_data->reattached_tile = NULL;
 
       g_object_add_weak_pointer (G_OBJECT (msg), (gpointer *) &tile_cancelled_data->msg);
       g_object_add_weak_pointer (G_OBJECT (map_source), (gpointer *) &tile_cancelled_data->map_source);
 
-      g_signal_connect_data (tile, "notify::state", G_CALLBACK (tile_state_notify),
-          tile_cancelled_data, (GClosureNotify) destroy_cancelled_data, 0);
+      g_signal_connect_data (champlain_tile_get_cancellable (tile), "cancelled",
+          G_CALLBACK (tile_cancelled_cb), tile_cancelled_data,
+          (GClosureNotify) destroy_cancelled_data, 0);
 
       callback_data = g_slice_new (TileLoadedData);
       callback_data->tile = tile;
       callback_data->map_source = map_source;
       callback_data->cancelled_data = tile_cancelled_data;
+      callback_data->start_time = g_get_monotonic_time ();
+      callback_data->msg = msg;
+      callback_data->hedge_msg = NULL;
+      callback_data->hedge_timeout = 0;
+      callback_data->pending = 1;
+      callback_data->completed = FALSE;
+
+      if (priv->mirror_uri_formats && priv->mirror_uri_formats[0])
+        callback_data->hedge_timeout = g_timeout_add (get_hedge_delay (priv),
+              (GSourceFunc) hedge_timeout_cb, callback_data);
 
       g_object_ref (map_source);
       g_object_ref (tile);
 
+      _champlain_map_source_peek_stats (map_source)->in_flight++;
+      _champlain_trace_tile ('b', "network", "download", tile);
       soup_session_queue_message (priv->soup_session, msg,
           tile_loaded_cb,
           callback_data);
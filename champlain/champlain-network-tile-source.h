@@ -96,6 +96,22 @@ const gchar *champlain_network_tile_source_get_proxy_uri (ChamplainNetworkTileSo
 void champlain_network_tile_source_set_proxy_uri (ChamplainNetworkTileSource *tile_source,
     const gchar *proxy_uri);
 
+gboolean champlain_network_tile_source_get_large_tiles (ChamplainNetworkTileSource *tile_source);
+void champlain_network_tile_source_set_large_tiles (ChamplainNetworkTileSource *tile_source,
+    gboolean large_tiles);
+
+guint champlain_network_tile_source_get_detach_grace_time (ChamplainNetworkTileSource *tile_source);
+void champlain_network_tile_source_set_detach_grace_time (ChamplainNetworkTileSource *tile_source,
+    guint grace_time);
+
+guint champlain_network_tile_source_get_max_detached_loads (ChamplainNetworkTileSource *tile_source);
+void champlain_network_tile_source_set_max_detached_loads (ChamplainNetworkTileSource *tile_source,
+    guint max_loads);
+
+const gchar * const *champlain_network_tile_source_get_mirror_uri_formats (ChamplainNetworkTileSource *tile_source);
+void champlain_network_tile_source_set_mirror_uri_formats (ChamplainNetworkTileSource *tile_source,
+    const gchar * const *uri_formats);
+
 G_END_DECLS
 
 #endif /* _CHAMPLAIN_NETWORK_TILE_SOURCE_H_ */
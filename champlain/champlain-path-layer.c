@@ -412,6 +412,8 @@ champlain_path_layer_init (ChamplainPathLayer *self)
 
   priv->right_canvas = clutter_canvas_new ();
   priv->left_canvas = clutter_canvas_new ();
+  _champlain_memory_usage_track_canvas (priv->right_canvas, CHAMPLAIN_MEMORY_CATEGORY_PATH_CANVASES);
+  _champlain_memory_usage_track_canvas (priv->left_canvas, CHAMPLAIN_MEMORY_CATEGORY_PATH_CANVASES);
 
   clutter_canvas_set_size (CLUTTER_CANVAS (priv->right_canvas), 255, 255);
   clutter_canvas_set_size (CLUTTER_CANVAS (priv->left_canvas), 0, 0);
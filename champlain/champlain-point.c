@@ -287,6 +287,7 @@ champlain_point_init (ChamplainPoint *point)
   priv->color = clutter_color_copy (&DEFAULT_COLOR);
   priv->size = 12;
   priv->canvas = clutter_canvas_new ();
+  _champlain_memory_usage_track_canvas (priv->canvas, CHAMPLAIN_MEMORY_CATEGORY_POINT_CANVASES);
   g_signal_connect (priv->canvas, "draw", G_CALLBACK (draw), point);
   clutter_canvas_set_size (CLUTTER_CANVAS (priv->canvas), priv->size, priv->size);
   clutter_actor_set_size (CLUTTER_ACTOR (point), priv->size, priv->size);
@@ -22,6 +22,14 @@
 #include <glib.h>
 #include <clutter/clutter.h>
 
+#include "champlain-layer.h"
+#include "champlain-map-source.h"
+#include "champlain-map-source-chain.h"
+#include "champlain-bounding-box.h"
+#include "champlain-memory-cache.h"
+#include "champlain-memory-usage.h"
+#include "champlain-network-tile-source.h"
+
 
 #define CHAMPLAIN_PARAM_READABLE     \
   (G_PARAM_READABLE |     \
@@ -31,4 +39,99 @@
   (G_PARAM_READABLE | G_PARAM_WRITABLE | \
    G_PARAM_STATIC_NICK | G_PARAM_STATIC_NAME | G_PARAM_STATIC_BLURB)
 
+/* Virtual functions added after the class structures of the 0.12 series,
+   registered per type so that the size of the class structures stays the
+   same. Subtypes inherit the function of the nearest ancestor. */
+void _champlain_type_set_vfunc (GType type,
+    const gchar *name,
+    gpointer func);
+gpointer _champlain_type_get_vfunc (GType type,
+    const gchar *name);
+
+/* Removal of the cached tiles within an area, registered as
+   "invalidate-area", see champlain_tile_cache_invalidate_area() */
+typedef void (*ChamplainInvalidateAreaFunc) (ChamplainTileCache *tile_cache,
+    ChamplainBoundingBox *bbox);
+
+/* Sets data which only changes the rendering within @area, e.g. data
+   extended by newly loaded parts, see champlain-renderer.c */
+void _champlain_renderer_set_data_in_area (ChamplainRenderer *renderer,
+    const gchar *data,
+    guint size,
+    ChamplainBoundingBox *area);
+ChamplainBoundingBox *_champlain_renderer_get_data_area (ChamplainRenderer *renderer);
+
+/* Statistics counters updated by the map source implementations */
+ChamplainMapSourceStats *_champlain_map_source_peek_stats (ChamplainMapSource *map_source);
+void _champlain_map_source_stats_render_begin (ChamplainMapSource *map_source,
+    ChamplainTile *tile);
+void _champlain_map_source_stats_render_end (ChamplainMapSource *map_source,
+    ChamplainTile *tile);
+
+/* Invalidation of the tiles affected by a change of the rendered data, a
+   NULL bbox stands for everything */
+gboolean _champlain_map_source_tile_in_area (ChamplainMapSource *map_source,
+    guint zoom_level,
+    gint x,
+    gint y,
+    ChamplainBoundingBox *bbox);
+gboolean _champlain_map_source_uses_renderer (ChamplainMapSource *map_source,
+    ChamplainRenderer *renderer);
+gboolean _champlain_map_source_chain_invalidate_area (ChamplainMapSourceChain *source_chain,
+    ChamplainRenderer *renderer,
+    ChamplainBoundingBox *bbox);
+
+/* Tile lifecycle tracing, see champlain-trace.c. The phase is the Chrome
+   trace event phase: 'b' begins a span, 'e' ends it, 'n' is an instant */
+void _champlain_trace_init_from_env (void);
+void _champlain_trace_async (gchar phase,
+    const gchar *category,
+    const gchar *name,
+    gconstpointer id,
+    guint zoom_level,
+    guint x,
+    guint y);
+void _champlain_trace_tile (gchar phase,
+    const gchar *category,
+    const gchar *name,
+    ChamplainTile *tile);
+
+/* Memory accounting, see champlain-memory-usage.c */
+void _champlain_memory_usage_init_from_env (void);
+void _champlain_memory_usage_add (ChamplainMemoryCategory category,
+    gssize bytes);
+void _champlain_memory_usage_track_surface (cairo_surface_t *surface,
+    ChamplainMemoryCategory category);
+void _champlain_memory_usage_track_object (GObject *object,
+    ChamplainMemoryCategory category,
+    gsize bytes);
+void _champlain_memory_usage_track_canvas (ClutterContent *canvas,
+    ChamplainMemoryCategory category);
+
+/* Called by champlain_trim_memory() until the object is finalized */
+typedef void (*ChamplainTrimFunc) (GObject *object,
+    ChamplainTrimLevel level);
+void _champlain_memory_usage_add_trim_handler (GObject *object,
+    ChamplainTrimFunc func);
+
+/* Releases the surface of a displayed tile, see champlain_trim_memory() */
+void _champlain_tile_drop_surface (ChamplainTile *tile);
+
+/* Formatting of the URIs of tiles, see champlain-network-tile-source.c */
+typedef gchar *(*ChamplainUriTokenFunc) (const gchar *token,
+    gpointer user_data);
+gchar *_champlain_format_tile_uri (const gchar *uri_format,
+    gint x,
+    gint y,
+    gint z,
+    ChamplainUriTokenFunc token_func,
+    gpointer user_data);
+
+/* Interaction recording, see champlain-recording.c */
+GList *_champlain_view_get_user_layers (ChamplainView *view);
+void _champlain_recording_layer_added (ChamplainView *view,
+    ChamplainLayer *layer);
+void _champlain_recording_layer_removed (ChamplainView *view,
+    ChamplainLayer *layer);
+
 #endif
@@ -0,0 +1,684 @@
+/*
+ * Copyright (C) 2010-2013 Jiri Techet <techet@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:champlain-recording
+ * @short_description: Recording and replaying of view interactions
+ *
+ * A recording is a timestamped log of everything the user or the
+ * application did with a #ChamplainView: changes of the size, the map
+ * source, the zoom level and the center, and layers, markers and path
+ * nodes being added or removed. Recordings made in the field can be
+ * replayed into another view, shown on a stage or not, at the original or
+ * an accelerated speed, which turns them into reproducible benchmark
+ * inputs.
+ *
+ * Only the positions of markers and path nodes are recorded; replayed
+ * markers are #ChamplainPoint instances. Nodes added to a path layer after
+ * the layer was added to the view are not recorded.
+ *
+ * The file is a text file with one event per line, starting with the
+ * number of milliseconds since the start of the recording.
+ */
+
+#include "config.h"
+
+#include "champlain-recording.h"
+#include "champlain-private.h"
+#include "champlain.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#define RECORDING_HEADER "# libchamplain recording 1"
+
+typedef struct
+{
+  ChamplainView *view;
+  FILE *file;
+  gint64 start_time;
+  /* ChamplainLayer -> id */
+  GHashTable *layers;
+  guint next_layer_id;
+  gdouble latitude;
+  gdouble longitude;
+  gfloat width;
+  gfloat height;
+} Recording;
+
+typedef struct
+{
+  ChamplainView *view;
+  gchar **lines;
+  guint pos;
+  gdouble speed;
+  gint64 start_time;
+  guint timeout_id;
+  /* id -> ChamplainLayer created by the replay */
+  GHashTable *layers;
+} Replay;
+
+
+static void
+write_event (Recording *recording,
+    const gchar *format,
+    ...)
+{
+  va_list args;
+
+  fprintf (recording->file, "%" G_GINT64_FORMAT " ",
+      (g_get_monotonic_time () - recording->start_time) / 1000);
+
+  va_start (args, format);
+  vfprintf (recording->file, format, args);
+  va_end (args);
+
+  fputc ('\n', recording->file);
+}
+
+
+/* Doubles are written independently of the locale */
+static void
+write_location_event (Recording *recording,
+    const gchar *event,
+    guint layer_id,
+    gdouble latitude,
+    gdouble longitude)
+{
+  gchar lat[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar lon[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_ascii_formatd (lat, sizeof (lat), "%.7f", latitude);
+  g_ascii_formatd (lon, sizeof (lon), "%.7f", longitude);
+  write_event (recording, "%s %u %s %s", event, layer_id, lat, lon);
+}
+
+
+static void
+record_size (Recording *recording)
+{
+  gfloat width, height;
+
+  clutter_actor_get_size (CLUTTER_ACTOR (recording->view), &width, &height);
+  if (width == recording->width && height == recording->height)
+    return;
+
+  recording->width = width;
+  recording->height = height;
+  write_event (recording, "size %d %d", (gint) width, (gint) height);
+}
+
+
+static void
+record_center (Recording *recording)
+{
+  gdouble latitude = champlain_view_get_center_latitude (recording->view);
+  gdouble longitude = champlain_view_get_center_longitude (recording->view);
+  gchar lat[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar lon[G_ASCII_DTOSTR_BUF_SIZE];
+
+  /* latitude and longitude are notified separately for a single move */
+  if (latitude == recording->latitude && longitude == recording->longitude)
+    return;
+
+  recording->latitude = latitude;
+  recording->longitude = longitude;
+  g_ascii_formatd (lat, sizeof (lat), "%.7f", latitude);
+  g_ascii_formatd (lon, sizeof (lon), "%.7f", longitude);
+  write_event (recording, "center %s %s", lat, lon);
+}
+
+
+static void
+record_zoom (Recording *recording)
+{
+  write_event (recording, "zoom %u", champlain_view_get_zoom_level (recording->view));
+}
+
+
+static void
+record_source (Recording *recording)
+{
+  ChamplainMapSource *source = champlain_view_get_map_source (recording->view);
+
+  write_event (recording, "source %s", champlain_map_source_get_id (source));
+}
+
+
+static void
+view_notify_cb (G_GNUC_UNUSED ChamplainView *view,
+    GParamSpec *pspec,
+    Recording *recording)
+{
+  if (pspec->name == g_intern_static_string ("width") ||
+      pspec->name == g_intern_static_string ("height"))
+    record_size (recording);
+  else if (pspec->name == g_intern_static_string ("latitude") ||
+           pspec->name == g_intern_static_string ("longitude"))
+    record_center (recording);
+  else if (pspec->name == g_intern_static_string ("zoom-level"))
+    record_zoom (recording);
+  else if (pspec->name == g_intern_static_string ("map-source"))
+    record_source (recording);
+}
+
+
+static void
+marker_added_cb (ChamplainMarkerLayer *layer,
+    ClutterActor *marker,
+    Recording *recording)
+{
+  guint id = GPOINTER_TO_UINT (g_hash_table_lookup (recording->layers, layer));
+
+  write_location_event (recording, "marker+", id,
+      champlain_location_get_latitude (CHAMPLAIN_LOCATION (marker)),
+      champlain_location_get_longitude (CHAMPLAIN_LOCATION (marker)));
+}
+
+
+static void
+marker_removed_cb (ChamplainMarkerLayer *layer,
+    ClutterActor *marker,
+    Recording *recording)
+{
+  guint id = GPOINTER_TO_UINT (g_hash_table_lookup (recording->layers, layer));
+
+  write_location_event (recording, "marker-", id,
+      champlain_location_get_latitude (CHAMPLAIN_LOCATION (marker)),
+      champlain_location_get_longitude (CHAMPLAIN_LOCATION (marker)));
+}
+
+
+static void untrack_layer (Recording *recording,
+    ChamplainLayer *layer);
+
+
+static void
+layer_finalized_cb (Recording *recording,
+    GObject *where_the_layer_was)
+{
+  g_hash_table_remove (recording->layers, where_the_layer_was);
+}
+
+
+static void
+track_layer (Recording *recording,
+    ChamplainLayer *layer)
+{
+  guint id = ++recording->next_layer_id;
+  GList *iter, *items;
+
+  g_hash_table_insert (recording->layers, layer, GUINT_TO_POINTER (id));
+  g_object_weak_ref (G_OBJECT (layer), (GWeakNotify) layer_finalized_cb, recording);
+
+  if (CHAMPLAIN_IS_MARKER_LAYER (layer))
+    {
+      write_event (recording, "layer+ %u marker", id);
+
+      items = champlain_marker_layer_get_markers (CHAMPLAIN_MARKER_LAYER (layer));
+      for (iter = items; iter; iter = iter->next)
+        write_location_event (recording, "marker+", id,
+            champlain_location_get_latitude (iter->data),
+            champlain_location_get_longitude (iter->data));
+      g_list_free (items);
+
+      g_signal_connect (layer, "actor-added", G_CALLBACK (marker_added_cb), recording);
+      g_signal_connect (layer, "actor-removed", G_CALLBACK (marker_removed_cb), recording);
+    }
+  else if (CHAMPLAIN_IS_PATH_LAYER (layer))
+    {
+      write_event (recording, "layer+ %u path", id);
+
+      items = champlain_path_layer_get_nodes (CHAMPLAIN_PATH_LAYER (layer));
+      for (iter = items; iter; iter = iter->next)
+        write_location_event (recording, "node+", id,
+            champlain_location_get_latitude (iter->data),
+            champlain_location_get_longitude (iter->data));
+      g_list_free (items);
+    }
+  else
+    write_event (recording, "layer+ %u other", id);
+}
+
+
+static void
+untrack_layer (Recording *recording,
+    ChamplainLayer *layer)
+{
+  guint id = GPOINTER_TO_UINT (g_hash_table_lookup (recording->layers, layer));
+
+  if (id == 0)
+    return;
+
+  g_signal_handlers_disconnect_by_data (layer, recording);
+  g_object_weak_unref (G_OBJECT (layer), (GWeakNotify) layer_finalized_cb, recording);
+  g_hash_table_remove (recording->layers, layer);
+
+  write_event (recording, "layer- %u", id);
+}
+
+
+static void
+recording_free (Recording *recording)
+{
+  GHashTableIter iter;
+  gpointer layer;
+
+  g_signal_handlers_disconnect_by_data (recording->view, recording);
+
+  g_hash_table_iter_init (&iter, recording->layers);
+  while (g_hash_table_iter_next (&iter, &layer, NULL))
+    {
+      g_signal_handlers_disconnect_by_data (layer, recording);
+      g_object_weak_unref (G_OBJECT (layer), (GWeakNotify) layer_finalized_cb, recording);
+    }
+  g_hash_table_destroy (recording->layers);
+
+  fclose (recording->file);
+  g_slice_free (Recording, recording);
+}
+
+
+/**
+ * champlain_recording_start:
+ * @view: a #ChamplainView
+ * @filename: the name of the file the recording is written to
+ * @error: return location for a #GError, or %NULL
+ *
+ * Starts recording the interactions with @view into @filename. The
+ * current state of the view, including its layers, is recorded first. If
+ * the view is already being recorded, the previous recording is stopped.
+ *
+ * Returns: %TRUE when the file could be opened, %FALSE otherwise.
+ *
+ * Since: 0.12.15
+ */
+gboolean
+champlain_recording_start (ChamplainView *view,
+    const gchar *filename,
+    GError **error)
+{
+  Recording *recording;
+  GList *layers, *iter;
+  FILE *file;
+
+  g_return_val_if_fail (CHAMPLAIN_IS_VIEW (view), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  champlain_recording_stop (view);
+
+  file = g_fopen (filename, "w");
+  if (!file)
+    {
+      gint saved_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+          "Failed to open recording file '%s': %s", filename, g_strerror (saved_errno));
+      return FALSE;
+    }
+
+  recording = g_slice_new0 (Recording);
+  recording->view = view;
+  recording->file = file;
+  recording->start_time = g_get_monotonic_time ();
+  recording->layers = g_hash_table_new (g_direct_hash, g_direct_equal);
+  recording->latitude = recording->longitude = G_MAXDOUBLE;
+  recording->width = recording->height = -1;
+
+  fputs (RECORDING_HEADER "\n", file);
+  record_size (recording);
+  record_source (recording);
+  record_zoom (recording);
+  record_center (recording);
+
+  layers = _champlain_view_get_user_layers (view);
+  for (iter = layers; iter; iter = iter->next)
+    track_layer (recording, iter->data);
+  g_list_free (layers);
+
+  g_signal_connect (view, "notify", G_CALLBACK (view_notify_cb), recording);
+
+  g_object_set_data_full (G_OBJECT (view), "champlain-recording", recording,
+      (GDestroyNotify) recording_free);
+
+  return TRUE;
+}
+
+
+/**
+ * champlain_recording_stop:
+ * @view: a #ChamplainView
+ *
+ * Stops recording the interactions with @view and closes the file. Does
+ * nothing if the view is not being recorded.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_recording_stop (ChamplainView *view)
+{
+  g_return_if_fail (CHAMPLAIN_IS_VIEW (view));
+
+  g_object_set_data (G_OBJECT (view), "champlain-recording", NULL);
+}
+
+
+void
+_champlain_recording_layer_added (ChamplainView *view,
+    ChamplainLayer *layer)
+{
+  Recording *recording = g_object_get_data (G_OBJECT (view), "champlain-recording");
+
+  if (recording)
+    track_layer (recording, layer);
+}
+
+
+void
+_champlain_recording_layer_removed (ChamplainView *view,
+    ChamplainLayer *layer)
+{
+  Recording *recording = g_object_get_data (G_OBJECT (view), "champlain-recording");
+
+  if (recording)
+    untrack_layer (recording, layer);
+}
+
+
+static void
+replay_set_source (Replay *replay,
+    const gchar *id)
+{
+  ChamplainMapSourceFactory *factory = champlain_map_source_factory_dup_default ();
+  GSList *descs, *iter;
+
+  descs = champlain_map_source_factory_get_registered (factory);
+  for (iter = descs; iter; iter = iter->next)
+    {
+      if (g_strcmp0 (champlain_map_source_desc_get_id (iter->data), id) == 0)
+        {
+          champlain_view_set_map_source (replay->view,
+              champlain_map_source_factory_create_cached_source (factory, id));
+          break;
+        }
+    }
+  if (!iter)
+    g_warning ("Replay: map source '%s' not registered, ignoring", id);
+
+  g_slist_free (descs);
+  g_object_unref (factory);
+}
+
+
+static gboolean
+parse_location (gchar **tokens,
+    guint *id,
+    gdouble *latitude,
+    gdouble *longitude)
+{
+  if (g_strv_length (tokens) < 5)
+    return FALSE;
+
+  *id = strtoul (tokens[2], NULL, 10);
+  *latitude = g_ascii_strtod (tokens[3], NULL);
+  *longitude = g_ascii_strtod (tokens[4], NULL);
+
+  return TRUE;
+}
+
+
+static void
+replay_remove_marker (ChamplainMarkerLayer *layer,
+    gdouble latitude,
+    gdouble longitude)
+{
+  GList *markers = champlain_marker_layer_get_markers (layer);
+  GList *iter;
+
+  for (iter = markers; iter; iter = iter->next)
+    {
+      ChamplainLocation *location = iter->data;
+
+      if (champlain_location_get_latitude (location) == latitude &&
+          champlain_location_get_longitude (location) == longitude)
+        break;
+    }
+
+  /* positions are rounded in the file, remove any marker as a fallback */
+  if (!iter)
+    iter = markers;
+  if (iter)
+    champlain_marker_layer_remove_marker (layer, iter->data);
+
+  g_list_free (markers);
+}
+
+
+static void
+replay_event (Replay *replay,
+    gchar **tokens)
+{
+  const gchar *event = tokens[1];
+  ChamplainLayer *layer;
+  gdouble latitude, longitude;
+  guint id;
+
+  if (g_strcmp0 (event, "size") == 0 && g_strv_length (tokens) >= 4)
+    clutter_actor_set_size (CLUTTER_ACTOR (replay->view),
+        atoi (tokens[2]), atoi (tokens[3]));
+  else if (g_strcmp0 (event, "source") == 0 && tokens[2])
+    replay_set_source (replay, tokens[2]);
+  else if (g_strcmp0 (event, "zoom") == 0 && tokens[2])
+    champlain_view_set_zoom_level (replay->view, atoi (tokens[2]));
+  else if (g_strcmp0 (event, "center") == 0 && g_strv_length (tokens) >= 4)
+    champlain_view_center_on (replay->view,
+        g_ascii_strtod (tokens[2], NULL), g_ascii_strtod (tokens[3], NULL));
+  else if (g_strcmp0 (event, "layer+") == 0 && g_strv_length (tokens) >= 4)
+    {
+      id = strtoul (tokens[2], NULL, 10);
+      if (g_strcmp0 (tokens[3], "marker") == 0)
+        layer = CHAMPLAIN_LAYER (champlain_marker_layer_new ());
+      else if (g_strcmp0 (tokens[3], "path") == 0)
+        layer = CHAMPLAIN_LAYER (champlain_path_layer_new ());
+      else
+        return;
+
+      champlain_view_add_layer (replay->view, layer);
+      g_hash_table_insert (replay->layers, GUINT_TO_POINTER (id), g_object_ref (layer));
+    }
+  else if (g_strcmp0 (event, "layer-") == 0 && tokens[2])
+    {
+      id = strtoul (tokens[2], NULL, 10);
+      layer = g_hash_table_lookup (replay->layers, GUINT_TO_POINTER (id));
+      if (layer)
+        {
+          champlain_view_remove_layer (replay->view, layer);
+          g_hash_table_remove (replay->layers, GUINT_TO_POINTER (id));
+        }
+    }
+  else if (g_strcmp0 (event, "marker+") == 0 && parse_location (tokens, &id, &latitude, &longitude))
+    {
+      layer = g_hash_table_lookup (replay->layers, GUINT_TO_POINTER (id));
+      if (CHAMPLAIN_IS_MARKER_LAYER (layer))
+        {
+          ClutterActor *point = champlain_point_new ();
+
+          champlain_location_set_location (CHAMPLAIN_LOCATION (point), latitude, longitude);
+          champlain_marker_layer_add_marker (CHAMPLAIN_MARKER_LAYER (layer), CHAMPLAIN_MARKER (point));
+        }
+    }
+  else if (g_strcmp0 (event, "marker-") == 0 && parse_location (tokens, &id, &latitude, &longitude))
+    {
+      layer = g_hash_table_lookup (replay->layers, GUINT_TO_POINTER (id));
+      if (CHAMPLAIN_IS_MARKER_LAYER (layer))
+        replay_remove_marker (CHAMPLAIN_MARKER_LAYER (layer), latitude, longitude);
+    }
+  else if (g_strcmp0 (event, "node+") == 0 && parse_location (tokens, &id, &latitude, &longitude))
+    {
+      layer = g_hash_table_lookup (replay->layers, GUINT_TO_POINTER (id));
+      if (CHAMPLAIN_IS_PATH_LAYER (layer))
+        champlain_path_layer_add_node (CHAMPLAIN_PATH_LAYER (layer),
+            CHAMPLAIN_LOCATION (champlain_coordinate_new_full (latitude, longitude)));
+    }
+}
+
+
+/* Returns the time of the next event or -1 at the end of the file */
+static gint64
+next_event_time (Replay *replay)
+{
+  while (replay->lines[replay->pos])
+    {
+      const gchar *line = replay->lines[replay->pos];
+
+      if (*line != '\0' && *line != '#')
+        return g_ascii_strtoll (line, NULL, 10);
+      replay->pos++;
+    }
+
+  return -1;
+}
+
+
+static gboolean
+replay_cb (ChamplainView *view)
+{
+  Replay *replay = g_object_get_data (G_OBJECT (view), "champlain-replay");
+  gdouble elapsed;
+  gint64 next;
+
+  replay->timeout_id = 0;
+  elapsed = (g_get_monotonic_time () - replay->start_time) / 1000.0 * replay->speed;
+
+  /* Without a speed every main loop iteration replays one event */
+  while ((next = next_event_time (replay)) >= 0 &&
+         (replay->speed <= 0 || next <= elapsed))
+    {
+      gchar **tokens = g_strsplit (replay->lines[replay->pos], " ", 6);
+
+      replay->pos++;
+      replay_event (replay, tokens);
+      g_strfreev (tokens);
+
+      if (replay->speed <= 0)
+        break;
+    }
+
+  if (next < 0)
+    {
+      g_object_set_data (G_OBJECT (view), "champlain-replay", NULL);
+      g_signal_emit_by_name (view, "animation-completed::replay", NULL);
+    }
+  else if (replay->speed <= 0)
+    replay->timeout_id = g_idle_add ((GSourceFunc) replay_cb, view);
+  else
+    replay->timeout_id = g_timeout_add ((next - elapsed) / replay->speed,
+          (GSourceFunc) replay_cb, view);
+
+  return FALSE;
+}
+
+
+static void
+replay_free (Replay *replay)
+{
+  if (replay->timeout_id)
+    g_source_remove (replay->timeout_id);
+
+  g_strfreev (replay->lines);
+  g_hash_table_destroy (replay->layers);
+  g_slice_free (Replay, replay);
+}
+
+
+/**
+ * champlain_recording_replay:
+ * @view: a #ChamplainView
+ * @filename: the name of a file written by champlain_recording_start()
+ * @speed: the replay speed; 1.0 replays at the original speed, 2.0 twice as
+ * fast and 0 as fast as the main loop allows
+ * @error: return location for a #GError, or %NULL
+ *
+ * Starts replaying the recorded interactions into @view. The replay runs
+ * in the main loop; when it is finished, "animation-completed::replay" is
+ * emitted on the view. A replay already running on the view is stopped.
+ *
+ * Returns: %TRUE when the file could be read, %FALSE otherwise.
+ *
+ * Since: 0.12.15
+ */
+gboolean
+champlain_recording_replay (ChamplainView *view,
+    const gchar *filename,
+    gdouble speed,
+    GError **error)
+{
+  Replay *replay;
+  gchar *contents;
+
+  g_return_val_if_fail (CHAMPLAIN_IS_VIEW (view), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  champlain_recording_stop_replay (view);
+
+  if (!g_file_get_contents (filename, &contents, NULL, error))
+    return FALSE;
+
+  if (!g_str_has_prefix (contents, RECORDING_HEADER))
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+          "'%s' is not a libchamplain recording", filename);
+      g_free (contents);
+      return FALSE;
+    }
+
+  replay = g_slice_new0 (Replay);
+  replay->view = view;
+  replay->lines = g_strsplit (contents, "\n", -1);
+  replay->speed = speed;
+  replay->start_time = g_get_monotonic_time ();
+  replay->layers = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_object_unref);
+  g_free (contents);
+
+  g_object_set_data_full (G_OBJECT (view), "champlain-replay", replay,
+      (GDestroyNotify) replay_free);
+  replay->timeout_id = g_idle_add ((GSourceFunc) replay_cb, view);
+
+  return TRUE;
+}
+
+
+/**
+ * champlain_recording_stop_replay:
+ * @view: a #ChamplainView
+ *
+ * Stops the replay running on @view. The layers created by the replay stay
+ * in the view.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_recording_stop_replay (ChamplainView *view)
+{
+  g_return_if_fail (CHAMPLAIN_IS_VIEW (view));
+
+  g_object_set_data (G_OBJECT (view), "champlain-replay", NULL);
+}
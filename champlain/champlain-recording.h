@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2010-2013 Jiri Techet <techet@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#if !defined (__CHAMPLAIN_CHAMPLAIN_H_INSIDE__) && !defined (CHAMPLAIN_COMPILATION)
+#error "Only <champlain/champlain.h> can be included directly."
+#endif
+
+#ifndef _CHAMPLAIN_RECORDING_H_
+#define _CHAMPLAIN_RECORDING_H_
+
+#include <champlain/champlain-defines.h>
+
+G_BEGIN_DECLS
+
+gboolean champlain_recording_start (ChamplainView *view,
+    const gchar *filename,
+    GError **error);
+void champlain_recording_stop (ChamplainView *view);
+
+gboolean champlain_recording_replay (ChamplainView *view,
+    const gchar *filename,
+    gdouble speed,
+    GError **error);
+void champlain_recording_stop_replay (ChamplainView *view);
+
+G_END_DECLS
+
+#endif /* _CHAMPLAIN_RECORDING_H_ */
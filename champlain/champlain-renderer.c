@@ -25,9 +25,19 @@
  */
 
 #include "champlain-renderer.h"
+#include "champlain-private.h"
 
 G_DEFINE_TYPE (ChamplainRenderer, champlain_renderer, G_TYPE_INITIALLY_UNOWNED)
 
+enum
+{
+  /* normal signals */
+  AREA_CHANGED,
+  LAST_SIGNAL
+};
+
+static guint champlain_renderer_signals[LAST_SIGNAL] = { 0, };
+
 static void
 champlain_renderer_dispose (GObject *object)
 {
@@ -52,6 +62,37 @@ champlain_renderer_class_init (ChamplainRendererClass *klass)
 
   klass->set_data = NULL;
   klass->render = NULL;
+
+  /**
+   * ChamplainRenderer::area-changed:
+   * @renderer: a #ChamplainRenderer
+   * @bbox: (allow-none): the area whose rendering changed or %NULL when
+   * all of it changed
+   *
+   * The #ChamplainRenderer::area-changed signal is emitted when a change of
+   * the data or of the rendering rules makes the tiles rendered within @bbox
+   * outdated. The tiles outside of it stay valid. Connect
+   * champlain_view_invalidate_area() to it to re-render only the outdated
+   * tiles of the map sources using the renderer:
+   *
+   * |[
+   * g_signal_connect_swapped (renderer, "area-changed",
+   *     G_CALLBACK (champlain_view_invalidate_area), view);
+   * ]|
+   *
+   * Since: 0.12.15
+   */
+  champlain_renderer_signals[AREA_CHANGED] =
+    g_signal_new ("area-changed",
+        G_OBJECT_CLASS_TYPE (object_class),
+        G_SIGNAL_RUN_LAST,
+        0,
+        NULL,
+        NULL,
+        g_cclosure_marshal_VOID__BOXED,
+        G_TYPE_NONE,
+        1,
+        CHAMPLAIN_TYPE_BOUNDING_BOX);
 }
 
 
@@ -98,6 +139,50 @@ champlain_renderer_render (ChamplainRenderer *renderer,
 }
 
 
+/**
+ * champlain_renderer_area_changed:
+ * @renderer: a #ChamplainRenderer
+ * @bbox: (allow-none): the area whose rendering changed or %NULL when all
+ * of it changed
+ *
+ * Emits the #ChamplainRenderer::area-changed signal. To be called by
+ * renderer implementations.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_renderer_area_changed (ChamplainRenderer *renderer,
+    ChamplainBoundingBox *bbox)
+{
+  g_return_if_fail (CHAMPLAIN_IS_RENDERER (renderer));
+
+  g_signal_emit (renderer, champlain_renderer_signals[AREA_CHANGED], 0, bbox);
+}
+
+
+/* Renderers pass the area to #ChamplainRenderer::area-changed in their
+ * set_data implementation, it is NULL for champlain_renderer_set_data () */
+void
+_champlain_renderer_set_data_in_area (ChamplainRenderer *renderer,
+    const gchar *data,
+    guint size,
+    ChamplainBoundingBox *area)
+{
+  g_return_if_fail (CHAMPLAIN_IS_RENDERER (renderer));
+
+  g_object_set_data (G_OBJECT (renderer), "champlain-data-area", area);
+  champlain_renderer_set_data (renderer, data, size);
+  g_object_set_data (G_OBJECT (renderer), "champlain-data-area", NULL);
+}
+
+
+ChamplainBoundingBox *
+_champlain_renderer_get_data_area (ChamplainRenderer *renderer)
+{
+  return g_object_get_data (G_OBJECT (renderer), "champlain-data-area");
+}
+
+
 static void
 champlain_renderer_init (ChamplainRenderer *self)
 {
@@ -24,6 +24,7 @@
 #define __CHAMPLAIN_RENDERER_H__
 
 #include <champlain/champlain-tile.h>
+#include <champlain/champlain-bounding-box.h>
 
 G_BEGIN_DECLS
 
@@ -79,6 +80,8 @@ void champlain_renderer_set_data (ChamplainRenderer *renderer,
     guint size);
 void champlain_renderer_render (ChamplainRenderer *renderer,
     ChamplainTile *tile);
+void champlain_renderer_area_changed (ChamplainRenderer *renderer,
+    ChamplainBoundingBox *bbox);
 
 G_END_DECLS
 
@@ -26,6 +26,7 @@
  */
 
 #include "champlain-tile-cache.h"
+#include "champlain-private.h"
 
 G_DEFINE_ABSTRACT_TYPE (ChamplainTileCache, champlain_tile_cache, CHAMPLAIN_TYPE_MAP_SOURCE)
 
@@ -165,6 +166,33 @@ champlain_tile_cache_on_tile_filled (ChamplainTileCache *tile_cache,
 }
 
 
+/**
+ * champlain_tile_cache_invalidate_area:
+ * @tile_cache: a #ChamplainTileCache
+ * @bbox: (allow-none): the area whose tiles are outdated or %NULL for all
+ * tiles
+ *
+ * Removes the cached tiles of all zoom levels which intersect @bbox, e.g.
+ * because the data they were rendered from changed. Caches not supporting
+ * it keep their tiles.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_tile_cache_invalidate_area (ChamplainTileCache *tile_cache,
+    ChamplainBoundingBox *bbox)
+{
+  g_return_if_fail (CHAMPLAIN_IS_TILE_CACHE (tile_cache));
+
+  ChamplainInvalidateAreaFunc invalidate_area;
+
+  invalidate_area = (ChamplainInvalidateAreaFunc) _champlain_type_get_vfunc (G_OBJECT_TYPE (tile_cache),
+        "invalidate-area");
+  if (invalidate_area)
+    invalidate_area (tile_cache, bbox);
+}
+
+
 static const gchar *
 get_id (ChamplainMapSource *map_source)
 {
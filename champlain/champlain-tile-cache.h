@@ -89,6 +89,8 @@ void champlain_tile_cache_refresh_tile_time (ChamplainTileCache *tile_cache,
     ChamplainTile *tile);
 void champlain_tile_cache_on_tile_filled (ChamplainTileCache *tile_cache,
     ChamplainTile *tile);
+void champlain_tile_cache_invalidate_area (ChamplainTileCache *tile_cache,
+    ChamplainBoundingBox *bbox);
 
 G_END_DECLS
 
@@ -88,6 +88,8 @@ struct _ChamplainTilePrivate
   gchar *etag; /* The HTTP ETag sent by the server */
   gboolean content_displayed;
   cairo_surface_t *surface;
+  /* Cancelled when the tile is no longer needed */
+  GCancellable *cancellable;
 };
 
 static void
@@ -217,6 +219,8 @@ champlain_tile_finalize (GObject *object)
 
   g_free (priv->modified_time);
   g_free (priv->etag);
+  if (priv->cancellable)
+    g_object_unref (priv->cancellable);
 
   G_OBJECT_CLASS (champlain_tile_parent_class)->finalize (object);
 }
@@ -412,6 +416,7 @@ champlain_tile_init (ChamplainTile *self)
   priv->etag = NULL;
   priv->fade_in = FALSE;
   priv->content_displayed = FALSE;
+  priv->cancellable = NULL;
 
   priv->content_actor = NULL;
 }
@@ -431,10 +436,24 @@ set_surface (ChamplainExportable *exportable,
 
   cairo_surface_destroy (self->priv->surface);
   self->priv->surface = cairo_surface_reference (surface);
+  _champlain_memory_usage_track_surface (surface, CHAMPLAIN_MEMORY_CATEGORY_TILE_SURFACES);
   g_object_notify (G_OBJECT (self), "surface");
 }
 
 
+void
+_champlain_tile_drop_surface (ChamplainTile *tile)
+{
+  g_return_if_fail (CHAMPLAIN_IS_TILE (tile));
+
+  if (!tile->priv->surface)
+    return;
+
+  g_clear_pointer (&tile->priv->surface, cairo_surface_destroy);
+  g_object_notify (G_OBJECT (tile), "surface");
+}
+
+
 static cairo_surface_t *
 get_surface (ChamplainExportable *exportable)
 {
@@ -784,6 +803,84 @@ champlain_tile_set_etag (ChamplainTile *self,
 }
 
 
+/**
+ * champlain_tile_get_cancellable:
+ * @self: the #ChamplainTile
+ *
+ * Gets the token that is cancelled when the tile is no longer needed, e.g.
+ * because it left the view. Map sources, caches and renderers pass it to
+ * their asynchronous operations and check it before each stage of their
+ * work, so that abandoned tiles stop consuming I/O, network and CPU. When
+ * no token was set with champlain_tile_set_cancellable(), a new one is
+ * created.
+ *
+ * Returns: (transfer none): the tile's #GCancellable
+ *
+ * Since: 0.12.15
+ */
+GCancellable *
+champlain_tile_get_cancellable (ChamplainTile *self)
+{
+  g_return_val_if_fail (CHAMPLAIN_TILE (self), NULL);
+
+  ChamplainTilePrivate *priv = self->priv;
+
+  if (!priv->cancellable)
+    priv->cancellable = g_cancellable_new ();
+
+  return priv->cancellable;
+}
+
+
+/**
+ * champlain_tile_set_cancellable:
+ * @self: the #ChamplainTile
+ * @cancellable: (allow-none): the #GCancellable of the tile request
+ *
+ * Sets the token of the tile request, see champlain_tile_get_cancellable().
+ * It has to be set before the tile is passed to
+ * champlain_map_source_fill_tile(). #ChamplainView sets a new token on
+ * every tile it requests and cancels it when the tile is no longer needed.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_tile_set_cancellable (ChamplainTile *self,
+    GCancellable *cancellable)
+{
+  g_return_if_fail (CHAMPLAIN_TILE (self));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  ChamplainTilePrivate *priv = self->priv;
+
+  if (cancellable)
+    g_object_ref (cancellable);
+  if (priv->cancellable)
+    g_object_unref (priv->cancellable);
+  priv->cancellable = cancellable;
+}
+
+
+/**
+ * champlain_tile_is_cancelled:
+ * @self: the #ChamplainTile
+ *
+ * Checks whether the tile request was cancelled, see
+ * champlain_tile_get_cancellable().
+ *
+ * Returns: %TRUE when the tile is no longer needed, %FALSE otherwise.
+ *
+ * Since: 0.12.15
+ */
+gboolean
+champlain_tile_is_cancelled (ChamplainTile *self)
+{
+  g_return_val_if_fail (CHAMPLAIN_TILE (self), FALSE);
+
+  return self->priv->cancellable && g_cancellable_is_cancelled (self->priv->cancellable);
+}
+
+
 /**
  * champlain_tile_set_content:
  * @self: the #ChamplainTile
@@ -808,6 +905,8 @@ champlain_tile_set_content (ChamplainTile *self,
 
   priv->content_actor = g_object_ref_sink (actor);
   priv->content_displayed = FALSE;
+  _champlain_memory_usage_track_object (G_OBJECT (actor), CHAMPLAIN_MEMORY_CATEGORY_TILE_TEXTURES,
+      (gsize) priv->size * priv->size * 4);
   
   g_object_notify (G_OBJECT (self), "content");
 }
@@ -823,6 +922,7 @@ fade_in_completed (ClutterActor *actor,
     clutter_actor_destroy (clutter_actor_get_first_child (CLUTTER_ACTOR (self)));
 
   g_signal_handlers_disconnect_by_func (actor, fade_in_completed, self);
+  _champlain_trace_tile ('e', "tile", "fade", self);
 }
 
 
@@ -848,6 +948,9 @@ champlain_tile_display_content (ChamplainTile *self)
   g_object_unref (priv->content_actor);
   priv->content_displayed = TRUE;
 
+  _champlain_trace_tile ('n', "tile", "display", self);
+  _champlain_trace_tile ('b', "tile", "fade", self);
+
   clutter_actor_set_opacity (priv->content_actor, 0);
   clutter_actor_save_easing_state (priv->content_actor);
   if (priv->fade_in)
@@ -24,6 +24,7 @@
 #include <champlain/champlain-exportable.h>
 
 #include <glib.h>
+#include <gio/gio.h>
 #include <clutter/clutter.h>
 
 G_BEGIN_DECLS
@@ -122,6 +123,10 @@ void champlain_tile_set_content (ChamplainTile *self,
     ClutterActor *actor);
 void champlain_tile_set_etag (ChamplainTile *self,
     const gchar *etag);
+GCancellable *champlain_tile_get_cancellable (ChamplainTile *self);
+void champlain_tile_set_cancellable (ChamplainTile *self,
+    GCancellable *cancellable);
+gboolean champlain_tile_is_cancelled (ChamplainTile *self);
 void champlain_tile_set_modified_time (ChamplainTile *self,
     const GTimeVal *time);
 void champlain_tile_set_fade_in (ChamplainTile *self,
@@ -0,0 +1,1053 @@
+/*
+ * Copyright (C) 2010-2013 Jiri Techet <techet@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:champlain-time-series-tile-source
+ * @short_description: A map source for animated, time dependent overlays
+ *
+ * This map source downloads tiles of a layer which changes in time, such as
+ * weather radar or cloud maps. Its URI format may contain, in addition to the
+ * tokens supported by #ChamplainNetworkTileSource, the #TIME# token which is
+ * replaced by the value of the frame being downloaded. The frames are set by
+ * champlain_time_series_tile_source_set_frames().
+ *
+ * Besides the current frame, the following frames (see
+ * #ChamplainTimeSeriesTileSource:preload-frames) are downloaded and decoded
+ * in advance for every tile the source fills. When the current frame changes,
+ * the displayed tiles only swap their content for the already decoded one so
+ * animations can be played without network stalls.
+ *
+ * The source keeps track of the tiles it filled and updates them itself, so
+ * it should be used directly (typically as an overlay source of #ChamplainView)
+ * and not behind a #ChamplainTileCache.
+ */
+
+#include "config.h"
+
+#include "champlain-time-series-tile-source.h"
+
+#define DEBUG_FLAG CHAMPLAIN_DEBUG_LOADING
+#include "champlain-debug.h"
+
+#include "champlain.h"
+#include "champlain-defines.h"
+#include "champlain-enum-types.h"
+#include "champlain-map-source.h"
+#include "champlain-private.h"
+
+#include <glib.h>
+#include <glib-object.h>
+#include <libsoup/soup.h>
+#include <string.h>
+
+enum
+{
+  PROP_0,
+  PROP_URI_FORMAT,
+  PROP_CURRENT_FRAME,
+  PROP_PRELOAD_FRAMES,
+  PROP_MAX_DECODED_TILES
+};
+
+G_DEFINE_TYPE (ChamplainTimeSeriesTileSource, champlain_time_series_tile_source, CHAMPLAIN_TYPE_TILE_SOURCE);
+
+#define GET_PRIVATE(obj) \
+  (G_TYPE_INSTANCE_GET_PRIVATE ((obj), CHAMPLAIN_TYPE_TIME_SERIES_TILE_SOURCE, ChamplainTimeSeriesTileSourcePrivate))
+
+struct _ChamplainTimeSeriesTileSourcePrivate
+{
+  gchar *uri_format;
+  GPtrArray *frames;
+  guint current_frame;
+  guint preload_frames;
+  guint max_decoded_tiles;
+
+  SoupSession *soup_session;
+  /* "time/z/x/y" -> cairo_surface_t */
+  GHashTable *decoded;
+  /* keys of decoded, oldest first */
+  GQueue *decoded_order;
+  /* "time/z/x/y" of the frames being downloaded or rendered */
+  GHashTable *pending;
+  /* tiles filled by this source, updated on frame change */
+  GList *tiles;
+};
+
+typedef struct
+{
+  ChamplainTimeSeriesTileSource *source;
+  gchar *key;
+  gchar *time;
+  gint x;
+  gint y;
+  gint z;
+} FrameLoadData;
+
+
+static void fill_tile (ChamplainMapSource *map_source,
+    ChamplainTile *tile);
+static void tile_destroyed_cb (ChamplainTile *tile,
+    ChamplainTimeSeriesTileSource *tile_source);
+static void trim_memory (GObject *object,
+    ChamplainTrimLevel level);
+
+
+static void
+champlain_time_series_tile_source_get_property (GObject *object,
+    guint prop_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  ChamplainTimeSeriesTileSourcePrivate *priv = CHAMPLAIN_TIME_SERIES_TILE_SOURCE (object)->priv;
+
+  switch (prop_id)
+    {
+    case PROP_URI_FORMAT:
+      g_value_set_string (value, priv->uri_format);
+      break;
+
+    case PROP_CURRENT_FRAME:
+      g_value_set_uint (value, priv->current_frame);
+      break;
+
+    case PROP_PRELOAD_FRAMES:
+      g_value_set_uint (value, priv->preload_frames);
+      break;
+
+    case PROP_MAX_DECODED_TILES:
+      g_value_set_uint (value, priv->max_decoded_tiles);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+
+static void
+champlain_time_series_tile_source_set_property (GObject *object,
+    guint prop_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  ChamplainTimeSeriesTileSource *tile_source = CHAMPLAIN_TIME_SERIES_TILE_SOURCE (object);
+
+  switch (prop_id)
+    {
+    case PROP_URI_FORMAT:
+      champlain_time_series_tile_source_set_uri_format (tile_source,
+          g_value_get_string (value));
+      break;
+
+    case PROP_CURRENT_FRAME:
+      champlain_time_series_tile_source_set_current_frame (tile_source,
+          g_value_get_uint (value));
+      break;
+
+    case PROP_PRELOAD_FRAMES:
+      champlain_time_series_tile_source_set_preload_frames (tile_source,
+          g_value_get_uint (value));
+      break;
+
+    case PROP_MAX_DECODED_TILES:
+      champlain_time_series_tile_source_set_max_decoded_tiles (tile_source,
+          g_value_get_uint (value));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+
+static void
+champlain_time_series_tile_source_dispose (GObject *object)
+{
+  ChamplainTimeSeriesTileSource *tile_source = CHAMPLAIN_TIME_SERIES_TILE_SOURCE (object);
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+  GList *iter;
+
+  if (priv->soup_session)
+    {
+      soup_session_abort (priv->soup_session);
+      g_object_unref (priv->soup_session);
+      priv->soup_session = NULL;
+    }
+
+  for (iter = priv->tiles; iter; iter = iter->next)
+    g_signal_handlers_disconnect_by_func (iter->data, tile_destroyed_cb, tile_source);
+  g_list_free (priv->tiles);
+  priv->tiles = NULL;
+
+  G_OBJECT_CLASS (champlain_time_series_tile_source_parent_class)->dispose (object);
+}
+
+
+static void
+champlain_time_series_tile_source_finalize (GObject *object)
+{
+  ChamplainTimeSeriesTileSourcePrivate *priv = CHAMPLAIN_TIME_SERIES_TILE_SOURCE (object)->priv;
+
+  g_free (priv->uri_format);
+  g_ptr_array_free (priv->frames, TRUE);
+  g_hash_table_destroy (priv->decoded);
+  g_queue_free (priv->decoded_order);
+  g_hash_table_destroy (priv->pending);
+
+  G_OBJECT_CLASS (champlain_time_series_tile_source_parent_class)->finalize (object);
+}
+
+
+static void
+champlain_time_series_tile_source_class_init (ChamplainTimeSeriesTileSourceClass *klass)
+{
+  ChamplainMapSourceClass *map_source_class = CHAMPLAIN_MAP_SOURCE_CLASS (klass);
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GParamSpec *pspec;
+
+  g_type_class_add_private (klass, sizeof (ChamplainTimeSeriesTileSourcePrivate));
+
+  object_class->finalize = champlain_time_series_tile_source_finalize;
+  object_class->dispose = champlain_time_series_tile_source_dispose;
+  object_class->get_property = champlain_time_series_tile_source_get_property;
+  object_class->set_property = champlain_time_series_tile_source_set_property;
+
+  map_source_class->fill_tile = fill_tile;
+
+  /**
+   * ChamplainTimeSeriesTileSource:uri-format:
+   *
+   * The uri format of the tile source, see #champlain_time_series_tile_source_set_uri_format
+   *
+   * Since: 0.12.15
+   */
+  pspec = g_param_spec_string ("uri-format",
+        "URI Format",
+        "The URI format",
+        "",
+        G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+  g_object_class_install_property (object_class, PROP_URI_FORMAT, pspec);
+
+  /**
+   * ChamplainTimeSeriesTileSource:current-frame:
+   *
+   * The index of the displayed frame
+   *
+   * Since: 0.12.15
+   */
+  pspec = g_param_spec_uint ("current-frame",
+        "Current frame",
+        "The index of the displayed frame",
+        0,
+        G_MAXUINT,
+        0,
+        G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_CURRENT_FRAME, pspec);
+
+  /**
+   * ChamplainTimeSeriesTileSource:preload-frames:
+   *
+   * The number of frames following the current one which are downloaded
+   * and decoded in advance
+   *
+   * Since: 0.12.15
+   */
+  pspec = g_param_spec_uint ("preload-frames",
+        "Preload frames",
+        "The number of frames downloaded in advance",
+        0,
+        G_MAXUINT,
+        4,
+        G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_PRELOAD_FRAMES, pspec);
+
+  /**
+   * ChamplainTimeSeriesTileSource:max-decoded-tiles:
+   *
+   * The maximum number of decoded tiles (of all frames) kept in memory
+   *
+   * Since: 0.12.15
+   */
+  pspec = g_param_spec_uint ("max-decoded-tiles",
+        "Max decoded tiles",
+        "The maximum number of decoded tiles kept in memory",
+        1,
+        G_MAXUINT,
+        256,
+        G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_MAX_DECODED_TILES, pspec);
+}
+
+
+static void
+champlain_time_series_tile_source_init (ChamplainTimeSeriesTileSource *tile_source)
+{
+  ChamplainTimeSeriesTileSourcePrivate *priv = GET_PRIVATE (tile_source);
+
+  tile_source->priv = priv;
+
+  priv->uri_format = NULL;
+  priv->frames = g_ptr_array_new_with_free_func (g_free);
+  priv->current_frame = 0;
+  priv->preload_frames = 4;
+  priv->max_decoded_tiles = 256;
+  priv->decoded = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) cairo_surface_destroy);
+  priv->decoded_order = g_queue_new ();
+  priv->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  priv->tiles = NULL;
+
+  priv->soup_session = soup_session_new_with_options (
+        "proxy-uri", NULL,
+        "ssl-strict", FALSE,
+        SOUP_SESSION_ADD_FEATURE_BY_TYPE,
+        SOUP_TYPE_PROXY_RESOLVER_DEFAULT,
+        SOUP_SESSION_ADD_FEATURE_BY_TYPE,
+        SOUP_TYPE_CONTENT_DECODER,
+        NULL);
+  g_object_set (G_OBJECT (priv->soup_session),
+      "user-agent",
+      "libchamplain/" CHAMPLAIN_VERSION_S,
+      "max-conns-per-host", 2,
+      NULL);
+
+  _champlain_memory_usage_add_trim_handler (G_OBJECT (tile_source), trim_memory);
+}
+
+
+/**
+ * champlain_time_series_tile_source_new_full:
+ * @id: the map source's id
+ * @name: the map source's name
+ * @license: the map source's license
+ * @license_uri: the map source's license URI
+ * @min_zoom: the map source's minimum zoom level
+ * @max_zoom: the map source's maximum zoom level
+ * @tile_size: the map source's tile size (in pixels)
+ * @projection: the map source's projection
+ * @uri_format: the URI to fetch the tiles from, see #champlain_time_series_tile_source_set_uri_format
+ * @renderer: the #ChamplainRenderer used to render tiles
+ *
+ * Constructor of #ChamplainTimeSeriesTileSource.
+ *
+ * Returns: a constructed #ChamplainTimeSeriesTileSource object
+ *
+ * Since: 0.12.15
+ */
+ChamplainTimeSeriesTileSource *
+champlain_time_series_tile_source_new_full (const gchar *id,
+    const gchar *name,
+    const gchar *license,
+    const gchar *license_uri,
+    guint min_zoom,
+    guint max_zoom,
+    guint tile_size,
+    ChamplainMapProjection projection,
+    const gchar *uri_format,
+    ChamplainRenderer *renderer)
+{
+  ChamplainTimeSeriesTileSource *source;
+
+  source = g_object_new (CHAMPLAIN_TYPE_TIME_SERIES_TILE_SOURCE,
+        "id", id,
+        "name", name,
+        "license", license,
+        "license-uri", license_uri,
+        "min-zoom-level", min_zoom,
+        "max-zoom-level", max_zoom,
+        "tile-size", tile_size,
+        "projection", projection,
+        "uri-format", uri_format,
+        "renderer", renderer,
+        NULL);
+  return source;
+}
+
+
+/**
+ * champlain_time_series_tile_source_get_uri_format:
+ * @tile_source: the #ChamplainTimeSeriesTileSource
+ *
+ * Gets the URI format of the source.
+ *
+ * Returns: A URI format used for URI creation when downloading tiles. See
+ * champlain_time_series_tile_source_set_uri_format() for more information.
+ *
+ * Since: 0.12.15
+ */
+const gchar *
+champlain_time_series_tile_source_get_uri_format (ChamplainTimeSeriesTileSource *tile_source)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_TIME_SERIES_TILE_SOURCE (tile_source), NULL);
+
+  return tile_source->priv->uri_format;
+}
+
+
+/**
+ * champlain_time_series_tile_source_set_uri_format:
+ * @tile_source: the #ChamplainTimeSeriesTileSource
+ * @uri_format: the URI format
+ *
+ * A URI format is a URI where x, y, zoom level and time information have
+ * been marked for parsing and insertion.  There can be an unlimited number
+ * of markers (#X#, #Y#, #Z#, #TMSY#, #TIME#) in the URI, for example
+ * http://tile.example.org/radar/#TIME#/#Z#/#X#/#Y#.png
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_time_series_tile_source_set_uri_format (ChamplainTimeSeriesTileSource *tile_source,
+    const gchar *uri_format)
+{
+  g_return_if_fail (CHAMPLAIN_IS_TIME_SERIES_TILE_SOURCE (tile_source));
+
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+
+  g_free (priv->uri_format);
+  priv->uri_format = g_strdup (uri_format);
+
+  g_hash_table_remove_all (priv->decoded);
+  g_queue_clear (priv->decoded_order);
+
+  g_object_notify (G_OBJECT (tile_source), "uri-format");
+}
+
+
+/* The time is escaped as it comes from the application */
+static gchar *
+format_time_token (const gchar *token,
+    gpointer user_data)
+{
+  if (strcmp (token, "TIME") == 0)
+    return g_uri_escape_string (user_data, NULL, FALSE);
+
+  return NULL;
+}
+
+
+static gchar *
+get_tile_uri (ChamplainTimeSeriesTileSource *tile_source,
+    const gchar *time,
+    gint x,
+    gint y,
+    gint z)
+{
+  return _champlain_format_tile_uri (tile_source->priv->uri_format, x, y, z,
+      format_time_token, (gpointer) time);
+}
+
+
+static gchar *
+generate_key (const gchar *time,
+    gint x,
+    gint y,
+    gint z)
+{
+  return g_strdup_printf ("%s/%d/%d/%d", time, z, x, y);
+}
+
+
+static gboolean
+tile_draw_cb (G_GNUC_UNUSED ClutterCanvas *canvas,
+    cairo_t *cr,
+    G_GNUC_UNUSED gint width,
+    G_GNUC_UNUSED gint height,
+    ChamplainTile *tile)
+{
+  cairo_surface_t *surface;
+
+  surface = champlain_exportable_get_surface (CHAMPLAIN_EXPORTABLE (tile));
+
+  /* Clear the drawing area */
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+
+  if (surface)
+    {
+      cairo_set_source_surface (cr, surface, 0, 0);
+      cairo_paint (cr);
+    }
+
+  return FALSE;
+}
+
+
+/* Displays an already decoded frame - on frame change only the surface
+   is replaced and the canvas invalidated */
+static void
+display_surface (ChamplainTile *tile,
+    cairo_surface_t *surface)
+{
+  ClutterActor *actor;
+  ClutterContent *content = NULL;
+
+  champlain_exportable_set_surface (CHAMPLAIN_EXPORTABLE (tile), surface);
+
+  actor = champlain_tile_get_content (tile);
+  if (actor)
+    content = clutter_actor_get_content (actor);
+
+  if (content && g_object_get_data (G_OBJECT (content), "time-series"))
+    {
+      clutter_content_invalidate (content);
+      return;
+    }
+
+  gint size = champlain_tile_get_size (tile);
+
+  content = clutter_canvas_new ();
+  clutter_canvas_set_size (CLUTTER_CANVAS (content), size, size);
+  g_object_set_data (G_OBJECT (content), "time-series", GINT_TO_POINTER (TRUE));
+  g_signal_connect (content, "draw", G_CALLBACK (tile_draw_cb), tile);
+  clutter_content_invalidate (content);
+
+  actor = clutter_actor_new ();
+  clutter_actor_set_size (actor, size, size);
+  clutter_actor_set_content (actor, content);
+  g_object_unref (content);
+  /* has to be set for proper opacity */
+  clutter_actor_set_offscreen_redirect (actor, CLUTTER_OFFSCREEN_REDIRECT_AUTOMATIC_FOR_OPACITY);
+
+  champlain_tile_set_content (tile, actor);
+  champlain_tile_set_fade_in (tile, TRUE);
+  champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
+  champlain_tile_display_content (tile);
+}
+
+
+static const gchar *
+get_frame_time (ChamplainTimeSeriesTileSource *tile_source,
+    guint frame)
+{
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+
+  if (frame >= priv->frames->len)
+    return NULL;
+
+  return g_ptr_array_index (priv->frames, frame);
+}
+
+
+static gboolean
+tile_matches (ChamplainTile *tile,
+    gint x,
+    gint y,
+    gint z)
+{
+  return champlain_tile_get_x (tile) == x &&
+         champlain_tile_get_y (tile) == y &&
+         champlain_tile_get_zoom_level (tile) == z;
+}
+
+
+static void
+store_decoded (ChamplainTimeSeriesTileSource *tile_source,
+    const gchar *key,
+    cairo_surface_t *surface)
+{
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+  gchar *stored_key;
+
+  if (g_hash_table_lookup (priv->decoded, key))
+    return;
+
+  stored_key = g_strdup (key);
+  g_hash_table_insert (priv->decoded, stored_key, cairo_surface_reference (surface));
+  g_queue_push_tail (priv->decoded_order, stored_key);
+
+  while (g_queue_get_length (priv->decoded_order) > priv->max_decoded_tiles)
+    {
+      gchar *oldest = g_queue_pop_head (priv->decoded_order);
+
+      DEBUG ("Dropping decoded frame tile %s", oldest);
+      g_hash_table_remove (priv->decoded, oldest);
+    }
+}
+
+
+/* Drops the preloaded frames; under higher pressure also the current one,
+   whose surfaces stay referenced by the displayed tiles */
+static void
+trim_memory (GObject *object,
+    ChamplainTrimLevel level)
+{
+  ChamplainTimeSeriesTileSource *tile_source = CHAMPLAIN_TIME_SERIES_TILE_SOURCE (object);
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+  const gchar *current = get_frame_time (tile_source, priv->current_frame);
+  gsize current_len = current ? strlen (current) : 0;
+  GList *iter, *next;
+
+  for (iter = priv->decoded_order->head; iter; iter = next)
+    {
+      gchar *key = iter->data;
+
+      next = iter->next;
+
+      if (level == CHAMPLAIN_TRIM_LEVEL_MODERATE && current &&
+          strncmp (key, current, current_len) == 0 && key[current_len] == '/')
+        continue;
+
+      g_queue_delete_link (priv->decoded_order, iter);
+      g_hash_table_remove (priv->decoded, key);
+    }
+
+  DEBUG ("Kept %u decoded frame tiles", g_queue_get_length (priv->decoded_order));
+}
+
+
+static void
+frame_load_data_free (FrameLoadData *data)
+{
+  g_object_unref (data->source);
+  g_free (data->key);
+  g_free (data->time);
+  g_slice_free (FrameLoadData, data);
+}
+
+
+static void
+frame_failed (FrameLoadData *data)
+{
+  ChamplainTimeSeriesTileSourcePrivate *priv = data->source->priv;
+  ChamplainMapSource *next_source;
+  const gchar *current_time;
+  GList *iter;
+
+  current_time = get_frame_time (data->source, priv->current_frame);
+  if (g_strcmp0 (current_time, data->time) != 0)
+    return;
+
+  /* The current frame can't be loaded, let the next source fill the tiles
+     still waiting for it */
+  next_source = champlain_map_source_get_next_source (CHAMPLAIN_MAP_SOURCE (data->source));
+  for (iter = priv->tiles; iter; iter = iter->next)
+    {
+      ChamplainTile *tile = iter->data;
+
+      if (tile_matches (tile, data->x, data->y, data->z) &&
+          champlain_tile_get_state (tile) != CHAMPLAIN_STATE_DONE &&
+          next_source)
+        champlain_map_source_fill_tile (next_source, tile);
+    }
+}
+
+
+static void
+frame_rendered_cb (ChamplainTile *frame_tile,
+    G_GNUC_UNUSED gpointer data,
+    G_GNUC_UNUSED guint size,
+    gboolean error,
+    FrameLoadData *load_data)
+{
+  ChamplainTimeSeriesTileSource *tile_source = load_data->source;
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+  cairo_surface_t *surface;
+
+  g_signal_handlers_disconnect_by_func (frame_tile, frame_rendered_cb, load_data);
+  g_hash_table_remove (priv->pending, load_data->key);
+
+  surface = champlain_exportable_get_surface (CHAMPLAIN_EXPORTABLE (frame_tile));
+
+  if (!error && surface)
+    {
+      const gchar *current_time;
+      GList *iter;
+
+      store_decoded (tile_source, load_data->key, surface);
+
+      current_time = get_frame_time (tile_source, priv->current_frame);
+      if (g_strcmp0 (current_time, load_data->time) == 0)
+        {
+          for (iter = priv->tiles; iter; iter = iter->next)
+            {
+              ChamplainTile *tile = iter->data;
+
+              if (tile_matches (tile, load_data->x, load_data->y, load_data->z))
+                display_surface (tile, surface);
+            }
+        }
+    }
+  else
+    frame_failed (load_data);
+
+  clutter_actor_destroy (CLUTTER_ACTOR (frame_tile));
+  g_object_unref (frame_tile);
+  frame_load_data_free (load_data);
+}
+
+
+static void
+frame_loaded_cb (G_GNUC_UNUSED SoupSession *session,
+    SoupMessage *msg,
+    FrameLoadData *data)
+{
+  ChamplainTimeSeriesTileSource *tile_source = data->source;
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+  ChamplainRenderer *renderer;
+  ChamplainTile *frame_tile;
+
+  DEBUG ("Got reply %d for frame tile %s", msg->status_code, data->key);
+
+  if (msg->status_code == SOUP_STATUS_CANCELLED)
+    {
+      g_hash_table_remove (priv->pending, data->key);
+      frame_load_data_free (data);
+      return;
+    }
+
+  if (!SOUP_STATUS_IS_SUCCESSFUL (msg->status_code))
+    {
+      g_hash_table_remove (priv->pending, data->key);
+      frame_failed (data);
+      frame_load_data_free (data);
+      return;
+    }
+
+  renderer = champlain_map_source_get_renderer (CHAMPLAIN_MAP_SOURCE (tile_source));
+
+  /* The frame is decoded into an off-stage tile, only its surface is kept */
+  frame_tile = champlain_tile_new_full (data->x, data->y,
+        champlain_map_source_get_tile_size (CHAMPLAIN_MAP_SOURCE (tile_source)),
+        data->z);
+  g_object_ref_sink (frame_tile);
+
+  g_signal_connect (frame_tile, "render-complete", G_CALLBACK (frame_rendered_cb), data);
+
+  champlain_renderer_set_data (renderer, msg->response_body->data, msg->response_body->length);
+  champlain_renderer_render (renderer, frame_tile);
+}
+
+
+static void
+load_frame (ChamplainTimeSeriesTileSource *tile_source,
+    guint frame,
+    gint x,
+    gint y,
+    gint z)
+{
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+  const gchar *time = get_frame_time (tile_source, frame);
+  FrameLoadData *data;
+  SoupMessage *msg;
+  gchar *uri;
+  gchar *key;
+
+  if (!time || !priv->uri_format)
+    return;
+
+  key = generate_key (time, x, y, z);
+  if (g_hash_table_lookup (priv->decoded, key) ||
+      g_hash_table_lookup (priv->pending, key))
+    {
+      g_free (key);
+      return;
+    }
+
+  uri = get_tile_uri (tile_source, time, x, y, z);
+  DEBUG ("Loading frame tile %s from %s", key, uri);
+  msg = soup_message_new (SOUP_METHOD_GET, uri);
+  g_free (uri);
+
+  if (!msg)
+    {
+      g_free (key);
+      return;
+    }
+
+  g_hash_table_insert (priv->pending, g_strdup (key), GINT_TO_POINTER (TRUE));
+
+  data = g_slice_new (FrameLoadData);
+  data->source = g_object_ref (tile_source);
+  data->key = key;
+  data->time = g_strdup (time);
+  data->x = x;
+  data->y = y;
+  data->z = z;
+
+  soup_session_queue_message (priv->soup_session, msg,
+      (SoupSessionCallback) frame_loaded_cb, data);
+}
+
+
+/* Displays the current frame if decoded and makes sure the frames in the
+   preload window are on their way */
+static void
+update_tile (ChamplainTimeSeriesTileSource *tile_source,
+    ChamplainTile *tile)
+{
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+  gint x = champlain_tile_get_x (tile);
+  gint y = champlain_tile_get_y (tile);
+  gint z = champlain_tile_get_zoom_level (tile);
+  const gchar *time;
+  guint i, n_frames;
+
+  time = get_frame_time (tile_source, priv->current_frame);
+  if (time)
+    {
+      gchar *key = generate_key (time, x, y, z);
+      cairo_surface_t *surface = g_hash_table_lookup (priv->decoded, key);
+
+      g_free (key);
+
+      if (surface)
+        display_surface (tile, surface);
+      else
+        load_frame (tile_source, priv->current_frame, x, y, z);
+    }
+
+  n_frames = MIN (priv->preload_frames, priv->frames->len);
+  for (i = 1; i <= n_frames; i++)
+    load_frame (tile_source, (priv->current_frame + i) % priv->frames->len, x, y, z);
+}
+
+
+static void
+tile_destroyed_cb (ChamplainTile *tile,
+    ChamplainTimeSeriesTileSource *tile_source)
+{
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+
+  g_signal_handlers_disconnect_by_func (tile, tile_destroyed_cb, tile_source);
+  priv->tiles = g_list_remove (priv->tiles, tile);
+}
+
+
+static void
+fill_tile (ChamplainMapSource *map_source,
+    ChamplainTile *tile)
+{
+  g_return_if_fail (CHAMPLAIN_IS_TIME_SERIES_TILE_SOURCE (map_source));
+  g_return_if_fail (CHAMPLAIN_IS_TILE (tile));
+
+  ChamplainTimeSeriesTileSource *tile_source = CHAMPLAIN_TIME_SERIES_TILE_SOURCE (map_source);
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+
+  if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_DONE)
+    return;
+
+  if (priv->frames->len == 0)
+    {
+      ChamplainMapSource *next_source = champlain_map_source_get_next_source (map_source);
+
+      if (CHAMPLAIN_IS_MAP_SOURCE (next_source))
+        champlain_map_source_fill_tile (next_source, tile);
+      return;
+    }
+
+  if (!g_list_find (priv->tiles, tile))
+    {
+      priv->tiles = g_list_prepend (priv->tiles, tile);
+      g_signal_connect (tile, "destroy", G_CALLBACK (tile_destroyed_cb), tile_source);
+    }
+
+  update_tile (tile_source, tile);
+}
+
+
+/**
+ * champlain_time_series_tile_source_set_frames:
+ * @tile_source: the #ChamplainTimeSeriesTileSource
+ * @frames: (array zero-terminated=1): %NULL-terminated array of the values
+ * substituted for the #TIME# token, in playback order
+ *
+ * Sets the frames of the time series. Decoded tiles of frames which are
+ * also present in the new set are kept so a sliding window of frames
+ * can be updated without downloading everything again. The current frame
+ * is reset to the first one.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_time_series_tile_source_set_frames (ChamplainTimeSeriesTileSource *tile_source,
+    const gchar * const *frames)
+{
+  g_return_if_fail (CHAMPLAIN_IS_TIME_SERIES_TILE_SOURCE (tile_source));
+
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+  gint i;
+
+  g_ptr_array_set_size (priv->frames, 0);
+  for (i = 0; frames && frames[i]; i++)
+    g_ptr_array_add (priv->frames, g_strdup (frames[i]));
+
+  champlain_time_series_tile_source_set_current_frame (tile_source, 0);
+}
+
+
+/**
+ * champlain_time_series_tile_source_get_n_frames:
+ * @tile_source: the #ChamplainTimeSeriesTileSource
+ *
+ * Gets the number of frames of the time series.
+ *
+ * Returns: the number of frames.
+ *
+ * Since: 0.12.15
+ */
+guint
+champlain_time_series_tile_source_get_n_frames (ChamplainTimeSeriesTileSource *tile_source)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_TIME_SERIES_TILE_SOURCE (tile_source), 0);
+
+  return tile_source->priv->frames->len;
+}
+
+
+/**
+ * champlain_time_series_tile_source_get_current_frame:
+ * @tile_source: the #ChamplainTimeSeriesTileSource
+ *
+ * Gets the index of the displayed frame.
+ *
+ * Returns: the index of the displayed frame.
+ *
+ * Since: 0.12.15
+ */
+guint
+champlain_time_series_tile_source_get_current_frame (ChamplainTimeSeriesTileSource *tile_source)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_TIME_SERIES_TILE_SOURCE (tile_source), 0);
+
+  return tile_source->priv->current_frame;
+}
+
+
+/**
+ * champlain_time_series_tile_source_set_current_frame:
+ * @tile_source: the #ChamplainTimeSeriesTileSource
+ * @frame: the index of the frame to display
+ *
+ * Switches all the tiles filled by the source to the given frame. Tiles
+ * whose frame has already been decoded are updated immediately, the rest
+ * keep showing their previous content until the frame arrives.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_time_series_tile_source_set_current_frame (ChamplainTimeSeriesTileSource *tile_source,
+    guint frame)
+{
+  g_return_if_fail (CHAMPLAIN_IS_TIME_SERIES_TILE_SOURCE (tile_source));
+
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+  GList *iter;
+
+  if (priv->frames->len > 0)
+    frame = MIN (frame, priv->frames->len - 1);
+  else
+    frame = 0;
+
+  priv->current_frame = frame;
+
+  for (iter = priv->tiles; iter; iter = iter->next)
+    update_tile (tile_source, iter->data);
+
+  g_object_notify (G_OBJECT (tile_source), "current-frame");
+}
+
+
+/**
+ * champlain_time_series_tile_source_get_preload_frames:
+ * @tile_source: the #ChamplainTimeSeriesTileSource
+ *
+ * Gets the number of frames downloaded in advance.
+ *
+ * Returns: the number of frames following the current one which are
+ * downloaded in advance.
+ *
+ * Since: 0.12.15
+ */
+guint
+champlain_time_series_tile_source_get_preload_frames (ChamplainTimeSeriesTileSource *tile_source)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_TIME_SERIES_TILE_SOURCE (tile_source), 0);
+
+  return tile_source->priv->preload_frames;
+}
+
+
+/**
+ * champlain_time_series_tile_source_set_preload_frames:
+ * @tile_source: the #ChamplainTimeSeriesTileSource
+ * @preload_frames: the number of frames to download in advance
+ *
+ * Sets the number of frames following the current one which are downloaded
+ * and decoded in advance for every displayed tile.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_time_series_tile_source_set_preload_frames (ChamplainTimeSeriesTileSource *tile_source,
+    guint preload_frames)
+{
+  g_return_if_fail (CHAMPLAIN_IS_TIME_SERIES_TILE_SOURCE (tile_source));
+
+  tile_source->priv->preload_frames = preload_frames;
+
+  g_object_notify (G_OBJECT (tile_source), "preload-frames");
+}
+
+
+/**
+ * champlain_time_series_tile_source_get_max_decoded_tiles:
+ * @tile_source: the #ChamplainTimeSeriesTileSource
+ *
+ * Gets the maximum number of decoded tiles kept in memory.
+ *
+ * Returns: the maximum number of decoded tiles.
+ *
+ * Since: 0.12.15
+ */
+guint
+champlain_time_series_tile_source_get_max_decoded_tiles (ChamplainTimeSeriesTileSource *tile_source)
+{
+  g_return_val_if_fail (CHAMPLAIN_IS_TIME_SERIES_TILE_SOURCE (tile_source), 0);
+
+  return tile_source->priv->max_decoded_tiles;
+}
+
+
+/**
+ * champlain_time_series_tile_source_set_max_decoded_tiles:
+ * @tile_source: the #ChamplainTimeSeriesTileSource
+ * @max_decoded_tiles: the maximum number of decoded tiles
+ *
+ * Sets the maximum number of decoded tiles (of all frames) kept in memory.
+ * It should be at least the number of visible tiles multiplied by the
+ * number of preloaded frames.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_time_series_tile_source_set_max_decoded_tiles (ChamplainTimeSeriesTileSource *tile_source,
+    guint max_decoded_tiles)
+{
+  g_return_if_fail (CHAMPLAIN_IS_TIME_SERIES_TILE_SOURCE (tile_source));
+
+  ChamplainTimeSeriesTileSourcePrivate *priv = tile_source->priv;
+
+  priv->max_decoded_tiles = MAX (max_decoded_tiles, 1);
+
+  while (g_queue_get_length (priv->decoded_order) > priv->max_decoded_tiles)
+    g_hash_table_remove (priv->decoded, g_queue_pop_head (priv->decoded_order));
+
+  g_object_notify (G_OBJECT (tile_source), "max-decoded-tiles");
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2010-2013 Jiri Techet <techet@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:champlain-trace
+ * @short_description: Tile lifecycle tracing
+ *
+ * Tracing records timestamped events for every tile loaded by
+ * #ChamplainView: the time spent waiting in the main loop before the
+ * tile is requested, the map sources the tile passes through, file cache
+ * reads, network downloads, rendering, displaying and fading in. Clutter
+ * frames are recorded as well so the tile events can be related to
+ * repaints.
+ *
+ * The output is a JSON file in the Chrome trace event format which can be
+ * opened offline in chrome://tracing or in the Perfetto UI. Each tile is
+ * shown as a separate async track.
+ *
+ * Tracing is disabled by default and costs a single check per event when
+ * disabled. It can be started with champlain_trace_start() or by setting
+ * the CHAMPLAIN_TRACE environment variable to the output file name before
+ * the first #ChamplainView is created. Only events emitted from the main
+ * thread are recorded.
+ */
+
+#include "config.h"
+
+#include "champlain-trace.h"
+#include "champlain-debug.h"
+#include "champlain-private.h"
+#include "champlain-tile.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <clutter/clutter.h>
+
+G_LOCK_DEFINE_STATIC (trace);
+
+static FILE *trace_file = NULL;
+static gint64 trace_start_time = 0;
+static gboolean trace_first_event = TRUE;
+static guint trace_repaint_id = 0;
+
+
+static gint64
+trace_timestamp (void)
+{
+  return g_get_monotonic_time () - trace_start_time;
+}
+
+
+static void
+trace_separator (void)
+{
+  if (!trace_first_event)
+    fputs (",\n", trace_file);
+  trace_first_event = FALSE;
+}
+
+
+static gboolean
+trace_frame_cb (G_GNUC_UNUSED gpointer data)
+{
+  G_LOCK (trace);
+  if (trace_file)
+    {
+      trace_separator ();
+      fprintf (trace_file,
+          "{\"name\":\"frame\",\"cat\":\"clutter\",\"ph\":\"i\",\"s\":\"g\","
+          "\"ts\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":1}",
+          trace_timestamp (), (gint) getpid ());
+    }
+  G_UNLOCK (trace);
+
+  return TRUE;
+}
+
+
+static void
+trace_env_stop (void)
+{
+  champlain_trace_stop ();
+}
+
+
+/**
+ * champlain_trace_start:
+ * @filename: the name of the JSON file the trace is written to
+ * @error: return location for a #GError, or %NULL
+ *
+ * Starts recording the tile lifecycle trace into @filename. If a trace is
+ * already being recorded, it is stopped first.
+ *
+ * Returns: %TRUE when the file could be opened, %FALSE otherwise.
+ *
+ * Since: 0.12.15
+ */
+gboolean
+champlain_trace_start (const gchar *filename,
+    GError **error)
+{
+  FILE *file;
+
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  champlain_trace_stop ();
+
+  file = g_fopen (filename, "w");
+  if (!file)
+    {
+      gint saved_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+          "Failed to open trace file '%s': %s", filename, g_strerror (saved_errno));
+      return FALSE;
+    }
+
+  G_LOCK (trace);
+  trace_file = file;
+  trace_start_time = g_get_monotonic_time ();
+  trace_first_event = TRUE;
+  fputs ("[\n", trace_file);
+  G_UNLOCK (trace);
+
+  trace_repaint_id = clutter_threads_add_repaint_func (trace_frame_cb, NULL, NULL);
+
+  return TRUE;
+}
+
+
+/**
+ * champlain_trace_stop:
+ *
+ * Stops recording the trace and closes the trace file.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_trace_stop (void)
+{
+  if (trace_repaint_id)
+    {
+      clutter_threads_remove_repaint_func (trace_repaint_id);
+      trace_repaint_id = 0;
+    }
+
+  G_LOCK (trace);
+  if (trace_file)
+    {
+      fputs ("\n]\n", trace_file);
+      fclose (trace_file);
+      trace_file = NULL;
+    }
+  G_UNLOCK (trace);
+}
+
+
+/**
+ * champlain_trace_is_active:
+ *
+ * Checks whether a trace is being recorded.
+ *
+ * Returns: %TRUE when a trace is being recorded.
+ *
+ * Since: 0.12.15
+ */
+gboolean
+champlain_trace_is_active (void)
+{
+  return trace_file != NULL;
+}
+
+
+void
+_champlain_trace_init_from_env (void)
+{
+  static gboolean initialized = FALSE;
+  const gchar *filename;
+
+  if (initialized)
+    return;
+  initialized = TRUE;
+
+  filename = g_getenv ("CHAMPLAIN_TRACE");
+  if (filename && *filename)
+    {
+      GError *error = NULL;
+
+      if (champlain_trace_start (filename, &error))
+        atexit (trace_env_stop);
+      else
+        {
+          g_warning ("%s", error->message);
+          g_error_free (error);
+        }
+    }
+}
+
+
+void
+_champlain_trace_async (gchar phase,
+    const gchar *category,
+    const gchar *name,
+    gconstpointer id,
+    guint zoom_level,
+    guint x,
+    guint y)
+{
+  CHAMPLAIN_PROBE4 (tile_event, phase, category, name, id);
+
+  if (G_LIKELY (!trace_file))
+    return;
+
+  G_LOCK (trace);
+  if (trace_file)
+    {
+      trace_separator ();
+      fprintf (trace_file,
+          "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"id\":\"%p\","
+          "\"ts\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":1,"
+          "\"args\":{\"tile\":\"%u/%u/%u\"}}",
+          name, category, phase, id,
+          trace_timestamp (), (gint) getpid (),
+          zoom_level, x, y);
+    }
+  G_UNLOCK (trace);
+}
+
+
+void
+_champlain_trace_tile (gchar phase,
+    const gchar *category,
+    const gchar *name,
+    ChamplainTile *tile)
+{
+  if (G_LIKELY (!trace_file))
+    {
+      CHAMPLAIN_PROBE4 (tile_event, phase, category, name, tile);
+      return;
+    }
+
+  _champlain_trace_async (phase, category, name, tile,
+      champlain_tile_get_zoom_level (tile),
+      champlain_tile_get_x (tile),
+      champlain_tile_get_y (tile));
+}
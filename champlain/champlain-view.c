@@ -60,6 +60,7 @@
 #include "champlain-map-source.h"
 #include "champlain-map-source-factory.h"
 #include "champlain-private.h"
+#include "champlain-bench-private.h"
 #include "champlain-tile.h"
 #include "champlain-license.h"
 
@@ -67,15 +68,20 @@
 #include <glib.h>
 #include <glib-object.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <champlain-kinetic-scroll-view.h>
 #include <champlain-viewport.h>
 #include <champlain-adjustment.h>
 
+/* Define VIEW_LOG to print every view function call. Otherwise each call
+ * is a "view_call" static probe, see champlain-debug.h. Functions called
+ * per marker or per path point don't log at all. */
 /* #define VIEW_LOG */
 #ifdef VIEW_LOG
 #define DEBUG_LOG() g_print ("%s\n", __FUNCTION__);
 #else
-#define DEBUG_LOG()
+#define DEBUG_LOG() CHAMPLAIN_PROBE1 (view_call, G_STRFUNC);
 #endif
 
 enum
@@ -83,6 +89,7 @@ enum
   /* normal signals */
   ANIMATION_COMPLETED,
   LAYER_RELOCATED,
+  STATS_UPDATED,
   LAST_SIGNAL
 };
 
@@ -105,10 +112,17 @@ enum
   PROP_GOTO_ANIMATION_MODE,
   PROP_GOTO_ANIMATION_DURATION,
   PROP_WORLD,
-  PROP_HORIZONTAL_WRAP
+  PROP_HORIZONTAL_WRAP,
+  PROP_COMPOSITE_OVERLAYS
 };
 
 #define PADDING 10
+#define COMPOSITE_MAX_THREADS 2
+/* Number of most recent tile load latencies the percentiles are computed from */
+#define LATENCY_SAMPLES 256
+/* Session snapshots are saved at 1/SNAPSHOT_DOWNSCALE of the view size */
+#define SNAPSHOT_DOWNSCALE 2
+#define SNAPSHOT_GROUP "Snapshot"
 static guint signals[LAST_SIGNAL] = { 0, };
 
 #define GET_PRIVATE(obj) \
@@ -143,6 +157,37 @@ typedef struct
 } FillTileCallbackData;
 
 
+/* Per-cell state used when overlays are composited into the base tile */
+typedef struct
+{
+  ChamplainView *view;
+  ChamplainTile *tile;    /* the base tile, the only one added to map_layer */
+  GPtrArray *layers;      /* off-stage overlay tiles, in stacking order */
+  cairo_surface_t *base_surface;  /* the base tile's own rendering */
+  cairo_surface_t *composite;     /* last surface produced by the worker */
+  guint generation;
+} CompositeCell;
+
+
+typedef struct
+{
+  cairo_surface_t *surface;
+  guint8 opacity;
+} CompositeLayer;
+
+
+typedef struct
+{
+  ChamplainTile *tile;
+  guint generation;
+  gint size;
+  cairo_surface_t *base;
+  CompositeLayer *layers;
+  guint n_layers;
+  cairo_surface_t *result;
+} CompositeJob;
+
+
 struct _ChamplainViewPrivate
 {
                                 /* ChamplainView */
@@ -161,6 +206,7 @@ struct _ChamplainViewPrivate
 
   gboolean hwrap;
   gint num_clones;
+  gint clones_map_size; /* map width the clones were positioned for */
   GList *map_clones;
   /* There are num_clones user layer slots, overlayed on the map clones.
    * The first slot initially contains the real user_layers actor, and the
@@ -203,6 +249,7 @@ struct _ChamplainViewPrivate
   gint tiles_loading;
   
   guint redraw_timeout;
+  guint update_idle_id; /* coalesces size changes, see view_size_changed_cb */
   guint zoom_timeout;
   
   ClutterAnimationMode goto_mode;
@@ -232,12 +279,21 @@ struct _ChamplainViewPrivate
   ChamplainBoundingBox *world_bbox;
 
   GHashTable *visible_tiles;
+
+  gboolean composite_overlays;
+  GThreadPool *composite_pool;
+
+  ChamplainViewStats stats;
+  gint64 latencies[LATENCY_SAMPLES]; /* ring buffer, in microseconds */
+  guint n_latencies;
+  guint latency_pos;
 };
 
 G_DEFINE_TYPE (ChamplainView, champlain_view, CLUTTER_TYPE_ACTOR);
 
 static void exclusive_destroy_clone(ClutterActor *clone);
 static void update_clones (ChamplainView *view);
+static void resize_clones (ChamplainView *view);
 static gboolean scroll_event (ClutterActor *actor,
     ClutterScrollEvent *event,
     ChamplainView *view);
@@ -308,6 +364,8 @@ static gboolean tile_in_tile_table (ChamplainView *view,
     GHashTable *table,
     gint tile_x,
     gint tile_y);
+static void trim_memory (GObject *object,
+    ChamplainTrimLevel level);
 
 static gdouble
 x_to_wrap_x (gdouble x, gdouble width)
@@ -637,6 +695,10 @@ champlain_view_get_property (GObject *object,
       g_value_set_boolean (value, champlain_view_get_horizontal_wrap (view));
       break;
 
+    case PROP_COMPOSITE_OVERLAYS:
+      g_value_set_boolean (value, priv->composite_overlays);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -722,6 +784,10 @@ champlain_view_set_property (GObject *object,
       champlain_view_set_horizontal_wrap (view, g_value_get_boolean (value));
       break;
 
+    case PROP_COMPOSITE_OVERLAYS:
+      champlain_view_set_composite_overlays (view, g_value_get_boolean (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -739,6 +805,12 @@ champlain_view_dispose (GObject *object)
   if (priv->goto_context != NULL)
     champlain_view_stop_go_to (view);
 
+  if (priv->update_idle_id != 0)
+    {
+      g_source_remove (priv->update_idle_id);
+      priv->update_idle_id = 0;
+    }
+
   if (priv->kinetic_scroll != NULL)
     {
       champlain_kinetic_scroll_view_stop (CHAMPLAIN_KINETIC_SCROLL_VIEW (priv->kinetic_scroll));
@@ -818,6 +890,12 @@ champlain_view_dispose (GObject *object)
       priv->world_bbox = NULL;
     }
 
+  if (priv->composite_pool)
+    {
+      g_thread_pool_free (priv->composite_pool, FALSE, TRUE);
+      priv->composite_pool = NULL;
+    }
+
   G_OBJECT_CLASS (champlain_view_parent_class)->dispose (object);
 }
 
@@ -1172,6 +1250,25 @@ champlain_view_class_init (ChamplainViewClass *champlainViewClass)
           FALSE,
           CHAMPLAIN_PARAM_READWRITE));
 
+  /**
+   * ChamplainView:composite-overlays:
+   *
+   * Determines whether overlay tiles are blended into the base map tile
+   * instead of being displayed as separate actors. When set, every grid
+   * cell is represented by a single actor and texture regardless of the
+   * number of overlay sources; the blending is performed in a worker thread
+   * and only the affected cell is recomposited when an overlay tile arrives.
+   *
+   * Since: 0.12.15
+   */
+  g_object_class_install_property (object_class,
+      PROP_COMPOSITE_OVERLAYS,
+      g_param_spec_boolean ("composite-overlays",
+          "Composite overlays",
+          "Blend overlay tiles into the base map tiles",
+          FALSE,
+          CHAMPLAIN_PARAM_READWRITE));
+
   /**
    * ChamplainView::animation-completed:
    *
@@ -1209,6 +1306,23 @@ champlain_view_class_init (ChamplainViewClass *champlainViewClass)
         g_cclosure_marshal_VOID__VOID, 
         G_TYPE_NONE, 
         0);
+
+  /**
+   * ChamplainView::stats-updated:
+   *
+   * Emitted when the view finishes loading the visible tiles. The updated
+   * statistics can be obtained with champlain_view_get_stats().
+   *
+   * Since: 0.12.15
+   */
+  signals[STATS_UPDATED] =
+    g_signal_new ("stats-updated",
+        G_OBJECT_CLASS_TYPE (object_class),
+        G_SIGNAL_RUN_LAST,
+        0, NULL, NULL,
+        g_cclosure_marshal_VOID__VOID,
+        G_TYPE_NONE,
+        0);
 }
 
 
@@ -1240,7 +1354,9 @@ _update_idle_cb (ChamplainView *view)
   DEBUG_LOG ()
 
   ChamplainViewPrivate *priv = view->priv;
-  
+
+  priv->update_idle_id = 0;
+
   if (!priv->kinetic_scroll)
     return FALSE;
 
@@ -1257,7 +1373,7 @@ _update_idle_cb (ChamplainView *view)
 
   if (priv->hwrap)
     {
-      update_clones (view);
+      resize_clones (view);
       position_viewport (view, x_to_wrap_x (priv->viewport_x, get_map_width (view)), priv->viewport_y);
     }
 
@@ -1275,9 +1391,12 @@ view_size_changed_cb (ChamplainView *view,
   width = clutter_actor_get_width (CLUTTER_ACTOR (view));
   height = clutter_actor_get_height (CLUTTER_ACTOR (view));
   
-  if (priv->viewport_width != width || priv->viewport_height != height)
+  /* During a live resize the size changes many times per frame, only the
+   * last one is applied right before the next redraw */
+  if ((priv->viewport_width != width || priv->viewport_height != height) &&
+      priv->update_idle_id == 0)
     {
-      g_idle_add_full (CLUTTER_PRIORITY_REDRAW,
+      priv->update_idle_id = g_idle_add_full (CLUTTER_PRIORITY_REDRAW,
           (GSourceFunc) _update_idle_cb,
           g_object_ref (view),
           (GDestroyNotify) g_object_unref);
@@ -1296,6 +1415,33 @@ exclusive_destroy_clone (ClutterActor *clone)
   clutter_actor_destroy (clone);
 }
 
+/* Adds the map and user layer clones of the i-th map copy on the right */
+static void
+add_clone (ChamplainView *view,
+    gint i,
+    gint map_size)
+{
+  ChamplainViewPrivate *priv = view->priv;
+
+  /* Map layer clones */
+  ClutterActor *map_clone = clutter_clone_new (priv->map_layer);
+  clutter_actor_set_x (map_clone, (i + 1) * map_size);
+  clutter_actor_insert_child_below (priv->viewport_container, map_clone,
+                                    NULL);
+
+  priv->map_clones = g_list_prepend (priv->map_clones, map_clone);
+
+  /* User layer clones */
+  ClutterActor *clone_user = clutter_clone_new (priv->user_layers);
+  clutter_actor_set_x (clone_user, (i + 1) * map_size);
+  clutter_actor_insert_child_below (priv->viewport_container, clone_user,
+                                    priv->user_layers);
+
+  /* Inserting the user layer clones in the following slots */
+  priv->user_layer_slots = g_list_append (priv->user_layer_slots, clone_user);
+}
+
+
 static void
 update_clones (ChamplainView *view)
 {
@@ -1310,6 +1456,7 @@ update_clones (ChamplainView *view)
   clutter_actor_get_size (CLUTTER_ACTOR (view), &view_width, NULL);
 
   priv->num_clones = ceil (view_width / map_size) + 1;
+  priv->clones_map_size = map_size;
 
   if (priv->map_clones != NULL)
     {
@@ -1326,23 +1473,49 @@ update_clones (ChamplainView *view)
   clutter_actor_set_x (priv->user_layers, 0);
     
   for (i = 0; i < priv->num_clones; i++) 
+    add_clone (view, i, map_size);
+}
+
+
+/* Keeps the existing clones when only the view size changed and adds or
+ * removes the clones on the right side */
+static void
+resize_clones (ChamplainView *view)
+{
+  DEBUG_LOG ()
+
+  ChamplainViewPrivate *priv = view->priv;
+  gint map_size;
+  gfloat view_width;
+  gint num_clones;
+
+  map_size = get_map_width (view);
+  clutter_actor_get_size (CLUTTER_ACTOR (view), &view_width, NULL);
+  num_clones = ceil (view_width / map_size) + 1;
+
+  /* The real user layers may have been swapped into a removed slot */
+  if (priv->map_clones == NULL || priv->clones_map_size != map_size ||
+      g_list_index (priv->user_layer_slots, priv->user_layers) > num_clones)
     {
-      /* Map layer clones */
-      ClutterActor *map_clone = clutter_clone_new (priv->map_layer);
-      clutter_actor_set_x (map_clone, (i + 1) * map_size);
-      clutter_actor_insert_child_below (priv->viewport_container, map_clone,
-                                        NULL);
-
-      priv->map_clones = g_list_prepend (priv->map_clones, map_clone);
-
-      /* User layer clones */
-      ClutterActor *clone_user = clutter_clone_new (priv->user_layers);
-      clutter_actor_set_x (clone_user, (i + 1) * map_size);
-      clutter_actor_insert_child_below (priv->viewport_container, clone_user,
-                                        priv->user_layers);
-
-      /* Inserting the user layer clones in the following slots */
-      priv->user_layer_slots = g_list_append (priv->user_layer_slots, clone_user);
+      update_clones (view);
+      return;
+    }
+
+  while (priv->num_clones < num_clones)
+    add_clone (view, priv->num_clones++, map_size);
+
+  while (priv->num_clones > num_clones)
+    {
+      GList *last_slot = g_list_last (priv->user_layer_slots);
+
+      clutter_actor_destroy (CLUTTER_ACTOR (last_slot->data));
+      priv->user_layer_slots = g_list_delete_link (priv->user_layer_slots, last_slot);
+
+      /* map_clones is ordered from the rightmost clone */
+      clutter_actor_destroy (CLUTTER_ACTOR (priv->map_clones->data));
+      priv->map_clones = g_list_delete_link (priv->map_clones, priv->map_clones);
+
+      priv->num_clones--;
     }
 }
 
@@ -1468,6 +1641,8 @@ champlain_view_init (ChamplainView *view)
   ClutterColor color = { 0xf1, 0xee, 0xe8, 0xff };
 
   champlain_debug_set_flags (g_getenv ("CHAMPLAIN_DEBUG"));
+  _champlain_trace_init_from_env ();
+  _champlain_memory_usage_init_from_env ();
 
   view->priv = priv;
 
@@ -1514,6 +1689,13 @@ champlain_view_init (ChamplainView *view)
   priv->map_clones = NULL;
   priv->user_layer_slots = NULL;
   priv->hwrap = FALSE;
+  priv->composite_overlays = FALSE;
+  priv->composite_pool = NULL;
+  memset (&priv->stats, 0, sizeof (ChamplainViewStats));
+  priv->n_latencies = 0;
+  priv->latency_pos = 0;
+
+  _champlain_memory_usage_add_trim_handler (G_OBJECT (view), trim_memory);
 
   clutter_actor_set_background_color (CLUTTER_ACTOR (view), &color);
 
@@ -1617,8 +1799,6 @@ viewport_pos_changed_cb (G_GNUC_UNUSED GObject *gobject,
     G_GNUC_UNUSED GParamSpec *arg1,
     ChamplainView *view)
 {
-  DEBUG_LOG ()
-
   ChamplainViewPrivate *priv = view->priv;
   gdouble x, y;
 
@@ -2189,6 +2369,250 @@ champlain_view_to_surface (ChamplainView *view,
 }
 
 
+static gboolean
+snapshot_draw_cb (G_GNUC_UNUSED ClutterCanvas *canvas,
+    cairo_t *cr,
+    G_GNUC_UNUSED gint width,
+    G_GNUC_UNUSED gint height,
+    cairo_surface_t *surface)
+{
+  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_surface (cr, surface, 0, 0);
+  cairo_paint (cr);
+
+  return FALSE;
+}
+
+
+/**
+ * champlain_view_save_snapshot:
+ * @view: a #ChamplainView
+ * @filename: the name of the snapshot file
+ * @error: return location for a #GError, or %NULL
+ *
+ * Saves a downscaled image of the map currently shown in the view together
+ * with its map source, zoom level and center, so that the next session can
+ * show it immediately with champlain_view_load_snapshot(). Typically called
+ * when the application shuts down. The image is written next to @filename
+ * with the ".png" suffix appended.
+ *
+ * Like champlain_view_to_surface(), this only works when the view is in the
+ * #CHAMPLAIN_STATE_DONE state.
+ *
+ * Returns: %TRUE when the snapshot was saved, %FALSE otherwise.
+ *
+ * Since: 0.12.15
+ */
+gboolean
+champlain_view_save_snapshot (ChamplainView *view,
+    const gchar *filename,
+    GError **error)
+{
+  DEBUG_LOG ()
+
+  g_return_val_if_fail (CHAMPLAIN_IS_VIEW (view), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  ChamplainViewPrivate *priv = view->priv;
+  cairo_surface_t *surface, *snapshot;
+  cairo_status_t status;
+  cairo_t *cr;
+  GKeyFile *key_file;
+  gchar *image_filename, *image_basename, *data;
+  gint width, height;
+  gboolean ret;
+
+  surface = champlain_view_to_surface (view, FALSE);
+  if (!surface)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+          "The map is not completely loaded or cannot be exported");
+      return FALSE;
+    }
+
+  width = cairo_image_surface_get_width (surface);
+  height = cairo_image_surface_get_height (surface);
+  snapshot = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+        MAX (width / SNAPSHOT_DOWNSCALE, 1), MAX (height / SNAPSHOT_DOWNSCALE, 1));
+  cr = cairo_create (snapshot);
+  cairo_scale (cr, 1.0 / SNAPSHOT_DOWNSCALE, 1.0 / SNAPSHOT_DOWNSCALE);
+  cairo_set_source_surface (cr, surface, 0, 0);
+  cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_GOOD);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+  cairo_surface_destroy (surface);
+
+  image_filename = g_strconcat (filename, ".png", NULL);
+  status = cairo_surface_write_to_png (snapshot, image_filename);
+  cairo_surface_destroy (snapshot);
+  if (status != CAIRO_STATUS_SUCCESS)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+          "Failed to write snapshot image '%s': %s", image_filename,
+          cairo_status_to_string (status));
+      g_free (image_filename);
+      return FALSE;
+    }
+
+  image_basename = g_path_get_basename (image_filename);
+  key_file = g_key_file_new ();
+  g_key_file_set_string (key_file, SNAPSHOT_GROUP, "image", image_basename);
+  g_key_file_set_string (key_file, SNAPSHOT_GROUP, "map-source",
+      champlain_map_source_get_id (priv->map_source));
+  g_key_file_set_integer (key_file, SNAPSHOT_GROUP, "zoom-level", priv->zoom_level);
+  g_key_file_set_double (key_file, SNAPSHOT_GROUP, "latitude", priv->latitude);
+  g_key_file_set_double (key_file, SNAPSHOT_GROUP, "longitude", priv->longitude);
+  g_key_file_set_integer (key_file, SNAPSHOT_GROUP, "width", width);
+  g_key_file_set_integer (key_file, SNAPSHOT_GROUP, "height", height);
+
+  data = g_key_file_to_data (key_file, NULL, NULL);
+  ret = g_file_set_contents (filename, data, -1, error);
+
+  g_free (data);
+  g_key_file_free (key_file);
+  g_free (image_basename);
+  g_free (image_filename);
+
+  return ret;
+}
+
+
+/**
+ * champlain_view_load_snapshot:
+ * @view: a #ChamplainView
+ * @filename: the name of a file written by champlain_view_save_snapshot()
+ * @error: return location for a #GError, or %NULL
+ *
+ * Restores the zoom level and center stored in the snapshot and shows the
+ * snapshot image under the map tiles until the visible tiles are loaded, so
+ * the view shows a meaningful map right after startup instead of waiting for
+ * the tile caches and the network. Typically called when the application
+ * starts, after the map source has been set.
+ *
+ * The snapshot is only used when it was taken with the map source the view
+ * currently uses.
+ *
+ * Returns: %TRUE when the snapshot was applied, %FALSE otherwise.
+ *
+ * Since: 0.12.15
+ */
+gboolean
+champlain_view_load_snapshot (ChamplainView *view,
+    const gchar *filename,
+    GError **error)
+{
+  DEBUG_LOG ()
+
+  g_return_val_if_fail (CHAMPLAIN_IS_VIEW (view), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  static const gchar *keys[] = {
+    "image", "map-source", "zoom-level", "latitude", "longitude", "width", "height"
+  };
+  ChamplainViewPrivate *priv = view->priv;
+  cairo_surface_t *surface = NULL;
+  ClutterContent *content;
+  ClutterActor *actor;
+  GKeyFile *key_file;
+  gchar *source_id = NULL, *image = NULL, *dirname = NULL, *image_filename = NULL;
+  gint width, height;
+  gdouble x, y;
+  gboolean animate_zoom;
+  gboolean ret = FALSE;
+  guint i;
+
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, error))
+    goto finish;
+
+  for (i = 0; i < G_N_ELEMENTS (keys); i++)
+    {
+      if (!g_key_file_has_key (key_file, SNAPSHOT_GROUP, keys[i], NULL))
+        {
+          g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+              "Snapshot '%s' has no key '%s'", filename, keys[i]);
+          goto finish;
+        }
+    }
+
+  source_id = g_key_file_get_string (key_file, SNAPSHOT_GROUP, "map-source", NULL);
+  if (g_strcmp0 (source_id, champlain_map_source_get_id (priv->map_source)) != 0)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+          "Snapshot '%s' was taken with the map source '%s'", filename, source_id);
+      goto finish;
+    }
+
+  dirname = g_path_get_dirname (filename);
+  image = g_key_file_get_string (key_file, SNAPSHOT_GROUP, "image", NULL);
+  image_filename = g_build_filename (dirname, image, NULL);
+  surface = cairo_image_surface_create_from_png (image_filename);
+  if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+          "Failed to read snapshot image '%s': %s", image_filename,
+          cairo_status_to_string (cairo_surface_status (surface)));
+      goto finish;
+    }
+
+  /* A zoom animation would clear the zoom layer when it ends */
+  animate_zoom = priv->animate_zoom;
+  priv->animate_zoom = FALSE;
+  champlain_view_set_zoom_level (view,
+      g_key_file_get_integer (key_file, SNAPSHOT_GROUP, "zoom-level", NULL));
+  priv->animate_zoom = animate_zoom;
+  champlain_view_center_on (view,
+      g_key_file_get_double (key_file, SNAPSHOT_GROUP, "latitude", NULL),
+      g_key_file_get_double (key_file, SNAPSHOT_GROUP, "longitude", NULL));
+  ret = TRUE;
+
+  /* Everything came from the memory cache, nothing to cover */
+  if (priv->state == CHAMPLAIN_STATE_DONE)
+    goto finish;
+
+  width = g_key_file_get_integer (key_file, SNAPSHOT_GROUP, "width", NULL);
+  height = g_key_file_get_integer (key_file, SNAPSHOT_GROUP, "height", NULL);
+
+  content = clutter_canvas_new ();
+  clutter_canvas_set_size (CLUTTER_CANVAS (content),
+      cairo_image_surface_get_width (surface), cairo_image_surface_get_height (surface));
+  g_signal_connect_data (content, "draw", G_CALLBACK (snapshot_draw_cb),
+      cairo_surface_reference (surface), (GClosureNotify) cairo_surface_destroy, 0);
+  clutter_content_invalidate (content);
+
+  /* The content is scaled back to the original size by the actor */
+  actor = clutter_actor_new ();
+  clutter_actor_set_size (actor, width, height);
+  clutter_actor_set_content (actor, content);
+  g_object_unref (content);
+
+  /* The zoom layer lies under the tiles and is cleared once they are loaded */
+  if (priv->zoom_actor_timeout != 0)
+    {
+      g_source_remove (priv->zoom_actor_timeout);
+      priv->zoom_actor_timeout = 0;
+    }
+  clutter_actor_destroy_all_children (priv->zoom_layer);
+  clutter_actor_add_child (priv->zoom_layer, actor);
+
+  /* Centered, the view size may have changed since the snapshot was taken */
+  x = priv->viewport_x + (priv->viewport_width - width) / 2.0;
+  y = priv->viewport_y + (priv->viewport_height - height) / 2.0;
+  champlain_viewport_set_actor_position (CHAMPLAIN_VIEWPORT (priv->viewport), actor, x, y);
+
+finish:
+  if (surface)
+    cairo_surface_destroy (surface);
+  g_free (image_filename);
+  g_free (image);
+  g_free (dirname);
+  g_free (source_id);
+  g_key_file_free (key_file);
+
+  return ret;
+}
+
+
 /**
  * champlain_view_set_zoom_level:
  * @view: a #ChamplainView
@@ -2356,6 +2780,8 @@ champlain_view_add_layer (ChamplainView *view,
   clutter_actor_add_child (view->priv->user_layers, CLUTTER_ACTOR (layer));
   champlain_layer_set_view (layer, view);
   clutter_actor_set_child_above_sibling (view->priv->user_layers, CLUTTER_ACTOR (layer), NULL);
+
+  _champlain_recording_layer_added (view, layer);
 }
 
 
@@ -2377,6 +2803,7 @@ champlain_view_remove_layer (ChamplainView *view,
   g_return_if_fail (CHAMPLAIN_IS_VIEW (view));
   g_return_if_fail (CHAMPLAIN_IS_LAYER (layer));
 
+  _champlain_recording_layer_removed (view, layer);
   champlain_layer_set_view (layer, NULL);
 
   clutter_actor_remove_child (view->priv->user_layers, CLUTTER_ACTOR (layer));
@@ -2401,8 +2828,6 @@ champlain_view_x_to_longitude (ChamplainView *view,
   ChamplainViewPrivate *priv = view->priv;
   gdouble longitude;
 
-  DEBUG_LOG ()
-
   g_return_val_if_fail (CHAMPLAIN_IS_VIEW (view), 0.0);
 
   if (priv->hwrap) {
@@ -2440,8 +2865,6 @@ champlain_view_y_to_latitude (ChamplainView *view,
   ChamplainViewPrivate *priv = view->priv;
   gdouble latitude;
 
-  DEBUG_LOG ()
-
   g_return_val_if_fail (CHAMPLAIN_IS_VIEW (view), 0.0);
 
   latitude = champlain_map_source_get_latitude (priv->map_source,
@@ -2470,8 +2893,6 @@ champlain_view_longitude_to_x (ChamplainView *view,
   ChamplainViewPrivate *priv = view->priv;
   gdouble x;
 
-  DEBUG_LOG ()
-
   g_return_val_if_fail (CHAMPLAIN_IS_VIEW (view), 0);
 
   x = champlain_map_source_get_x (priv->map_source, priv->zoom_level, longitude);
@@ -2498,8 +2919,6 @@ champlain_view_latitude_to_y (ChamplainView *view,
   ChamplainViewPrivate *priv = view->priv;
   gdouble y;
 
-  DEBUG_LOG ()
-
   g_return_val_if_fail (CHAMPLAIN_IS_VIEW (view), 0);
 
   y = champlain_map_source_get_y (priv->map_source, priv->zoom_level, latitude);
@@ -2522,8 +2941,6 @@ champlain_view_get_viewport_anchor (ChamplainView *view,
     gint *anchor_x,
     gint *anchor_y)
 {
-    DEBUG_LOG ()
-
   g_return_if_fail (CHAMPLAIN_IS_VIEW (view));
   ChamplainViewPrivate *priv = view->priv;
 
@@ -2545,8 +2962,6 @@ champlain_view_get_viewport_origin (ChamplainView *view,
     gint *x,
     gint *y)
 {
-  DEBUG_LOG ()
-
   g_return_if_fail (CHAMPLAIN_IS_VIEW (view));
   ChamplainViewPrivate *priv = view->priv;
   gint anchor_x, anchor_y;
@@ -2567,12 +2982,9 @@ fill_background_tiles (ChamplainView *view)
   DEBUG_LOG ()
 
   ChamplainViewPrivate *priv = view->priv;
-  ClutterActorIter iter;
   ClutterActor *child;
   gint x_count, y_count, x_first, y_first;
-  gint x, y;
   gfloat width, height;
-  gboolean have_children = TRUE;
 
   clutter_content_get_preferred_size (priv->background_content, &width, &height);
 
@@ -2581,34 +2993,24 @@ fill_background_tiles (ChamplainView *view)
 
   x_first = (gint)priv->viewport_x / width - 1;
   y_first = (gint)priv->viewport_y / height - 1;
-  
-  clutter_actor_iter_init (&iter, priv->background_layer);
 
-  for (x = x_first; x < x_first + x_count; ++x)
-    {
-      for (y = y_first; y < y_first + y_count; ++y)
-        {
-          if (!have_children || !clutter_actor_iter_next (&iter, &child))
-            {
-              have_children = FALSE;
-              child = clutter_actor_new ();
-              clutter_actor_set_size (child, width, height);
-              clutter_actor_set_content (child, priv->background_content);
-              clutter_actor_add_child (priv->background_layer, child);
-            }
-          champlain_viewport_set_actor_position (CHAMPLAIN_VIEWPORT (priv->viewport),
-              child,
-              (x * width) - priv->bg_offset_x,
-              (y * height) - priv->bg_offset_y);
-          child = clutter_actor_get_next_sibling (child);
-        }
-    }
-  
-  if (have_children)
+  /* A single actor repeats the pattern over the whole area, it is only moved
+   * by whole pattern sizes so the repeats stay aligned with the map */
+  child = clutter_actor_get_first_child (priv->background_layer);
+  if (!child)
     {
-      while (clutter_actor_iter_next (&iter, &child))
-          clutter_actor_iter_destroy (&iter);
+      child = clutter_actor_new ();
+      clutter_actor_set_content (child, priv->background_content);
+      clutter_actor_set_content_gravity (child, CLUTTER_CONTENT_GRAVITY_TOP_LEFT);
+      clutter_actor_set_content_repeat (child, CLUTTER_REPEAT_BOTH);
+      clutter_actor_add_child (priv->background_layer, child);
     }
+
+  clutter_actor_set_size (child, x_count * width, y_count * height);
+  champlain_viewport_set_actor_position (CHAMPLAIN_VIEWPORT (priv->viewport),
+      child,
+      (x_first * width) - priv->bg_offset_x,
+      (y_first * height) - priv->bg_offset_y);
 }
 
 static void 
@@ -2645,13 +3047,74 @@ tile_in_tile_table (ChamplainView *view,
 }
 
 
+gdouble
+_champlain_view_x_to_wrap_x (gdouble x,
+    gdouble width)
+{
+  return x_to_wrap_x (x, width);
+}
+
+
+void
+_champlain_view_tile_table_set (ChamplainView *view,
+    GHashTable *table,
+    gint tile_x,
+    gint tile_y,
+    gboolean value)
+{
+  tile_table_set (view, table, tile_x, tile_y, value);
+}
+
+
+gboolean
+_champlain_view_tile_in_tile_table (ChamplainView *view,
+    GHashTable *table,
+    gint tile_x,
+    gint tile_y)
+{
+  return tile_in_tile_table (view, table, tile_x, tile_y);
+}
+
+
+/* The layers added with champlain_view_add_layer(), bottom first */
+GList *
+_champlain_view_get_user_layers (ChamplainView *view)
+{
+  return clutter_actor_get_children (view->priv->user_layers);
+}
+
+
+/* Each tile request gets its own cancellation token */
+static void
+set_new_cancellable (ChamplainTile *tile)
+{
+  GCancellable *cancellable = g_cancellable_new ();
+
+  champlain_tile_set_cancellable (tile, cancellable);
+  g_object_unref (cancellable);
+}
+
+
+/* The tile is no longer needed, every stage of its loading is cancelled */
 static void
+abandon_tile (ChamplainTile *tile)
+{
+  /* cancelled first so the tile isn't counted as displayed */
+  g_cancellable_cancel (champlain_tile_get_cancellable (tile));
+  champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
+}
+
+
+/* When batch is not NULL, the tile is added to it to be filled later
+ * together with the other tiles of the viewport update */
+static ChamplainTile *
 load_tile_for_source (ChamplainView *view,
     ChamplainMapSource *source,
     gint opacity,
     gint size,
     gint x,
-    gint y)
+    gint y,
+    GPtrArray *batch)
 {
   ChamplainViewPrivate *priv = view->priv;
   ChamplainTile *tile = champlain_tile_new ();
@@ -2663,6 +3126,7 @@ load_tile_for_source (ChamplainView *view,
   champlain_tile_set_zoom_level (tile, priv->zoom_level);
   champlain_tile_set_size (tile, size);
   clutter_actor_set_opacity (CLUTTER_ACTOR (tile), opacity);
+  set_new_cancellable (tile);
 
   g_signal_connect (tile, "notify::state", G_CALLBACK (tile_state_notify), view);
   clutter_actor_add_child (priv->map_layer, CLUTTER_ACTOR (tile));
@@ -2672,71 +3136,382 @@ load_tile_for_source (ChamplainView *view,
      notify::state signal is connected  */
   champlain_tile_set_state (tile, CHAMPLAIN_STATE_LOADING);
 
-  champlain_map_source_fill_tile (source, tile);
-
   if (source != priv->map_source)
     g_object_set_data (G_OBJECT (tile), "overlay", GINT_TO_POINTER (TRUE));
+
+  if (batch)
+    g_ptr_array_add (batch, g_object_ref (tile));
+  else
+    champlain_map_source_fill_tile (source, tile);
+
+  return tile;
 }
 
 
 static gboolean
-fill_tile_cb (FillTileCallbackData *data)
+composite_draw_cb (G_GNUC_UNUSED ClutterCanvas *canvas,
+    cairo_t *cr,
+    G_GNUC_UNUSED gint width,
+    G_GNUC_UNUSED gint height,
+    ChamplainTile *tile)
 {
-  DEBUG_LOG ()
-  
-  ChamplainView *view = data->view;
-  ChamplainViewPrivate *priv = view->priv;
-  gint x = data->x;
-  gint y = data->y;
-  gint size = data->size;
-  gint zoom_level = data->zoom_level;
-
-  if (!tile_in_tile_table (view, priv->tile_map, x, y) &&
-      zoom_level == priv->zoom_level &&
-      data->map_source == priv->map_source &&
-      tile_in_tile_table (view, priv->visible_tiles, x, y))
-    {
-      GList *iter;
+  cairo_surface_t *surface;
 
-      load_tile_for_source (view, priv->map_source, 255, size, x, y);
-      for (iter = priv->overlay_sources; iter; iter = iter->next)
-        {
-          gint opacity = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (iter->data), "opacity"));
-          load_tile_for_source (view, iter->data, opacity, size, x, y);
-        }
+  surface = champlain_exportable_get_surface (CHAMPLAIN_EXPORTABLE (tile));
 
-      tile_table_set (view, priv->tile_map, x, y, TRUE);
-    }
+  /* Clear the drawing area */
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
 
-  g_object_unref (view);
-  g_slice_free (FillTileCallbackData, data);
+  if (surface)
+    {
+      cairo_set_source_surface (cr, surface, 0, 0);
+      cairo_paint (cr);
+    }
 
   return FALSE;
 }
 
+
 static void
-load_visible_tiles (ChamplainView *view,
-    gboolean relocate)
+composite_job_free (CompositeJob *job)
 {
-  DEBUG_LOG ()
+  guint i;
 
-  ChamplainViewPrivate *priv = view->priv;
-  ClutterActorIter iter;
-  gint size;
-  ClutterActor *child;
-  gint x_count, y_count, column_count;
-  guint min_x, min_y, max_x, max_y;
-  gint arm_size, arm_max, turn;
-  gint dirs[5] = { 0, 1, 0, -1, 0 };
-  gint i, x, y;
+  for (i = 0; i < job->n_layers; i++)
+    cairo_surface_destroy (job->layers[i].surface);
+  g_free (job->layers);
 
-  size = champlain_map_source_get_tile_size (priv->map_source);
-  get_tile_bounds (view, &min_x, &min_y, &max_x, &max_y);
+  cairo_surface_destroy (job->base);
+  if (job->result)
+    cairo_surface_destroy (job->result);
 
-  x_count = ceil ((gfloat) priv->viewport_width / size) + 1;
-  column_count = champlain_map_source_get_column_count (priv->map_source, priv->zoom_level);
+  g_object_unref (job->tile);
+  g_slice_free (CompositeJob, job);
+}
 
-  if (priv->hwrap)
+
+static gboolean
+composite_done_cb (CompositeJob *job)
+{
+  ChamplainTile *tile = job->tile;
+  CompositeCell *cell;
+  ClutterActor *content_actor;
+  ClutterContent *content;
+
+  cell = g_object_get_data (G_OBJECT (tile), "composite-cell");
+
+  /* the tile has been destroyed or a newer composition is pending */
+  if (!cell || cell->generation != job->generation ||
+      cairo_surface_status (job->result) != CAIRO_STATUS_SUCCESS)
+    goto finish;
+
+  DEBUG ("Composited tile %d, %d, %d", champlain_tile_get_zoom_level (tile),
+      champlain_tile_get_x (tile), champlain_tile_get_y (tile));
+
+  if (cell->composite)
+    cairo_surface_destroy (cell->composite);
+  cell->composite = cairo_surface_reference (job->result);
+  champlain_exportable_set_surface (CHAMPLAIN_EXPORTABLE (tile), job->result);
+
+  /* Swap the content of the existing actor so that the tile doesn't fade
+     in again */
+  content_actor = champlain_tile_get_content (tile);
+  if (!content_actor)
+    goto finish;
+
+  content = clutter_actor_get_content (content_actor);
+  if (content && g_object_get_data (G_OBJECT (content), "composite"))
+    clutter_content_invalidate (content);
+  else
+    {
+      gint size = champlain_tile_get_size (tile);
+
+      content = clutter_canvas_new ();
+      clutter_canvas_set_size (CLUTTER_CANVAS (content), size, size);
+      g_object_set_data (G_OBJECT (content), "composite", GINT_TO_POINTER (TRUE));
+      g_signal_connect (content, "draw", G_CALLBACK (composite_draw_cb), tile);
+      clutter_content_invalidate (content);
+      clutter_actor_set_content (content_actor, content);
+      g_object_unref (content);
+    }
+
+finish:
+  composite_job_free (job);
+
+  return FALSE;
+}
+
+
+static void
+composite_worker_thread (gpointer worker_data,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  CompositeJob *job = (CompositeJob *) worker_data;
+  cairo_t *cr;
+  guint i;
+
+  job->result = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, job->size, job->size);
+  cr = cairo_create (job->result);
+
+  cairo_set_source_surface (cr, job->base, 0, 0);
+  cairo_paint (cr);
+
+  for (i = 0; i < job->n_layers; i++)
+    {
+      cairo_set_source_surface (cr, job->layers[i].surface, 0, 0);
+      cairo_paint_with_alpha (cr, job->layers[i].opacity / 255.0);
+    }
+
+  cairo_destroy (cr);
+
+  clutter_threads_add_idle_full (CLUTTER_PRIORITY_REDRAW, (GSourceFunc) composite_done_cb, job, NULL);
+}
+
+
+static void
+composite_cell_update (CompositeCell *cell)
+{
+  ChamplainViewPrivate *priv = cell->view->priv;
+  cairo_surface_t *surface;
+  CompositeJob *job;
+  GError *error = NULL;
+  guint i;
+
+  if (!priv->composite_pool)
+    return;
+
+  /* Remember the base tile's own rendering - the tile surface gets replaced
+     by the composited one afterwards */
+  surface = champlain_exportable_get_surface (CHAMPLAIN_EXPORTABLE (cell->tile));
+  if (surface && surface != cell->composite && surface != cell->base_surface)
+    {
+      if (cell->base_surface)
+        cairo_surface_destroy (cell->base_surface);
+      cell->base_surface = cairo_surface_reference (surface);
+    }
+
+  if (!cell->base_surface)
+    return;
+
+  job = g_slice_new0 (CompositeJob);
+  job->layers = g_new0 (CompositeLayer, cell->layers->len);
+
+  for (i = 0; i < cell->layers->len; i++)
+    {
+      ChamplainTile *layer = g_ptr_array_index (cell->layers, i);
+
+      if (champlain_tile_get_state (layer) != CHAMPLAIN_STATE_DONE)
+        continue;
+
+      surface = champlain_exportable_get_surface (CHAMPLAIN_EXPORTABLE (layer));
+      if (!surface)
+        continue;
+
+      job->layers[job->n_layers].surface = cairo_surface_reference (surface);
+      job->layers[job->n_layers].opacity = clutter_actor_get_opacity (CLUTTER_ACTOR (layer));
+      job->n_layers++;
+    }
+
+  if (job->n_layers == 0)
+    {
+      g_free (job->layers);
+      g_slice_free (CompositeJob, job);
+      return;
+    }
+
+  job->tile = g_object_ref (cell->tile);
+  job->generation = ++cell->generation;
+  job->size = champlain_tile_get_size (cell->tile);
+  job->base = cairo_surface_reference (cell->base_surface);
+
+  g_thread_pool_push (priv->composite_pool, job, &error);
+  if (error)
+    {
+      g_warning ("Thread pool error: %s", error->message);
+      g_error_free (error);
+      composite_job_free (job);
+    }
+}
+
+
+static void
+composite_state_notify (ChamplainTile *tile,
+    G_GNUC_UNUSED GParamSpec *pspec,
+    CompositeCell *cell)
+{
+  if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_DONE)
+    composite_cell_update (cell);
+}
+
+
+static void
+composite_cell_free (CompositeCell *cell)
+{
+  guint i;
+
+  g_signal_handlers_disconnect_by_func (cell->tile, composite_state_notify, cell);
+
+  for (i = 0; i < cell->layers->len; i++)
+    {
+      ChamplainTile *layer = g_ptr_array_index (cell->layers, i);
+
+      g_signal_handlers_disconnect_by_func (layer, composite_state_notify, cell);
+      /* cancels the pending downloads */
+      abandon_tile (layer);
+      g_signal_handlers_disconnect_by_func (layer, tile_state_notify, cell->view);
+      clutter_actor_destroy (CLUTTER_ACTOR (layer));
+    }
+  g_ptr_array_free (cell->layers, TRUE);
+
+  if (cell->base_surface)
+    cairo_surface_destroy (cell->base_surface);
+  if (cell->composite)
+    cairo_surface_destroy (cell->composite);
+
+  g_slice_free (CompositeCell, cell);
+}
+
+
+static void
+composite_tile_destroy_cb (ChamplainTile *tile)
+{
+  g_object_set_data (G_OBJECT (tile), "composite-cell", NULL);
+}
+
+
+static void
+load_composite_tile (ChamplainView *view,
+    gint size,
+    gint x,
+    gint y)
+{
+  ChamplainViewPrivate *priv = view->priv;
+  CompositeCell *cell;
+  GList *iter;
+
+  cell = g_slice_new0 (CompositeCell);
+  cell->view = view;
+  cell->layers = g_ptr_array_new_with_free_func (g_object_unref);
+  cell->tile = load_tile_for_source (view, priv->map_source, 255, size, x, y, NULL);
+
+  g_object_set_data_full (G_OBJECT (cell->tile), "composite-cell", cell,
+      (GDestroyNotify) composite_cell_free);
+  g_signal_connect (cell->tile, "destroy", G_CALLBACK (composite_tile_destroy_cb), NULL);
+  g_signal_connect (cell->tile, "notify::state", G_CALLBACK (composite_state_notify), cell);
+
+  /* Overlay tiles never get on the stage, their surfaces are only used
+     as the input of the compositing */
+  for (iter = priv->overlay_sources; iter; iter = iter->next)
+    {
+      gint opacity = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (iter->data), "opacity"));
+      ChamplainTile *layer = champlain_tile_new_full (x, y, size, priv->zoom_level);
+
+      g_ptr_array_add (cell->layers, g_object_ref_sink (layer));
+      clutter_actor_set_opacity (CLUTTER_ACTOR (layer), opacity);
+      set_new_cancellable (layer);
+
+      g_signal_connect (layer, "notify::state", G_CALLBACK (tile_state_notify), view);
+      g_signal_connect (layer, "notify::state", G_CALLBACK (composite_state_notify), cell);
+      champlain_tile_set_state (layer, CHAMPLAIN_STATE_LOADING);
+
+      champlain_map_source_fill_tile (iter->data, layer);
+    }
+}
+
+
+/* Creates the tiles queued by a viewport update and passes them to each map
+ * source in a single champlain_map_source_fill_tiles() call */
+static gboolean
+fill_tiles_cb (GPtrArray *queue)
+{
+  DEBUG_LOG ()
+
+  FillTileCallbackData *first = g_ptr_array_index (queue, 0);
+  ChamplainView *view = g_object_ref (first->view);
+  ChamplainViewPrivate *priv = view->priv;
+  guint n_sources = g_list_length (priv->overlay_sources) + 1;
+  GPtrArray **batches = g_newa (GPtrArray *, n_sources);
+  GList *iter;
+  guint i, k;
+
+  for (k = 0; k < n_sources; k++)
+    batches[k] = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (i = 0; i < queue->len; i++)
+    {
+      FillTileCallbackData *data = g_ptr_array_index (queue, i);
+      gint x = data->x;
+      gint y = data->y;
+      gint size = data->size;
+      gint zoom_level = data->zoom_level;
+
+      priv->stats.tiles_queued--;
+      _champlain_trace_async ('e', "view", "queued", data, zoom_level, x, y);
+
+      if (!tile_in_tile_table (view, priv->tile_map, x, y) &&
+          zoom_level == priv->zoom_level &&
+          data->map_source == priv->map_source &&
+          tile_in_tile_table (view, priv->visible_tiles, x, y))
+        {
+          if (priv->composite_overlays && priv->overlay_sources)
+            load_composite_tile (view, size, x, y);
+          else
+            {
+              load_tile_for_source (view, priv->map_source, 255, size, x, y, batches[0]);
+              for (iter = priv->overlay_sources, k = 1; iter; iter = iter->next, k++)
+                {
+                  gint opacity = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (iter->data), "opacity"));
+                  load_tile_for_source (view, iter->data, opacity, size, x, y, batches[k]);
+                }
+            }
+
+          tile_table_set (view, priv->tile_map, x, y, TRUE);
+        }
+
+      g_object_unref (data->view);
+      g_slice_free (FillTileCallbackData, data);
+    }
+
+  champlain_map_source_fill_tiles (priv->map_source,
+      (ChamplainTile **) batches[0]->pdata, batches[0]->len);
+  for (iter = priv->overlay_sources, k = 1; iter; iter = iter->next, k++)
+    champlain_map_source_fill_tiles (iter->data,
+        (ChamplainTile **) batches[k]->pdata, batches[k]->len);
+
+  for (k = 0; k < n_sources; k++)
+    g_ptr_array_free (batches[k], TRUE);
+  g_ptr_array_free (queue, TRUE);
+  g_object_unref (view);
+
+  return FALSE;
+}
+
+static void
+load_visible_tiles (ChamplainView *view,
+    gboolean relocate)
+{
+  DEBUG_LOG ()
+
+  ChamplainViewPrivate *priv = view->priv;
+  ClutterActorIter iter;
+  gint size;
+  ClutterActor *child;
+  gint x_count, y_count, column_count;
+  guint min_x, min_y, max_x, max_y;
+  gint arm_size, arm_max, turn;
+  gint dirs[5] = { 0, 1, 0, -1, 0 };
+  gint i, x, y;
+  GPtrArray *queue;
+
+  size = champlain_map_source_get_tile_size (priv->map_source);
+  get_tile_bounds (view, &min_x, &min_y, &max_x, &max_y);
+
+  x_count = ceil ((gfloat) priv->viewport_width / size) + 1;
+  column_count = champlain_map_source_get_column_count (priv->map_source, priv->zoom_level);
+
+  if (priv->hwrap)
     {
       priv->tile_x_first = priv->viewport_x / size;
       priv->tile_x_last = priv->tile_x_first + x_count;
@@ -2785,7 +3560,7 @@ load_visible_tiles (ChamplainView *view,
 
       if (!tile_in_tile_table (view, priv->visible_tiles, tile_x, tile_y))
         {
-          champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
+          abandon_tile (tile);
           clutter_actor_iter_destroy (&iter);
           tile_table_set (view, priv->tile_map, tile_x, tile_y, FALSE);
         }
@@ -2798,6 +3573,7 @@ load_visible_tiles (ChamplainView *view,
   y = priv->tile_y_first + y_count / 2 - 1;
   arm_max = MAX (x_count, y_count) + 2;
   arm_size = 1;
+  queue = g_ptr_array_new ();
 
   for (turn = 0; arm_size < arm_max; turn++)
     {
@@ -2827,7 +3603,9 @@ load_visible_tiles (ChamplainView *view,
               data->map_source = priv->map_source;
               data->view = g_object_ref (view);
 
-              g_idle_add_full (CLUTTER_PRIORITY_REDRAW, (GSourceFunc) fill_tile_cb, data, NULL);
+              priv->stats.tiles_queued++;
+              _champlain_trace_async ('b', "view", "queued", data, data->zoom_level, tile_x, y);
+              g_ptr_array_add (queue, data);
             }
 
           x += dirs[turn % 4 + 1];
@@ -2837,6 +3615,12 @@ load_visible_tiles (ChamplainView *view,
       if (turn % 2 == 1)
         arm_size++;
     }
+
+  /* The tiles are ordered from the center of the view */
+  if (queue->len > 0)
+    g_idle_add_full (CLUTTER_PRIORITY_REDRAW, (GSourceFunc) fill_tiles_cb, queue, NULL);
+  else
+    g_ptr_array_free (queue, TRUE);
 }
 
 
@@ -2853,7 +3637,7 @@ remove_all_tiles (ChamplainView *view)
 
   clutter_actor_iter_init (&iter, priv->map_layer);
   while (clutter_actor_iter_next (&iter, &child))
-    champlain_tile_set_state (CHAMPLAIN_TILE (child), CHAMPLAIN_STATE_DONE);
+    abandon_tile (CHAMPLAIN_TILE (child));
 
   g_hash_table_remove_all (priv->tile_map);
 
@@ -2880,6 +3664,104 @@ champlain_view_reload_tiles (ChamplainView *view)
 }
 
 
+/* Returns whether the caches of @map_source were invalidated */
+static gboolean
+invalidate_source_area (ChamplainMapSource *map_source,
+    ChamplainRenderer *renderer,
+    ChamplainBoundingBox *bbox)
+{
+  if (CHAMPLAIN_IS_MAP_SOURCE_CHAIN (map_source))
+    return _champlain_map_source_chain_invalidate_area (CHAMPLAIN_MAP_SOURCE_CHAIN (map_source),
+        renderer, bbox);
+
+  if (!_champlain_map_source_uses_renderer (map_source, renderer))
+    return FALSE;
+
+  while (map_source)
+    {
+      if (CHAMPLAIN_IS_TILE_CACHE (map_source))
+        champlain_tile_cache_invalidate_area (CHAMPLAIN_TILE_CACHE (map_source), bbox);
+      map_source = champlain_map_source_get_next_source (map_source);
+    }
+
+  return TRUE;
+}
+
+
+/**
+ * champlain_view_invalidate_area:
+ * @view: a #ChamplainView
+ * @bbox: (allow-none): the area whose data changed, or %NULL for the whole map
+ * @renderer: (allow-none): the renderer whose data changed, or %NULL for all
+ * the sources
+ *
+ * Drops the tiles intersecting @bbox from the tile caches of the map sources
+ * rendered by @renderer, which is either the map source or one of the
+ * overlay sources, and reloads the visible ones. The caches of the other
+ * sources are left alone. Unlike champlain_view_reload_tiles(), the tiles
+ * outside the area stay on the screen and in the caches.
+ *
+ * As the instance is passed last to swapped signal handlers, the function
+ * can be connected directly to the #ChamplainRenderer::area-changed signal:
+ *
+ * |[
+ * g_signal_connect_swapped (renderer, "area-changed",
+ *     G_CALLBACK (champlain_view_invalidate_area), view);
+ * ]|
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_view_invalidate_area (ChamplainView *view,
+    ChamplainBoundingBox *bbox,
+    ChamplainRenderer *renderer)
+{
+  DEBUG_LOG ()
+
+  g_return_if_fail (CHAMPLAIN_IS_VIEW (view));
+
+  ChamplainViewPrivate *priv = view->priv;
+  ClutterActorIter iter;
+  ClutterActor *child;
+  GList *source;
+  gboolean invalidated;
+
+  g_return_if_fail (renderer == NULL || CHAMPLAIN_IS_RENDERER (renderer));
+
+  if (!priv->map_source)
+    return;
+
+  invalidated = invalidate_source_area (priv->map_source, renderer, bbox);
+  for (source = priv->overlay_sources; source; source = source->next)
+    invalidated |= invalidate_source_area (source->data, renderer, bbox);
+
+  if (!invalidated)
+    return;
+
+  /* Already disposed */
+  if (!priv->map_layer)
+    return;
+
+  clutter_actor_iter_init (&iter, priv->map_layer);
+  while (clutter_actor_iter_next (&iter, &child))
+    {
+      ChamplainTile *tile = CHAMPLAIN_TILE (child);
+      gint tile_x = champlain_tile_get_x (tile);
+      gint tile_y = champlain_tile_get_y (tile);
+
+      if (_champlain_map_source_tile_in_area (priv->map_source,
+              champlain_tile_get_zoom_level (tile), tile_x, tile_y, bbox))
+        {
+          abandon_tile (tile);
+          clutter_actor_iter_destroy (&iter);
+          tile_table_set (view, priv->tile_map, tile_x, tile_y, FALSE);
+        }
+    }
+
+  load_visible_tiles (view, FALSE);
+}
+
+
 static gboolean
 remove_zoom_actor_cb (ChamplainView *view)
 {
@@ -2891,6 +3773,43 @@ remove_zoom_actor_cb (ChamplainView *view)
 }
 
 
+static void
+trim_memory (GObject *object,
+    ChamplainTrimLevel level)
+{
+  ChamplainView *view = CHAMPLAIN_VIEW (object);
+  ChamplainViewPrivate *priv = view->priv;
+  ClutterActorIter iter;
+  ClutterActor *child;
+
+  /* Already disposed */
+  if (!priv->map_layer)
+    return;
+
+  /* The tiles of the previous zoom level shown until the new ones load */
+  if (priv->zoom_actor_timeout != 0)
+    {
+      g_source_remove (priv->zoom_actor_timeout);
+      priv->zoom_actor_timeout = 0;
+    }
+  clutter_actor_destroy_all_children (priv->zoom_layer);
+
+  if (level < CHAMPLAIN_TRIM_LEVEL_CRITICAL)
+    return;
+
+  /* The displayed tiles keep their textures, their surfaces are only needed
+     by champlain_view_to_surface() */
+  clutter_actor_iter_init (&iter, priv->map_layer);
+  while (clutter_actor_iter_next (&iter, &child))
+    {
+      ChamplainTile *tile = CHAMPLAIN_TILE (child);
+
+      if (champlain_tile_get_state (tile) == CHAMPLAIN_STATE_DONE)
+        _champlain_tile_drop_surface (tile);
+    }
+}
+
+
 static void
 tile_state_notify (ChamplainTile *tile,
     G_GNUC_UNUSED GParamSpec *pspec,
@@ -2901,8 +3820,19 @@ tile_state_notify (ChamplainTile *tile,
   ChamplainState tile_state = champlain_tile_get_state (tile);
   ChamplainViewPrivate *priv = view->priv;
 
+  /* don't update the view's state when it's being disposed */
+  if (!priv->map_layer)
+    return;
+
   if (tile_state == CHAMPLAIN_STATE_LOADING)
     {
+      gint64 *start = g_new (gint64, 1);
+
+      *start = g_get_monotonic_time ();
+      g_object_set_data_full (G_OBJECT (tile), "load-start", start, g_free);
+      priv->stats.tiles_requested++;
+      _champlain_trace_tile ('b', "view", "load", tile);
+
       if (priv->tiles_loading == 0)
         {
           priv->state = CHAMPLAIN_STATE_LOADING;
@@ -2912,6 +3842,24 @@ tile_state_notify (ChamplainTile *tile,
     }
   else if (tile_state == CHAMPLAIN_STATE_DONE)
     {
+      gint64 *start = g_object_get_data (G_OBJECT (tile), "load-start");
+
+      if (start && champlain_tile_is_cancelled (tile))
+        {
+          g_object_set_data (G_OBJECT (tile), "load-start", NULL);
+          _champlain_trace_tile ('e', "view", "load", tile);
+        }
+      else if (start)
+        {
+          priv->latencies[priv->latency_pos] = g_get_monotonic_time () - *start;
+          priv->latency_pos = (priv->latency_pos + 1) % LATENCY_SAMPLES;
+          if (priv->n_latencies < LATENCY_SAMPLES)
+            priv->n_latencies++;
+          priv->stats.tiles_displayed++;
+          g_object_set_data (G_OBJECT (tile), "load-start", NULL);
+          _champlain_trace_tile ('e', "view", "load", tile);
+        }
+
       if (priv->tiles_loading > 0)
         priv->tiles_loading--;
       if (priv->tiles_loading == 0)
@@ -2920,6 +3868,7 @@ tile_state_notify (ChamplainTile *tile,
           g_object_notify (G_OBJECT (view), "state");
           if (clutter_actor_get_n_children (priv->zoom_layer) > 0)
             priv->zoom_actor_timeout = g_timeout_add_seconds_full (CLUTTER_PRIORITY_REDRAW, 1, (GSourceFunc) remove_zoom_actor_cb, view, NULL);
+          g_signal_emit (view, signals[STATS_UPDATED], 0);
         }
     }
 }
@@ -3324,6 +4273,136 @@ champlain_view_get_horizontal_wrap (ChamplainView *view)
 }
 
 
+/**
+ * champlain_view_set_composite_overlays:
+ * @view: a #ChamplainView
+ * @value: %TRUE to blend overlay tiles into the base map tiles
+ *
+ * Sets the value of the #ChamplainView:composite-overlays property.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_view_set_composite_overlays (ChamplainView *view,
+    gboolean value)
+{
+  DEBUG_LOG ()
+
+  g_return_if_fail (CHAMPLAIN_IS_VIEW (view));
+
+  ChamplainViewPrivate *priv = view->priv;
+
+  if (priv->composite_overlays == value)
+    return;
+
+  priv->composite_overlays = value;
+
+  if (priv->composite_overlays && !priv->composite_pool)
+    priv->composite_pool = g_thread_pool_new (composite_worker_thread, view,
+          COMPOSITE_MAX_THREADS, FALSE, NULL);
+
+  g_object_notify (G_OBJECT (view), "composite-overlays");
+
+  if (priv->overlay_sources)
+    champlain_view_reload_tiles (view);
+}
+
+
+/**
+ * champlain_view_get_composite_overlays:
+ * @view: a #ChamplainView
+ *
+ * Returns the value of the #ChamplainView:composite-overlays property.
+ *
+ * Returns: %TRUE if overlay tiles are blended into the base map tiles.
+ *
+ * Since: 0.12.15
+ */
+gboolean
+champlain_view_get_composite_overlays (ChamplainView *view)
+{
+  DEBUG_LOG ()
+
+  g_return_val_if_fail (CHAMPLAIN_IS_VIEW (view), FALSE);
+
+  return view->priv->composite_overlays;
+}
+
+
+static gint
+compare_latencies (gconstpointer a,
+    gconstpointer b)
+{
+  gint64 la = *(const gint64 *) a;
+  gint64 lb = *(const gint64 *) b;
+
+  return la < lb ? -1 : (la > lb ? 1 : 0);
+}
+
+
+/**
+ * champlain_view_get_stats:
+ * @view: a #ChamplainView
+ * @stats: (out caller-allocates): location to store the statistics
+ *
+ * Gets the tile loading statistics of the view. The counters are cheap to
+ * maintain and always enabled; the latency percentiles are computed from
+ * the last 256 loaded tiles when this function is called.
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_view_get_stats (ChamplainView *view,
+    ChamplainViewStats *stats)
+{
+  DEBUG_LOG ()
+
+  g_return_if_fail (CHAMPLAIN_IS_VIEW (view));
+  g_return_if_fail (stats != NULL);
+
+  ChamplainViewPrivate *priv = view->priv;
+  gint64 sorted[LATENCY_SAMPLES];
+
+  *stats = priv->stats;
+  stats->tiles_loading = priv->tiles_loading;
+  stats->latency_p50 = 0.0;
+  stats->latency_p95 = 0.0;
+
+  if (priv->n_latencies > 0)
+    {
+      memcpy (sorted, priv->latencies, priv->n_latencies * sizeof (gint64));
+      qsort (sorted, priv->n_latencies, sizeof (gint64), compare_latencies);
+      stats->latency_p50 = sorted[(priv->n_latencies - 1) / 2] / 1000.0;
+      stats->latency_p95 = sorted[(priv->n_latencies - 1) * 95 / 100] / 1000.0;
+    }
+}
+
+
+/**
+ * champlain_view_reset_stats:
+ * @view: a #ChamplainView
+ *
+ * Resets the tile loading statistics of the view. Statistics of the map
+ * sources have to be reset separately with champlain_map_source_reset_stats().
+ *
+ * Since: 0.12.15
+ */
+void
+champlain_view_reset_stats (ChamplainView *view)
+{
+  DEBUG_LOG ()
+
+  g_return_if_fail (CHAMPLAIN_IS_VIEW (view));
+
+  ChamplainViewPrivate *priv = view->priv;
+
+  priv->stats.tiles_requested = 0;
+  priv->stats.tiles_displayed = 0;
+  priv->n_latencies = 0;
+  priv->latency_pos = 0;
+}
+
+
 static void
 position_zoom_actor (ChamplainView *view)
 {
@@ -3430,7 +4509,7 @@ show_zoom_actor (ChamplainView *view,
           gint tile_y = champlain_tile_get_y (tile);
           gboolean overlay = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (tile), "overlay"));
 
-          champlain_tile_set_state (tile, CHAMPLAIN_STATE_DONE);
+          abandon_tile (tile);
 
           g_object_ref (CLUTTER_ACTOR (tile));
           clutter_actor_iter_remove (&iter);
@@ -55,6 +55,34 @@ G_BEGIN_DECLS
 
 typedef struct _ChamplainViewPrivate ChamplainViewPrivate;
 
+/**
+ * ChamplainViewStats:
+ * @tiles_requested: number of tiles the view started loading
+ * @tiles_displayed: number of tiles which finished loading
+ * @tiles_loading: number of tiles currently being loaded
+ * @tiles_queued: number of tiles waiting in the main loop to be requested
+ * from the map sources
+ * @latency_p50: median time in milliseconds from a tile request to its display,
+ * computed over the most recent tiles
+ * @latency_p95: 95th percentile of the time in milliseconds from a tile
+ * request to its display, computed over the most recent tiles
+ *
+ * Tile loading statistics of a view, see champlain_view_get_stats().
+ * Statistics of the individual map sources can be obtained with
+ * champlain_map_source_get_stats().
+ *
+ * Since: 0.12.15
+ */
+typedef struct
+{
+  guint tiles_requested;
+  guint tiles_displayed;
+  guint tiles_loading;
+  guint tiles_queued;
+  gdouble latency_p50;
+  gdouble latency_p95;
+} ChamplainViewStats;
+
 
 /**
  * ChamplainView:
@@ -130,12 +158,20 @@ void champlain_view_set_world (ChamplainView *view,
     ChamplainBoundingBox *bbox);
 void champlain_view_set_horizontal_wrap (ChamplainView *view,
     gboolean wrap);
+void champlain_view_set_composite_overlays (ChamplainView *view,
+    gboolean value);
 void champlain_view_add_layer (ChamplainView *view,
     ChamplainLayer *layer);
 void champlain_view_remove_layer (ChamplainView *view,
     ChamplainLayer *layer);
 cairo_surface_t * champlain_view_to_surface (ChamplainView *view,
     gboolean include_layers);
+gboolean champlain_view_save_snapshot (ChamplainView *view,
+    const gchar *filename,
+    GError **error);
+gboolean champlain_view_load_snapshot (ChamplainView *view,
+    const gchar *filename,
+    GError **error);
 
 guint champlain_view_get_zoom_level (ChamplainView *view);
 guint champlain_view_get_min_zoom_level (ChamplainView *view);
@@ -150,8 +186,16 @@ ChamplainState champlain_view_get_state (ChamplainView *view);
 ClutterContent *champlain_view_get_background_pattern (ChamplainView *view);
 ChamplainBoundingBox *champlain_view_get_world (ChamplainView *view);
 gboolean champlain_view_get_horizontal_wrap (ChamplainView *view);
+gboolean champlain_view_get_composite_overlays (ChamplainView *view);
 
 void champlain_view_reload_tiles (ChamplainView *view);
+void champlain_view_invalidate_area (ChamplainView *view,
+    ChamplainBoundingBox *bbox,
+    ChamplainRenderer *renderer);
+
+void champlain_view_get_stats (ChamplainView *view,
+    ChamplainViewStats *stats);
+void champlain_view_reset_stats (ChamplainView *view);
 
 gdouble champlain_view_x_to_longitude (ChamplainView *view,
     gdouble x);
@@ -41,6 +41,9 @@
 #include "champlain/champlain-view.h"
 #include "champlain/champlain-bounding-box.h"
 #include "champlain/champlain-scale.h"
+#include "champlain/champlain-trace.h"
+#include "champlain/champlain-memory-usage.h"
+#include "champlain/champlain-recording.h"
 
 #include "champlain/champlain-map-source.h"
 #include "champlain/champlain-tile-source.h"
@@ -52,6 +55,7 @@
 #include "champlain/champlain-map-source-chain.h"
 
 #include "champlain/champlain-network-tile-source.h"
+#include "champlain/champlain-time-series-tile-source.h"
 #include "champlain/champlain-network-bbox-tile-source.h"
 #include "champlain/champlain-file-tile-source.h"
 #include "champlain/champlain-null-tile-source.h"
@@ -60,6 +64,7 @@
 #include "champlain/champlain-file-cache.h"
 
 #include "champlain/champlain-image-renderer.h"
+#include "champlain/champlain-hillshade-renderer.h"
 #include "champlain/champlain-error-tile-renderer.h"
 
 #undef __CHAMPLAIN_CHAMPLAIN_H_INSIDE__